@@ -44,6 +44,7 @@
 #include "window.h"
 #include "../shared/cairo-util.h"
 #include "../shared/config-parser.h"
+#include "../shared/image-loader.h"
 
 #include "desktop-shell-client-protocol.h"
 
@@ -66,6 +67,23 @@ struct desktop {
 	enum cursor_type grab_cursor;
 
 	int painted;
+
+	/* Images are decoded off the main thread and swapped in as they
+	 * arrive, so the first frame only waits for the colors. */
+	struct image_load_queue *image_queue;
+	struct task image_task;
+	struct wl_list pending_images;
+	struct timespec start_time;
+};
+
+typedef void (*image_done_func_t)(void *owner, cairo_surface_t *surface);
+
+struct pending_image {
+	struct desktop *desktop;
+	/* cleared when the owner goes away before the image arrives */
+	void *owner;
+	image_done_func_t done;
+	struct wl_list link;
 };
 
 struct surface {
@@ -94,6 +112,9 @@ struct background {
 	char *image;
 	int type;
 	uint32_t color;
+
+	cairo_surface_t *image_surface;
+	struct pending_image *pending;
 };
 
 struct output {
@@ -109,6 +130,7 @@ struct panel_launcher {
 	struct widget *widget;
 	struct panel *panel;
 	cairo_surface_t *icon;
+	struct pending_image *pending;
 	int focused, pressed;
 	char *path;
 	struct wl_list link;
@@ -135,6 +157,105 @@ struct unlock_dialog {
 static void
 panel_add_launchers(struct panel *panel, struct desktop *desktop);
 
+static uint32_t
+desktop_elapsed_ms(struct desktop *desktop)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (now.tv_sec - desktop->start_time.tv_sec) * 1000 +
+		(now.tv_nsec - desktop->start_time.tv_nsec) / 1000000;
+}
+
+static const cairo_user_data_key_t image_key;
+
+static void
+image_destroy_func(void *data)
+{
+	pixman_image_unref(data);
+}
+
+static cairo_surface_t *
+surface_from_image(pixman_image_t *image)
+{
+	cairo_surface_t *surface;
+
+	surface = cairo_image_surface_create_for_data(
+		(unsigned char *) pixman_image_get_data(image),
+		CAIRO_FORMAT_ARGB32,
+		pixman_image_get_width(image),
+		pixman_image_get_height(image),
+		pixman_image_get_stride(image));
+
+	if (cairo_surface_set_user_data(surface, &image_key, image,
+					image_destroy_func) !=
+	    CAIRO_STATUS_SUCCESS) {
+		pixman_image_unref(image);
+		cairo_surface_destroy(surface);
+		return NULL;
+	}
+
+	return surface;
+}
+
+static void
+image_loaded(pixman_image_t *image, const char *filename, void *data)
+{
+	struct pending_image *pending = data;
+	struct desktop *desktop = pending->desktop;
+	cairo_surface_t *surface = NULL;
+
+	if (image)
+		surface = surface_from_image(image);
+
+	if (pending->owner)
+		pending->done(pending->owner, surface);
+	else if (surface)
+		cairo_surface_destroy(surface);
+
+	wl_list_remove(&pending->link);
+	free(pending);
+
+	if (wl_list_empty(&desktop->pending_images))
+		fprintf(stderr, "desktop-shell: images loaded after %u ms\n",
+			desktop_elapsed_ms(desktop));
+}
+
+/* Loads an image in the background and hands it to done() on the main
+ * loop, or NULL if it could not be loaded.  Returns NULL if done() has
+ * already run. */
+static struct pending_image *
+desktop_load_image(struct desktop *desktop, const char *filename,
+		   image_done_func_t done, void *owner)
+{
+	struct pending_image *pending;
+
+	pending = xzalloc(sizeof *pending);
+	pending->desktop = desktop;
+	pending->owner = owner;
+	pending->done = done;
+	wl_list_insert(desktop->pending_images.prev, &pending->link);
+
+	if (desktop->image_queue &&
+	    image_load_queue_add(desktop->image_queue, filename,
+				 image_loaded, pending) == 0)
+		return pending;
+
+	image_loaded(load_image(filename), filename, pending);
+
+	return NULL;
+}
+
+static void
+image_queue_func(struct task *task, uint32_t events)
+{
+	struct desktop *desktop =
+		container_of(task, struct desktop, image_task);
+
+	image_load_queue_dispatch(desktop->image_queue);
+}
+
 static void
 sigchild_handler(int s)
 {
@@ -191,6 +312,8 @@ check_desktop_ready(struct window *window)
 
 	if (!desktop->painted && is_desktop_painted(desktop)) {
 		desktop->painted = 1;
+		fprintf(stderr, "desktop-shell: first frame after %u ms\n",
+			desktop_elapsed_ms(desktop));
 
 		if (desktop->interface_version >= 2)
 			desktop_shell_desktop_ready(desktop->shell);
@@ -226,6 +349,9 @@ panel_launcher_redraw_handler(struct widget *widget, void *data)
 	struct rectangle allocation;
 	cairo_t *cr;
 
+	if (!launcher->icon)
+		return;
+
 	cr = widget_cairo_create(launcher->panel->widget);
 
 	widget_get_allocation(widget, &allocation);
@@ -476,8 +602,14 @@ panel_resize_handler(struct widget *widget,
 	x = 10;
 	y = 16;
 	wl_list_for_each(launcher, &panel->launcher_list, link) {
-		w = cairo_image_surface_get_width(launcher->icon);
-		h = cairo_image_surface_get_height(launcher->icon);
+		/* room for the fallback icon, until the icon arrives */
+		if (launcher->icon) {
+			w = cairo_image_surface_get_width(launcher->icon);
+			h = cairo_image_surface_get_height(launcher->icon);
+		} else {
+			w = 20;
+			h = 20;
+		}
 		widget_set_allocation(launcher->widget,
 				      x, y - h / 2, w + 1, h + 1);
 		x += w + 10;
@@ -510,7 +642,10 @@ panel_destroy_launcher(struct panel_launcher *launcher)
 
 	free(launcher->path);
 
-	cairo_surface_destroy(launcher->icon);
+	if (launcher->pending)
+		launcher->pending->owner = NULL;
+	if (launcher->icon)
+		cairo_surface_destroy(launcher->icon);
 
 	widget_destroy(launcher->widget);
 	wl_list_remove(&launcher->link);
@@ -567,21 +702,11 @@ panel_create(struct desktop *desktop)
 }
 
 static cairo_surface_t *
-load_icon_or_fallback(const char *icon)
+create_fallback_icon(void)
 {
-	cairo_surface_t *surface = cairo_image_surface_create_from_png(icon);
-	cairo_status_t status;
+	cairo_surface_t *surface;
 	cairo_t *cr;
 
-	status = cairo_surface_status(surface);
-	if (status == CAIRO_STATUS_SUCCESS)
-		return surface;
-
-	cairo_surface_destroy(surface);
-	fprintf(stderr, "ERROR loading icon from file '%s', error: '%s'\n",
-		icon, cairo_status_to_string(status));
-
-	/* draw fallback icon */
 	surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32,
 					     20, 20);
 	cr = cairo_create(surface);
@@ -604,14 +729,41 @@ load_icon_or_fallback(const char *icon)
 }
 
 static void
-panel_add_launcher(struct panel *panel, const char *icon, const char *path)
+panel_relayout(struct panel *panel)
+{
+	struct rectangle allocation;
+
+	window_get_allocation(panel->window, &allocation);
+	if (allocation.width > 0)
+		window_schedule_resize(panel->window,
+				       allocation.width, allocation.height);
+}
+
+static void
+panel_launcher_icon_loaded(void *owner, cairo_surface_t *surface)
+{
+	struct panel_launcher *launcher = owner;
+
+	launcher->pending = NULL;
+	if (!surface) {
+		fprintf(stderr, "ERROR loading icon for launcher '%s'\n",
+			launcher->path);
+		surface = create_fallback_icon();
+	}
+
+	launcher->icon = surface;
+	panel_relayout(launcher->panel);
+}
+
+static void
+panel_add_launcher(struct panel *panel, struct desktop *desktop,
+		   const char *icon, const char *path)
 {
 	struct panel_launcher *launcher;
 	char *start, *p, *eq, **ps;
 	int i, j, k;
 
 	launcher = xzalloc(sizeof *launcher);
-	launcher->icon = load_icon_or_fallback(icon);
 	launcher->path = xstrdup(path);
 
 	wl_array_init(&launcher->envp);
@@ -675,6 +827,10 @@ panel_add_launcher(struct panel *panel, const char *icon, const char *path)
 				  panel_launcher_redraw_handler);
 	widget_set_motion_handler(launcher->widget,
 				  panel_launcher_motion_handler);
+
+	launcher->pending = desktop_load_image(desktop, icon,
+					       panel_launcher_icon_loaded,
+					       launcher);
 }
 
 enum {
@@ -704,11 +860,7 @@ background_draw(struct widget *widget, void *data)
 	cairo_paint(cr);
 
 	widget_get_allocation(widget, &allocation);
-	image = NULL;
-	if (background->image)
-		image = load_cairo_surface(background->image);
-	else if (background->color == 0)
-		image = load_cairo_surface(DATADIR "/weston/pattern.png");
+	image = background->image_surface;
 
 	if (image && background->type != -1) {
 		im_w = cairo_image_surface_get_width(image);
@@ -741,8 +893,7 @@ background_draw(struct widget *widget, void *data)
 
 		cairo_set_source(cr, pattern);
 		cairo_pattern_destroy (pattern);
-		cairo_surface_destroy(image);
-	} else {
+	} else if (background->color || !background->pending) {
 		set_hex_color(cr, background->color);
 	}
 
@@ -754,6 +905,16 @@ background_draw(struct widget *widget, void *data)
 	check_desktop_ready(background->window);
 }
 
+static void
+background_image_loaded(void *owner, cairo_surface_t *surface)
+{
+	struct background *background = owner;
+
+	background->pending = NULL;
+	background->image_surface = surface;
+	widget_schedule_redraw(background->widget);
+}
+
 static void
 background_configure(void *data,
 		     struct desktop_shell *desktop_shell,
@@ -1027,6 +1188,11 @@ static const struct desktop_shell_listener listener = {
 static void
 background_destroy(struct background *background)
 {
+	if (background->pending)
+		background->pending->owner = NULL;
+	if (background->image_surface)
+		cairo_surface_destroy(background->image_surface);
+
 	widget_destroy(background->widget);
 	window_destroy(background->window);
 
@@ -1078,6 +1244,19 @@ background_create(struct desktop *desktop)
 
 	free(type);
 
+	/* the color is shown until the image is swapped in */
+	if (background->image)
+		background->pending =
+			desktop_load_image(desktop, background->image,
+					   background_image_loaded,
+					   background);
+	else if (background->color == 0)
+		background->pending =
+			desktop_load_image(desktop,
+					   DATADIR "/weston/pattern.png",
+					   background_image_loaded,
+					   background);
+
 	return background;
 }
 
@@ -1292,20 +1471,17 @@ panel_add_launchers(struct panel *panel, struct desktop *desktop)
 {
 	struct weston_config_section *s;
 	char *icon, *path;
-	const char *name;
 	int count;
 
 	count = 0;
 	s = NULL;
-	while (weston_config_next_section(desktop->config, &s, &name)) {
-		if (strcmp(name, "launcher") != 0)
-			continue;
-
+	while ((s = weston_config_next_section_match(desktop->config, s,
+						     "launcher", NULL, NULL))) {
 		weston_config_section_get_string(s, "icon", &icon, NULL);
 		weston_config_section_get_string(s, "path", &path, NULL);
 
 		if (icon != NULL && path != NULL) {
-			panel_add_launcher(panel, icon, path);
+			panel_add_launcher(panel, desktop, icon, path);
 			count++;
 		} else {
 			fprintf(stderr, "invalid launcher section\n");
@@ -1317,7 +1493,7 @@ panel_add_launchers(struct panel *panel, struct desktop *desktop)
 
 	if (count == 0) {
 		/* add default launcher */
-		panel_add_launcher(panel,
+		panel_add_launcher(panel, desktop,
 				   DATADIR "/weston/terminal.png",
 				   BINDIR "/weston-terminal");
 	}
@@ -1328,9 +1504,12 @@ int main(int argc, char *argv[])
 	struct desktop desktop = { 0 };
 	struct output *output;
 	struct weston_config_section *s;
+	struct pending_image *pending, *tmp;
 
+	clock_gettime(CLOCK_MONOTONIC, &desktop.start_time);
 	desktop.unlock_task.run = unlock_dialog_finish;
 	wl_list_init(&desktop.outputs);
+	wl_list_init(&desktop.pending_images);
 
 	desktop.config = weston_config_parse("weston.ini");
 	s = weston_config_get_section(desktop.config, "shell", NULL, NULL);
@@ -1342,6 +1521,14 @@ int main(int argc, char *argv[])
 		return -1;
 	}
 
+	desktop.image_queue = image_load_queue_create(0);
+	if (desktop.image_queue) {
+		desktop.image_task.run = image_queue_func;
+		display_watch_fd(desktop.display,
+				 image_load_queue_get_fd(desktop.image_queue),
+				 EPOLLIN, &desktop.image_task);
+	}
+
 	display_set_user_data(desktop.display, &desktop);
 	display_set_global_handler(desktop.display, global_handler);
 	display_set_global_handler_remove(desktop.display, global_handler_remove);
@@ -1363,6 +1550,13 @@ int main(int argc, char *argv[])
 	desktop_destroy_outputs(&desktop);
 	if (desktop.unlock_dialog)
 		unlock_dialog_destroy(desktop.unlock_dialog);
+	if (desktop.image_queue) {
+		display_unwatch_fd(desktop.display,
+				   image_load_queue_get_fd(desktop.image_queue));
+		image_load_queue_destroy(desktop.image_queue);
+	}
+	wl_list_for_each_safe(pending, tmp, &desktop.pending_images, link)
+		free(pending);
 	desktop_shell_destroy(desktop.shell);
 	display_destroy(desktop.display);
 
@@ -35,14 +35,19 @@
 #include <ctype.h>
 #include <cairo.h>
 #include <sys/epoll.h>
+#include <sys/mman.h>
 #include <wchar.h>
 #include <locale.h>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
 
 #include <linux/input.h>
 
 #include <wayland-client.h>
 
 #include "../shared/config-parser.h"
+#include "../shared/os-compatibility.h"
 #include "window.h"
 
 static int option_fullscreen;
@@ -50,6 +55,9 @@ static char *option_font;
 static int option_font_size;
 static char *option_term;
 static char *option_shell;
+static char *option_benchmark;
+static int option_scrollback_lines;
+static int option_scrollback_spill;
 
 static struct wl_list terminal_list;
 
@@ -398,6 +406,433 @@ attr_init(struct attr *data_attr, struct attr attr, int n)
 	}
 }
 
+/*
+ * Scrollback.  Lines that scroll off the top of the screen are packed
+ * into variable-length records: the number of cells, the attributes as
+ * runs and the characters as UTF-8.  Empty cells at the end of a line
+ * are dropped and come back as blanks in the attributes of the last
+ * one, so records do not depend on the width of the terminal.  The
+ * records are appended to large blocks, which are either malloced or
+ * mapped from an unlinked temporary file.
+ */
+#define SCROLLBACK_BLOCK_SIZE	(64 * 1024)
+#define SCROLLBACK_RAW_CELL	0xff
+
+struct scrollback_block {
+	char *data;
+	uint32_t size, used;
+	uint32_t first;		/* id of the first line */
+	uint32_t count;
+	uint32_t *offsets;
+	uint32_t offsets_alloc;
+	int mapped;
+};
+
+struct scrollback {
+	struct scrollback_block **blocks;
+	int block_count, block_alloc;
+	uint32_t limit;
+	int spill;
+	uint32_t total;		/* lines ever added, the id of the next one */
+	uint32_t count;		/* lines that are still kept */
+	size_t bytes;
+
+	char *packed;
+	size_t packed_size;
+
+	/* Unpacked lines, indexed by id modulo cache_size. */
+	union utf8_char *cache_data;
+	struct attr *cache_attr;
+	uint32_t *cache_id;
+	int cache_width, cache_size;
+};
+
+static void
+scrollback_init(struct scrollback *sb, uint32_t limit, int spill)
+{
+	memset(sb, 0, sizeof *sb);
+	sb->limit = limit;
+	sb->spill = spill;
+}
+
+static void
+scrollback_block_destroy(struct scrollback_block *block)
+{
+	if (block->mapped)
+		munmap(block->data, block->size);
+	else
+		free(block->data);
+	free(block->offsets);
+	free(block);
+}
+
+static struct scrollback_block *
+scrollback_block_create(struct scrollback *sb, size_t size)
+{
+	struct scrollback_block *block;
+	int fd;
+
+	block = xzalloc(sizeof *block);
+	block->size = size > SCROLLBACK_BLOCK_SIZE ?
+		size : SCROLLBACK_BLOCK_SIZE;
+	block->first = sb->total;
+
+	if (sb->spill) {
+		fd = os_create_anonymous_file(block->size);
+		if (fd >= 0) {
+			block->data = mmap(NULL, block->size,
+					   PROT_READ | PROT_WRITE,
+					   MAP_SHARED, fd, 0);
+			close(fd);
+			if (block->data == MAP_FAILED)
+				block->data = NULL;
+			else
+				block->mapped = 1;
+		}
+	}
+	if (!block->data)
+		block->data = xmalloc(block->size);
+
+	if (sb->block_count == sb->block_alloc) {
+		sb->block_alloc = sb->block_alloc ? sb->block_alloc * 2 : 8;
+		sb->blocks = (void *) xrealloc((char *) sb->blocks,
+					       sb->block_alloc *
+					       sizeof *sb->blocks);
+	}
+	sb->blocks[sb->block_count++] = block;
+
+	return block;
+}
+
+static void
+scrollback_release(struct scrollback *sb)
+{
+	int i;
+
+	for (i = 0; i < sb->block_count; i++)
+		scrollback_block_destroy(sb->blocks[i]);
+	free(sb->blocks);
+	free(sb->packed);
+	free(sb->cache_data);
+	free(sb->cache_attr);
+	free(sb->cache_id);
+}
+
+static int
+utf8_lead_length(unsigned char lead)
+{
+	if (lead < 0x80)
+		return 1;
+	else if (lead >= 0xc0 && lead < 0xe0)
+		return 2;
+	else if (lead >= 0xe0 && lead < 0xf0)
+		return 3;
+	else if (lead >= 0xf0 && lead < 0xf8)
+		return 4;
+	else
+		return -1;
+}
+
+/* The number of bytes a cell packs into, or -1 if it does not hold
+ * well-formed UTF-8 and has to be stored as is. */
+static int
+utf8_cell_length(union utf8_char *c)
+{
+	int i, len;
+
+	len = utf8_lead_length(c->byte[0]);
+	if (len < 0)
+		return -1;
+
+	for (i = 1; i < 4; i++) {
+		if (i < len && (c->byte[i] & 0xc0) != 0x80)
+			return -1;
+		if (i >= len && c->byte[i] != 0)
+			return -1;
+	}
+
+	return len;
+}
+
+/* Pack a line into sb->packed and return the size of the record. */
+static size_t
+scrollback_pack(struct scrollback *sb, union utf8_char *data,
+		struct attr *attr, int width)
+{
+	struct attr fill;
+	uint16_t n, runs, len;
+	size_t size;
+	char *p, *q;
+	int i, l;
+
+	fill = attr[width - 1];
+	for (n = width; n > 0; n--)
+		if (data[n - 1].ch != 0 ||
+		    memcmp(&attr[n - 1], &fill, sizeof fill) != 0)
+			break;
+
+	size = 4 + sizeof fill + n * (2 + sizeof fill + 5);
+	if (size > sb->packed_size) {
+		sb->packed_size = size;
+		sb->packed = xrealloc(sb->packed, size);
+	}
+
+	/* attribute runs first, then the characters */
+	p = sb->packed + 4 + sizeof fill;
+	runs = 0;
+	for (i = 0; i < n; i += len) {
+		for (len = 1; i + len < n; len++)
+			if (memcmp(&attr[i + len], &attr[i], sizeof fill) != 0)
+				break;
+		memcpy(p, &len, 2);
+		memcpy(p + 2, &attr[i], sizeof fill);
+		p += 2 + sizeof fill;
+		runs++;
+	}
+
+	q = p;
+	for (i = 0; i < n; i++) {
+		if (data[i].ch == 0) {
+			*q++ = 0;
+			continue;
+		}
+
+		l = utf8_cell_length(&data[i]);
+		if (l < 0) {
+			*q++ = (char) SCROLLBACK_RAW_CELL;
+			l = 4;
+		}
+		memcpy(q, data[i].byte, l);
+		q += l;
+	}
+
+	memcpy(sb->packed, &n, 2);
+	memcpy(sb->packed + 2, &runs, 2);
+	memcpy(sb->packed + 4, &fill, sizeof fill);
+
+	return q - sb->packed;
+}
+
+static void
+scrollback_unpack(const char *p, int width,
+		  union utf8_char *data, struct attr *attr)
+{
+	struct attr fill, a;
+	uint16_t n, runs, len;
+	const unsigned char *q;
+	int i, j, col, l;
+
+	memcpy(&n, p, 2);
+	memcpy(&runs, p + 2, 2);
+	memcpy(&fill, p + 4, sizeof fill);
+	p += 4 + sizeof fill;
+
+	col = 0;
+	for (i = 0; i < runs; i++) {
+		memcpy(&len, p, 2);
+		memcpy(&a, p + 2, sizeof a);
+		p += 2 + sizeof a;
+		for (j = 0; j < len && col < width; j++)
+			attr[col++] = a;
+	}
+	for (; col < width; col++)
+		attr[col] = fill;
+
+	memset(data, 0, width * sizeof *data);
+	q = (const unsigned char *) p;
+	for (col = 0; col < n && col < width; col++) {
+		if (*q == 0) {
+			q++;
+			continue;
+		}
+
+		if (*q == SCROLLBACK_RAW_CELL) {
+			q++;
+			l = 4;
+		} else {
+			l = utf8_lead_length(*q);
+		}
+		memcpy(data[col].byte, q, l);
+		q += l;
+	}
+}
+
+static void
+scrollback_invalidate(struct scrollback *sb, uint32_t id)
+{
+	int slot;
+
+	if (sb->cache_size == 0)
+		return;
+
+	/* id + 1 never maps to the same slot */
+	slot = id & (sb->cache_size - 1);
+	if (sb->cache_id[slot] == id)
+		sb->cache_id[slot] = id + 1;
+}
+
+/* Drop the oldest lines over the limit, and the blocks that only
+ * hold dropped lines. */
+static void
+scrollback_trim(struct scrollback *sb)
+{
+	struct scrollback_block *block;
+	uint32_t oldest;
+
+	if (sb->count > sb->limit)
+		sb->count = sb->limit;
+
+	oldest = sb->total - sb->count;
+	while (sb->block_count > 0) {
+		block = sb->blocks[0];
+		if ((int32_t) (block->first + block->count - oldest) > 0)
+			break;
+
+		sb->bytes -= block->used;
+		scrollback_block_destroy(block);
+		sb->block_count--;
+		memmove(sb->blocks, sb->blocks + 1,
+			sb->block_count * sizeof *sb->blocks);
+	}
+}
+
+static void
+scrollback_push(struct scrollback *sb, union utf8_char *data,
+		struct attr *attr, int width)
+{
+	struct scrollback_block *block = NULL;
+	size_t size;
+
+	if (sb->limit == 0) {
+		sb->total++;
+		return;
+	}
+
+	size = scrollback_pack(sb, data, attr, width);
+	if (sb->block_count > 0) {
+		block = sb->blocks[sb->block_count - 1];
+		if (block->used + size > block->size)
+			block = NULL;
+	}
+	if (!block)
+		block = scrollback_block_create(sb, size);
+
+	if (block->count == block->offsets_alloc) {
+		block->offsets_alloc = block->offsets_alloc ?
+			block->offsets_alloc * 2 : 256;
+		block->offsets = (void *) xrealloc((char *) block->offsets,
+						   block->offsets_alloc *
+						   sizeof *block->offsets);
+	}
+	block->offsets[block->count++] = block->used;
+	memcpy(block->data + block->used, sb->packed, size);
+	block->used += size;
+	sb->bytes += size;
+
+	scrollback_invalidate(sb, sb->total);
+	sb->total++;
+	sb->count++;
+	scrollback_trim(sb);
+}
+
+/* Take the most recent line back out of the scrollback. */
+static int
+scrollback_pop(struct scrollback *sb, int width,
+	       union utf8_char *data, struct attr *attr)
+{
+	struct scrollback_block *block;
+	uint32_t offset;
+
+	if (sb->count == 0)
+		return -1;
+
+	block = sb->blocks[sb->block_count - 1];
+	offset = block->offsets[--block->count];
+	scrollback_unpack(block->data + offset, width, data, attr);
+	sb->bytes -= block->used - offset;
+	block->used = offset;
+	if (block->count == 0) {
+		scrollback_block_destroy(block);
+		sb->block_count--;
+	}
+
+	sb->count--;
+	sb->total--;
+	scrollback_invalidate(sb, sb->total);
+
+	return 0;
+}
+
+static struct scrollback_block *
+scrollback_find(struct scrollback *sb, uint32_t id)
+{
+	struct scrollback_block *block;
+	int lo = 0, hi = sb->block_count - 1, mid;
+
+	while (lo < hi) {
+		mid = (lo + hi + 1) / 2;
+		block = sb->blocks[mid];
+		if ((int32_t) (id - block->first) < 0)
+			hi = mid - 1;
+		else
+			lo = mid;
+	}
+
+	return sb->blocks[lo];
+}
+
+/* Size the unpacked line cache to hold a screenful of lines. */
+static void
+scrollback_resize_cache(struct scrollback *sb, int width, int height)
+{
+	int i, size;
+
+	for (size = 16; size < height; size *= 2)
+		;
+
+	if (sb->cache_width == width && sb->cache_size >= size)
+		return;
+
+	free(sb->cache_data);
+	free(sb->cache_attr);
+	free(sb->cache_id);
+	sb->cache_data = xmalloc(size * width * sizeof *sb->cache_data);
+	sb->cache_attr = xmalloc(size * width * sizeof *sb->cache_attr);
+	sb->cache_id = xmalloc(size * sizeof *sb->cache_id);
+	for (i = 0; i < size; i++)
+		sb->cache_id[i] = i + 1;
+	sb->cache_width = width;
+	sb->cache_size = size;
+}
+
+/* Get a line by id, unpacked to the width of the cache.  Lines that
+ * are not kept come back blank. */
+static void
+scrollback_get(struct scrollback *sb, uint32_t id, struct attr blank,
+	       union utf8_char **data, struct attr **attr)
+{
+	struct scrollback_block *block;
+	int slot;
+
+	slot = id & (sb->cache_size - 1);
+	*data = sb->cache_data + slot * sb->cache_width;
+	*attr = sb->cache_attr + slot * sb->cache_width;
+	if (sb->cache_id[slot] == id)
+		return;
+
+	if (sb->total - id - 1 >= sb->count) {
+		memset(*data, 0, sb->cache_width * sizeof **data);
+		attr_init(*attr, blank, sb->cache_width);
+		sb->cache_id[slot] = slot + 1;
+		return;
+	}
+
+	block = scrollback_find(sb, id);
+	scrollback_unpack(block->data + block->offsets[id - block->first],
+			  sb->cache_width, *data, *attr);
+	sb->cache_id[slot] = id;
+}
+
 enum escape_state {
 	escape_state_normal = 0,
 	escape_state_escape,
@@ -424,6 +859,8 @@ enum {
 	SELECT_LINE
 };
 
+struct glyph_cache;
+
 struct terminal {
 	struct window *window;
 	struct widget *widget;
@@ -446,10 +883,11 @@ struct terminal {
 	int data_pitch, attr_pitch;  /* The width in bytes of a line */
 	int width, height, row, column, max_width;
 	uint32_t buffer_height;
-	uint32_t start, end, saved_start, log_size;
+	uint32_t start, end;
+	struct scrollback scrollback;
+	uint32_t view_offset;	/* lines the view is scrolled back */
 	wl_fixed_t smooth_scroll;
 	int saved_row, saved_column;
-	int scrolling;
 	int send_cursor_position;
 	int fd, master;
 	uint32_t modifiers;
@@ -476,6 +914,23 @@ struct terminal {
 	int selection_start_row, selection_start_col;
 	int selection_end_row, selection_end_col;
 	struct wl_list link;
+
+	/* Incremental redraw: rows are rendered into one of two cache
+	 * surfaces, which are only touched where rows changed.  Scrolling
+	 * copies the surviving rows over to the other cache surface. */
+	cairo_surface_t *cache[2];
+	int cache_current;
+	int cache_width, cache_height;
+	struct glyph_cache *glyph_cache;
+	int use_glyph_cache;
+	char *row_dirty;	/* indexed like data, by buffer row */
+	char *view_dirty;	/* indexed by row on screen */
+	int redraw_all;
+	uint32_t drawn_position;
+	int drawn_cursor_row;
+	uint32_t drawn_mode;
+	int drawn_selection_start_row, drawn_selection_start_col;
+	int drawn_selection_end_row, drawn_selection_end_col;
 };
 
 /* Create default tab stops, every 8 characters */
@@ -568,11 +1023,84 @@ terminal_get_attr_row(struct terminal *terminal, int row)
 	return (void *) terminal->data_attr + index * terminal->attr_pitch;
 }
 
+/* Lines from 0 up are the rows of the screen, negative ones count back
+ * into the scrollback, -1 being the most recent line there. */
+static union utf8_char *
+terminal_get_line(struct terminal *terminal, int line)
+{
+	union utf8_char *data;
+	struct attr *attr;
+
+	if (line >= 0)
+		return terminal_get_row(terminal, line);
+
+	scrollback_get(&terminal->scrollback,
+		       terminal->scrollback.total + line,
+		       terminal->curr_attr, &data, &attr);
+
+	return data;
+}
+
+static struct attr *
+terminal_get_line_attr(struct terminal *terminal, int line)
+{
+	union utf8_char *data;
+	struct attr *attr;
+
+	if (line >= 0)
+		return terminal_get_attr_row(terminal, line);
+
+	scrollback_get(&terminal->scrollback,
+		       terminal->scrollback.total + line,
+		       terminal->curr_attr, &data, &attr);
+
+	return attr;
+}
+
+/* Mark rows first to last (inclusive) as needing a redraw.  The dirty
+ * flags follow the buffer rows, so they stay with the contents when
+ * the buffer scrolls. */
+static void
+terminal_damage_rows(struct terminal *terminal, int first, int last)
+{
+	int row;
+
+	if (first < 0)
+		first = 0;
+	if (last >= terminal->height)
+		last = terminal->height - 1;
+
+	for (row = first; row <= last; row++)
+		terminal->row_dirty[(row + terminal->start) &
+				    (terminal->buffer_height - 1)] = 1;
+}
+
+static int
+terminal_row_is_dirty(struct terminal *terminal, int row)
+{
+	return terminal->view_dirty[row];
+}
+
+/* Where the view is, counted in lines that went by.  The difference
+ * between two positions is how far the contents moved up. */
+static uint32_t
+terminal_view_position(struct terminal *terminal)
+{
+	return terminal->scrollback.total - terminal->view_offset;
+}
+
 union decoded_attr {
 	struct attr attr;
 	uint32_t key;
 };
 
+/* A terminal without a window only exists for benchmarking. */
+static int
+terminal_has_focus(struct terminal *terminal)
+{
+	return terminal->window && window_has_focus(terminal->window);
+}
+
 static void
 terminal_decode_attr(struct terminal *terminal, int row, int col,
 		     union decoded_attr *decoded)
@@ -590,11 +1118,11 @@ terminal_decode_attr(struct terminal *terminal, int row, int col,
 		decoded->attr.s = 1;
 
 	/* get the attributes for this character cell */
-	attr = terminal_get_attr_row(terminal, row)[col];
+	attr = terminal_get_line_attr(terminal, row)[col];
 	if ((attr.a & ATTRMASK_INVERSE) ||
 	    decoded->attr.s ||
 	    ((terminal->mode & MODE_SHOW_CURSOR) &&
-	     window_has_focus(terminal->window) && terminal->row == row &&
+	     terminal_has_focus(terminal) && terminal->row == row &&
 	     terminal->column == col)) {
 		foreground = attr.bg;
 		background = attr.fg;
@@ -628,6 +1156,20 @@ terminal_scroll_buffer(struct terminal *terminal, int d)
 {
 	int i;
 
+	if (d > terminal->height)
+		d = terminal->height;
+	else if (d < -terminal->height)
+		d = -terminal->height;
+
+	/* the lines going off the top are kept in the scrollback */
+	for (i = 0; i < d; i++)
+		scrollback_push(&terminal->scrollback,
+				terminal_get_row(terminal, i),
+				terminal_get_attr_row(terminal, i),
+				terminal->width);
+	if (terminal->view_offset > terminal->scrollback.count)
+		terminal->view_offset = terminal->scrollback.count;
+
 	terminal->start += d;
 	if (d < 0) {
 		d = 0 - d;
@@ -636,12 +1178,16 @@ terminal_scroll_buffer(struct terminal *terminal, int d)
 			attr_init(terminal_get_attr_row(terminal, i),
 			    terminal->curr_attr, terminal->width);
 		}
+		/* the view does not move, so everything below changed */
+		terminal_damage_rows(terminal, 0, terminal->height - 1);
 	} else {
 		for (i = terminal->height - d; i < terminal->height; i++) {
 			memset(terminal_get_row(terminal, i), 0, terminal->data_pitch);
 			attr_init(terminal_get_attr_row(terminal, i),
 			    terminal->curr_attr, terminal->width);
 		}
+		terminal_damage_rows(terminal, terminal->height - d,
+				     terminal->height - 1);
 	}
 
 	terminal->selection_start_row -= d;
@@ -658,6 +1204,8 @@ terminal_scroll_window(struct terminal *terminal, int d)
 	// scrolling range is inclusive
 	window_height = terminal->margin_bottom - terminal->margin_top + 1;
 	d = d % (window_height + 1);
+	terminal_damage_rows(terminal,
+			     terminal->margin_top, terminal->margin_bottom);
 	if(d < 0) {
 		d = 0 - d;
 		to_row = terminal->margin_bottom;
@@ -713,6 +1261,7 @@ terminal_shift_line(struct terminal *terminal, int d)
 	
 	row = terminal_get_row(terminal, terminal->row);
 	attr_row = terminal_get_attr_row(terminal, terminal->row);
+	terminal_damage_rows(terminal, terminal->row, terminal->row);
 
 	if ((terminal->width + d) <= terminal->column)
 		d = terminal->column + 1 - terminal->width;
@@ -746,39 +1295,50 @@ terminal_resize_cells(struct terminal *terminal,
 	struct attr *data_attr;
 	char *tab_ruler;
 	int data_pitch, attr_pitch;
-	int i, l, total_rows;
-	uint32_t d, uheight = height;
+	int i, l, d, n, total_rows;
+	uint32_t buffer_height;
 	struct rectangle allocation;
 	struct winsize ws;
 
-	if (uheight > terminal->buffer_height)
-		height = terminal->buffer_height;
-
 	if (terminal->width == width && terminal->height == height)
 		return;
 
-	if (terminal->data && width <= terminal->max_width) {
-		d = 0;
-		if (height < terminal->height && height <= terminal->row)
-			d = terminal->height - height;
-		else if (height > terminal->height &&
-			 terminal->height - 1 == terminal->row) {
-			d = terminal->height - height;
-			if (terminal->log_size < uheight)
-				d = -terminal->start;
-		}
-
+	terminal->redraw_all = 1;
+
+	/* Keep the cursor on the screen.  Lines going off the top move
+	 * into the scrollback, and come back when the screen grows. */
+	d = 0;
+	if (terminal->data && height < terminal->height &&
+	    height <= terminal->row) {
+		d = terminal->height - height;
+		for (i = 0; i < d; i++)
+			scrollback_push(&terminal->scrollback,
+					terminal_get_row(terminal, i),
+					terminal_get_attr_row(terminal, i),
+					terminal->width);
 		terminal->start += d;
 		terminal->row -= d;
-	} else {
-		terminal->max_width = width;
-		data_pitch = width * sizeof(union utf8_char);
-		data = xzalloc(data_pitch * terminal->buffer_height);
-		attr_pitch = width * sizeof(struct attr);
-		data_attr = xmalloc(attr_pitch * terminal->buffer_height);
-		tab_ruler = xzalloc(width);
+	}
+	total_rows = terminal->height - d;
+	if (total_rows > height)
+		total_rows = height;
+
+	/* Only the screen lives in the buffer, so growing it never
+	 * copies more than a screenful. */
+	if (!terminal->data || width > terminal->max_width ||
+	    (uint32_t) height > terminal->buffer_height) {
+		for (buffer_height = 32;
+		     buffer_height < (uint32_t) height; buffer_height *= 2)
+			;
+		if (width > terminal->max_width)
+			terminal->max_width = width;
+		data_pitch = terminal->max_width * sizeof(union utf8_char);
+		data = xzalloc(data_pitch * buffer_height);
+		attr_pitch = terminal->max_width * sizeof(struct attr);
+		data_attr = xmalloc(attr_pitch * buffer_height);
+		tab_ruler = xzalloc(terminal->max_width);
 		attr_init(data_attr, terminal->curr_attr,
-			  width * terminal->buffer_height);
+			  terminal->max_width * buffer_height);
 
 		if (terminal->data && terminal->data_attr) {
 			if (width > terminal->width)
@@ -786,22 +1346,11 @@ terminal_resize_cells(struct terminal *terminal,
 			else
 				l = width;
 
-			if (terminal->height > height) {
-				total_rows = height;
-				i = 1 + terminal->row - height;
-				if (i > 0) {
-					terminal->start += i;
-					terminal->row = terminal->row - i;
-				}
-			} else {
-				total_rows = terminal->height;
-			}
-
 			for (i = 0; i < total_rows; i++) {
-				memcpy(&data[width * i],
+				memcpy((void *) data + i * data_pitch,
 				       terminal_get_row(terminal, i),
 				       l * sizeof(union utf8_char));
-				memcpy(&data_attr[width * i],
+				memcpy((void *) data_attr + i * attr_pitch,
 				       terminal_get_attr_row(terminal, i),
 				       l * sizeof(struct attr));
 			}
@@ -811,20 +1360,63 @@ terminal_resize_cells(struct terminal *terminal,
 			free(terminal->tab_ruler);
 		}
 
+		free(terminal->row_dirty);
+		free(terminal->view_dirty);
+		terminal->row_dirty = xzalloc(buffer_height);
+		terminal->view_dirty = xzalloc(buffer_height);
+
+		terminal->buffer_height = buffer_height;
 		terminal->data_pitch = data_pitch;
 		terminal->attr_pitch = attr_pitch;
 		terminal->data = data;
 		terminal->data_attr = data_attr;
 		terminal->tab_ruler = tab_ruler;
 		terminal->start = 0;
+	} else if (width > terminal->width) {
+		/* clear what an earlier, wider screen left behind */
+		for (i = 0; i < total_rows; i++) {
+			memset(terminal_get_row(terminal, i) + terminal->width,
+			       0, (width - terminal->width) *
+			       sizeof(union utf8_char));
+			attr_init(terminal_get_attr_row(terminal, i) +
+				  terminal->width, terminal->curr_attr,
+				  width - terminal->width);
+		}
+	}
+
+	n = 0;
+	if (terminal->height > 0 && height > terminal->height &&
+	    terminal->row == terminal->height - 1) {
+		n = height - terminal->height;
+		if ((uint32_t) n > terminal->scrollback.count)
+			n = terminal->scrollback.count;
+		for (i = 1; i <= n; i++)
+			scrollback_pop(&terminal->scrollback, width,
+				       terminal_get_row(terminal, -i),
+				       terminal_get_attr_row(terminal, -i));
+		terminal->start -= n;
+		terminal->row += n;
+	}
+
+	for (i = total_rows + n; i < height; i++) {
+		memset(terminal_get_row(terminal, i), 0, terminal->data_pitch);
+		attr_init(terminal_get_attr_row(terminal, i),
+			  terminal->curr_attr, width);
 	}
 
+	if (terminal->view_offset > terminal->scrollback.count)
+		terminal->view_offset = terminal->scrollback.count;
+	scrollback_resize_cache(&terminal->scrollback, width, height);
+
 	terminal->margin_bottom =
 		height - (terminal->height - terminal->margin_bottom);
 	terminal->width = width;
 	terminal->height = height;
 	terminal_init_tabs(terminal);
 
+	if (!terminal->widget)
+		return;
+
 	/* Update the window size */
 	ws.ws_row = terminal->height;
 	ws.ws_col = terminal->width;
@@ -868,6 +1460,7 @@ resize_handler(struct widget *widget,
 
 	terminal_resize_cells(terminal, columns, rows);
 	update_title(terminal);
+	terminal->redraw_all = 1;
 }
 
 static void
@@ -882,6 +1475,9 @@ terminal_resize(struct terminal *terminal, int columns, int rows)
 {
 	int32_t width, height, m;
 
+	if (!terminal->window)
+		return;
+
 	if (window_is_fullscreen(terminal->window) ||
 	    window_is_maximized(terminal->window))
 		return;
@@ -929,7 +1525,7 @@ terminal_set_color(struct terminal *terminal, cairo_t *cr, int index)
 static void
 terminal_send_selection(struct terminal *terminal, int fd)
 {
-	int row, col;
+	int row, col, first, last;
 	union utf8_char *p_row;
 	union decoded_attr attr;
 	FILE *fp;
@@ -940,8 +1536,17 @@ terminal_send_selection(struct terminal *terminal, int fd)
 		close(fd);
 		return;
 	}
-	for (row = 0; row < terminal->height; row++) {
-		p_row = terminal_get_row(terminal, row);
+
+	/* the selection can reach back into the scrollback */
+	first = terminal->selection_start_row;
+	if (first < -(int) terminal->scrollback.count)
+		first = -(int) terminal->scrollback.count;
+	last = terminal->selection_end_row;
+	if (last > terminal->height - 1)
+		last = terminal->height - 1;
+
+	for (row = first; row <= last; row++) {
+		p_row = terminal_get_line(terminal, row);
 		for (col = 0; col < terminal->width; col++) {
 			if (p_row[col].ch == 0x200B) /* space glyph */
 				continue;
@@ -1025,52 +1630,397 @@ glyph_run_add(struct glyph_run *run, int x, int y, union utf8_char *c)
 }
 
 
+/* Rasterized glyphs are kept in an A8 atlas of equally sized slots and
+ * blitted through a mask with the cell's foreground color, instead of
+ * going through cairo_show_glyphs() for every cell on every frame.
+ * The atlas is bounded; the least recently used glyph is replaced
+ * once it is full. */
+#define GLYPH_CACHE_SIZE	(4 * 1024 * 1024)
+#define GLYPH_CACHE_COLUMNS	64
+#define GLYPH_CACHE_PAD		2
+
+struct glyph_cache_entry {
+	uint32_t ch;
+	cairo_scaled_font_t *font;
+	int next;			/* hash chain, -1 terminated */
+	struct wl_list link;		/* LRU, most recent first */
+	cairo_surface_t *mask;		/* the slot within the atlas */
+};
+
+struct glyph_cache {
+	cairo_surface_t *atlas;
+	int slot_width, slot_height;
+	double ascent;
+	int capacity, count;
+	struct glyph_cache_entry *entries;	/* entry i lives in slot i */
+	int *buckets;
+	uint32_t bucket_mask;
+	struct wl_list lru;
+	uint32_t hits, misses;
+};
+
+static struct glyph_cache *
+glyph_cache_create(struct terminal *terminal)
+{
+	struct glyph_cache *cache;
+	uint32_t buckets;
+	int rows, i;
+
+	cache = xzalloc(sizeof *cache);
+	cache->slot_width = 2 * terminal->average_width + 2 * GLYPH_CACHE_PAD;
+	cache->slot_height = ceil(terminal->extents.height) +
+		2 * GLYPH_CACHE_PAD;
+	cache->ascent = terminal->extents.ascent;
+
+	cache->capacity = GLYPH_CACHE_SIZE /
+		(cache->slot_width * cache->slot_height);
+	cache->capacity -= cache->capacity % GLYPH_CACHE_COLUMNS;
+	if (cache->capacity < GLYPH_CACHE_COLUMNS)
+		cache->capacity = GLYPH_CACHE_COLUMNS;
+	rows = cache->capacity / GLYPH_CACHE_COLUMNS;
+
+	cache->atlas =
+		cairo_image_surface_create(CAIRO_FORMAT_A8,
+					   GLYPH_CACHE_COLUMNS *
+					   cache->slot_width,
+					   rows * cache->slot_height);
+	if (cairo_surface_status(cache->atlas) != CAIRO_STATUS_SUCCESS) {
+		cairo_surface_destroy(cache->atlas);
+		free(cache);
+		return NULL;
+	}
+
+	for (buckets = 1; buckets < (uint32_t) cache->capacity; buckets *= 2)
+		;
+	cache->bucket_mask = buckets - 1;
+	cache->buckets = xmalloc(buckets * sizeof *cache->buckets);
+	for (i = 0; i < (int) buckets; i++)
+		cache->buckets[i] = -1;
+
+	cache->entries = xzalloc(cache->capacity * sizeof *cache->entries);
+	wl_list_init(&cache->lru);
+
+	return cache;
+}
+
 static void
-redraw_handler(struct widget *widget, void *data)
+glyph_cache_destroy(struct glyph_cache *cache)
+{
+	int i;
+
+	for (i = 0; i < cache->count; i++)
+		cairo_surface_destroy(cache->entries[i].mask);
+	cairo_surface_destroy(cache->atlas);
+	free(cache->entries);
+	free(cache->buckets);
+	free(cache);
+}
+
+static uint32_t
+glyph_cache_hash(struct glyph_cache *cache,
+		 cairo_scaled_font_t *font, uint32_t ch)
+{
+	uint32_t hash;
+
+	hash = ch * 2654435761u;
+	hash ^= (uint32_t) ((uintptr_t) font >> 4);
+
+	return hash & cache->bucket_mask;
+}
+
+static void
+glyph_cache_unlink(struct glyph_cache *cache, int index)
+{
+	struct glyph_cache_entry *entry = &cache->entries[index];
+	int *p;
+
+	p = &cache->buckets[glyph_cache_hash(cache, entry->font, entry->ch)];
+	while (*p != index)
+		p = &cache->entries[*p].next;
+	*p = entry->next;
+}
+
+static void
+glyph_cache_render(struct glyph_cache *cache, int index,
+		   union utf8_char *c)
+{
+	struct glyph_cache_entry *entry = &cache->entries[index];
+	cairo_glyph_t glyphs[8], *g = glyphs;
+	int num_glyphs = ARRAY_LENGTH(glyphs);
+	cairo_t *cr;
+
+	cr = cairo_create(entry->mask);
+	cairo_set_operator(cr, CAIRO_OPERATOR_CLEAR);
+	cairo_paint(cr);
+	cairo_set_operator(cr, CAIRO_OPERATOR_OVER);
+
+	cairo_set_scaled_font(cr, entry->font);
+	if (cairo_scaled_font_text_to_glyphs(entry->font,
+					     GLYPH_CACHE_PAD,
+					     GLYPH_CACHE_PAD + cache->ascent,
+					     (char *) c->byte,
+					     strnlen((char *) c->byte, 4),
+					     &g, &num_glyphs,
+					     NULL, NULL, NULL) ==
+	    CAIRO_STATUS_SUCCESS)
+		cairo_show_glyphs(cr, g, num_glyphs);
+	if (g != glyphs)
+		cairo_glyph_free(g);
+
+	cairo_destroy(cr);
+}
+
+static struct glyph_cache_entry *
+glyph_cache_lookup(struct glyph_cache *cache,
+		   cairo_scaled_font_t *font, union utf8_char *c)
+{
+	struct glyph_cache_entry *entry;
+	uint32_t hash;
+	int i, x, y;
+
+	hash = glyph_cache_hash(cache, font, c->ch);
+	for (i = cache->buckets[hash]; i >= 0; i = entry->next) {
+		entry = &cache->entries[i];
+		if (entry->ch == c->ch && entry->font == font) {
+			wl_list_remove(&entry->link);
+			wl_list_insert(&cache->lru, &entry->link);
+			cache->hits++;
+			return entry;
+		}
+	}
+
+	cache->misses++;
+	if (cache->count < cache->capacity) {
+		i = cache->count++;
+		entry = &cache->entries[i];
+		x = (i % GLYPH_CACHE_COLUMNS) * cache->slot_width;
+		y = (i / GLYPH_CACHE_COLUMNS) * cache->slot_height;
+		entry->mask =
+			cairo_surface_create_for_rectangle(cache->atlas, x, y,
+							   cache->slot_width,
+							   cache->slot_height);
+	} else {
+		entry = container_of(cache->lru.prev,
+				     struct glyph_cache_entry, link);
+		i = entry - cache->entries;
+		wl_list_remove(&entry->link);
+		glyph_cache_unlink(cache, i);
+	}
+
+	entry->ch = c->ch;
+	entry->font = font;
+	entry->next = cache->buckets[hash];
+	cache->buckets[hash] = i;
+	wl_list_insert(&cache->lru, &entry->link);
+
+	glyph_cache_render(cache, i, c);
+
+	return entry;
+}
+
+static void
+glyph_cache_draw(struct terminal *terminal, cairo_t *cr,
+		 union decoded_attr attr, int x, int y, union utf8_char *c)
+{
+	struct glyph_cache *cache = terminal->glyph_cache;
+	struct glyph_cache_entry *entry;
+	cairo_scaled_font_t *font;
+
+	/* empty cells and spaces have nothing to show */
+	if (c->ch == 0 || c->ch == ' ' || (attr.attr.a & ATTRMASK_CONCEALED))
+		return;
+
+	if (attr.attr.a & (ATTRMASK_BOLD | ATTRMASK_BLINK))
+		font = terminal->font_bold;
+	else
+		font = terminal->font_normal;
+
+	entry = glyph_cache_lookup(cache, font, c);
+	cairo_mask_surface(cr, entry->mask,
+			   x - GLYPH_CACHE_PAD,
+			   y - cache->ascent - GLYPH_CACHE_PAD);
+}
+
+static void
+terminal_ensure_cache(struct terminal *terminal, cairo_surface_t *surface,
+		      int width, int height)
+{
+	cairo_t *cr;
+	int i;
+
+	if (terminal->cache[0] &&
+	    terminal->cache_width == width && terminal->cache_height == height)
+		return;
+
+	for (i = 0; i < 2; i++) {
+		if (terminal->cache[i])
+			cairo_surface_destroy(terminal->cache[i]);
+		terminal->cache[i] =
+			cairo_surface_create_similar(surface,
+						     CAIRO_CONTENT_COLOR_ALPHA,
+						     width, height);
+
+		/* The margins are only painted here. */
+		cr = cairo_create(terminal->cache[i]);
+		cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
+		terminal_set_color(terminal, cr,
+				   terminal->color_scheme->border);
+		cairo_paint(cr);
+		cairo_destroy(cr);
+	}
+
+	terminal->cache_current = 0;
+	terminal->cache_width = width;
+	terminal->cache_height = height;
+	terminal->redraw_all = 1;
+}
+
+/* Work out which rows need to be rendered since the last redraw.
+ * Returns the number of rows the contents moved up since then. */
+static int
+terminal_update_dirty_rows(struct terminal *terminal)
+{
+	int scroll, row, offset = terminal->view_offset;
+
+	scroll = (int32_t) (terminal_view_position(terminal) -
+			    terminal->drawn_position);
+	if (scroll >= terminal->height || -scroll >= terminal->height)
+		terminal->redraw_all = 1;
+
+	/* The selection and the screen mode apply to every cell. */
+	if (terminal->selection_start_row + offset !=
+	    terminal->drawn_selection_start_row - scroll ||
+	    terminal->selection_end_row + offset !=
+	    terminal->drawn_selection_end_row - scroll ||
+	    terminal->selection_start_col !=
+	    terminal->drawn_selection_start_col ||
+	    terminal->selection_end_col != terminal->drawn_selection_end_col ||
+	    (terminal->mode & MODE_INVERSE) !=
+	    (terminal->drawn_mode & MODE_INVERSE))
+		terminal->redraw_all = 1;
+
+	if (terminal->redraw_all) {
+		memset(terminal->view_dirty, 1, terminal->height);
+		return 0;
+	}
+
+	memset(terminal->view_dirty, 0, terminal->height);
+	if (scroll > 0)
+		memset(terminal->view_dirty + terminal->height - scroll,
+		       1, scroll);
+	else if (scroll < 0)
+		memset(terminal->view_dirty, 1, -scroll);
+
+	/* Rows of the screen that changed; the scrollback never does. */
+	for (row = offset; row < terminal->height; row++)
+		if (terminal->row_dirty[(row - offset + terminal->start) &
+					(terminal->buffer_height - 1)])
+			terminal->view_dirty[row] = 1;
+
+	/* The cursor is drawn as part of the cell under it, so both the
+	 * row it left and the row it is on now need redrawing. */
+	row = terminal->drawn_cursor_row - scroll;
+	if (row >= 0 && row < terminal->height)
+		terminal->view_dirty[row] = 1;
+	row = terminal->row + offset;
+	if (row < terminal->height)
+		terminal->view_dirty[row] = 1;
+
+	return scroll;
+}
+
+/* Move the rows that are still on screen after scrolling into the
+ * other cache surface, instead of rendering them again. */
+static void
+terminal_scroll_cache(struct terminal *terminal, int scroll, int top_margin)
+{
+	cairo_surface_t *source;
+	cairo_t *cr;
+	double row_height = terminal->extents.height;
+
+	source = terminal->cache[terminal->cache_current];
+	terminal->cache_current ^= 1;
+
+	cr = cairo_create(terminal->cache[terminal->cache_current]);
+	cairo_rectangle(cr, 0, top_margin,
+			terminal->cache_width,
+			terminal->height * row_height);
+	cairo_clip(cr);
+	cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
+	cairo_set_source_surface(cr, source, 0, -scroll * row_height);
+	cairo_paint(cr);
+	cairo_destroy(cr);
+}
+
+/*
+ * Render the rows that changed since the last call into the cache, which
+ * is sized width x height and made similar to surface.  Returns the
+ * cache, with damage set to the area that changed.
+ */
+static cairo_surface_t *
+terminal_render(struct terminal *terminal, cairo_surface_t *surface,
+		int width, int height, struct rectangle *damage)
 {
-	struct terminal *terminal = data;
-	struct rectangle allocation;
 	cairo_t *cr;
 	int top_margin, side_margin;
-	int row, col, cursor_x, cursor_y;
+	int row, col, fg, line;
+	int scroll, first_row, last_row;
 	union utf8_char *p_row;
 	union decoded_attr attr;
 	int text_x, text_y;
-	cairo_surface_t *surface;
 	double d;
 	struct glyph_run run;
 	cairo_font_extents_t extents;
 	double average_width;
 	double unichar_width;
 
-	surface = window_get_surface(terminal->window);
-	widget_get_allocation(terminal->widget, &allocation);
-	cr = widget_cairo_create(terminal->widget);
-	cairo_rectangle(cr, allocation.x, allocation.y,
-			allocation.width, allocation.height);
+	extents = terminal->extents;
+	average_width = terminal->average_width;
+	side_margin = (width - terminal->width * average_width) / 2;
+	top_margin = (height - terminal->height * extents.height) / 2;
+
+	terminal_ensure_cache(terminal, surface, width, height);
+	if (terminal->use_glyph_cache && !terminal->glyph_cache)
+		terminal->glyph_cache = glyph_cache_create(terminal);
+
+	scroll = terminal_update_dirty_rows(terminal);
+	if (scroll != 0)
+		terminal_scroll_cache(terminal, scroll, top_margin);
+
+	cr = cairo_create(terminal->cache[terminal->cache_current]);
+	cairo_translate(cr, side_margin, top_margin);
+
+	/* only touch the dirty rows */
+	first_row = -1;
+	last_row = -1;
+	for (row = 0; row < terminal->height; row++) {
+		if (!terminal_row_is_dirty(terminal, row))
+			continue;
+		if (first_row < 0)
+			first_row = row;
+		last_row = row;
+		cairo_rectangle(cr, 0, row * extents.height,
+				terminal->width * average_width,
+				extents.height);
+	}
 	cairo_clip(cr);
-	cairo_push_group(cr);
 
 	cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
 	terminal_set_color(terminal, cr, terminal->color_scheme->border);
 	cairo_paint(cr);
 
 	cairo_set_scaled_font(cr, terminal->font_normal);
-
-	extents = terminal->extents;
-	average_width = terminal->average_width;
-	side_margin = (allocation.width - terminal->width * average_width) / 2;
-	top_margin = (allocation.height - terminal->height * extents.height) / 2;
-
 	cairo_set_line_width(cr, 1.0);
-	cairo_translate(cr, allocation.x + side_margin,
-			allocation.y + top_margin);
+
 	/* paint the background */
-	for (row = 0; row < terminal->height; row++) {
-		p_row = terminal_get_row(terminal, row);
+	for (row = first_row; row >= 0 && row <= last_row; row++) {
+		if (!terminal_row_is_dirty(terminal, row))
+			continue;
+		line = row - terminal->view_offset;
+		p_row = terminal_get_line(terminal, line);
 		for (col = 0; col < terminal->width; col++) {
 			/* get the attributes for this character cell */
-			terminal_decode_attr(terminal, row, col, &attr);
+			terminal_decode_attr(terminal, line, col, &attr);
 
 			if (attr.attr.bg == terminal->color_scheme->border)
 				continue;
@@ -1095,18 +2045,24 @@ redraw_handler(struct widget *widget, void *data)
 
 	/* paint the foreground */
 	glyph_run_init(&run, terminal, cr);
-	for (row = 0; row < terminal->height; row++) {
-		p_row = terminal_get_row(terminal, row);
+	fg = -1;
+	for (row = first_row; row >= 0 && row <= last_row; row++) {
+		if (!terminal_row_is_dirty(terminal, row))
+			continue;
+		line = row - terminal->view_offset;
+		p_row = terminal_get_line(terminal, line);
 		for (col = 0; col < terminal->width; col++) {
 			/* get the attributes for this character cell */
-			terminal_decode_attr(terminal, row, col, &attr);
+			terminal_decode_attr(terminal, line, col, &attr);
 
-			glyph_run_flush(&run, attr);
+			if (!terminal->glyph_cache)
+				glyph_run_flush(&run, attr);
 
 			text_x = col * average_width;
 			text_y = extents.ascent + row * extents.height;
 			if (attr.attr.a & ATTRMASK_UNDERLINE) {
 				terminal_set_color(terminal, cr, attr.attr.fg);
+				fg = attr.attr.fg;
 				cairo_move_to(cr, text_x, (double)text_y + 1.5);
 				cairo_line_to(cr, text_x + average_width, (double) text_y + 1.5);
 				cairo_stroke(cr);
@@ -1118,20 +2074,33 @@ redraw_handler(struct widget *widget, void *data)
 			if (p_row[col].ch == 0x200B)
 				continue;
 
-			glyph_run_add(&run, text_x, text_y, &p_row[col]);
+			if (terminal->glyph_cache) {
+				if (fg != attr.attr.fg) {
+					terminal_set_color(terminal, cr,
+							   attr.attr.fg);
+					fg = attr.attr.fg;
+				}
+				glyph_cache_draw(terminal, cr, attr,
+						 text_x, text_y, &p_row[col]);
+			} else {
+				glyph_run_add(&run, text_x, text_y,
+					      &p_row[col]);
+			}
 		}
 	}
 
 	attr.key = ~0;
-	glyph_run_flush(&run, attr);
+	if (!terminal->glyph_cache)
+		glyph_run_flush(&run, attr);
 
+	row = terminal->row + terminal->view_offset;
 	if ((terminal->mode & MODE_SHOW_CURSOR) &&
-	    !window_has_focus(terminal->window)) {
+	    !terminal_has_focus(terminal) && row < terminal->height) {
 		d = 0.5;
 
 		cairo_set_line_width(cr, 1);
 		cairo_move_to(cr, terminal->column * average_width + d,
-			      terminal->row * extents.height + d);
+			      row * extents.height + d);
 		cairo_rel_line_to(cr, average_width - 2 * d, 0);
 		cairo_rel_line_to(cr, 0, extents.height - 2 * d);
 		cairo_rel_line_to(cr, -average_width + 2 * d, 0);
@@ -1140,16 +2109,88 @@ redraw_handler(struct widget *widget, void *data)
 		cairo_stroke(cr);
 	}
 
-	cairo_pop_group_to_source(cr);
+	cairo_destroy(cr);
+
+	damage->x = 0;
+	damage->width = width;
+	if (terminal->redraw_all) {
+		damage->y = 0;
+		damage->height = height;
+	} else if (scroll != 0) {
+		damage->y = top_margin;
+		damage->height = terminal->height * extents.height;
+	} else if (first_row >= 0) {
+		damage->y = top_margin + first_row * extents.height;
+		damage->height = (last_row - first_row + 1) * extents.height;
+	} else {
+		damage->y = 0;
+		damage->height = 0;
+	}
+
+	for (row = 0; row < terminal->height; row++)
+		terminal->row_dirty[(row + terminal->start) &
+				    (terminal->buffer_height - 1)] = 0;
+	terminal->redraw_all = 0;
+	terminal->drawn_position = terminal_view_position(terminal);
+	terminal->drawn_cursor_row = terminal->row + terminal->view_offset;
+	terminal->drawn_mode = terminal->mode;
+	terminal->drawn_selection_start_row =
+		terminal->selection_start_row + terminal->view_offset;
+	terminal->drawn_selection_start_col = terminal->selection_start_col;
+	terminal->drawn_selection_end_row =
+		terminal->selection_end_row + terminal->view_offset;
+	terminal->drawn_selection_end_col = terminal->selection_end_col;
+
+	return terminal->cache[terminal->cache_current];
+}
+
+static void
+redraw_handler(struct widget *widget, void *data)
+{
+	struct terminal *terminal = data;
+	struct rectangle allocation, damage;
+	cairo_surface_t *surface, *cache;
+	cairo_t *cr;
+	int top_margin, side_margin;
+	int cursor_x, cursor_y;
+
+	surface = window_get_surface(terminal->window);
+	widget_get_allocation(terminal->widget, &allocation);
+
+	cache = terminal_render(terminal, surface,
+				allocation.width, allocation.height, &damage);
+
+	/* Unless the buffer still holds the last frame, the whole cache
+	 * is copied, but only the changes are damaged either way. */
+	cr = widget_cairo_create(terminal->widget);
+	if (widget_get_buffer_age(widget) == 1)
+		cairo_rectangle(cr, allocation.x + damage.x,
+				allocation.y + damage.y,
+				damage.width, damage.height);
+	else
+		cairo_rectangle(cr, allocation.x, allocation.y,
+				allocation.width, allocation.height);
+	cairo_clip(cr);
+	cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
+	cairo_set_source_surface(cr, cache, allocation.x, allocation.y);
 	cairo_paint(cr);
 	cairo_destroy(cr);
 	cairo_surface_destroy(surface);
 
+	widget_damage(widget, allocation.x + damage.x, allocation.y + damage.y,
+		      damage.width, damage.height);
+
+	side_margin = (allocation.width -
+		       terminal->width * terminal->average_width) / 2;
+	top_margin = (allocation.height -
+		      terminal->height * terminal->extents.height) / 2;
+
 	if (terminal->send_cursor_position) {
 		cursor_x = side_margin + allocation.x +
-				terminal->column * average_width;
+				terminal->column * terminal->average_width;
 		cursor_y = top_margin + allocation.y +
-				terminal->row * extents.height;
+				(terminal->row + terminal->view_offset) *
+				terminal->extents.height;
 		window_set_text_cursor_position(terminal->window,
 						cursor_x, cursor_y);
 		terminal->send_cursor_position = 0;
@@ -1204,6 +2245,7 @@ handle_term_parameter(struct terminal *terminal, int code, int sr)
 				attr_init(terminal_get_attr_row(terminal, i),
 				    terminal->curr_attr, terminal->width);
 			}
+			terminal->redraw_all = 1;
 			break;
 		case 5:  /* DECSCNM */
 			if (sr)	terminal->mode |=  MODE_INVERSE;
@@ -1290,7 +2332,8 @@ handle_osc(struct terminal *terminal)
 	case 2: /* Window title*/
 		free(terminal->title);
 		terminal->title = strdup(p);
-		window_set_title(terminal->window, p);
+		if (terminal->window)
+			window_set_title(terminal->window, p);
 		break;
 	case 7: /* shell cwd as uri */
 		break;
@@ -1421,6 +2464,8 @@ handle_escape(struct terminal *terminal)
 		row = terminal_get_row(terminal, terminal->row);
 		attr_row = terminal_get_attr_row(terminal, terminal->row);
 		if (!set[0] || args[0] == 0 || args[0] > 2) {
+			terminal_damage_rows(terminal, terminal->row,
+					     terminal->height - 1);
 			memset(&row[terminal->column],
 			       0, (terminal->width - terminal->column) * sizeof(union utf8_char));
 			attr_init(&attr_row[terminal->column],
@@ -1432,6 +2477,7 @@ handle_escape(struct terminal *terminal)
 				    terminal->curr_attr, terminal->width);
 			}
 		} else if (args[0] == 1) {
+			terminal_damage_rows(terminal, 0, terminal->row);
 			memset(row, 0, (terminal->column+1) * sizeof(union utf8_char));
 			attr_init(attr_row, terminal->curr_attr, terminal->column+1);
 			for (i = 0; i < terminal->row; i++) {
@@ -1442,13 +2488,15 @@ handle_escape(struct terminal *terminal)
 			}
 		} else if (args[0] == 2) {
 			/* Clear screen by scrolling contents out */
-			terminal_scroll_buffer(terminal,
-					       terminal->end - terminal->start);
+			i = terminal->end - terminal->start;
+			if (i > 0)
+				terminal_scroll_buffer(terminal, i);
 		}
 		break;
 	case 'K':    /* EL */
 		row = terminal_get_row(terminal, terminal->row);
 		attr_row = terminal_get_attr_row(terminal, terminal->row);
+		terminal_damage_rows(terminal, terminal->row, terminal->row);
 		if (!set[0] || args[0] == 0 || args[0] > 2) {
 			memset(&row[terminal->column], 0,
 			    (terminal->width - terminal->column) * sizeof(union utf8_char));
@@ -1477,6 +2525,8 @@ handle_escape(struct terminal *terminal)
 			       0, terminal->data_pitch);
 			attr_init(terminal_get_attr_row(terminal, terminal->row),
 				terminal->curr_attr, terminal->width);
+			terminal_damage_rows(terminal,
+					     terminal->row, terminal->row);
 		}
 		break;
 	case 'M':    /* DL */
@@ -1492,6 +2542,8 @@ handle_escape(struct terminal *terminal)
 		} else if (terminal->row == terminal->margin_bottom) {
 			memset(terminal_get_row(terminal, terminal->row),
 			       0, terminal->data_pitch);
+			terminal_damage_rows(terminal,
+					     terminal->row, terminal->row);
 		}
 		break;
 	case 'P':    /* DCH */
@@ -1514,6 +2566,7 @@ handle_escape(struct terminal *terminal)
 		attr_row = terminal_get_attr_row(terminal, terminal->row);
 		memset(&row[terminal->column], 0, count * sizeof(union utf8_char));
 		attr_init(&attr_row[terminal->column], terminal->curr_attr, count);
+		terminal_damage_rows(terminal, terminal->row, terminal->row);
 		break;
 	case 'Z':    /* CBT */
 		count = set[0] ? args[0] : 1;
@@ -1631,7 +2684,7 @@ handle_escape(struct terminal *terminal)
 		terminal->saved_column = terminal->column;
 		break;
 	case 't':    /* windowOps */
-		if (!set[0]) break;
+		if (!set[0] || !terminal->window) break;
 		switch (args[0]) {
 		case 4:  /* resize px */
 			if (set[1] && set[2]) {
@@ -1754,6 +2807,7 @@ handle_special_escape(struct terminal *terminal, char special, char code)
 			for(i = 0; i < numChars; i++) {
 				terminal->data[i].byte[0] = 'E';
 			}
+			terminal->redraw_all = 1;
 			break;
 		default:
 			fprintf(stderr, "Unknown HASH escape #%c\n", code);
@@ -1897,6 +2951,8 @@ handle_special_char(struct terminal *terminal, char c)
 				row[terminal->column].byte[0] = ' ';
 				row[terminal->column].byte[1] = '\0';
 				attr_row[terminal->column] = terminal->curr_attr;
+				terminal_damage_rows(terminal, terminal->row,
+						     terminal->row);
 			}
 
 			terminal->column++;
@@ -1940,6 +2996,13 @@ handle_special_char(struct terminal *terminal, char c)
 	return 1;
 }
 
+static void
+terminal_update_log(struct terminal *terminal)
+{
+	if ((int32_t) (terminal->row + terminal->start + 1 - terminal->end) > 0)
+		terminal->end = terminal->row + terminal->start + 1;
+}
+
 static void
 handle_char(struct terminal *terminal, union utf8_char utf8)
 {
@@ -1979,18 +3042,14 @@ handle_char(struct terminal *terminal, union utf8_char utf8)
 	
 	row = terminal_get_row(terminal, terminal->row);
 	attr_row = terminal_get_attr_row(terminal, terminal->row);
+	terminal_damage_rows(terminal, terminal->row, terminal->row);
 	
 	if (terminal->mode & MODE_IRM)
 		terminal_shift_line(terminal, +1);
 	row[terminal->column] = utf8;
 	attr_row[terminal->column++] = terminal->curr_attr;
 
-	if (terminal->row + terminal->start + 1 > terminal->end)
-		terminal->end = terminal->row + terminal->start + 1;
-	if (terminal->end == terminal->buffer_height)
-		terminal->log_size = terminal->buffer_height;
-	else if (terminal->log_size < terminal->buffer_height)
-		terminal->log_size = terminal->end;
+	terminal_update_log(terminal);
 
 	/* cursor jump for wide character. */
 	if (is_wide(utf8))
@@ -2020,14 +3079,116 @@ escape_append_utf8(struct terminal *terminal, union utf8_char utf8)
 	}
 }
 
+/* Return the length of the run of printable ASCII that data starts
+ * with. */
+static size_t
+scan_printable(const char *data, size_t length)
+{
+	size_t i = 0;
+#ifdef __SSE2__
+	const __m128i space = _mm_set1_epi8(0x1f);
+	const __m128i del = _mm_set1_epi8(0x7f);
+	__m128i v, printable;
+	unsigned int mask;
+
+	/* Bytes from 0x80 up compare as negative, so they fail the
+	 * signed greater-than test along with the control characters. */
+	for (; i + 16 <= length; i += 16) {
+		v = _mm_loadu_si128((const __m128i *) (data + i));
+		printable = _mm_andnot_si128(_mm_cmpeq_epi8(v, del),
+					     _mm_cmpgt_epi8(v, space));
+		mask = _mm_movemask_epi8(printable);
+		if (mask != 0xffff)
+			return i + __builtin_ctz(~mask);
+	}
+#endif
+	for (; i < length; i++) {
+		if ((unsigned char) data[i] < 0x20 ||
+		    (unsigned char) data[i] >= 0x7f)
+			break;
+	}
+
+	return i;
+}
+
+/* Whether printable ASCII can bypass handle_char(): not inside an
+ * escape sequence or a multibyte character, no character set
+ * translation and no insert mode. */
+static int
+terminal_can_write_run(struct terminal *terminal)
+{
+	enum utf8_state state = terminal->state_machine.state;
+
+	return terminal->state == escape_state_normal &&
+		(state == utf8state_start ||
+		 state == utf8state_accept ||
+		 state == utf8state_reject) &&
+		terminal->cs == CS_US &&
+		!(terminal->mode & MODE_IRM);
+}
+
+/* Store a run of printable ASCII, a row segment at a time. */
+static void
+terminal_write_run(struct terminal *terminal, const char *data, size_t length)
+{
+	union utf8_char *row, utf8;
+	struct attr *attr_row;
+	size_t i, n;
+
+	while (length > 0) {
+		if (terminal->column >= terminal->width) {
+			/* let handle_char() deal with the right margin */
+			utf8.ch = 0;
+			utf8.byte[0] = data[0];
+			handle_char(terminal, utf8);
+			data++;
+			length--;
+			continue;
+		}
+
+		n = terminal->width - terminal->column;
+		if (n > length)
+			n = length;
+
+		row = terminal_get_row(terminal, terminal->row) +
+			terminal->column;
+		attr_row = terminal_get_attr_row(terminal, terminal->row) +
+			terminal->column;
+		terminal_damage_rows(terminal, terminal->row, terminal->row);
+
+		for (i = 0; i < n; i++) {
+			row[i].ch = 0;
+			row[i].byte[0] = data[i];
+			attr_row[i] = terminal->curr_attr;
+		}
+
+		terminal->column += n;
+		terminal_update_log(terminal);
+		terminal->last_char = row[n - 1];
+
+		data += n;
+		length -= n;
+	}
+}
+
 static void
 terminal_data(struct terminal *terminal, const char *data, size_t length)
 {
 	unsigned int i;
 	union utf8_char utf8;
 	enum utf8_state parser_state;
+	size_t run;
 
 	for (i = 0; i < length; i++) {
+		if (terminal_can_write_run(terminal)) {
+			run = scan_printable(data + i, length - i);
+			if (run > 0) {
+				terminal_write_run(terminal, data + i, run);
+				i += run - 1;
+				continue;
+			}
+		}
+
 		parser_state =
 			utf8_next_char(&terminal->state_machine, data[i]);
 		switch(parser_state) {
@@ -2167,7 +3328,8 @@ terminal_data(struct terminal *terminal, const char *data, size_t length)
 		} /* if */
 	} /* for */
 
-	window_schedule_redraw(terminal->window);
+	if (terminal->widget)
+		widget_schedule_partial_redraw(terminal->widget);
 }
 
 static void
@@ -2297,31 +3459,18 @@ handle_bound_key(struct terminal *terminal,
 		return 1;
 
 	case XKB_KEY_Up:
-		if (!terminal->scrolling)
-			terminal->saved_start = terminal->start;
-		if (terminal->start == terminal->end - terminal->log_size)
+		if (terminal->view_offset == terminal->scrollback.count)
 			return 1;
 
-		terminal->scrolling = 1;
-		terminal->start--;
-		terminal->row++;
-		terminal->selection_start_row++;
-		terminal->selection_end_row++;
+		terminal->view_offset++;
 		widget_schedule_redraw(terminal->widget);
 		return 1;
 
 	case XKB_KEY_Down:
-		if (!terminal->scrolling)
-			terminal->saved_start = terminal->start;
-
-		if (terminal->start == terminal->saved_start)
+		if (terminal->view_offset == 0)
 			return 1;
 
-		terminal->scrolling = 1;
-		terminal->start++;
-		terminal->row--;
-		terminal->selection_start_row--;
-		terminal->selection_end_row--;
+		terminal->view_offset--;
 		widget_schedule_redraw(terminal->widget);
 		return 1;
 
@@ -2338,7 +3487,7 @@ key_handler(struct window *window, struct input *input, uint32_t time,
 	struct terminal *terminal = data;
 	char ch[MAX_RESPONSE];
 	uint32_t modifiers, serial;
-	int ret, len = 0, d;
+	int ret, len = 0;
 	bool convert_utf8 = true;
 
 	modifiers = input_get_modifiers(input);
@@ -2542,13 +3691,8 @@ key_handler(struct window *window, struct input *input, uint32_t time,
 	}
 
 	if (state == WL_KEYBOARD_KEY_STATE_PRESSED && len > 0) {
-		if (terminal->scrolling) {
-			d = terminal->saved_start - terminal->start;
-			terminal->row -= d;
-			terminal->selection_start_row -= d;
-			terminal->selection_end_row -= d;
-			terminal->start = terminal->saved_start;
-			terminal->scrolling = 0;
+		if (terminal->view_offset) {
+			terminal->view_offset = 0;
 			widget_schedule_redraw(terminal->widget);
 		}
 
@@ -2603,8 +3747,10 @@ recompute_selection(struct terminal *terminal)
 	side_margin = allocation.x + (allocation.width - width) / 2;
 	top_margin = allocation.y + (allocation.height - height) / 2;
 
-	start_row = (terminal->selection_start_y - top_margin + ch) / ch - 1;
-	end_row = (terminal->selection_end_y - top_margin + ch) / ch - 1;
+	start_row = (terminal->selection_start_y - top_margin + ch) / ch - 1 -
+		terminal->view_offset;
+	end_row = (terminal->selection_end_y - top_margin + ch) / ch - 1 -
+		terminal->view_offset;
 
 	if (start_row < end_row ||
 	    (start_row == end_row &&
@@ -2621,13 +3767,13 @@ recompute_selection(struct terminal *terminal)
 	}
 
 	eol = 0;
-	if (terminal->selection_start_row < 0) {
-		terminal->selection_start_row = 0;
+	if (terminal->selection_start_row < -(int) terminal->view_offset) {
+		terminal->selection_start_row = -(int) terminal->view_offset;
 		terminal->selection_start_col = 0;
 	} else {
 		x = side_margin + cw / 2;
-		data = terminal_get_row(terminal,
-					terminal->selection_start_row);
+		data = terminal_get_line(terminal,
+					 terminal->selection_start_row);
 		word_start = 0;
 		for (col = 0; col < terminal->width; col++, x += cw) {
 			if (col == 0 || wordsep(data[col - 1].ch))
@@ -2656,7 +3802,7 @@ recompute_selection(struct terminal *terminal)
 		terminal->selection_end_col = 0;
 	} else {
 		x = side_margin + cw / 2;
-		data = terminal_get_row(terminal, terminal->selection_end_row);
+		data = terminal_get_line(terminal, terminal->selection_end_row);
 		for (col = 0; col < terminal->width; col++, x += cw) {
 			if (terminal->dragging == SELECT_CHAR && end_x < x)
 				break;
@@ -2672,7 +3818,8 @@ recompute_selection(struct terminal *terminal)
 		col = terminal->selection_end_col;
 		if (col > 0 && data[col - 1].ch == 0)
 			terminal->selection_end_col = terminal->width;
-		data = terminal_get_row(terminal, terminal->selection_start_row);
+		data = terminal_get_line(terminal,
+					 terminal->selection_start_row);
 		if (data[terminal->selection_start_col].ch == 0)
 			terminal->selection_start_col = eol;
 	}
@@ -2808,29 +3955,17 @@ axis_handler(struct widget *widget,
 	terminal->smooth_scroll -= lines * AXIS_UNITS_PER_LINE;
 
 	if (lines > 0) {
-		if (terminal->scrolling) {
-			if ((uint32_t)lines > terminal->saved_start - terminal->start)
-				lines = terminal->saved_start - terminal->start;
-		} else {
-			lines = 0;
-		}
+		if ((uint32_t)lines > terminal->view_offset)
+			lines = terminal->view_offset;
 	} else if (lines < 0) {
 		uint32_t neg_lines = -lines;
 
-		if (neg_lines > terminal->log_size + terminal->start - terminal->end)
-			lines = terminal->end - terminal->log_size - terminal->start;
+		if (neg_lines > terminal->scrollback.count - terminal->view_offset)
+			lines = terminal->view_offset - terminal->scrollback.count;
 	}
 
 	if (lines) {
-		if (!terminal->scrolling)
-			terminal->saved_start = terminal->start;
-		terminal->scrolling = 1;
-
-		terminal->start += lines;
-		terminal->row -= lines;
-		terminal->selection_start_row -= lines;
-		terminal->selection_end_row -= lines;
-
+		terminal->view_offset -= lines;
 		widget_schedule_redraw(widget);
 	}
 }
@@ -2886,8 +4021,9 @@ touch_motion_handler(struct widget *widget, struct input *input,
 #define howmany(x, y) (((x) + ((y) - 1)) / (y))
 #endif
 
+/* Set up everything but the window. */
 static struct terminal *
-terminal_create(struct display *display)
+terminal_alloc(void)
 {
 	struct terminal *terminal;
 	cairo_surface_t *surface;
@@ -2899,41 +4035,16 @@ terminal_create(struct display *display)
 	terminal_init(terminal);
 	terminal->margin_top = 0;
 	terminal->margin_bottom = -1;
-	terminal->window = window_create(display);
-	terminal->widget = window_frame_create(terminal->window, terminal);
 	terminal->title = xstrdup("Wayland Terminal");
-	window_set_title(terminal->window, terminal->title);
-	widget_set_transparent(terminal->widget, 0);
 
 	init_state_machine(&terminal->state_machine);
 	init_color_table(terminal);
 
-	terminal->display = display;
 	terminal->margin = 5;
-	terminal->buffer_height = 1024;
 	terminal->end = 1;
-
-	window_set_user_data(terminal->window, terminal);
-	window_set_key_handler(terminal->window, key_handler);
-	window_set_keyboard_focus_handler(terminal->window,
-					  keyboard_focus_handler);
-	window_set_fullscreen_handler(terminal->window, fullscreen_handler);
-	window_set_output_handler(terminal->window, output_handler);
-	window_set_close_handler(terminal->window, close_handler);
-	window_set_state_changed_handler(terminal->window, state_changed_handler);
-
-	window_set_data_handler(terminal->window, data_handler);
-	window_set_drop_handler(terminal->window, drop_handler);
-
-	widget_set_redraw_handler(terminal->widget, redraw_handler);
-	widget_set_resize_handler(terminal->widget, resize_handler);
-	widget_set_button_handler(terminal->widget, button_handler);
-	widget_set_enter_handler(terminal->widget, enter_handler);
-	widget_set_motion_handler(terminal->widget, motion_handler);
-	widget_set_axis_handler(terminal->widget, axis_handler);
-	widget_set_touch_up_handler(terminal->widget, touch_up_handler);
-	widget_set_touch_down_handler(terminal->widget, touch_down_handler);
-	widget_set_touch_motion_handler(terminal->widget, touch_motion_handler);
+	scrollback_init(&terminal->scrollback,
+			option_scrollback_lines, option_scrollback_spill);
+	terminal->use_glyph_cache = 1;
 
 	surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32, 0, 0);
 	cr = cairo_create(surface);
@@ -2963,6 +4074,44 @@ terminal_create(struct display *display)
 	cairo_destroy(cr);
 	cairo_surface_destroy(surface);
 
+	return terminal;
+}
+
+static struct terminal *
+terminal_create(struct display *display)
+{
+	struct terminal *terminal;
+
+	terminal = terminal_alloc();
+	terminal->window = window_create(display);
+	terminal->widget = window_frame_create(terminal->window, terminal);
+	window_set_title(terminal->window, terminal->title);
+	widget_set_transparent(terminal->widget, 0);
+
+	terminal->display = display;
+
+	window_set_user_data(terminal->window, terminal);
+	window_set_key_handler(terminal->window, key_handler);
+	window_set_keyboard_focus_handler(terminal->window,
+					  keyboard_focus_handler);
+	window_set_fullscreen_handler(terminal->window, fullscreen_handler);
+	window_set_output_handler(terminal->window, output_handler);
+	window_set_close_handler(terminal->window, close_handler);
+	window_set_state_changed_handler(terminal->window, state_changed_handler);
+
+	window_set_data_handler(terminal->window, data_handler);
+	window_set_drop_handler(terminal->window, drop_handler);
+
+	widget_set_redraw_handler(terminal->widget, redraw_handler);
+	widget_set_resize_handler(terminal->widget, resize_handler);
+	widget_set_button_handler(terminal->widget, button_handler);
+	widget_set_enter_handler(terminal->widget, enter_handler);
+	widget_set_motion_handler(terminal->widget, motion_handler);
+	widget_set_axis_handler(terminal->widget, axis_handler);
+	widget_set_touch_up_handler(terminal->widget, touch_up_handler);
+	widget_set_touch_down_handler(terminal->widget, touch_down_handler);
+	widget_set_touch_motion_handler(terminal->widget, touch_motion_handler);
+
 	terminal_resize(terminal, 20, 5); /* Set minimum size first */
 	terminal_resize(terminal, 80, 25);
 
@@ -2971,6 +4120,27 @@ terminal_create(struct display *display)
 	return terminal;
 }
 
+static void
+terminal_free(struct terminal *terminal)
+{
+	if (terminal->glyph_cache)
+		glyph_cache_destroy(terminal->glyph_cache);
+	if (terminal->cache[0]) {
+		cairo_surface_destroy(terminal->cache[0]);
+		cairo_surface_destroy(terminal->cache[1]);
+	}
+	cairo_scaled_font_destroy(terminal->font_normal);
+	cairo_scaled_font_destroy(terminal->font_bold);
+	free(terminal->data);
+	free(terminal->data_attr);
+	free(terminal->tab_ruler);
+	free(terminal->row_dirty);
+	free(terminal->view_dirty);
+	scrollback_release(&terminal->scrollback);
+	free(terminal->title);
+	free(terminal);
+}
+
 static void
 terminal_destroy(struct terminal *terminal)
 {
@@ -2982,8 +4152,7 @@ terminal_destroy(struct terminal *terminal)
 	if (wl_list_empty(&terminal_list))
 		display_exit(terminal->display);
 
-	free(terminal->title);
-	free(terminal);
+	terminal_free(terminal);
 }
 
 static void
@@ -2991,7 +4160,7 @@ io_handler(struct task *task, uint32_t events)
 {
 	struct terminal *terminal =
 		container_of(task, struct terminal, io_task);
-	char buffer[256];
+	char buffer[64 * 1024];
 	int len;
 
 	if (events & EPOLLHUP) {
@@ -3039,11 +4208,156 @@ terminal_run(struct terminal *terminal, const char *path)
 	return 0;
 }
 
+/*
+ * Headless benchmark: feed a file through the terminal as if it was
+ * printed with cat.  The first pass only times the parser, the other
+ * two time the full-screen redraws in between, once through
+ * cairo_show_glyphs() and once through the glyph cache.
+ */
+#define BENCHMARK_CHUNK_SIZE	(32 * 1024)
+
+static double
+benchmark_time(void)
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + 1e-9 * t.tv_nsec;
+}
+
+static void
+terminal_benchmark_parse(const char *data, size_t size)
+{
+	struct terminal *terminal;
+	double start, elapsed;
+	size_t offset, len;
+	int i, rounds = 0;
+
+	terminal = terminal_alloc();
+	terminal->master = open("/dev/null", O_WRONLY | O_CLOEXEC);
+	terminal_resize_cells(terminal, 80, 24);
+
+	/* repeat small inputs until the timing means something */
+	start = benchmark_time();
+	do {
+		for (i = 0; i < 16; i++) {
+			for (offset = 0; offset < size; offset += len) {
+				len = size - offset;
+				if (len > BENCHMARK_CHUNK_SIZE)
+					len = BENCHMARK_CHUNK_SIZE;
+				terminal_data(terminal, data + offset, len);
+			}
+		}
+		rounds += 16;
+		elapsed = benchmark_time() - start;
+	} while (elapsed < 0.5 && size > 0);
+
+	printf("%-18s %8.1f MB/s\n", "parser:",
+	       elapsed > 0 ? rounds * size / elapsed / 1e6 : 0.0);
+	printf("%-18s %u lines in %zu bytes, %zu unpacked\n", "scrollback:",
+	       terminal->scrollback.count, terminal->scrollback.bytes,
+	       (size_t) terminal->scrollback.count * terminal->width *
+	       (sizeof(union utf8_char) + sizeof(struct attr)));
+
+	close(terminal->master);
+	terminal_free(terminal);
+}
+
+static void
+terminal_benchmark_pass(const char *data, size_t size, int use_glyph_cache)
+{
+	struct terminal *terminal;
+	struct rectangle damage;
+	cairo_surface_t *target;
+	double start, render_time = 0;
+	int width, height, frames = 0;
+	size_t offset, len;
+
+	terminal = terminal_alloc();
+	terminal->use_glyph_cache = use_glyph_cache;
+	terminal->master = open("/dev/null", O_WRONLY | O_CLOEXEC);
+	terminal_resize_cells(terminal, 80, 24);
+
+	width = terminal->width * terminal->average_width +
+		2 * terminal->margin;
+	height = terminal->height * terminal->extents.height +
+		2 * terminal->margin;
+	target = cairo_image_surface_create(CAIRO_FORMAT_ARGB32,
+					    width, height);
+
+	for (offset = 0; offset < size; offset += len) {
+		len = size - offset;
+		if (len > BENCHMARK_CHUNK_SIZE)
+			len = BENCHMARK_CHUNK_SIZE;
+		terminal_data(terminal, data + offset, len);
+
+		terminal->redraw_all = 1;
+		start = benchmark_time();
+		terminal_render(terminal, target, width, height, &damage);
+		cairo_surface_flush(terminal->cache[terminal->cache_current]);
+		render_time += benchmark_time() - start;
+		frames++;
+	}
+
+	printf("%-18s %6d frames, %8.3f ms per full-screen redraw\n",
+	       use_glyph_cache ? "glyph cache:" : "cairo_show_glyphs:",
+	       frames, frames ? 1000.0 * render_time / frames : 0.0);
+	if (terminal->glyph_cache)
+		printf("%-18s %u hits, %u misses, %d slots\n", "",
+		       terminal->glyph_cache->hits,
+		       terminal->glyph_cache->misses,
+		       terminal->glyph_cache->capacity);
+
+	cairo_surface_destroy(target);
+	close(terminal->master);
+	terminal_free(terminal);
+}
+
+static int
+terminal_benchmark(const char *path)
+{
+	char *data;
+	size_t size;
+	ssize_t len;
+	int fd;
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0) {
+		fprintf(stderr, "failed to open %s: %m\n", path);
+		return -1;
+	}
+
+	data = NULL;
+	size = 0;
+	do {
+		data = xrealloc(data, size + BENCHMARK_CHUNK_SIZE);
+		len = read(fd, data + size, BENCHMARK_CHUNK_SIZE);
+		if (len > 0)
+			size += len;
+	} while (len > 0);
+	close(fd);
+
+	if (len < 0) {
+		fprintf(stderr, "failed to read %s: %m\n", path);
+		free(data);
+		return -1;
+	}
+
+	printf("%s: %zu bytes\n", path, size);
+	terminal_benchmark_parse(data, size);
+	terminal_benchmark_pass(data, size, 0);
+	terminal_benchmark_pass(data, size, 1);
+	free(data);
+
+	return 0;
+}
+
 static const struct weston_option terminal_options[] = {
 	{ WESTON_OPTION_BOOLEAN, "fullscreen", 'f', &option_fullscreen },
 	{ WESTON_OPTION_STRING, "font", 0, &option_font },
 	{ WESTON_OPTION_INTEGER, "font-size", 0, &option_font_size },
 	{ WESTON_OPTION_STRING, "shell", 0, &option_shell },
+	{ WESTON_OPTION_STRING, "benchmark", 0, &option_benchmark },
 };
 
 int main(int argc, char *argv[])
@@ -3066,6 +4380,10 @@ int main(int argc, char *argv[])
 	weston_config_section_get_string(s, "font", &option_font, "mono");
 	weston_config_section_get_int(s, "font-size", &option_font_size, 14);
 	weston_config_section_get_string(s, "term", &option_term, "xterm");
+	weston_config_section_get_int(s, "scrollback-lines",
+				      &option_scrollback_lines, 1000);
+	weston_config_section_get_bool(s, "scrollback-spill",
+				       &option_scrollback_spill, 0);
 	weston_config_destroy(config);
 
 	if (parse_options(terminal_options,
@@ -3074,10 +4392,17 @@ int main(int argc, char *argv[])
 		       "  --fullscreen or -f\n"
 		       "  --font=NAME\n"
 		       "  --font-size=SIZE\n"
-		       "  --shell=NAME\n", argv[0]);
+		       "  --shell=NAME\n"
+		       "  --benchmark=FILE\n", argv[0]);
 		return 1;
 	}
 
+	if (option_scrollback_lines < 0)
+		option_scrollback_lines = 0;
+
+	if (option_benchmark)
+		return terminal_benchmark(option_benchmark) ? EXIT_FAILURE : 0;
+
 	d = display_create(&argc, argv);
 	if (d == NULL) {
 		fprintf(stderr, "failed to create display: %m\n");
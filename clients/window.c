@@ -28,6 +28,7 @@
 #include <stdlib.h>
 #include <stdarg.h>
 #include <string.h>
+#include <limits.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <errno.h>
@@ -164,11 +165,22 @@ struct toysurface {
 	 * Post the surface to the server, returning the server allocation
 	 * rectangle. The Cairo surface from prepare() must be destroyed
 	 * after calling this.
+	 * damage is the area that changed since the previous swap, in
+	 * surface coordinates, or NULL if the whole surface changed.
 	 */
 	void (*swap)(struct toysurface *base,
 		     enum wl_output_transform buffer_transform, int32_t buffer_scale,
+		     struct rectangle *damage,
 		     struct rectangle *server_allocation);
 
+	/*
+	 * Brings the Cairo surface from prepare() up to date with what
+	 * was posted by the previous swap, if that can be done.
+	 * Returns 1 if it now holds that, or 0 if its contents are
+	 * undefined.  Never returns more than 1.
+	 */
+	int (*get_buffer_age)(struct toysurface *base);
+
 	/*
 	 * Make the toysurface current with the given EGL context.
 	 * Returns 0 on success, and negative of failure.
@@ -204,6 +216,10 @@ struct surface {
 	struct rectangle allocation;
 	struct rectangle server_allocation;
 
+	/* Damage posted with the next swap, unless damage_all is set. */
+	struct rectangle damage;
+	int damage_all;
+
 	struct wl_region *input_region;
 	struct wl_region *opaque_region;
 
@@ -540,6 +556,7 @@ egl_window_surface_prepare(struct toysurface *base, int dx, int dy,
 static void
 egl_window_surface_swap(struct toysurface *base,
 			enum wl_output_transform buffer_transform, int32_t buffer_scale,
+			struct rectangle *damage,
 			struct rectangle *server_allocation)
 {
 	struct egl_window_surface *surface = to_egl_window_surface(base);
@@ -554,6 +571,12 @@ egl_window_surface_swap(struct toysurface *base,
 				&server_allocation->height);
 }
 
+static int
+egl_window_surface_get_buffer_age(struct toysurface *base)
+{
+	return 0;
+}
+
 static int
 egl_window_surface_acquire(struct toysurface *base, EGLContext ctx)
 {
@@ -628,6 +651,7 @@ egl_window_surface_create(struct display *display,
 
 	surface->base.prepare = egl_window_surface_prepare;
 	surface->base.swap = egl_window_surface_swap;
+	surface->base.get_buffer_age = egl_window_surface_get_buffer_age;
 	surface->base.acquire = egl_window_surface_acquire;
 	surface->base.release = egl_window_surface_release;
 	surface->base.destroy = egl_window_surface_destroy;
@@ -841,27 +865,12 @@ display_create_shm_surface_from_pool(struct display *display,
 
 static cairo_surface_t *
 display_create_shm_surface(struct display *display,
-			   struct rectangle *rectangle, uint32_t flags,
-			   struct shm_pool *alternate_pool,
-			   struct shm_surface_data **data_ret)
+			   struct rectangle *rectangle, uint32_t flags)
 {
 	struct shm_surface_data *data;
 	struct shm_pool *pool;
 	cairo_surface_t *surface;
 
-	if (alternate_pool) {
-		shm_pool_reset(alternate_pool);
-		surface = display_create_shm_surface_from_pool(display,
-							       rectangle,
-							       flags,
-							       alternate_pool);
-		if (surface) {
-			data = cairo_surface_get_user_data(surface,
-							   &shm_surface_data_key);
-			goto out;
-		}
-	}
-
 	pool = shm_pool_create(display,
 			       data_length_for_shm_surface(rectangle));
 	if (!pool)
@@ -880,10 +889,6 @@ display_create_shm_surface(struct display *display,
 	data = cairo_surface_get_user_data(surface, &shm_surface_data_key);
 	data->pool = pool;
 
-out:
-	if (data_ret)
-		*data_ret = data;
-
 	return surface;
 }
 
@@ -908,8 +913,7 @@ display_create_surface(struct display *display,
 		return NULL;
 
 	assert(flags & SURFACE_SHM);
-	return display_create_shm_surface(display, rectangle, flags,
-					  NULL, NULL);
+	return display_create_shm_surface(display, rectangle, flags);
 }
 
 struct shm_surface_leaf {
@@ -917,8 +921,13 @@ struct shm_surface_leaf {
 	/* 'data' is automatically destroyed, when 'cairo_surface' is */
 	struct shm_surface_data *data;
 
-	struct shm_pool *resize_pool;
+	/* Backing storage, kept across buffer size changes until a
+	 * buffer no longer fits into it. */
+	struct shm_pool *pool;
 	int busy;
+
+	/* Swaps since the contents were posted, 0 if undefined. */
+	int age;
 };
 
 static void
@@ -928,8 +937,8 @@ shm_surface_leaf_release(struct shm_surface_leaf *leaf)
 		cairo_surface_destroy(leaf->cairo_surface);
 	/* leaf->data already destroyed via cairo private */
 
-	if (leaf->resize_pool)
-		shm_pool_destroy(leaf->resize_pool);
+	if (leaf->pool)
+		shm_pool_destroy(leaf->pool);
 
 	memset(leaf, 0, sizeof *leaf);
 }
@@ -945,6 +954,10 @@ struct shm_surface {
 
 	struct shm_surface_leaf leaf[MAX_LEAVES];
 	struct shm_surface_leaf *current;
+	struct shm_surface_leaf *last;
+
+	/* Buffer damage of the last MAX_LEAVES swaps, newest first */
+	struct rectangle damage[MAX_LEAVES];
 };
 
 static struct shm_surface *
@@ -983,7 +996,6 @@ shm_surface_buffer_release(void *data, struct wl_buffer *buffer)
 	struct shm_surface *surface = data;
 	struct shm_surface_leaf *leaf;
 	int i;
-	int free_found;
 
 	shm_surface_buffer_state_debug(surface, "buffer_release before");
 
@@ -996,17 +1008,17 @@ shm_surface_buffer_release(void *data, struct wl_buffer *buffer)
 	}
 	assert(i < MAX_LEAVES && "unknown buffer released");
 
-	/* Leave one free leaf with storage, release others */
-	free_found = 0;
+	/* Keep the storage of every leaf still taking turns, so that the
+	 * pools are not recreated when the server holds on to two buffers
+	 * every now and then.  Leaves left out of the last MAX_LEAVES
+	 * swaps are released. */
 	for (i = 0; i < MAX_LEAVES; i++) {
 		leaf = &surface->leaf[i];
 
-		if (!leaf->cairo_surface || leaf->busy)
+		if (!leaf->pool || leaf->busy || leaf == surface->current)
 			continue;
 
-		if (!free_found)
-			free_found = 1;
-		else
+		if (leaf->age > MAX_LEAVES)
 			shm_surface_leaf_release(leaf);
 	}
 
@@ -1017,6 +1029,83 @@ static const struct wl_buffer_listener shm_surface_buffer_listener = {
 	shm_surface_buffer_release
 };
 
+static int
+shm_surface_leaf_rank(struct shm_surface_leaf *leaf)
+{
+	if (!leaf->cairo_surface)
+		return INT_MAX;
+
+	if (leaf->age == 0)
+		return INT_MAX - 1;
+
+	return leaf->age;
+}
+
+/*
+ * Brings a reused leaf up to date with the last posted buffer, by
+ * copying over what the swaps it missed have damaged.  A new leaf gets
+ * the whole buffer copied, if the size matches.  Nothing is copied
+ * inside keep, if given, where the leaf already has the new frame.
+ * Afterwards the leaf has age 1.
+ */
+static void
+shm_surface_copy_forward(struct shm_surface *surface,
+			 struct shm_surface_leaf *leaf,
+			 struct rectangle *keep)
+{
+	struct shm_surface_leaf *last = surface->last;
+	struct rectangle *damage;
+	cairo_t *cr;
+	int i;
+
+	if (leaf->age == 1)
+		return;
+
+	if (!last || last == leaf || !last->cairo_surface ||
+	    cairo_image_surface_get_format(last->cairo_surface) !=
+	    cairo_image_surface_get_format(leaf->cairo_surface) ||
+	    cairo_image_surface_get_width(last->cairo_surface) !=
+	    cairo_image_surface_get_width(leaf->cairo_surface) ||
+	    cairo_image_surface_get_height(last->cairo_surface) !=
+	    cairo_image_surface_get_height(leaf->cairo_surface)) {
+		leaf->age = 0;
+		return;
+	}
+
+	cr = cairo_create(leaf->cairo_surface);
+	cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
+	cairo_set_source_surface(cr, last->cairo_surface, 0, 0);
+
+	if (keep) {
+		cairo_rectangle(cr, 0, 0,
+				cairo_image_surface_get_width(leaf->cairo_surface),
+				cairo_image_surface_get_height(leaf->cairo_surface));
+		cairo_rectangle(cr, keep->x, keep->y,
+				keep->width, keep->height);
+		cairo_set_fill_rule(cr, CAIRO_FILL_RULE_EVEN_ODD);
+		cairo_clip(cr);
+		cairo_set_fill_rule(cr, CAIRO_FILL_RULE_WINDING);
+	}
+
+	if (leaf->age == 0 || leaf->age > MAX_LEAVES) {
+		cairo_paint(cr);
+	} else {
+		for (i = 0; i < leaf->age - 1; i++) {
+			damage = &surface->damage[i];
+			cairo_rectangle(cr, damage->x, damage->y,
+					damage->width, damage->height);
+		}
+		cairo_fill(cr);
+	}
+
+	cairo_destroy(cr);
+
+	DBG_OBJ(surface->surface, "leaf %d copied forward from age %d\n",
+		(int)(leaf - &surface->leaf[0]), leaf->age);
+
+	leaf->age = 1;
+}
+
 static cairo_surface_t *
 shm_surface_prepare(struct toysurface *base, int dx, int dy,
 		    int32_t width, int32_t height, uint32_t flags,
@@ -1026,17 +1115,20 @@ shm_surface_prepare(struct toysurface *base, int dx, int dy,
 	struct shm_surface *surface = to_shm_surface(base);
 	struct rectangle rect = { 0};
 	struct shm_surface_leaf *leaf = NULL;
+	size_t length, pool_size;
 	int i;
 
 	surface->dx = dx;
 	surface->dy = dy;
 
-	/* pick a free buffer, preferrably one that already has storage */
+	/* pick a free buffer, preferrably the one with the newest
+	 * contents, else one that already has storage */
 	for (i = 0; i < MAX_LEAVES; i++) {
 		if (surface->leaf[i].busy)
 			continue;
 
-		if (!leaf || surface->leaf[i].cairo_surface)
+		if (!leaf || shm_surface_leaf_rank(&surface->leaf[i]) <
+			     shm_surface_leaf_rank(leaf))
 			leaf = &surface->leaf[i];
 	}
 	DBG_OBJ(surface->surface, "pick leaf %d\n",
@@ -1049,13 +1141,6 @@ shm_surface_prepare(struct toysurface *base, int dx, int dy,
 		return NULL;
 	}
 
-	if (!resize_hint && leaf->resize_pool) {
-		cairo_surface_destroy(leaf->cairo_surface);
-		leaf->cairo_surface = NULL;
-		shm_pool_destroy(leaf->resize_pool);
-		leaf->resize_pool = NULL;
-	}
-
 	surface_to_buffer_size (buffer_transform, buffer_scale, &width, &height);
 
 	if (leaf->cairo_surface &&
@@ -1063,33 +1148,53 @@ shm_surface_prepare(struct toysurface *base, int dx, int dy,
 	    cairo_image_surface_get_height(leaf->cairo_surface) == height)
 		goto out;
 
-	if (leaf->cairo_surface)
+	if (leaf->cairo_surface) {
 		cairo_surface_destroy(leaf->cairo_surface);
+		leaf->cairo_surface = NULL;
+		leaf->data = NULL;
+	}
+	leaf->age = 0;
+
+	rect.width = width;
+	rect.height = height;
+	length = data_length_for_shm_surface(&rect);
+
+	/* Map a new pool only when the buffer outgrows the old one, or
+	 * to give memory back once resizing ends well below it. */
+	if (leaf->pool &&
+	    (length > leaf->pool->size ||
+	     (!resize_hint && length < leaf->pool->size / 4))) {
+		shm_pool_destroy(leaf->pool);
+		leaf->pool = NULL;
+	}
 
+	if (!leaf->pool) {
+		pool_size = length;
 #ifdef USE_RESIZE_POOL
-	if (resize_hint && !leaf->resize_pool) {
 		/* Create a big pool to allocate from, while continuously
 		 * resizing. Mmapping a new pool in the server
 		 * is relatively expensive, so reusing a pool performs
 		 * better, but may temporarily reserve unneeded memory.
 		 */
 		/* We should probably base this number on the output size. */
-		leaf->resize_pool = shm_pool_create(surface->display,
-						    6 * 1024 * 1024);
-	}
+		if (resize_hint && pool_size < 6 * 1024 * 1024)
+			pool_size = 6 * 1024 * 1024;
 #endif
+		leaf->pool = shm_pool_create(surface->display, pool_size);
+		if (!leaf->pool)
+			return NULL;
+	}
 
-	rect.width = width;
-	rect.height = height;
-
+	shm_pool_reset(leaf->pool);
 	leaf->cairo_surface =
-		display_create_shm_surface(surface->display, &rect,
-					   surface->flags,
-					   leaf->resize_pool,
-					   &leaf->data);
+		display_create_shm_surface_from_pool(surface->display, &rect,
+						     surface->flags,
+						     leaf->pool);
 	if (!leaf->cairo_surface)
 		return NULL;
 
+	leaf->data = cairo_surface_get_user_data(leaf->cairo_surface,
+						 &shm_surface_data_key);
 	wl_buffer_add_listener(leaf->data->buffer,
 			       &shm_surface_buffer_listener, surface);
 
@@ -1102,33 +1207,89 @@ out:
 static void
 shm_surface_swap(struct toysurface *base,
 		 enum wl_output_transform buffer_transform, int32_t buffer_scale,
+		 struct rectangle *damage,
 		 struct rectangle *server_allocation)
 {
 	struct shm_surface *surface = to_shm_surface(base);
 	struct shm_surface_leaf *leaf = surface->current;
+	struct rectangle buffer_damage;
+	int32_t width, height;
+	int i;
 
-	server_allocation->width =
-		cairo_image_surface_get_width(leaf->cairo_surface);
-	server_allocation->height =
-		cairo_image_surface_get_height(leaf->cairo_surface);
+	width = cairo_image_surface_get_width(leaf->cairo_surface);
+	height = cairo_image_surface_get_height(leaf->cairo_surface);
+
+	server_allocation->width = width;
+	server_allocation->height = height;
 
 	buffer_to_surface_size (buffer_transform, buffer_scale,
 				&server_allocation->width,
 				&server_allocation->height);
 
+	/* The damage in buffer coordinates, for bringing the other
+	 * leaves up to date when they are reused. */
+	if (!damage || buffer_transform != WL_OUTPUT_TRANSFORM_NORMAL) {
+		buffer_damage.x = 0;
+		buffer_damage.y = 0;
+		buffer_damage.width = width;
+		buffer_damage.height = height;
+	} else {
+		buffer_damage.x = damage->x * buffer_scale;
+		buffer_damage.y = damage->y * buffer_scale;
+		buffer_damage.width = damage->width * buffer_scale;
+		buffer_damage.height = damage->height * buffer_scale;
+	}
+
+	/* Nobody asked for the buffer age of a partial redraw, so what
+	 * lies outside the damage has not been painted yet. */
+	if (damage && leaf->age != 1)
+		shm_surface_copy_forward(surface, leaf, &buffer_damage);
+
 	wl_surface_attach(surface->surface, leaf->data->buffer,
 			  surface->dx, surface->dy);
-	wl_surface_damage(surface->surface, 0, 0,
-			  server_allocation->width, server_allocation->height);
+	if (!damage)
+		wl_surface_damage(surface->surface, 0, 0,
+				  server_allocation->width,
+				  server_allocation->height);
+	else if (damage->width > 0 && damage->height > 0)
+		wl_surface_damage(surface->surface, damage->x, damage->y,
+				  damage->width, damage->height);
 	wl_surface_commit(surface->surface);
 
+	memmove(&surface->damage[1], &surface->damage[0],
+		(MAX_LEAVES - 1) * sizeof surface->damage[0]);
+	surface->damage[0] = buffer_damage;
+
+	for (i = 0; i < MAX_LEAVES; i++) {
+		if (surface->leaf[i].age > 0 &&
+		    surface->leaf[i].age <= MAX_LEAVES)
+			surface->leaf[i].age++;
+	}
+
 	DBG_OBJ(surface->surface, "leaf %d busy\n",
 		(int)(leaf - &surface->leaf[0]));
 
 	leaf->busy = 1;
+	leaf->age = 1;
+	surface->last = leaf;
 	surface->current = NULL;
 }
 
+/* The leaf is copied forward only here, so that full redraws, which
+ * never ask, skip the copy. */
+static int
+shm_surface_get_buffer_age(struct toysurface *base)
+{
+	struct shm_surface *surface = to_shm_surface(base);
+
+	if (!surface->current)
+		return 0;
+
+	shm_surface_copy_forward(surface, surface->current, NULL);
+
+	return surface->current->age;
+}
+
 static int
 shm_surface_acquire(struct toysurface *base, EGLContext ctx)
 {
@@ -1167,6 +1328,7 @@ shm_surface_create(struct display *display, struct wl_surface *wl_surface,
 
 	surface->base.prepare = shm_surface_prepare;
 	surface->base.swap = shm_surface_swap;
+	surface->base.get_buffer_age = shm_surface_get_buffer_age;
 	surface->base.acquire = shm_surface_acquire;
 	surface->base.release = shm_surface_release;
 	surface->base.destroy = shm_surface_destroy;
@@ -1341,6 +1503,8 @@ display_get_pointer_image(struct display *display, int pointer)
 static void
 surface_flush(struct surface *surface)
 {
+	struct rectangle *damage = NULL;
+
 	if (!surface->cairo_surface)
 		return;
 
@@ -1358,9 +1522,18 @@ surface_flush(struct surface *surface)
 		surface->input_region = NULL;
 	}
 
+	/* A new buffer size always needs the whole surface posted. */
+	if (!surface->damage_all &&
+	    surface->allocation.width == surface->server_allocation.width &&
+	    surface->allocation.height == surface->server_allocation.height)
+		damage = &surface->damage;
+
 	surface->toysurface->swap(surface->toysurface,
 				  surface->buffer_transform, surface->buffer_scale,
-				  &surface->server_allocation);
+				  damage, &surface->server_allocation);
+
+	memset(&surface->damage, 0, sizeof surface->damage);
+	surface->damage_all = 0;
 
 	cairo_surface_destroy(surface->cairo_surface);
 	surface->cairo_surface = NULL;
@@ -1935,12 +2108,85 @@ window_schedule_redraw_task(struct window *window);
 
 void
 widget_schedule_redraw(struct widget *widget)
+{
+	DBG_OBJ(widget->surface->surface, "widget %p\n", widget);
+	widget->surface->redraw_needed = 1;
+	widget->surface->damage_all = 1;
+	window_schedule_redraw_task(widget->window);
+}
+
+/*
+ * Like widget_schedule_redraw(), but the surface is only damaged where
+ * widget_damage() is called from the redraw handlers.  The widgets
+ * must redraw everything they cover, unless widget_get_buffer_age()
+ * says the buffer already holds the last frame.
+ */
+void
+widget_schedule_partial_redraw(struct widget *widget)
 {
 	DBG_OBJ(widget->surface->surface, "widget %p\n", widget);
 	widget->surface->redraw_needed = 1;
 	window_schedule_redraw_task(widget->window);
 }
 
+void
+widget_damage(struct widget *widget,
+	      int32_t x, int32_t y, int32_t width, int32_t height)
+{
+	struct surface *surface = widget->surface;
+	struct rectangle *damage = &surface->damage;
+	int32_t x2, y2;
+
+	if (width <= 0 || height <= 0)
+		return;
+
+	x -= surface->allocation.x;
+	y -= surface->allocation.y;
+
+	if (damage->width <= 0 || damage->height <= 0) {
+		damage->x = x;
+		damage->y = y;
+		damage->width = width;
+		damage->height = height;
+		return;
+	}
+
+	x2 = damage->x + damage->width;
+	if (x2 < x + width)
+		x2 = x + width;
+	y2 = damage->y + damage->height;
+	if (y2 < y + height)
+		y2 = y + height;
+	if (damage->x > x)
+		damage->x = x;
+	if (damage->y > y)
+		damage->y = y;
+	damage->width = x2 - damage->x;
+	damage->height = y2 - damage->y;
+}
+
+/*
+ * Returns 1 when the buffer being drawn holds the frame posted last and
+ * nothing asked for a full redraw, so only what widget_damage() covers
+ * needs painting.  Returns 0 when everything has to be painted.
+ *
+ * Only 0 and 1 are ever returned: an older buffer is brought up to date
+ * by the first call in a redraw, instead of reporting its real age.
+ */
+int
+widget_get_buffer_age(struct widget *widget)
+{
+	struct surface *surface = widget->surface;
+
+	if (surface->damage_all || !widget->use_cairo)
+		return 0;
+
+	if (!widget_get_cairo_surface(widget))
+		return 0;
+
+	return surface->toysurface->get_buffer_age(surface->toysurface);
+}
+
 void
 widget_set_use_cairo(struct widget *widget,
 		     int use_cairo)
@@ -2223,6 +2469,14 @@ frame_redraw_handler(struct widget *widget, void *data)
 	if (window->fullscreen)
 		return;
 
+	/* The decorations from the last frame are still in the buffer. */
+	if (widget_get_buffer_age(widget) == 1 &&
+	    !(frame_status(frame->frame) & FRAME_STATUS_REPAINT))
+		return;
+
+	/* Repainting the frame clears the whole buffer. */
+	widget->surface->damage_all = 1;
+
 	cr = widget_cairo_create(widget);
 
 	frame_repaint(frame->frame, cr);
@@ -4163,6 +4417,9 @@ surface_redraw(struct surface *surface)
 	if (!surface->window->redraw_needed && !surface->redraw_needed)
 		return 0;
 
+	if (surface->window->redraw_needed)
+		surface->damage_all = 1;
+
 	/* Whole-window redraw forces a redraw even if the previous has
 	 * not yet hit the screen.
 	 */
@@ -4260,8 +4517,10 @@ window_schedule_redraw(struct window *window)
 
 	DBG_OBJ(window->main_surface->surface, "window %p\n", window);
 
-	wl_list_for_each(surface, &window->subsurface_list, link)
+	wl_list_for_each(surface, &window->subsurface_list, link) {
 		surface->redraw_needed = 1;
+		surface->damage_all = 1;
+	}
 
 	window_schedule_redraw_task(window);
 }
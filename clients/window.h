@@ -526,6 +526,13 @@ widget_set_axis_handler(struct widget *widget,
 void
 widget_schedule_redraw(struct widget *widget);
 void
+widget_schedule_partial_redraw(struct widget *widget);
+void
+widget_damage(struct widget *widget,
+	      int32_t x, int32_t y, int32_t width, int32_t height);
+int
+widget_get_buffer_age(struct widget *widget);
+void
 widget_set_use_cairo(struct widget *widget, int use_cairo);
 
 struct widget *
@@ -3545,6 +3545,7 @@ handle_resource_destroy(struct wl_listener *listener, void *data)
 
 	pixman_region32_fini(&shsurf->surface->pending.input);
 	pixman_region32_init(&shsurf->surface->pending.input);
+	shsurf->surface->pending.changed |= WESTON_SURFACE_STATE_INPUT;
 	pixman_region32_fini(&shsurf->surface->input);
 	pixman_region32_init(&shsurf->surface->input);
 	if (shsurf->shell->win_close_animation_type == ANIMATION_FADE) {
@@ -4485,6 +4486,11 @@ desktop_shell_desktop_ready(struct wl_client *client,
 {
 	struct desktop_shell *shell = wl_resource_get_user_data(resource);
 
+	if (shell->fade.startup_timer)
+		weston_log("desktop-shell client ready after %u ms\n",
+			   weston_compositor_get_time() -
+			   shell->child.launch_time);
+
 	shell_fade_startup(shell);
 }
 
@@ -5269,6 +5275,10 @@ fade_startup_timeout(void *data)
 {
 	struct desktop_shell *shell = data;
 
+	weston_log("desktop-shell client not ready after %u ms, "
+		   "fading in anyway\n",
+		   weston_compositor_get_time() - shell->child.launch_time);
+
 	shell_fade_startup(shell);
 	return 0;
 }
@@ -5681,6 +5691,7 @@ launch_desktop_shell_process(void *data)
 {
 	struct desktop_shell *shell = data;
 
+	shell->child.launch_time = weston_compositor_get_time();
 	shell->child.client = weston_client_start(shell->compositor,
 						  shell->client);
 
@@ -6732,7 +6743,6 @@ module_init(struct weston_compositor *ec,
 	setup_output_destroy_handler(ec, shell);
 
 	loop = wl_display_get_event_loop(ec->wl_display);
-	wl_event_loop_add_idle(loop, launch_desktop_shell_process, shell);
 
 	shell->screensaver.timer =
 		wl_event_loop_add_timer(loop, screensaver_timeout, shell);
@@ -6750,5 +6760,10 @@ module_init(struct weston_compositor *ec,
 
 	clock_gettime(CLOCK_MONOTONIC, &shell->startup_time);
 
+	/* Start the client now rather than from an idle callback, so that
+	 * it starts up while the remaining modules load.  It is not served
+	 * before the event loop runs, and by then every global is there. */
+	launch_desktop_shell_process(shell);
+
 	return 0;
 }
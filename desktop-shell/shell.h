@@ -141,6 +141,7 @@ struct desktop_shell {
 
 		unsigned deathcount;
 		uint32_t deathstamp;
+		uint32_t launch_time;
 	} child;
 
 	bool locked;
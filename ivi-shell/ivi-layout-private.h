@@ -26,6 +26,8 @@
 #include "compositor.h"
 #include "ivi-layout-export.h"
 
+struct hash_table;
+
 struct ivi_layout_surface {
 	struct wl_list link;
 	struct wl_signal property_changed;
@@ -45,6 +47,7 @@ struct ivi_layout_surface {
 
 	struct ivi_layout_surface_properties prop;
 	uint32_t event_mask;
+	struct wl_list dirty_link;
 
 	struct {
 		struct ivi_layout_surface_properties prop;
@@ -75,6 +78,7 @@ struct ivi_layout_layer {
 
 	struct ivi_layout_layer_properties prop;
 	uint32_t event_mask;
+	struct wl_list dirty_link;
 
 	struct {
 		struct ivi_layout_layer_properties prop;
@@ -95,6 +99,15 @@ struct ivi_layout {
 	struct wl_list layer_list;
 	struct wl_list screen_list;
 
+	/* surfaces and layers changed since the last commit */
+	struct wl_list dirty_surface_list;
+	struct wl_list dirty_layer_list;
+
+	/* id lookups, keyed by id_surface, id_layer and id_screen */
+	struct hash_table *surface_index;
+	struct hash_table *layer_index;
+	struct hash_table *screen_index;
+
 	struct {
 		struct wl_signal created;
 		struct wl_signal removed;
@@ -110,7 +123,6 @@ struct ivi_layout {
 	struct wl_signal warning_signal;
 
 	struct ivi_layout_transition_set *transitions;
-	struct wl_list pending_transition_list;
 };
 
 struct ivi_layout *get_instance(void);
@@ -119,7 +131,15 @@ struct ivi_layout_transition;
 
 struct ivi_layout_transition_set {
 	struct wl_event_source  *event_source;
-	struct wl_list          transition_list;
+
+	/* struct ivi_layout_transition *, running and pending alike;
+	 * NULL for those removed while the frame walks the array */
+	struct wl_array         transitions;
+	uint32_t                pending_count;
+	int                     walking;
+
+	/* registered transitions of each type, keyed by surface or layer id */
+	struct hash_table       *index[IVI_LAYOUT_TRANSITION_MAX];
 };
 
 typedef void (*ivi_layout_transition_destroy_user_func)(void *user_data);
@@ -127,6 +147,9 @@ typedef void (*ivi_layout_transition_destroy_user_func)(void *user_data);
 struct ivi_layout_transition_set *
 ivi_layout_transition_set_create(struct weston_compositor *ec);
 
+void
+ivi_layout_transition_set_commit(struct ivi_layout_transition_set *transitions);
+
 void
 ivi_layout_transition_move_resize_view(struct ivi_layout_surface *surface,
 				       int32_t dest_x, int32_t dest_y,
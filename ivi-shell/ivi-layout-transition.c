@@ -27,6 +27,7 @@
 
 #include "ivi-layout-export.h"
 #include "ivi-layout-private.h"
+#include "../shared/hash.h"
 
 struct ivi_layout_transition;
 
@@ -38,6 +39,9 @@ typedef int32_t (*ivi_layout_is_transition_func)(void *private_data, void *id);
 
 struct ivi_layout_transition {
 	enum ivi_layout_transition_type type;
+	uint32_t id;
+	int32_t slot;		/* position in the set, -1 if not registered */
+	uint32_t is_pending;	/* registered, waiting for the next commit */
 	void *private_data;
 	void *user_data;
 
@@ -50,28 +54,25 @@ struct ivi_layout_transition {
 	ivi_layout_transition_destroy_func destroy_func;
 };
 
-struct transition_node {
-	struct ivi_layout_transition *transition;
-	struct wl_list link;
-};
-
 static void layout_transition_destroy(struct ivi_layout_transition *transition);
 
+/**
+ * Looks up the transition of the given type running on a surface or a
+ * layer. id is the id of the object, id_data the object itself: ids
+ * can be reused once an object is gone, so the match is confirmed
+ * against the transition's own data.
+ */
 static struct ivi_layout_transition *
 get_transition_from_type_and_id(enum ivi_layout_transition_type type,
-				void *id_data)
+				uint32_t id, void *id_data)
 {
 	struct ivi_layout *layout = get_instance();
-	struct transition_node *node;
 	struct ivi_layout_transition *tran;
 
-	wl_list_for_each(node, &layout->transitions->transition_list, link) {
-		tran = node->transition;
-
-		if (tran->type == type &&
-		    tran->is_transition_func(tran->private_data, id_data))
-			return tran;
-	}
+	tran = hash_table_lookup(layout->transitions->index[type], id);
+	if (tran != NULL &&
+	    tran->is_transition_func(tran->private_data, id_data))
+		return tran;
 
 	return NULL;
 }
@@ -79,18 +80,13 @@ get_transition_from_type_and_id(enum ivi_layout_transition_type type,
 int32_t
 is_surface_transition(struct ivi_layout_surface *surface)
 {
-	struct ivi_layout *layout = get_instance();
-	struct transition_node *node;
-	struct ivi_layout_transition *tran;
-
-	wl_list_for_each(node, &layout->transitions->transition_list, link) {
-		tran = node->transition;
-
-		if ((tran->type == IVI_LAYOUT_TRANSITION_VIEW_MOVE_RESIZE ||
-		     tran->type == IVI_LAYOUT_TRANSITION_VIEW_RESIZE) &&
-		    tran->is_transition_func(tran->private_data, surface))
-			return 1;
-	}
+	if (get_transition_from_type_and_id(
+				IVI_LAYOUT_TRANSITION_VIEW_MOVE_RESIZE,
+				surface->id_surface, surface) ||
+	    get_transition_from_type_and_id(
+				IVI_LAYOUT_TRANSITION_VIEW_RESIZE,
+				surface->id_surface, surface))
+		return 1;
 
 	return 0;
 }
@@ -128,17 +124,48 @@ do_transition_frame(struct ivi_layout_transition *transition,
 		layout_transition_destroy(transition);
 }
 
+static uint32_t
+transition_count(struct ivi_layout_transition_set *transitions)
+{
+	return transitions->transitions.size /
+		sizeof(struct ivi_layout_transition *);
+}
+
+/* Drops the entries removed during a walk, keeping the order. */
+static void
+compact_transitions(struct ivi_layout_transition_set *transitions)
+{
+	struct ivi_layout_transition **array = transitions->transitions.data;
+	uint32_t i, n = 0;
+
+	for (i = 0; i < transition_count(transitions); i++) {
+		if (array[i] == NULL)
+			continue;
+		array[n] = array[i];
+		array[n]->slot = n;
+		n++;
+	}
+
+	transitions->transitions.size = n * sizeof *array;
+}
+
+/**
+ * Advances every running transition in one pass and commits their
+ * results together. Callbacks run during the walk may remove any
+ * transition, so removed entries are only cleared, and the array is
+ * compacted once the walk is over.
+ */
 static int32_t
 layout_transition_frame(void *data)
 {
 	struct ivi_layout_transition_set *transitions = data;
+	struct ivi_layout_transition **array;
 	uint32_t fps = 30;
 	struct timespec timestamp = {};
 	uint32_t msec = 0;
-	struct transition_node *node = NULL;
-	struct transition_node *next = NULL;
+	uint32_t i, count;
 
-	if (wl_list_empty(&transitions->transition_list)) {
+	if (transition_count(transitions) == transitions->pending_count) {
 		wl_event_source_timer_update(transitions->event_source, 0);
 		return 1;
 	}
@@ -148,19 +175,49 @@ layout_transition_frame(void *data)
 	clock_gettime(CLOCK_MONOTONIC, &timestamp);/* FIXME */
 	msec = (1e+3 * timestamp.tv_sec + 1e-6 * timestamp.tv_nsec);
 
-	wl_list_for_each_safe(node, next, &transitions->transition_list, link) {
-		do_transition_frame(node->transition, msec);
+	/* Transitions registered by callbacks are appended, pending,
+	 * and left for the next frame. */
+	count = transition_count(transitions);
+	transitions->walking = 1;
+	for (i = 0; i < count; i++) {
+		array = transitions->transitions.data;
+		if (array[i] == NULL || array[i]->is_pending)
+			continue;
+
+		do_transition_frame(array[i], msec);
 	}
+	transitions->walking = 0;
+	compact_transitions(transitions);
 
 	ivi_layout_commit_changes();
 	return 1;
 }
 
+/**
+ * Starts the transitions registered since the last commit.
+ */
+void
+ivi_layout_transition_set_commit(struct ivi_layout_transition_set *transitions)
+{
+	struct ivi_layout_transition **trans;
+
+	if (transitions->pending_count == 0)
+		return;
+
+	wl_array_for_each(trans, &transitions->transitions)
+		if (*trans)
+			(*trans)->is_pending = 0;
+	transitions->pending_count = 0;
+
+	wl_event_source_timer_update(transitions->event_source, 1);
+}
+
 struct ivi_layout_transition_set *
 ivi_layout_transition_set_create(struct weston_compositor *ec)
 {
 	struct ivi_layout_transition_set *transitions;
 	struct wl_event_loop *loop;
+	int i;
 
 	transitions = malloc(sizeof(*transitions));
 	if (transitions == NULL) {
@@ -168,7 +225,20 @@ ivi_layout_transition_set_create(struct weston_compositor *ec)
 		return NULL;
 	}
 
-	wl_list_init(&transitions->transition_list);
+	wl_array_init(&transitions->transitions);
+	transitions->pending_count = 0;
+	transitions->walking = 0;
+
+	for (i = 0; i < IVI_LAYOUT_TRANSITION_MAX; i++) {
+		transitions->index[i] = hash_table_create();
+		if (transitions->index[i] == NULL) {
+			weston_log("%s: memory allocation fails\n", __func__);
+			while (i--)
+				hash_table_destroy(transitions->index[i]);
+			free(transitions);
+			return NULL;
+		}
+	}
 
 	loop = wl_display_get_event_loop(ec->wl_display);
 	transitions->event_source =
@@ -182,42 +252,57 @@ static void
 layout_transition_register(struct ivi_layout_transition *trans)
 {
 	struct ivi_layout *layout = get_instance();
-	struct transition_node *node;
+	struct ivi_layout_transition **slot;
+
+	if (trans == NULL)
+		return;
 
-	node = malloc(sizeof(*node));
-	if (node == NULL) {
+	slot = wl_array_add(&layout->transitions->transitions, sizeof *slot);
+	if (slot == NULL) {
 		weston_log("%s: memory allocation fails\n", __func__);
 		return;
 	}
 
-	node->transition = trans;
-	wl_list_insert(&layout->pending_transition_list, &node->link);
+	*slot = trans;
+	trans->slot = transition_count(layout->transitions) - 1;
+	trans->is_pending = 1;
+	layout->transitions->pending_count++;
+
+	hash_table_remove(layout->transitions->index[trans->type], trans->id);
+	hash_table_insert(layout->transitions->index[trans->type],
+			  trans->id, trans);
 }
 
 static void
 remove_transition(struct ivi_layout *layout,
 		  struct ivi_layout_transition *trans)
 {
-	struct transition_node *node;
-	struct transition_node *next;
+	struct ivi_layout_transition_set *transitions = layout->transitions;
+	struct hash_table *index = transitions->index[trans->type];
+	struct ivi_layout_transition **array = transitions->transitions.data;
+	struct ivi_layout_transition *last;
 
-	wl_list_for_each_safe(node, next,
-			      &layout->transitions->transition_list, link) {
-		if (node->transition == trans) {
-			wl_list_remove(&node->link);
-			free(node);
-			return;
-		}
-	}
+	if (trans->slot < 0)
+		return;
 
-	wl_list_for_each_safe(node, next,
-			      &layout->pending_transition_list, link) {
-		if (node->transition == trans) {
-			wl_list_remove(&node->link);
-			free(node);
-			return;
-		}
+	if (hash_table_lookup(index, trans->id) == trans)
+		hash_table_remove(index, trans->id);
+
+	if (trans->is_pending)
+		transitions->pending_count--;
+
+	if (transitions->walking) {
+		array[trans->slot] = NULL;
+		trans->slot = -1;
+		return;
 	}
+
+	last = array[transition_count(transitions) - 1];
+	array[trans->slot] = last;
+	last->slot = trans->slot;
+	transitions->transitions.size -= sizeof *array;
+
+	trans->slot = -1;
 }
 
 static void
@@ -242,6 +327,9 @@ create_layout_transition(void)
 	}
 
 	transition->type = IVI_LAYOUT_TRANSITION_MAX;
+	transition->id = 0;
+	transition->slot = -1;
+	transition->is_pending = 0;
 	transition->time_start = 0;
 	transition->time_duration = 300; /* 300ms */
 	transition->time_elapsed = 0;
@@ -338,6 +426,7 @@ create_move_resize_view_transition(
 	}
 
 	transition->type = IVI_LAYOUT_TRANSITION_VIEW_MOVE_RESIZE;
+	transition->id = surface->id_surface;
 	transition->is_transition_func = (ivi_layout_is_transition_func)is_transition_move_resize_view_func;
 
 	transition->frame_func = frame_func;
@@ -380,7 +469,7 @@ ivi_layout_transition_move_resize_view(struct ivi_layout_surface *surface,
 
 	transition = get_transition_from_type_and_id(
 					IVI_LAYOUT_TRANSITION_VIEW_MOVE_RESIZE,
-					surface);
+					surface->id_surface, surface);
 	if (transition) {
 		struct move_resize_view_data *data = transition->private_data;
 		transition->time_start = 0;
@@ -463,6 +552,7 @@ create_fade_view_transition(
 	}
 
 	transition->type = IVI_LAYOUT_TRANSITION_VIEW_FADE;
+	transition->id = surface->id_surface;
 	transition->is_transition_func = (ivi_layout_is_transition_func)is_transition_fade_view_func;
 
 	transition->user_data = user_data;
@@ -529,7 +619,7 @@ ivi_layout_transition_visibility_on(struct ivi_layout_surface *surface,
 
 	transition = get_transition_from_type_and_id(
 					IVI_LAYOUT_TRANSITION_VIEW_FADE,
-					surface);
+					surface->id_surface, surface);
 	if (transition) {
 		start_alpha = ivi_layout_surface_get_opacity(surface);
 		user_data = transition->user_data;
@@ -592,7 +682,7 @@ ivi_layout_transition_visibility_off(struct ivi_layout_surface *surface,
 
 	transition =
 		get_transition_from_type_and_id(IVI_LAYOUT_TRANSITION_VIEW_FADE,
-						surface);
+						surface->id_surface, surface);
 	if (transition) {
 		data = transition->private_data;
 
@@ -689,6 +779,7 @@ create_move_layer_transition(
 	}
 
 	transition->type = IVI_LAYOUT_TRANSITION_LAYER_MOVE;
+	transition->id = layer->id_layer;
 	transition->is_transition_func = (ivi_layout_is_transition_func)is_transition_move_layer_func;
 
 	transition->frame_func = transition_move_layer_user_frame;
@@ -720,6 +811,22 @@ ivi_layout_transition_move_layer(struct ivi_layout_layer *layer,
 
 	ivi_layout_layer_get_position(layer, &start_pos_x, &start_pos_y);
 
+	transition = get_transition_from_type_and_id(
+					IVI_LAYOUT_TRANSITION_LAYER_MOVE,
+					layer->id_layer, layer);
+	if (transition) {
+		struct move_layer_data *data = transition->private_data;
+		transition->time_start = 0;
+		if (duration != 0)
+			transition->time_duration = duration;
+
+		data->start_x = start_pos_x;
+		data->start_y = start_pos_y;
+		data->end_x   = dest_x;
+		data->end_y   = dest_y;
+		return;
+	}
+
 	transition = create_move_layer_transition(
 		layer,
 		start_pos_x, start_pos_y,
@@ -738,7 +845,7 @@ ivi_layout_transition_move_layer_cancel(struct ivi_layout_layer *layer)
 	struct ivi_layout_transition *transition =
 		get_transition_from_type_and_id(
 					IVI_LAYOUT_TRANSITION_LAYER_MOVE,
-					layer);
+					layer->id_layer, layer);
 	if (transition) {
 		layout_transition_destroy(transition);
 	}
@@ -802,7 +909,7 @@ ivi_layout_transition_fade_layer(
 
 	transition = get_transition_from_type_and_id(
 					IVI_LAYOUT_TRANSITION_LAYER_FADE,
-					layer);
+					layer->id_layer, layer);
 	if (transition) {
 		/* transition update */
 		data = transition->private_data;
@@ -835,6 +942,7 @@ ivi_layout_transition_fade_layer(
 	}
 
 	transition->type = IVI_LAYOUT_TRANSITION_LAYER_FADE;
+	transition->id = layer->id_layer;
 	transition->is_transition_func = (ivi_layout_is_transition_func)is_transition_fade_layer_func;
 
 	transition->private_data = data;
@@ -61,6 +61,7 @@
 #include "ivi-layout-private.h"
 
 #include "../shared/os-compatibility.h"
+#include "../shared/hash.h"
 
 struct link_layer {
 	struct ivi_layout_layer *ivilayer;
@@ -240,37 +241,6 @@ remove_orderlayer_from_screen(struct ivi_layout_layer *ivilayer)
 	wl_list_init(&ivilayer->screen_list);
 }
 
-/**
- * Internal API to add/remove a ivi_layer to/from ivi_screen.
- */
-static struct ivi_layout_surface *
-get_surface(struct wl_list *surf_list, uint32_t id_surface)
-{
-	struct ivi_layout_surface *ivisurf;
-
-	wl_list_for_each(ivisurf, surf_list, link) {
-		if (ivisurf->id_surface == id_surface) {
-			return ivisurf;
-		}
-	}
-
-	return NULL;
-}
-
-static struct ivi_layout_layer *
-get_layer(struct wl_list *layer_list, uint32_t id_layer)
-{
-	struct ivi_layout_layer *ivilayer;
-
-	wl_list_for_each(ivilayer, layer_list, link) {
-		if (ivilayer->id_layer == id_layer) {
-			return ivilayer;
-		}
-	}
-
-	return NULL;
-}
-
 static void
 remove_configured_listener(struct ivi_layout_surface *ivisurf)
 {
@@ -338,6 +308,9 @@ ivi_layout_surface_remove(struct ivi_layout_surface *ivisurf)
 	if (!wl_list_empty(&ivisurf->link)) {
 		wl_list_remove(&ivisurf->link);
 	}
+	wl_list_remove(&ivisurf->dirty_link);
+	if (hash_table_lookup(layout->surface_index, ivisurf->id_surface) == ivisurf)
+		hash_table_remove(layout->surface_index, ivisurf->id_surface);
 	remove_ordersurface_from_layer(ivisurf);
 
 	wl_signal_emit(&layout->surface_notification.removed, ivisurf);
@@ -441,6 +414,7 @@ create_screen(struct weston_compositor *ec)
 		wl_list_init(&iviscrn->link_to_layer);
 
 		wl_list_insert(&layout->screen_list, &iviscrn->link);
+		hash_table_insert(layout->screen_index, iviscrn->id_screen, iviscrn);
 	}
 }
 
@@ -466,6 +440,36 @@ init_surface_properties(struct ivi_layout_surface_properties *prop)
 	prop->opacity = wl_fixed_from_double(1.0);
 }
 
+/**
+ * Internal APIs to record changes to be applied by the next commit.
+ * Only objects queued on the dirty lists are visited by
+ * ivi_layout_commit_changes, so every write to pending state or
+ * event_mask has to go through these.
+ */
+static void
+surface_mark_dirty(struct ivi_layout_surface *ivisurf, uint32_t mask)
+{
+	struct ivi_layout *layout = get_instance();
+
+	ivisurf->event_mask |= mask;
+
+	if (wl_list_empty(&ivisurf->dirty_link))
+		wl_list_insert(layout->dirty_surface_list.prev,
+			       &ivisurf->dirty_link);
+}
+
+static void
+layer_mark_dirty(struct ivi_layout_layer *ivilayer, uint32_t mask)
+{
+	struct ivi_layout *layout = get_instance();
+
+	ivilayer->event_mask |= mask;
+
+	if (wl_list_empty(&ivilayer->dirty_link))
+		wl_list_insert(layout->dirty_layer_list.prev,
+			       &ivilayer->dirty_link);
+}
+
 /**
  * Internal APIs to be called from ivi_layout_commit_changes.
  */
@@ -773,20 +777,53 @@ update_prop(struct ivi_layout_layer *ivilayer,
 	}
 }
 
+static struct ivi_layout_layer *
+get_order_layer(struct ivi_layout_surface *ivisurf)
+{
+	struct link_layer *link_layer = NULL;
+
+	if (wl_list_empty(&ivisurf->layer_list))
+		return NULL;
+
+	link_layer = container_of(ivisurf->layer_list.next,
+				  struct link_layer, link);
+
+	return link_layer->ivilayer;
+}
+
 static void
 commit_changes(struct ivi_layout *layout)
 {
-	struct ivi_layout_screen  *iviscrn  = NULL;
 	struct ivi_layout_layer   *ivilayer = NULL;
 	struct ivi_layout_surface *ivisurf  = NULL;
 
-	wl_list_for_each(iviscrn, &layout->screen_list, link) {
-		wl_list_for_each(ivilayer, &iviscrn->order.layer_list, order.link) {
-			wl_list_for_each(ivisurf, &ivilayer->order.surface_list, order.link) {
-				update_prop(ivilayer, ivisurf);
-			}
+	/*
+	 * A changed layer affects every surface it shows, so those are
+	 * updated as a whole. Changed surfaces sitting on an unchanged
+	 * layer are updated on their own.
+	 */
+	wl_list_for_each(ivilayer, &layout->dirty_layer_list, dirty_link) {
+		if (ivilayer->event_mask == 0 ||
+		    wl_list_empty(&ivilayer->order.link))
+			continue;
+
+		wl_list_for_each(ivisurf, &ivilayer->order.surface_list, order.link) {
+			update_prop(ivilayer, ivisurf);
 		}
 	}
+
+	wl_list_for_each(ivisurf, &layout->dirty_surface_list, dirty_link) {
+		if (ivisurf->event_mask == 0 ||
+		    wl_list_empty(&ivisurf->order.link))
+			continue;
+
+		ivilayer = get_order_layer(ivisurf);
+		if (ivilayer == NULL || ivilayer->event_mask != 0 ||
+		    wl_list_empty(&ivilayer->order.link))
+			continue;
+
+		update_prop(ivilayer, ivisurf);
+	}
 }
 
 static void
@@ -799,7 +836,7 @@ commit_surface_list(struct ivi_layout *layout)
 	int32_t dest_height = 0;
 	int32_t configured = 0;
 
-	wl_list_for_each(ivisurf, &layout->surface_list, link) {
+	wl_list_for_each(ivisurf, &layout->dirty_surface_list, dirty_link) {
 		if(ivisurf->pending.prop.transition_type == IVI_LAYOUT_TRANSITION_VIEW_DEFAULT) {
 			dest_x = ivisurf->prop.dest_x;
 			dest_y = ivisurf->prop.dest_y;
@@ -892,7 +929,7 @@ commit_layer_list(struct ivi_layout *layout)
 	struct ivi_layout_surface *ivisurf  = NULL;
 	struct ivi_layout_surface *next     = NULL;
 
-	wl_list_for_each(ivilayer, &layout->layer_list, link) {
+	wl_list_for_each(ivilayer, &layout->dirty_layer_list, dirty_link) {
 		if(ivilayer->pending.prop.transition_type == IVI_LAYOUT_TRANSITION_LAYER_MOVE) {
 			ivi_layout_transition_move_layer(ivilayer, ivilayer->pending.prop.dest_x, ivilayer->pending.prop.dest_y, ivilayer->pending.prop.transition_duration);
 		} else if(ivilayer->pending.prop.transition_type == IVI_LAYOUT_TRANSITION_LAYER_FADE) {
@@ -920,7 +957,7 @@ commit_layer_list(struct ivi_layout *layout)
 				}
 
 				wl_list_init(&ivisurf->order.link);
-				ivisurf->event_mask |= IVI_NOTIFICATION_REMOVE;
+				surface_mark_dirty(ivisurf, IVI_NOTIFICATION_REMOVE);
 			}
 
 			wl_list_init(&ivilayer->order.surface_list);
@@ -949,12 +986,34 @@ commit_layer_list(struct ivi_layout *layout)
 				wl_list_insert(&ivilayer->order.surface_list,
 					       &ivisurf->order.link);
 				add_ordersurface_to_layer(ivisurf, ivilayer);
-				ivisurf->event_mask |= IVI_NOTIFICATION_ADD;
+				surface_mark_dirty(ivisurf, IVI_NOTIFICATION_ADD);
 			}
 		}
 	}
 }
 
+static int32_t
+is_view_list_changed(struct ivi_layout *layout)
+{
+	const uint32_t mask = IVI_NOTIFICATION_VISIBILITY |
+			      IVI_NOTIFICATION_ADD |
+			      IVI_NOTIFICATION_REMOVE;
+	struct ivi_layout_layer   *ivilayer = NULL;
+	struct ivi_layout_surface *ivisurf  = NULL;
+
+	wl_list_for_each(ivilayer, &layout->dirty_layer_list, dirty_link) {
+		if (ivilayer->event_mask & mask)
+			return 1;
+	}
+
+	wl_list_for_each(ivisurf, &layout->dirty_surface_list, dirty_link) {
+		if (ivisurf->event_mask & mask)
+			return 1;
+	}
+
+	return 0;
+}
+
 static void
 commit_screen_list(struct ivi_layout *layout)
 {
@@ -962,8 +1021,12 @@ commit_screen_list(struct ivi_layout *layout)
 	struct ivi_layout_layer   *ivilayer = NULL;
 	struct ivi_layout_layer   *next     = NULL;
 	struct ivi_layout_surface *ivisurf  = NULL;
+	int32_t changed = 0;
 
 	wl_list_for_each(iviscrn, &layout->screen_list, link) {
+		if (iviscrn->event_mask != 0)
+			changed = 1;
+
 		if (iviscrn->event_mask & IVI_NOTIFICATION_REMOVE) {
 			wl_list_for_each_safe(ivilayer, next,
 					      &iviscrn->order.layer_list, order.link) {
@@ -974,7 +1037,7 @@ commit_screen_list(struct ivi_layout *layout)
 				}
 
 				wl_list_init(&ivilayer->order.link);
-				ivilayer->event_mask |= IVI_NOTIFICATION_REMOVE;
+				layer_mark_dirty(ivilayer, IVI_NOTIFICATION_REMOVE);
 			}
 		}
 
@@ -996,12 +1059,16 @@ commit_screen_list(struct ivi_layout *layout)
 				wl_list_insert(&iviscrn->order.layer_list,
 					       &ivilayer->order.link);
 				add_orderlayer_to_screen(ivilayer, iviscrn);
-				ivilayer->event_mask |= IVI_NOTIFICATION_ADD;
+				layer_mark_dirty(ivilayer, IVI_NOTIFICATION_ADD);
 			}
 		}
 
 		iviscrn->event_mask = 0;
 
+		/* Nothing shown on the screen has changed its stacking */
+		if (!changed && !is_view_list_changed(layout))
+			break;
+
 		/* Clear view list of layout ivi_layer */
 		wl_list_init(&layout->layout_layer.view_list.link);
 
@@ -1036,21 +1103,15 @@ commit_screen_list(struct ivi_layout *layout)
 static void
 commit_transition(struct ivi_layout* layout)
 {
-	if(wl_list_empty(&layout->pending_transition_list)){
-		return;
-	}
-
-	wl_list_insert_list(&layout->transitions->transition_list,
-			    &layout->pending_transition_list);
-
-	wl_list_init(&layout->pending_transition_list);
-
-	wl_event_source_timer_update(layout->transitions->event_source, 1);
+	ivi_layout_transition_set_commit(layout->transitions);
 }
 
 static void
 send_surface_prop(struct ivi_layout_surface *ivisurf)
 {
+	if (ivisurf->event_mask == 0)
+		return;
+
 	wl_signal_emit(&ivisurf->property_changed, ivisurf);
 	ivisurf->event_mask = 0;
 }
@@ -1058,21 +1119,46 @@ send_surface_prop(struct ivi_layout_surface *ivisurf)
 static void
 send_layer_prop(struct ivi_layout_layer *ivilayer)
 {
+	if (ivilayer->event_mask == 0)
+		return;
+
 	wl_signal_emit(&ivilayer->property_changed, ivilayer);
 	ivilayer->event_mask = 0;
 }
 
+/**
+ * The dirty lists are detached before notifying, so that properties
+ * changed again by a listener are queued for the next commit.
+ */
 static void
 send_prop(struct ivi_layout *layout)
 {
 	struct ivi_layout_layer   *ivilayer = NULL;
 	struct ivi_layout_surface *ivisurf  = NULL;
-
-	wl_list_for_each_reverse(ivilayer, &layout->layer_list, link) {
+	struct wl_list layer_list;
+	struct wl_list surface_list;
+
+	wl_list_init(&layer_list);
+	wl_list_insert_list(&layer_list, &layout->dirty_layer_list);
+	wl_list_init(&layout->dirty_layer_list);
+
+	wl_list_init(&surface_list);
+	wl_list_insert_list(&surface_list, &layout->dirty_surface_list);
+	wl_list_init(&layout->dirty_surface_list);
+
+	while (!wl_list_empty(&layer_list)) {
+		ivilayer = container_of(layer_list.next,
+					struct ivi_layout_layer, dirty_link);
+		wl_list_remove(&ivilayer->dirty_link);
+		wl_list_init(&ivilayer->dirty_link);
 		send_layer_prop(ivilayer);
 	}
 
-	wl_list_for_each_reverse(ivisurf, &layout->surface_list, link) {
+	while (!wl_list_empty(&surface_list)) {
+		ivisurf = container_of(surface_list.next,
+				       struct ivi_layout_surface, dirty_link);
+		wl_list_remove(&ivisurf->dirty_link);
+		wl_list_init(&ivisurf->dirty_link);
 		send_surface_prop(ivisurf);
 	}
 }
@@ -1092,7 +1178,7 @@ clear_surface_pending_list(struct ivi_layout_layer *ivilayer)
 		wl_list_init(&surface_link->pending.link);
 	}
 
-	ivilayer->event_mask |= IVI_NOTIFICATION_REMOVE;
+	layer_mark_dirty(ivilayer, IVI_NOTIFICATION_REMOVE);
 }
 
 static void
@@ -1108,9 +1194,10 @@ clear_surface_order_list(struct ivi_layout_layer *ivilayer)
 		}
 
 		wl_list_init(&surface_link->order.link);
+		surface_mark_dirty(surface_link, IVI_NOTIFICATION_REMOVE);
 	}
 
-	ivilayer->event_mask |= IVI_NOTIFICATION_REMOVE;
+	layer_mark_dirty(ivilayer, IVI_NOTIFICATION_REMOVE);
 }
 
 static void
@@ -1474,45 +1561,24 @@ static struct ivi_layout_layer *
 ivi_layout_get_layer_from_id(uint32_t id_layer)
 {
 	struct ivi_layout *layout = get_instance();
-	struct ivi_layout_layer *ivilayer = NULL;
-
-	wl_list_for_each(ivilayer, &layout->layer_list, link) {
-		if (ivilayer->id_layer == id_layer) {
-			return ivilayer;
-		}
-	}
 
-	return NULL;
+	return hash_table_lookup(layout->layer_index, id_layer);
 }
 
 struct ivi_layout_surface *
 ivi_layout_get_surface_from_id(uint32_t id_surface)
 {
 	struct ivi_layout *layout = get_instance();
-	struct ivi_layout_surface *ivisurf = NULL;
 
-	wl_list_for_each(ivisurf, &layout->surface_list, link) {
-		if (ivisurf->id_surface == id_surface) {
-			return ivisurf;
-		}
-	}
-
-	return NULL;
+	return hash_table_lookup(layout->surface_index, id_surface);
 }
 
 static struct ivi_layout_screen *
 ivi_layout_get_screen_from_id(uint32_t id_screen)
 {
 	struct ivi_layout *layout = get_instance();
-	struct ivi_layout_screen *iviscrn = NULL;
-
-	wl_list_for_each(iviscrn, &layout->screen_list, link) {
-/* FIXME : select iviscrn from screen_list by id_screen */
-		return iviscrn;
-		break;
-	}
 
-	return NULL;
+	return hash_table_lookup(layout->screen_index, id_screen);
 }
 
 static int32_t
@@ -1823,7 +1889,7 @@ ivi_layout_layer_create_with_dimension(uint32_t id_layer,
 	struct ivi_layout *layout = get_instance();
 	struct ivi_layout_layer *ivilayer = NULL;
 
-	ivilayer = get_layer(&layout->layer_list, id_layer);
+	ivilayer = ivi_layout_get_layer_from_id(id_layer);
 	if (ivilayer != NULL) {
 		weston_log("id_layer is already created\n");
 		return ivilayer;
@@ -1852,7 +1918,10 @@ ivi_layout_layer_create_with_dimension(uint32_t id_layer,
 	wl_list_init(&ivilayer->order.surface_list);
 	wl_list_init(&ivilayer->order.link);
 
+	wl_list_init(&ivilayer->dirty_link);
+
 	wl_list_insert(&layout->layer_list, &ivilayer->link);
+	hash_table_insert(layout->layer_index, id_layer, ivilayer);
 
 	wl_signal_emit(&layout->layer_notification.created, ivilayer);
 
@@ -1894,6 +1963,8 @@ ivi_layout_layer_remove(struct ivi_layout_layer *ivilayer)
 	if (!wl_list_empty(&ivilayer->link)) {
 		wl_list_remove(&ivilayer->link);
 	}
+	wl_list_remove(&ivilayer->dirty_link);
+	hash_table_remove(layout->layer_index, ivilayer->id_layer);
 	remove_orderlayer_from_screen(ivilayer);
 	remove_link_to_surface(ivilayer);
 	ivi_layout_layer_remove_notification(ivilayer);
@@ -1915,7 +1986,7 @@ ivi_layout_layer_set_visibility(struct ivi_layout_layer *ivilayer,
 	prop = &ivilayer->pending.prop;
 	prop->visibility = newVisibility;
 
-	ivilayer->event_mask |= IVI_NOTIFICATION_VISIBILITY;
+	layer_mark_dirty(ivilayer, IVI_NOTIFICATION_VISIBILITY);
 
 	return IVI_SUCCEEDED;
 }
@@ -1945,7 +2016,7 @@ ivi_layout_layer_set_opacity(struct ivi_layout_layer *ivilayer,
 	prop = &ivilayer->pending.prop;
 	prop->opacity = opacity;
 
-	ivilayer->event_mask |= IVI_NOTIFICATION_OPACITY;
+	layer_mark_dirty(ivilayer, IVI_NOTIFICATION_OPACITY);
 
 	return IVI_SUCCEEDED;
 }
@@ -1979,7 +2050,7 @@ ivi_layout_layer_set_source_rectangle(struct ivi_layout_layer *ivilayer,
 	prop->source_width = width;
 	prop->source_height = height;
 
-	ivilayer->event_mask |= IVI_NOTIFICATION_SOURCE_RECT;
+	layer_mark_dirty(ivilayer, IVI_NOTIFICATION_SOURCE_RECT);
 
 	return IVI_SUCCEEDED;
 }
@@ -2002,7 +2073,7 @@ ivi_layout_layer_set_destination_rectangle(struct ivi_layout_layer *ivilayer,
 	prop->dest_width = width;
 	prop->dest_height = height;
 
-	ivilayer->event_mask |= IVI_NOTIFICATION_DEST_RECT;
+	layer_mark_dirty(ivilayer, IVI_NOTIFICATION_DEST_RECT);
 
 	return IVI_SUCCEEDED;
 }
@@ -2038,7 +2109,7 @@ ivi_layout_layer_set_dimension(struct ivi_layout_layer *ivilayer,
 	prop->dest_width  = dest_width;
 	prop->dest_height = dest_height;
 
-	ivilayer->event_mask |= IVI_NOTIFICATION_DIMENSION;
+	layer_mark_dirty(ivilayer, IVI_NOTIFICATION_DIMENSION);
 
 	return IVI_SUCCEEDED;
 }
@@ -2073,7 +2144,7 @@ ivi_layout_layer_set_position(struct ivi_layout_layer *ivilayer,
 	prop->dest_x = dest_x;
 	prop->dest_y = dest_y;
 
-	ivilayer->event_mask |= IVI_NOTIFICATION_POSITION;
+	layer_mark_dirty(ivilayer, IVI_NOTIFICATION_POSITION);
 
 	return IVI_SUCCEEDED;
 }
@@ -2092,7 +2163,7 @@ ivi_layout_layer_set_orientation(struct ivi_layout_layer *ivilayer,
 	prop = &ivilayer->pending.prop;
 	prop->orientation = orientation;
 
-	ivilayer->event_mask |= IVI_NOTIFICATION_ORIENTATION;
+	layer_mark_dirty(ivilayer, IVI_NOTIFICATION_ORIENTATION);
 
 	return IVI_SUCCEEDED;
 }
@@ -2132,7 +2203,7 @@ ivi_layout_layer_set_render_order(struct ivi_layout_layer *ivilayer,
 
 			wl_list_init(&ivisurf->pending.link);
 		}
-		ivilayer->event_mask |= IVI_NOTIFICATION_REMOVE;
+		layer_mark_dirty(ivilayer, IVI_NOTIFICATION_REMOVE);
 		return IVI_SUCCEEDED;
 	}
 
@@ -2154,7 +2225,7 @@ ivi_layout_layer_set_render_order(struct ivi_layout_layer *ivilayer,
 		}
 	}
 
-	ivilayer->event_mask |= IVI_NOTIFICATION_ADD;
+	layer_mark_dirty(ivilayer, IVI_NOTIFICATION_ADD);
 
 	return IVI_SUCCEEDED;
 }
@@ -2173,7 +2244,7 @@ ivi_layout_surface_set_visibility(struct ivi_layout_surface *ivisurf,
 	prop = &ivisurf->pending.prop;
 	prop->visibility = newVisibility;
 
-	ivisurf->event_mask |= IVI_NOTIFICATION_VISIBILITY;
+	surface_mark_dirty(ivisurf, IVI_NOTIFICATION_VISIBILITY);
 
 	return IVI_SUCCEEDED;
 }
@@ -2203,7 +2274,7 @@ ivi_layout_surface_set_opacity(struct ivi_layout_surface *ivisurf,
 	prop = &ivisurf->pending.prop;
 	prop->opacity = opacity;
 
-	ivisurf->event_mask |= IVI_NOTIFICATION_OPACITY;
+	surface_mark_dirty(ivisurf, IVI_NOTIFICATION_OPACITY);
 
 	return IVI_SUCCEEDED;
 }
@@ -2241,7 +2312,7 @@ ivi_layout_surface_set_destination_rectangle(struct ivi_layout_surface *ivisurf,
 	prop->dest_width = width;
 	prop->dest_height = height;
 
-	ivisurf->event_mask |= IVI_NOTIFICATION_DEST_RECT;
+	surface_mark_dirty(ivisurf, IVI_NOTIFICATION_DEST_RECT);
 
 	return IVI_SUCCEEDED;
 }
@@ -2261,7 +2332,7 @@ ivi_layout_surface_set_dimension(struct ivi_layout_surface *ivisurf,
 	prop->dest_width  = dest_width;
 	prop->dest_height = dest_height;
 
-	ivisurf->event_mask |= IVI_NOTIFICATION_DIMENSION;
+	surface_mark_dirty(ivisurf, IVI_NOTIFICATION_DIMENSION);
 
 	return IVI_SUCCEEDED;
 }
@@ -2296,7 +2367,7 @@ ivi_layout_surface_set_position(struct ivi_layout_surface *ivisurf,
 	prop->dest_x = dest_x;
 	prop->dest_y = dest_y;
 
-	ivisurf->event_mask |= IVI_NOTIFICATION_POSITION;
+	surface_mark_dirty(ivisurf, IVI_NOTIFICATION_POSITION);
 
 	return IVI_SUCCEEDED;
 }
@@ -2330,7 +2401,7 @@ ivi_layout_surface_set_orientation(struct ivi_layout_surface *ivisurf,
 	prop = &ivisurf->pending.prop;
 	prop->orientation = orientation;
 
-	ivisurf->event_mask |= IVI_NOTIFICATION_ORIENTATION;
+	surface_mark_dirty(ivisurf, IVI_NOTIFICATION_ORIENTATION);
 
 	return IVI_SUCCEEDED;
 }
@@ -2350,9 +2421,7 @@ static int32_t
 ivi_layout_screen_add_layer(struct ivi_layout_screen *iviscrn,
 			    struct ivi_layout_layer *addlayer)
 {
-	struct ivi_layout *layout = get_instance();
 	struct ivi_layout_layer *ivilayer = NULL;
-	struct ivi_layout_layer *next = NULL;
 	int is_layer_in_scrn = 0;
 
 	if (iviscrn == NULL || addlayer == NULL) {
@@ -2366,16 +2435,14 @@ ivi_layout_screen_add_layer(struct ivi_layout_screen *iviscrn,
 		return IVI_SUCCEEDED;
 	}
 
-	wl_list_for_each_safe(ivilayer, next, &layout->layer_list, link) {
-		if (ivilayer->id_layer == addlayer->id_layer) {
-			if (!wl_list_empty(&ivilayer->pending.link)) {
-				wl_list_remove(&ivilayer->pending.link);
-			}
-			wl_list_init(&ivilayer->pending.link);
-			wl_list_insert(&iviscrn->pending.layer_list,
-				       &ivilayer->pending.link);
-			break;
+	ivilayer = ivi_layout_get_layer_from_id(addlayer->id_layer);
+	if (ivilayer != NULL) {
+		if (!wl_list_empty(&ivilayer->pending.link)) {
+			wl_list_remove(&ivilayer->pending.link);
 		}
+		wl_list_init(&ivilayer->pending.link);
+		wl_list_insert(&iviscrn->pending.layer_list,
+			       &ivilayer->pending.link);
 	}
 
 	iviscrn->event_mask |= IVI_NOTIFICATION_ADD;
@@ -2499,9 +2566,7 @@ static int32_t
 ivi_layout_layer_add_surface(struct ivi_layout_layer *ivilayer,
 			     struct ivi_layout_surface *addsurf)
 {
-	struct ivi_layout *layout = get_instance();
 	struct ivi_layout_surface *ivisurf = NULL;
-	struct ivi_layout_surface *next = NULL;
 	int is_surf_in_layer = 0;
 
 	if (ivilayer == NULL || addsurf == NULL) {
@@ -2515,19 +2580,17 @@ ivi_layout_layer_add_surface(struct ivi_layout_layer *ivilayer,
 		return IVI_SUCCEEDED;
 	}
 
-	wl_list_for_each_safe(ivisurf, next, &layout->surface_list, link) {
-		if (ivisurf->id_surface == addsurf->id_surface) {
-			if (!wl_list_empty(&ivisurf->pending.link)) {
-				wl_list_remove(&ivisurf->pending.link);
-			}
-			wl_list_init(&ivisurf->pending.link);
-			wl_list_insert(&ivilayer->pending.surface_list,
-				       &ivisurf->pending.link);
-			break;
+	ivisurf = ivi_layout_get_surface_from_id(addsurf->id_surface);
+	if (ivisurf != NULL) {
+		if (!wl_list_empty(&ivisurf->pending.link)) {
+			wl_list_remove(&ivisurf->pending.link);
 		}
+		wl_list_init(&ivisurf->pending.link);
+		wl_list_insert(&ivilayer->pending.surface_list,
+			       &ivisurf->pending.link);
 	}
 
-	ivilayer->event_mask |= IVI_NOTIFICATION_ADD;
+	layer_mark_dirty(ivilayer, IVI_NOTIFICATION_ADD);
 
 	return IVI_SUCCEEDED;
 }
@@ -2555,7 +2618,7 @@ ivi_layout_layer_remove_surface(struct ivi_layout_layer *ivilayer,
 		}
 	}
 
-	remsurf->event_mask |= IVI_NOTIFICATION_REMOVE;
+	surface_mark_dirty(remsurf, IVI_NOTIFICATION_REMOVE);
 }
 
 static int32_t
@@ -2576,7 +2639,7 @@ ivi_layout_surface_set_source_rectangle(struct ivi_layout_surface *ivisurf,
 	prop->source_width = width;
 	prop->source_height = height;
 
-	ivisurf->event_mask |= IVI_NOTIFICATION_SOURCE_RECT;
+	surface_mark_dirty(ivisurf, IVI_NOTIFICATION_SOURCE_RECT);
 
 	return IVI_SUCCEEDED;
 }
@@ -2611,6 +2674,7 @@ ivi_layout_layer_set_transition(struct ivi_layout_layer *ivilayer,
 
 	ivilayer->pending.prop.transition_type = type;
 	ivilayer->pending.prop.transition_duration = duration;
+	layer_mark_dirty(ivilayer, 0);
 
 	return 0;
 }
@@ -2628,6 +2692,7 @@ ivi_layout_layer_set_fade_info(struct ivi_layout_layer* ivilayer,
 	ivilayer->pending.prop.is_fade_in = is_fade_in;
 	ivilayer->pending.prop.start_alpha = start_alpha;
 	ivilayer->pending.prop.end_alpha = end_alpha;
+	layer_mark_dirty(ivilayer, 0);
 
 	return 0;
 }
@@ -2645,6 +2710,7 @@ ivi_layout_surface_set_transition_duration(struct ivi_layout_surface *ivisurf,
 
 	prop = &ivisurf->pending.prop;
 	prop->transition_duration = duration*10;
+	surface_mark_dirty(ivisurf, 0);
 	return 0;
 }
 
@@ -2663,6 +2729,7 @@ ivi_layout_surface_set_transition(struct ivi_layout_surface *ivisurf,
 	prop = &ivisurf->pending.prop;
 	prop->transition_type = type;
 	prop->transition_duration = duration;
+	surface_mark_dirty(ivisurf, 0);
 	return 0;
 }
 
@@ -2707,7 +2774,7 @@ ivi_layout_surface_configure(struct ivi_layout_surface *ivisurf,
 		ivisurf->prop.source_height = height;
 	/* } */
 
-	ivisurf->event_mask |= IVI_NOTIFICATION_CONFIGURE;
+	surface_mark_dirty(ivisurf, IVI_NOTIFICATION_CONFIGURE);
 
 	if (in_init) {
 		wl_signal_emit(&layout->surface_notification.configure_changed, ivisurf);
@@ -2744,7 +2811,7 @@ ivi_layout_surface_create(struct weston_surface *wl_surface,
 		return NULL;
 	}
 
-	ivisurf = get_surface(&layout->surface_list, id_surface);
+	ivisurf = ivi_layout_get_surface_from_id(id_surface);
 	if (ivisurf != NULL) {
 		if (ivisurf->surface != NULL) {
 			weston_log("id_surface(%d) is already created\n", id_surface);
@@ -2800,7 +2867,11 @@ ivi_layout_surface_create(struct weston_surface *wl_surface,
 	wl_list_init(&ivisurf->order.link);
 	wl_list_init(&ivisurf->order.layer_list);
 
+	wl_list_init(&ivisurf->dirty_link);
+
 	wl_list_insert(&layout->surface_list, &ivisurf->link);
+	hash_table_remove(layout->surface_index, id_surface);
+	hash_table_insert(layout->surface_index, id_surface, ivisurf);
 
 	wl_signal_emit(&layout->surface_notification.created, ivisurf);
 
@@ -2818,6 +2889,13 @@ ivi_layout_init_with_compositor(struct weston_compositor *ec)
 	wl_list_init(&layout->layer_list);
 	wl_list_init(&layout->screen_list);
 
+	wl_list_init(&layout->dirty_surface_list);
+	wl_list_init(&layout->dirty_layer_list);
+
+	layout->surface_index = hash_table_create();
+	layout->layer_index = hash_table_create();
+	layout->screen_index = hash_table_create();
+
 	wl_signal_init(&layout->layer_notification.created);
 	wl_signal_init(&layout->layer_notification.removed);
 
@@ -2831,7 +2909,6 @@ ivi_layout_init_with_compositor(struct weston_compositor *ec)
 	create_screen(ec);
 
 	layout->transitions = ivi_layout_transition_set_create(ec);
-	wl_list_init(&layout->pending_transition_list);
 }
 
 
@@ -74,6 +74,16 @@ theme_render_frame(struct theme *t,
 		   const char *title, struct wl_list *buttons,
 		   uint32_t flags);
 
+/* The two halves of theme_render_frame(), for callers that cache the
+ * title.  The title is not clipped to the title bar. */
+void
+theme_render_frame_border(struct theme *t,
+			  cairo_t *cr, int width, int height, uint32_t flags);
+void
+theme_render_frame_title(struct theme *t,
+			 cairo_t *cr, int width, const char *title,
+			 uint32_t flags);
+
 enum theme_location {
 	THEME_LOCATION_INTERIOR = 0,
 	THEME_LOCATION_RESIZING_TOP = 1,
@@ -227,4 +237,14 @@ frame_double_touch_up(struct frame *frame, void *data, int32_t id);
 void
 frame_repaint(struct frame *frame, cairo_t *cr);
 
+/* Like frame_repaint(), but only redraws what changed since the last
+ * repaint.  The target must still hold the previous contents. */
+void
+frame_repaint_damage(struct frame *frame, cairo_t *cr);
+
+/* Makes the next frame_repaint_damage() redraw everything, for when
+ * the target contents were lost. */
+void
+frame_damage_all(struct frame *frame);
+
 #endif
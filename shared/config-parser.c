@@ -41,23 +41,174 @@
 	const __typeof__( ((type *)0)->member ) *__mptr = (ptr);	\
 	(type *)( (char *)__mptr - offsetof(type,member) );})
 
+/*
+ * Sections and entries stay on lists in file order, and are also
+ * chained into hash tables: sections by name, entries by key within
+ * their section, and entries by section name, key and value within the
+ * whole config. Chains are kept in insertion order so that the first
+ * match is always the first one in the file.
+ */
+struct config_hash_node {
+	uint32_t hash;
+	struct config_hash_node *next;
+};
+
+struct config_hash_bucket {
+	struct config_hash_node *first;
+	struct config_hash_node *last;
+};
+
+struct config_hash {
+	struct config_hash_bucket *buckets;
+	uint32_t size;
+	uint32_t count;
+};
+
 struct weston_config_entry {
 	char *key;
 	char *value;
+	struct weston_config_section *section;
+	struct config_hash_node key_node;
+	struct config_hash_node value_node;
 	struct wl_list link;
 };
 
 struct weston_config_section {
 	char *name;
+	struct config_hash_node name_node;
+	struct config_hash entry_table;
 	struct wl_list entry_list;
 	struct wl_list link;
 };
 
 struct weston_config {
 	struct wl_list section_list;
+	struct config_hash section_table;
+	struct config_hash value_table;
 	char path[PATH_MAX];
 };
 
+/* FNV-1a over a NUL-terminated string, chained from a previous hash */
+static uint32_t
+hash_string(uint32_t hash, const char *s)
+{
+	while (*s) {
+		hash ^= (unsigned char) *s++;
+		hash *= 16777619u;
+	}
+
+	/* separate concatenated strings */
+	hash ^= 0xff;
+	hash *= 16777619u;
+
+	return hash;
+}
+
+#define HASH_INIT 2166136261u
+
+static uint32_t
+hash_entry_value(const char *section, const char *key, const char *value)
+{
+	return hash_string(hash_string(hash_string(HASH_INIT, section),
+				       key), value);
+}
+
+static void
+config_hash_init(struct config_hash *table)
+{
+	table->buckets = NULL;
+	table->size = 0;
+	table->count = 0;
+}
+
+static void
+config_hash_release(struct config_hash *table)
+{
+	free(table->buckets);
+	config_hash_init(table);
+}
+
+static void
+config_hash_append(struct config_hash_bucket *bucket,
+		   struct config_hash_node *node)
+{
+	node->next = NULL;
+	if (bucket->last)
+		bucket->last->next = node;
+	else
+		bucket->first = node;
+	bucket->last = node;
+}
+
+/* Rehashing walks the old chains in order, which keeps equal hashes
+ * in insertion order. */
+static int
+config_hash_resize(struct config_hash *table, uint32_t size)
+{
+	struct config_hash_bucket *buckets;
+	struct config_hash_node *node, *next;
+	uint32_t i;
+
+	buckets = calloc(size, sizeof *buckets);
+	if (buckets == NULL)
+		return -1;
+
+	for (i = 0; i < table->size; i++) {
+		for (node = table->buckets[i].first; node; node = next) {
+			next = node->next;
+			config_hash_append(&buckets[node->hash & (size - 1)],
+					   node);
+		}
+	}
+
+	free(table->buckets);
+	table->buckets = buckets;
+	table->size = size;
+
+	return 0;
+}
+
+static int
+config_hash_insert(struct config_hash *table, struct config_hash_node *node)
+{
+	if (table->count >= table->size &&
+	    config_hash_resize(table, table->size ? table->size * 2 : 8) < 0)
+		return -1;
+
+	config_hash_append(&table->buckets[node->hash & (table->size - 1)],
+			   node);
+	table->count++;
+
+	return 0;
+}
+
+static struct config_hash_node *
+config_hash_first(struct config_hash *table, uint32_t hash)
+{
+	struct config_hash_node *node;
+
+	if (table->size == 0)
+		return NULL;
+
+	node = table->buckets[hash & (table->size - 1)].first;
+	while (node && node->hash != hash)
+		node = node->next;
+
+	return node;
+}
+
+static struct config_hash_node *
+config_hash_next(struct config_hash_node *node)
+{
+	uint32_t hash = node->hash;
+
+	node = node->next;
+	while (node && node->hash != hash)
+		node = node->next;
+
+	return node;
+}
+
 static int
 open_config_file(struct weston_config *c, const char *name)
 {
@@ -119,13 +270,55 @@ static struct weston_config_entry *
 config_section_get_entry(struct weston_config_section *section,
 			 const char *key)
 {
+	struct config_hash_node *node;
 	struct weston_config_entry *e;
 
 	if (section == NULL)
 		return NULL;
-	wl_list_for_each(e, &section->entry_list, link)
+
+	node = config_hash_first(&section->entry_table,
+				 hash_string(HASH_INIT, key));
+	for (; node; node = config_hash_next(node)) {
+		e = container_of(node, struct weston_config_entry, key_node);
 		if (strcmp(e->key, key) == 0)
 			return e;
+	}
+
+	return NULL;
+}
+
+static struct weston_config_section *
+section_from_name_node(struct config_hash_node *node, const char *name)
+{
+	struct weston_config_section *s;
+
+	for (; node; node = config_hash_next(node)) {
+		s = container_of(node, struct weston_config_section, name_node);
+		if (strcmp(s->name, name) == 0)
+			return s;
+	}
+
+	return NULL;
+}
+
+/*
+ * Only the first entry for a key counts, as for the getters, so a
+ * section matches when that entry has the given value.
+ */
+static struct weston_config_section *
+section_from_value_node(struct config_hash_node *node, const char *name,
+			const char *key, const char *value)
+{
+	struct weston_config_entry *e;
+
+	for (; node; node = config_hash_next(node)) {
+		e = container_of(node, struct weston_config_entry, value_node);
+		if (strcmp(e->section->name, name) == 0 &&
+		    strcmp(e->key, key) == 0 &&
+		    strcmp(e->value, value) == 0 &&
+		    config_section_get_entry(e->section, key) == e)
+			return e->section;
+	}
 
 	return NULL;
 }
@@ -135,22 +328,45 @@ struct weston_config_section *
 weston_config_get_section(struct weston_config *config, const char *section,
 			  const char *key, const char *value)
 {
-	struct weston_config_section *s;
+	return weston_config_next_section_match(config, NULL,
+						section, key, value);
+}
+
+WL_EXPORT
+struct weston_config_section *
+weston_config_next_section_match(struct weston_config *config,
+				 struct weston_config_section *prev,
+				 const char *section,
+				 const char *key, const char *value)
+{
+	struct config_hash_node *node;
 	struct weston_config_entry *e;
 
 	if (config == NULL)
 		return NULL;
-	wl_list_for_each(s, &config->section_list, link) {
-		if (strcmp(s->name, section) != 0)
-			continue;
-		if (key == NULL)
-			return s;
-		e = config_section_get_entry(s, key);
-		if (e && strcmp(e->value, value) == 0)
-			return s;
+
+	if (key == NULL) {
+		if (prev)
+			node = config_hash_next(&prev->name_node);
+		else
+			node = config_hash_first(&config->section_table,
+						 hash_string(HASH_INIT,
+							     section));
+
+		return section_from_name_node(node, section);
 	}
 
-	return NULL;
+	if (prev) {
+		e = config_section_get_entry(prev, key);
+		if (e == NULL)
+			return NULL;
+		node = config_hash_next(&e->value_node);
+	} else {
+		node = config_hash_first(&config->value_table,
+					 hash_entry_value(section, key, value));
+	}
+
+	return section_from_value_node(node, section, key, value);
 }
 
 WL_EXPORT
@@ -300,51 +516,82 @@ config_add_section(struct weston_config *config, const char *name)
 	struct weston_config_section *section;
 
 	section = malloc(sizeof *section);
+	if (section == NULL)
+		return NULL;
+
 	section->name = strdup(name);
+	if (section->name == NULL) {
+		free(section);
+		return NULL;
+	}
+
+	config_hash_init(&section->entry_table);
 	wl_list_init(&section->entry_list);
 	wl_list_insert(config->section_list.prev, &section->link);
 
+	section->name_node.hash = hash_string(HASH_INIT, name);
+	if (config_hash_insert(&config->section_table,
+			       &section->name_node) < 0)
+		return NULL;
+
 	return section;
 }
 
 static struct weston_config_entry *
-section_add_entry(struct weston_config_section *section,
+section_add_entry(struct weston_config *config,
+		  struct weston_config_section *section,
 		  const char *key, const char *value)
 {
 	struct weston_config_entry *entry;
 
 	entry = malloc(sizeof *entry);
+	if (entry == NULL)
+		return NULL;
+
 	entry->key = strdup(key);
 	entry->value = strdup(value);
+	entry->section = section;
 	wl_list_insert(section->entry_list.prev, &entry->link);
+	if (entry->key == NULL || entry->value == NULL)
+		return NULL;
+
+	entry->key_node.hash = hash_string(HASH_INIT, key);
+	entry->value_node.hash = hash_entry_value(section->name, key, value);
+	if (config_hash_insert(&section->entry_table, &entry->key_node) < 0 ||
+	    config_hash_insert(&config->value_table, &entry->value_node) < 0)
+		return NULL;
 
 	return entry;
 }
 
-struct weston_config *
-weston_config_parse(const char *name)
+static struct weston_config *
+config_create(void)
 {
-	FILE *fp;
-	char line[512], *p;
 	struct weston_config *config;
-	struct weston_config_section *section = NULL;
-	int i, fd;
 
 	config = malloc(sizeof *config);
 	if (config == NULL)
 		return NULL;
 
 	wl_list_init(&config->section_list);
+	config_hash_init(&config->section_table);
+	config_hash_init(&config->value_table);
 
-	fd = open_config_file(config, name);
-	if (fd == -1) {
-		free(config);
-		return NULL;
-	}
+	return config;
+}
+
+static struct weston_config *
+config_parse_fd(struct weston_config *config, int fd)
+{
+	FILE *fp;
+	char line[512], *p;
+	struct weston_config_section *section = NULL;
+	int i;
 
 	fp = fdopen(fd, "r");
 	if (fp == NULL) {
-		free(config);
+		close(fd);
+		weston_config_destroy(config);
 		return NULL;
 	}
 
@@ -364,6 +611,12 @@ weston_config_parse(const char *name)
 			}
 			p[0] = '\0';
 			section = config_add_section(config, &line[1]);
+			if (section == NULL) {
+				fprintf(stderr, "out of memory\n");
+				fclose(fp);
+				weston_config_destroy(config);
+				return NULL;
+			}
 			continue;
 		default:
 			p = strchr(line, '=');
@@ -384,7 +637,12 @@ weston_config_parse(const char *name)
 				p[i - 1] = '\0';
 				i--;
 			}
-			section_add_entry(section, line, p);
+			if (!section_add_entry(config, section, line, p)) {
+				fprintf(stderr, "out of memory\n");
+				fclose(fp);
+				weston_config_destroy(config);
+				return NULL;
+			}
 			continue;
 		}
 	}
@@ -394,6 +652,144 @@ weston_config_parse(const char *name)
 	return config;
 }
 
+struct weston_config *
+weston_config_parse(const char *name)
+{
+	struct weston_config *config;
+	int fd;
+
+	config = config_create();
+	if (config == NULL)
+		return NULL;
+
+	fd = open_config_file(config, name);
+	if (fd == -1) {
+		weston_config_destroy(config);
+		return NULL;
+	}
+
+	return config_parse_fd(config, fd);
+}
+
+struct weston_config *
+weston_config_reload(struct weston_config *config)
+{
+	struct weston_config *reloaded;
+	int fd;
+
+	if (config == NULL)
+		return NULL;
+
+	reloaded = config_create();
+	if (reloaded == NULL)
+		return NULL;
+
+	snprintf(reloaded->path, sizeof reloaded->path, "%s", config->path);
+	fd = open(reloaded->path, O_RDONLY | O_CLOEXEC);
+	if (fd == -1) {
+		weston_config_destroy(reloaded);
+		return NULL;
+	}
+
+	return config_parse_fd(reloaded, fd);
+}
+
+static int
+diff_entries(struct weston_config_section *old_section,
+	     struct weston_config_section *new_section,
+	     weston_config_diff_func_t func, void *data)
+{
+	struct weston_config_section *s =
+		old_section ? old_section : new_section;
+	struct weston_config_entry *e, *other;
+	int count = 0;
+
+	if (old_section == NULL || new_section == NULL) {
+		func(old_section, new_section, s->name, NULL, NULL, NULL, data);
+		count++;
+	}
+
+	if (old_section) {
+		wl_list_for_each(e, &old_section->entry_list, link) {
+			/* shadowed duplicates are never looked up */
+			if (config_section_get_entry(old_section, e->key) != e)
+				continue;
+
+			other = config_section_get_entry(new_section, e->key);
+			if (other && strcmp(e->value, other->value) == 0)
+				continue;
+
+			func(old_section, new_section, s->name, e->key,
+			     e->value, other ? other->value : NULL, data);
+			count++;
+		}
+	}
+
+	if (new_section) {
+		wl_list_for_each(e, &new_section->entry_list, link) {
+			if (config_section_get_entry(new_section, e->key) != e ||
+			    config_section_get_entry(old_section, e->key))
+				continue;
+
+			func(old_section, new_section, s->name, e->key,
+			     NULL, e->value, data);
+			count++;
+		}
+	}
+
+	return count;
+}
+
+/*
+ * Sections are paired by name and by rank among the sections of that
+ * name: the second [output] of the old config is compared with the
+ * second [output] of the new one.
+ */
+int
+weston_config_diff(struct weston_config *old_config,
+		   struct weston_config *new_config,
+		   weston_config_diff_func_t func, void *data)
+{
+	struct weston_config_section *s, *old_s, *new_s;
+	int count = 0;
+
+	if (old_config) {
+		wl_list_for_each(s, &old_config->section_list, link) {
+			/* each name is handled once, from its first section */
+			if (weston_config_get_section(old_config, s->name,
+						      NULL, NULL) != s)
+				continue;
+
+			old_s = s;
+			new_s = weston_config_get_section(new_config, s->name,
+							  NULL, NULL);
+			while (old_s || new_s) {
+				count += diff_entries(old_s, new_s, func, data);
+				if (old_s)
+					old_s = weston_config_next_section_match(
+						old_config, old_s, s->name,
+						NULL, NULL);
+				if (new_s)
+					new_s = weston_config_next_section_match(
+						new_config, new_s, s->name,
+						NULL, NULL);
+			}
+		}
+	}
+
+	if (new_config) {
+		wl_list_for_each(s, &new_config->section_list, link) {
+			if (weston_config_get_section(old_config, s->name,
+						      NULL, NULL))
+				continue;
+
+			count += diff_entries(NULL, s, func, data);
+		}
+	}
+
+	return count;
+}
+
 const char *
 weston_config_get_full_path(struct weston_config *config)
 {
@@ -438,9 +834,12 @@ weston_config_destroy(struct weston_config *config)
 			free(e->value);
 			free(e);
 		}
+		config_hash_release(&s->entry_table);
 		free(s->name);
 		free(s);
 	}
 
+	config_hash_release(&config->section_table);
+	config_hash_release(&config->value_table);
 	free(config);
 }
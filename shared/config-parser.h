@@ -71,6 +71,11 @@ struct weston_config;
 struct weston_config_section *
 weston_config_get_section(struct weston_config *config, const char *section,
 			  const char *key, const char *value);
+struct weston_config_section *
+weston_config_next_section_match(struct weston_config *config,
+				 struct weston_config_section *prev,
+				 const char *section,
+				 const char *key, const char *value);
 int
 weston_config_section_get_int(struct weston_config_section *section,
 			      const char *key,
@@ -104,6 +109,23 @@ weston_config_get_full_path(struct weston_config *config);
 void
 weston_config_destroy(struct weston_config *config);
 
+struct weston_config *
+weston_config_reload(struct weston_config *config);
+
+/* key is NULL when a whole section was added or removed; old_value is
+ * NULL for an added key and new_value for a removed one */
+typedef void (*weston_config_diff_func_t)(
+			struct weston_config_section *old_section,
+			struct weston_config_section *new_section,
+			const char *section, const char *key,
+			const char *old_value, const char *new_value,
+			void *data);
+
+int
+weston_config_diff(struct weston_config *old_config,
+		   struct weston_config *new_config,
+		   weston_config_diff_func_t func, void *data);
+
 int weston_config_next_section(struct weston_config *config,
 			       struct weston_config_section **section,
 			       const char **name);
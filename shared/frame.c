@@ -37,14 +37,30 @@ enum frame_button_flags {
 	FRAME_BUTTON_CLICK_DOWN = 0x4,
 };
 
+/* Pre-rendered looks of a decorated button */
+enum frame_button_look {
+	FRAME_BUTTON_LOOK_NORMAL,
+	FRAME_BUTTON_LOOK_HOVER,
+	FRAME_BUTTON_LOOK_PRESSED,
+	FRAME_BUTTON_LOOK_COUNT
+};
+
+enum frame_damage {
+	FRAME_DAMAGE_NONE = 0,
+	FRAME_DAMAGE_TITLE = 0x1,
+	FRAME_DAMAGE_ALL = 0x2
+};
+
 struct frame_button {
 	struct frame *frame;
 	struct wl_list link;	/* buttons_list */
 
 	cairo_surface_t *icon;
+	cairo_surface_t *look[FRAME_BUTTON_LOOK_COUNT];
 	enum frame_button_flags flags;
 	int hover_count;
 	int press_count;
+	int damaged;
 
 	struct {
 		int x, y;
@@ -95,6 +111,12 @@ struct frame {
 	int geometry_dirty;
 
 	uint32_t status;
+	uint32_t damage;
+
+	/* The title text as rendered for the inactive and active
+	 * state, at title_width. */
+	cairo_surface_t *title_cache[2];
+	int32_t title_width;
 
 	struct wl_list buttons;
 	struct wl_list pointers;
@@ -130,15 +152,27 @@ frame_button_create(struct frame *frame, const char *icon,
 static void
 frame_button_destroy(struct frame_button *button)
 {
+	int i;
+
+	for (i = 0; i < FRAME_BUTTON_LOOK_COUNT; i++)
+		if (button->look[i])
+			cairo_surface_destroy(button->look[i]);
 	cairo_surface_destroy(button->icon);
 	free(button);
 }
 
+static void
+frame_button_damage(struct frame_button *button)
+{
+	button->damaged = 1;
+	button->frame->status |= FRAME_STATUS_REPAINT;
+}
+
 static void
 frame_button_enter(struct frame_button *button)
 {
 	if (!button->hover_count)
-		button->frame->status |= FRAME_STATUS_REPAINT;
+		frame_button_damage(button);
 	button->hover_count++;
 }
 
@@ -147,14 +181,14 @@ frame_button_leave(struct frame_button *button, struct frame_pointer *pointer)
 {
 	button->hover_count--;
 	if (!button->hover_count)
-		button->frame->status |= FRAME_STATUS_REPAINT;
+		frame_button_damage(button);
 }
 
 static void
 frame_button_press(struct frame_button *button)
 {
 	if (!button->press_count)
-		button->frame->status |= FRAME_STATUS_REPAINT;
+		frame_button_damage(button);
 	button->press_count++;
 
 	if (button->flags & FRAME_BUTTON_CLICK_DOWN)
@@ -168,7 +202,7 @@ frame_button_release(struct frame_button *button)
 	if (button->press_count)
 		return;
 
-	button->frame->status |= FRAME_STATUS_REPAINT;
+	frame_button_damage(button);
 
 	if (!(button->flags & FRAME_BUTTON_CLICK_DOWN))
 		button->frame->status |= button->status_effect;
@@ -179,7 +213,64 @@ frame_button_cancel(struct frame_button *button)
 {
 	button->press_count--;
 	if (!button->press_count)
-		button->frame->status |= FRAME_STATUS_REPAINT;
+		frame_button_damage(button);
+}
+
+/* The outline of a decorated button is stroked half a pixel outside
+ * of its allocation, so the pre-rendered looks carry a one pixel
+ * border around it. */
+static cairo_surface_t *
+frame_button_get_look(struct frame_button *button)
+{
+	enum frame_button_look look;
+	cairo_surface_t *surface;
+	cairo_t *cr;
+
+	if (button->press_count)
+		look = FRAME_BUTTON_LOOK_PRESSED;
+	else if (button->hover_count)
+		look = FRAME_BUTTON_LOOK_HOVER;
+	else
+		look = FRAME_BUTTON_LOOK_NORMAL;
+
+	if (button->look[look])
+		return button->look[look];
+
+	surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32,
+					     button->allocation.width + 2,
+					     button->allocation.height + 2);
+	cr = cairo_create(surface);
+	cairo_translate(cr, 1, 1);
+
+	cairo_set_line_width(cr, 1);
+
+	cairo_set_source_rgb(cr, 0.0, 0.0, 0.0);
+	cairo_rectangle(cr, 0, 0, 25, 16);
+
+	cairo_stroke_preserve(cr);
+
+	switch (look) {
+	case FRAME_BUTTON_LOOK_PRESSED:
+		cairo_set_source_rgb(cr, 0.7, 0.7, 0.7);
+		break;
+	case FRAME_BUTTON_LOOK_HOVER:
+		cairo_set_source_rgb(cr, 1.0, 1.0, 1.0);
+		break;
+	default:
+		cairo_set_source_rgb(cr, 0.88, 0.88, 0.88);
+		break;
+	}
+
+	cairo_fill (cr);
+
+	cairo_set_source_surface(cr, button->icon, 4, 0);
+	cairo_paint(cr);
+
+	cairo_destroy(cr);
+
+	button->look[look] = surface;
+
+	return surface;
 }
 
 static void
@@ -197,31 +288,16 @@ frame_button_repaint(struct frame_button *button, cairo_t *cr)
 
 	cairo_save(cr);
 
-	if (button->flags & FRAME_BUTTON_DECORATED) {
-		cairo_set_line_width(cr, 1);
-
-		cairo_set_source_rgb(cr, 0.0, 0.0, 0.0);
-		cairo_rectangle(cr, x, y, 25, 16);
-
-		cairo_stroke_preserve(cr);
-
-		if (button->press_count) {
-			cairo_set_source_rgb(cr, 0.7, 0.7, 0.7);
-		} else if (button->hover_count) {
-			cairo_set_source_rgb(cr, 1.0, 1.0, 1.0);
-		} else {
-			cairo_set_source_rgb(cr, 0.88, 0.88, 0.88);
-		}
-
-		cairo_fill (cr);
-
-		x += 4;
-	}
-
-	cairo_set_source_surface(cr, button->icon, x, y);
+	if (button->flags & FRAME_BUTTON_DECORATED)
+		cairo_set_source_surface(cr, frame_button_get_look(button),
+					 x - 1, y - 1);
+	else
+		cairo_set_source_surface(cr, button->icon, x, y);
 	cairo_paint(cr);
 
 	cairo_restore(cr);
+
+	button->damaged = 0;
 }
 
 static struct frame_pointer *
@@ -277,6 +353,18 @@ frame_touch_destroy(struct frame_touch *touch)
 	free(touch);
 }
 
+static void
+frame_title_cache_clear(struct frame *frame)
+{
+	int i;
+
+	for (i = 0; i < 2; i++) {
+		if (frame->title_cache[i])
+			cairo_surface_destroy(frame->title_cache[i]);
+		frame->title_cache[i] = NULL;
+	}
+}
+
 void
 frame_destroy(struct frame *frame)
 {
@@ -293,6 +381,7 @@ frame_destroy(struct frame *frame)
 	wl_list_for_each_safe(pointer, next_pointer, &frame->pointers, link)
 		frame_pointer_destroy(pointer);
 
+	frame_title_cache_clear(frame);
 	free(frame->title);
 	free(frame);
 }
@@ -313,6 +402,7 @@ frame_create(struct theme *t, int32_t width, int32_t height, uint32_t buttons,
 	frame->flags = 0;
 	frame->theme = t;
 	frame->status = FRAME_STATUS_REPAINT;
+	frame->damage = FRAME_DAMAGE_ALL;
 	frame->geometry_dirty = 1;
 
 	wl_list_init(&frame->buttons);
@@ -382,8 +472,15 @@ frame_set_title(struct frame *frame, const char *title)
 			return -1;
 	}
 
+	/* Gaining or losing the title changes the title bar height. */
+	if (!frame->title != !dup)
+		frame->damage |= FRAME_DAMAGE_ALL;
+	else
+		frame->damage |= FRAME_DAMAGE_TITLE;
+
 	free(frame->title);
 	frame->title = dup;
+	frame_title_cache_clear(frame);
 
 	frame->geometry_dirty = 1;
 	frame->status |= FRAME_STATUS_REPAINT;
@@ -394,8 +491,13 @@ frame_set_title(struct frame *frame, const char *title)
 void
 frame_set_flag(struct frame *frame, enum frame_flag flag)
 {
-	if (flag & FRAME_FLAG_MAXIMIZED && !(frame->flags & FRAME_FLAG_MAXIMIZED))
+	if (flag & FRAME_FLAG_MAXIMIZED && !(frame->flags & FRAME_FLAG_MAXIMIZED)) {
 		frame->geometry_dirty = 1;
+		frame_title_cache_clear(frame);
+	}
+
+	if ((frame->flags & flag) != flag)
+		frame->damage |= FRAME_DAMAGE_ALL;
 
 	frame->flags |= flag;
 	frame->status |= FRAME_STATUS_REPAINT;
@@ -404,8 +506,13 @@ frame_set_flag(struct frame *frame, enum frame_flag flag)
 void
 frame_unset_flag(struct frame *frame, enum frame_flag flag)
 {
-	if (flag & FRAME_FLAG_MAXIMIZED && frame->flags & FRAME_FLAG_MAXIMIZED)
+	if (flag & FRAME_FLAG_MAXIMIZED && frame->flags & FRAME_FLAG_MAXIMIZED) {
 		frame->geometry_dirty = 1;
+		frame_title_cache_clear(frame);
+	}
+
+	if (frame->flags & flag)
+		frame->damage |= FRAME_DAMAGE_ALL;
 
 	frame->flags &= ~flag;
 	frame->status |= FRAME_STATUS_REPAINT;
@@ -414,6 +521,9 @@ frame_unset_flag(struct frame *frame, enum frame_flag flag)
 void
 frame_resize(struct frame *frame, int32_t width, int32_t height)
 {
+	if (frame->width != width || frame->height != height)
+		frame->damage |= FRAME_DAMAGE_ALL;
+
 	frame->width = width;
 	frame->height = height;
 
@@ -917,27 +1027,152 @@ frame_double_touch_up(struct frame *frame, void *data, int32_t id)
 	}
 }
 
-void
-frame_repaint(struct frame *frame, cairo_t *cr)
+static uint32_t
+frame_theme_flags(struct frame *frame)
 {
-	struct frame_button *button;
 	uint32_t flags = 0;
 
-	frame_refresh_geometry(frame);
-
 	if (frame->flags & FRAME_FLAG_MAXIMIZED)
 		flags |= THEME_FRAME_MAXIMIZED;
 
 	if (frame->flags & FRAME_FLAG_ACTIVE)
 		flags |= THEME_FRAME_ACTIVE;
 
+	if (!frame->title && wl_list_empty(&frame->buttons))
+		flags |= THEME_FRAME_NO_TITLE;
+
+	return flags;
+}
+
+static void
+frame_title_rect(struct frame *frame, int32_t *x, int32_t *y,
+		 int32_t *width, int32_t *height)
+{
+	struct theme *t = frame->theme;
+
+	*x = frame->shadow_margin + t->width;
+	*y = frame->shadow_margin;
+	*width = frame->width - (frame->shadow_margin + t->width) * 2;
+	*height = t->titlebar_height - t->width;
+}
+
+static void
+frame_repaint_title(struct frame *frame, cairo_t *cr, uint32_t flags)
+{
+	cairo_surface_t *surface;
+	cairo_t *title_cr;
+	int32_t x, y, width, height;
+	int active = !!(flags & THEME_FRAME_ACTIVE);
+
+	frame_title_rect(frame, &x, &y, &width, &height);
+	if (width <= 0 || height <= 0 || !frame->title)
+		return;
+
+	if (frame->title_width != frame->width) {
+		frame_title_cache_clear(frame);
+		frame->title_width = frame->width;
+	}
+
+	surface = frame->title_cache[active];
+	if (!surface) {
+		surface = cairo_image_surface_create(CAIRO_FORMAT_ARGB32,
+						     width, height);
+		title_cr = cairo_create(surface);
+		cairo_translate(title_cr, -x, -y);
+		theme_render_frame_title(frame->theme, title_cr, frame->width,
+					 frame->title, flags);
+		cairo_destroy(title_cr);
+		frame->title_cache[active] = surface;
+	}
+
+	cairo_save(cr);
+	cairo_set_operator(cr, CAIRO_OPERATOR_OVER);
+	cairo_set_source_surface(cr, surface, x, y);
+	cairo_rectangle(cr, x, y, width, height);
+	cairo_fill(cr);
+	cairo_restore(cr);
+}
+
+static void
+frame_render(struct frame *frame, cairo_t *cr)
+{
+	struct frame_button *button;
+	uint32_t flags;
+
+	flags = frame_theme_flags(frame);
+
 	cairo_save(cr);
-	theme_render_frame(frame->theme, cr, frame->width, frame->height,
-			   frame->title, &frame->buttons, flags);
+	theme_render_frame_border(frame->theme, cr,
+				  frame->width, frame->height, flags);
 	cairo_restore(cr);
 
+	if (!(flags & THEME_FRAME_NO_TITLE))
+		frame_repaint_title(frame, cr, flags);
+
 	wl_list_for_each(button, &frame->buttons, link)
 		frame_button_repaint(button, cr);
 
+	frame->damage = FRAME_DAMAGE_NONE;
 	frame_status_clear(frame, FRAME_STATUS_REPAINT);
 }
+
+void
+frame_repaint(struct frame *frame, cairo_t *cr)
+{
+	frame_refresh_geometry(frame);
+
+	frame_render(frame, cr);
+}
+
+void
+frame_repaint_damage(struct frame *frame, cairo_t *cr)
+{
+	struct frame_button *button;
+	int32_t x, y, width, height;
+	int damaged = 0;
+
+	frame_refresh_geometry(frame);
+
+	if (frame->damage & FRAME_DAMAGE_ALL) {
+		frame_render(frame, cr);
+		return;
+	}
+
+	/* Everything below is composed from the cached pieces, so
+	 * clipping to the damage only leaves the rest untouched. */
+	cairo_save(cr);
+	cairo_new_path(cr);
+
+	if (frame->damage & FRAME_DAMAGE_TITLE) {
+		frame_title_rect(frame, &x, &y, &width, &height);
+		cairo_rectangle(cr, x, y, width, height);
+		damaged = 1;
+	}
+
+	wl_list_for_each(button, &frame->buttons, link) {
+		if (!button->damaged)
+			continue;
+		cairo_rectangle(cr,
+				button->allocation.x - 1,
+				button->allocation.y - 1,
+				button->allocation.width + 2,
+				button->allocation.height + 2);
+		damaged = 1;
+	}
+
+	if (damaged) {
+		cairo_clip(cr);
+		frame_render(frame, cr);
+	} else {
+		frame_status_clear(frame, FRAME_STATUS_REPAINT);
+	}
+
+	cairo_restore(cr);
+}
+
+void
+frame_damage_all(struct frame *frame)
+{
+	frame->damage |= FRAME_DAMAGE_ALL;
+	frame->status |= FRAME_STATUS_REPAINT;
+}
@@ -25,13 +25,27 @@
 
 #include <errno.h>
 #include <stdlib.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <limits.h>
+#include <dirent.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <jpeglib.h>
 #include <png.h>
 #include <pixman.h>
 
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
 #include "image-loader.h"
+#include "os-compatibility.h"
 
 #define ARRAY_LENGTH(a) (sizeof (a) / sizeof (a)[0])
 
@@ -45,6 +59,7 @@ stride_for_width(int width)
 	return width * 4;
 }
 
+#ifndef JCS_EXTENSIONS
 static void
 swizzle_row(JSAMPLE *row, JDIMENSION width)
 {
@@ -59,6 +74,7 @@ swizzle_row(JSAMPLE *row, JDIMENSION width)
 		d--;
 	}
 }
+#endif
 
 static void
 error_exit(j_common_ptr cinfo)
@@ -95,7 +111,17 @@ load_jpeg(FILE *fp)
 
 	jpeg_read_header(&cinfo, TRUE);
 
+#ifdef JCS_EXTENSIONS
+	/* Let libjpeg-turbo write x8r8g8b8 directly, the filler byte
+	 * is set to 0xff. */
+#if __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+	cinfo.out_color_space = JCS_EXT_XRGB;
+#else
+	cinfo.out_color_space = JCS_EXT_BGRX;
+#endif
+#else
 	cinfo.out_color_space = JCS_RGB;
+#endif
 	jpeg_start_decompress(&cinfo);
 
 	stride = cinfo.output_width * 4;
@@ -111,8 +137,10 @@ load_jpeg(FILE *fp)
 			rows[i] = data + (first + i) * stride;
 
 		jpeg_read_scanlines(&cinfo, rows, ARRAY_LENGTH(rows));
+#ifndef JCS_EXTENSIONS
 		for (i = 0; first + i < cinfo.output_scanline; i++)
 			swizzle_row(rows[i], cinfo.output_width);
+#endif
 	}
 
 	jpeg_finish_decompress(&cinfo);
@@ -130,43 +158,78 @@ load_jpeg(FILE *fp)
 	return pixman_image;
 }
 
-static inline int
-multiply_alpha(int alpha, int color)
+/* Computes alpha * color / 255, rounded, for the two channels in the
+ * 0x00ff00ff lanes of rb at once.  Neither lane can carry into the
+ * other. */
+static inline uint32_t
+multiply_alpha_x2(uint32_t alpha, uint32_t rb)
 {
-    int temp = (alpha * color) + 0x80;
+	uint32_t temp = rb * alpha + 0x00800080;
 
-    return ((temp + (temp >> 8)) >> 8);
+	return ((temp + ((temp >> 8) & 0x00ff00ff)) >> 8) & 0x00ff00ff;
 }
 
+#ifdef __SSE2__
+/* Premultiplies and swizzles four r8g8b8a8 pixels into a8r8g8b8. */
+static inline void
+premultiply_sse2(uint8_t *p)
+{
+	const __m128i zero = _mm_setzero_si128();
+	const __m128i round = _mm_set1_epi16(0x80);
+	/* keeps alpha itself by multiplying it with 0xff */
+	const __m128i alpha_mask = _mm_set_epi16(0xff, 0, 0, 0,
+						 0xff, 0, 0, 0);
+	__m128i in, lo, hi, alo, ahi;
+
+	in = _mm_loadu_si128((const __m128i *) p);
+	lo = _mm_unpacklo_epi8(in, zero);
+	hi = _mm_unpackhi_epi8(in, zero);
+
+	/* r g b a -> b g r a */
+	lo = _mm_shufflelo_epi16(lo, _MM_SHUFFLE(3, 0, 1, 2));
+	lo = _mm_shufflehi_epi16(lo, _MM_SHUFFLE(3, 0, 1, 2));
+	hi = _mm_shufflelo_epi16(hi, _MM_SHUFFLE(3, 0, 1, 2));
+	hi = _mm_shufflehi_epi16(hi, _MM_SHUFFLE(3, 0, 1, 2));
+
+	alo = _mm_shufflelo_epi16(lo, _MM_SHUFFLE(3, 3, 3, 3));
+	alo = _mm_shufflehi_epi16(alo, _MM_SHUFFLE(3, 3, 3, 3));
+	ahi = _mm_shufflelo_epi16(hi, _MM_SHUFFLE(3, 3, 3, 3));
+	ahi = _mm_shufflehi_epi16(ahi, _MM_SHUFFLE(3, 3, 3, 3));
+	alo = _mm_or_si128(_mm_andnot_si128(alpha_mask, alo), alpha_mask);
+	ahi = _mm_or_si128(_mm_andnot_si128(alpha_mask, ahi), alpha_mask);
+
+	lo = _mm_add_epi16(_mm_mullo_epi16(lo, alo), round);
+	hi = _mm_add_epi16(_mm_mullo_epi16(hi, ahi), round);
+	lo = _mm_srli_epi16(_mm_add_epi16(lo, _mm_srli_epi16(lo, 8)), 8);
+	hi = _mm_srli_epi16(_mm_add_epi16(hi, _mm_srli_epi16(hi, 8)), 8);
+
+	_mm_storeu_si128((__m128i *) p, _mm_packus_epi16(lo, hi));
+}
+#endif
+
 static void
 premultiply_data(png_structp   png,
 		 png_row_infop row_info,
 		 png_bytep     data)
 {
-    unsigned int i;
-    png_bytep p;
+	png_size_t i = 0;
+	png_bytep p;
+	uint32_t alpha;
+
+#ifdef __SSE2__
+	/* The vector path stores bytes, so this only holds on
+	 * little-endian, which is all SSE2 ever runs on. */
+	for (; i + 16 <= row_info->rowbytes; i += 16)
+		premultiply_sse2(data + i);
+#endif
 
-    for (i = 0, p = data; i < row_info->rowbytes; i += 4, p += 4) {
-	png_byte  alpha = p[3];
-	uint32_t w;
+	for (p = data + i; i < row_info->rowbytes; i += 4, p += 4) {
+		alpha = p[3];
 
-	if (alpha == 0) {
-		w = 0;
-	} else {
-		png_byte red   = p[0];
-		png_byte green = p[1];
-		png_byte blue  = p[2];
-
-		if (alpha != 0xff) {
-			red   = multiply_alpha(alpha, red);
-			green = multiply_alpha(alpha, green);
-			blue  = multiply_alpha(alpha, blue);
-		}
-		w = (alpha << 24) | (red << 16) | (green << 8) | (blue << 0);
+		* (uint32_t *) p = (alpha << 24) |
+			multiply_alpha_x2(alpha, (p[0] << 16) | p[2]) |
+			(multiply_alpha_x2(alpha, p[1]) << 8);
 	}
-
-	* (uint32_t *) p = w;
-    }
 }
 
 static void
@@ -367,11 +430,313 @@ static const struct image_loader loaders[] = {
 #endif
 };
 
+/*
+ * Decoded images are cached premultiplied in
+ * $XDG_CACHE_HOME/weston/images, one file per image named after a hash
+ * of its real path.  The header records the path, mtime and size of the
+ * source, and a hit is just a matter of mapping the pixels.
+ *
+ * The mtime of a cache file itself is bumped on every hit, and each
+ * store evicts the least recently used files until the directory is
+ * back under IMAGE_CACHE_MAX_ENTRIES and IMAGE_CACHE_MAX_BYTES.
+ */
+#define IMAGE_CACHE_MAGIC	0x31434957	/* "WIC1" */
+#define IMAGE_CACHE_MAX_ENTRIES	64
+#define IMAGE_CACHE_MAX_BYTES	(256LL * 1024 * 1024)
+#define IMAGE_CACHE_NAME_LENGTH	16
+
+struct image_cache_header {
+	uint32_t magic;
+	uint32_t data_offset;
+	int64_t mtime_sec;
+	int64_t mtime_nsec;
+	int64_t size;
+	int32_t width;
+	int32_t height;
+	int32_t stride;
+	uint32_t path_length;
+	/* followed by the path, and the pixels at data_offset */
+};
+
+struct image_cache {
+	char *real_path;
+	char path[PATH_MAX];
+	struct stat st;
+};
+
+static int
+image_cache_init(struct image_cache *cache, const char *filename, int fd)
+{
+	const char *cache_home = getenv("XDG_CACHE_HOME");
+	const char *home_dir = getenv("HOME");
+	uint64_t hash = 0xcbf29ce484222325ULL;
+	const char *p;
+	int len;
+
+	if (fstat(fd, &cache->st) < 0 || !S_ISREG(cache->st.st_mode))
+		return -1;
+
+	cache->real_path = realpath(filename, NULL);
+	if (!cache->real_path)
+		return -1;
+
+	/* FNV-1a */
+	for (p = cache->real_path; *p; p++) {
+		hash ^= (unsigned char) *p;
+		hash *= 0x100000001b3ULL;
+	}
+
+	if (cache_home)
+		len = snprintf(cache->path, sizeof cache->path,
+			       "%s/weston/images/%016llx", cache_home,
+			       (unsigned long long) hash);
+	else if (home_dir)
+		len = snprintf(cache->path, sizeof cache->path,
+			       "%s/.cache/weston/images/%016llx", home_dir,
+			       (unsigned long long) hash);
+	else
+		len = -1;
+
+	if (len < 0 || len >= (int) sizeof cache->path) {
+		free(cache->real_path);
+		return -1;
+	}
+
+	return 0;
+}
+
+static void
+image_cache_release(struct image_cache *cache)
+{
+	free(cache->real_path);
+}
+
+static void
+image_cache_destroy_func(pixman_image_t *image, void *data)
+{
+	struct image_cache_header *header = data;
+
+	munmap(data, header->data_offset +
+	       (size_t) header->stride * header->height);
+}
+
+static pixman_image_t *
+image_cache_load(struct image_cache *cache)
+{
+	struct image_cache_header *header;
+	pixman_image_t *image;
+	struct stat st;
+	size_t length;
+	void *map;
+	int fd;
+
+	fd = open(cache->path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		return NULL;
+
+	if (fstat(fd, &st) < 0 || st.st_size < (off_t) sizeof *header) {
+		close(fd);
+		return NULL;
+	}
+
+	/* Private and writable, since the pixels are handed out
+	 * like any other decoded image. */
+	length = st.st_size;
+	map = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+	close(fd);
+	if (map == MAP_FAILED)
+		return NULL;
+
+	header = map;
+	if (header->magic != IMAGE_CACHE_MAGIC ||
+	    header->mtime_sec != cache->st.st_mtim.tv_sec ||
+	    header->mtime_nsec != cache->st.st_mtim.tv_nsec ||
+	    header->size != cache->st.st_size ||
+	    header->width <= 0 || header->height <= 0 ||
+	    header->stride < stride_for_width(header->width) ||
+	    header->path_length != strlen(cache->real_path) ||
+	    sizeof *header + header->path_length > header->data_offset ||
+	    header->data_offset +
+	    (size_t) header->stride * header->height != length ||
+	    memcmp(header + 1, cache->real_path, header->path_length) != 0) {
+		munmap(map, length);
+		return NULL;
+	}
+
+	image = pixman_image_create_bits(PIXMAN_a8r8g8b8,
+					 header->width, header->height,
+					 (uint32_t *) ((char *) map +
+						       header->data_offset),
+					 header->stride);
+	if (!image) {
+		munmap(map, length);
+		return NULL;
+	}
+
+	pixman_image_set_destroy_function(image,
+					  image_cache_destroy_func, map);
+
+	/* mark it recently used, best effort */
+	utimensat(AT_FDCWD, cache->path, NULL, 0);
+
+	return image;
+}
+
+struct image_cache_entry {
+	char name[IMAGE_CACHE_NAME_LENGTH + 1];
+	struct timespec mtime;
+	off_t size;
+};
+
+static int
+image_cache_entry_compare(const void *a, const void *b)
+{
+	const struct image_cache_entry *ea = a, *eb = b;
+
+	if (ea->mtime.tv_sec != eb->mtime.tv_sec)
+		return ea->mtime.tv_sec < eb->mtime.tv_sec ? -1 : 1;
+	if (ea->mtime.tv_nsec != eb->mtime.tv_nsec)
+		return ea->mtime.tv_nsec < eb->mtime.tv_nsec ? -1 : 1;
+
+	return 0;
+}
+
+static int
+is_cache_name(const char *name)
+{
+	return strlen(name) == IMAGE_CACHE_NAME_LENGTH &&
+		strspn(name, "0123456789abcdef") == IMAGE_CACHE_NAME_LENGTH;
+}
+
+/*
+ * Evict the least recently used cache files while the cache directory
+ * is over its entry or byte budget.  Other loaders may be storing and
+ * pruning concurrently; losing a race only means an unlink fails.
+ */
+static void
+image_cache_prune(struct image_cache *cache)
+{
+	struct image_cache_entry *entries = NULL, *e;
+	int count = 0, alloc = 0, i, dir_fd;
+	long long total = 0;
+	char dir[PATH_MAX], *p;
+	struct dirent *de;
+	struct stat st;
+	DIR *d;
+
+	snprintf(dir, sizeof dir, "%s", cache->path);
+	p = strrchr(dir, '/');
+	if (!p)
+		return;
+	*p = '\0';
+
+	d = opendir(dir);
+	if (!d)
+		return;
+	dir_fd = dirfd(d);
+
+	while ((de = readdir(d))) {
+		if (!is_cache_name(de->d_name))
+			continue;
+		if (fstatat(dir_fd, de->d_name, &st,
+			    AT_SYMLINK_NOFOLLOW) < 0 || !S_ISREG(st.st_mode))
+			continue;
+
+		if (count == alloc) {
+			alloc = alloc ? alloc * 2 : 64;
+			e = realloc(entries, alloc * sizeof *e);
+			if (!e)
+				goto out;
+			entries = e;
+		}
+
+		e = &entries[count++];
+		memcpy(e->name, de->d_name, sizeof e->name);
+		e->mtime = st.st_mtim;
+		e->size = st.st_size;
+		total += st.st_size;
+	}
+
+	if (count <= IMAGE_CACHE_MAX_ENTRIES && total <= IMAGE_CACHE_MAX_BYTES)
+		goto out;
+
+	qsort(entries, count, sizeof *entries, image_cache_entry_compare);
+
+	for (i = 0; i < count; i++) {
+		if (count - i <= IMAGE_CACHE_MAX_ENTRIES &&
+		    total <= IMAGE_CACHE_MAX_BYTES)
+			break;
+		unlinkat(dir_fd, entries[i].name, 0);
+		total -= entries[i].size;
+	}
+
+out:
+	free(entries);
+	closedir(d);
+}
+
+static void
+image_cache_store(struct image_cache *cache, pixman_image_t *image)
+{
+	static const char pad[64];
+	struct image_cache_header header;
+	char tmp[PATH_MAX + 8];
+	char *p;
+	int fd, ret;
+
+	memset(&header, 0, sizeof header);
+	header.magic = IMAGE_CACHE_MAGIC;
+	header.mtime_sec = cache->st.st_mtim.tv_sec;
+	header.mtime_nsec = cache->st.st_mtim.tv_nsec;
+	header.size = cache->st.st_size;
+	header.width = pixman_image_get_width(image);
+	header.height = pixman_image_get_height(image);
+	header.stride = pixman_image_get_stride(image);
+	header.path_length = strlen(cache->real_path);
+	header.data_offset = (sizeof header + header.path_length +
+			      sizeof pad - 1) & ~(sizeof pad - 1);
+
+	/* create the directories leading up to the cache file */
+	snprintf(tmp, sizeof tmp, "%s", cache->path);
+	for (p = strchr(tmp + 1, '/'); p; p = strchr(p + 1, '/')) {
+		*p = '\0';
+		mkdir(tmp, 0700);
+		*p = '/';
+	}
+
+	/* written aside and renamed, so readers never see half a file */
+	snprintf(tmp, sizeof tmp, "%s.XXXXXX", cache->path);
+	fd = mkostemp(tmp, O_CLOEXEC);
+	if (fd < 0)
+		return;
+
+	ret = os_write_all(fd, &header, sizeof header);
+	if (ret == 0)
+		ret = os_write_all(fd, cache->real_path, header.path_length);
+	if (ret == 0)
+		ret = os_write_all(fd, pad, header.data_offset -
+				   sizeof header - header.path_length);
+	if (ret == 0)
+		ret = os_write_all(fd, pixman_image_get_data(image),
+				   (size_t) header.stride * header.height);
+	if (close(fd) < 0)
+		ret = -1;
+
+	if (ret < 0 || rename(tmp, cache->path) < 0) {
+		unlink(tmp);
+		return;
+	}
+
+	image_cache_prune(cache);
+}
+
 pixman_image_t *
 load_image(const char *filename)
 {
 	pixman_image_t *image;
 	unsigned char header[4];
+	struct image_cache cache;
+	int cached;
 	FILE *fp;
 	unsigned int i;
 
@@ -384,7 +749,19 @@ load_image(const char *filename)
 		return NULL;
 	}
 
+	cached = image_cache_init(&cache, filename, fileno(fp)) == 0;
+	if (cached) {
+		image = image_cache_load(&cache);
+		if (image) {
+			image_cache_release(&cache);
+			fclose(fp);
+			return image;
+		}
+	}
+
 	if (fread(header, sizeof header, 1, fp) != 1) {
+		if (cached)
+			image_cache_release(&cache);
 		fclose(fp);
 		fprintf(stderr, "%s: unable to read file header\n", filename);
 		return NULL;
@@ -411,5 +788,263 @@ load_image(const char *filename)
 		fprintf(stderr, "%s: error reading image\n", filename);
 	}
 
+	if (cached) {
+		if (image)
+			image_cache_store(&cache, image);
+		image_cache_release(&cache);
+	}
+
 	return image;
 }
+
+struct image_load_job {
+	char *filename;
+	image_load_func_t func;
+	void *data;
+	pixman_image_t *image;
+	struct image_load_job *next;
+};
+
+struct image_load_queue {
+	pthread_mutex_t mutex;
+	pthread_cond_t work_cond;
+	pthread_cond_t done_cond;
+
+	pthread_t *threads;
+	int thread_count;
+	int max_threads;
+	int idle_threads;
+	int running;
+	int stopping;
+
+	/* FIFOs of jobs waiting for a thread, and decoded jobs
+	 * waiting for image_load_queue_dispatch() */
+	struct image_load_job *pending, **pending_tail;
+	int pending_count;
+	struct image_load_job *done, **done_tail;
+
+	int fd;
+};
+
+/* Called with the mutex held. */
+static void
+image_load_queue_finish(struct image_load_queue *queue,
+			struct image_load_job *job)
+{
+	uint64_t one = 1;
+
+	job->next = NULL;
+	*queue->done_tail = job;
+	queue->done_tail = &job->next;
+
+	pthread_cond_broadcast(&queue->done_cond);
+	if (write(queue->fd, &one, sizeof one) < 0 && errno != EAGAIN)
+		fprintf(stderr, "image load queue: %m\n");
+}
+
+static void *
+image_load_worker(void *data)
+{
+	struct image_load_queue *queue = data;
+	struct image_load_job *job;
+
+	pthread_mutex_lock(&queue->mutex);
+	while (1) {
+		while (!queue->pending && !queue->stopping) {
+			queue->idle_threads++;
+			pthread_cond_wait(&queue->work_cond, &queue->mutex);
+			queue->idle_threads--;
+		}
+
+		if (queue->stopping)
+			break;
+
+		job = queue->pending;
+		queue->pending = job->next;
+		if (!queue->pending)
+			queue->pending_tail = &queue->pending;
+		queue->pending_count--;
+		queue->running++;
+		pthread_mutex_unlock(&queue->mutex);
+
+		job->image = load_image(job->filename);
+
+		pthread_mutex_lock(&queue->mutex);
+		queue->running--;
+		image_load_queue_finish(queue, job);
+	}
+	pthread_mutex_unlock(&queue->mutex);
+
+	return NULL;
+}
+
+struct image_load_queue *
+image_load_queue_create(int max_threads)
+{
+	struct image_load_queue *queue;
+	long cpus;
+
+	if (max_threads <= 0) {
+		cpus = sysconf(_SC_NPROCESSORS_ONLN);
+		max_threads = cpus > 0 ? cpus : 1;
+	}
+
+	queue = calloc(1, sizeof *queue);
+	if (!queue)
+		return NULL;
+
+	queue->threads = calloc(max_threads, sizeof queue->threads[0]);
+	if (!queue->threads) {
+		free(queue);
+		return NULL;
+	}
+
+	queue->fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (queue->fd < 0) {
+		free(queue->threads);
+		free(queue);
+		return NULL;
+	}
+
+	pthread_mutex_init(&queue->mutex, NULL);
+	pthread_cond_init(&queue->work_cond, NULL);
+	pthread_cond_init(&queue->done_cond, NULL);
+	queue->max_threads = max_threads;
+	queue->pending_tail = &queue->pending;
+	queue->done_tail = &queue->done;
+
+	return queue;
+}
+
+static void
+image_load_job_destroy(struct image_load_job *job)
+{
+	if (job->image)
+		pixman_image_unref(job->image);
+	free(job->filename);
+	free(job);
+}
+
+void
+image_load_queue_destroy(struct image_load_queue *queue)
+{
+	struct image_load_job *job, *next;
+	int i;
+
+	pthread_mutex_lock(&queue->mutex);
+	queue->stopping = 1;
+	pthread_cond_broadcast(&queue->work_cond);
+	pthread_mutex_unlock(&queue->mutex);
+
+	for (i = 0; i < queue->thread_count; i++)
+		pthread_join(queue->threads[i], NULL);
+
+	for (job = queue->pending; job; job = next) {
+		next = job->next;
+		image_load_job_destroy(job);
+	}
+
+	for (job = queue->done; job; job = next) {
+		next = job->next;
+		image_load_job_destroy(job);
+	}
+
+	close(queue->fd);
+	pthread_cond_destroy(&queue->done_cond);
+	pthread_cond_destroy(&queue->work_cond);
+	pthread_mutex_destroy(&queue->mutex);
+	free(queue->threads);
+	free(queue);
+}
+
+int
+image_load_queue_get_fd(struct image_load_queue *queue)
+{
+	return queue->fd;
+}
+
+int
+image_load_queue_add(struct image_load_queue *queue, const char *filename,
+		     image_load_func_t func, void *data)
+{
+	struct image_load_job *job;
+	pthread_t *thread;
+
+	job = calloc(1, sizeof *job);
+	if (!job)
+		return -1;
+
+	job->filename = strdup(filename ? filename : "");
+	if (!job->filename) {
+		free(job);
+		return -1;
+	}
+	job->func = func;
+	job->data = data;
+
+	pthread_mutex_lock(&queue->mutex);
+
+	/* Start threads lazily, as long as jobs would otherwise wait. */
+	if (queue->pending_count >= queue->idle_threads &&
+	    queue->thread_count < queue->max_threads) {
+		thread = &queue->threads[queue->thread_count];
+		if (pthread_create(thread, NULL,
+				   image_load_worker, queue) == 0)
+			queue->thread_count++;
+	}
+
+	if (queue->thread_count == 0) {
+		/* no thread to hand it to, so decode it right here */
+		pthread_mutex_unlock(&queue->mutex);
+		job->image = load_image(job->filename);
+		pthread_mutex_lock(&queue->mutex);
+		image_load_queue_finish(queue, job);
+	} else {
+		*queue->pending_tail = job;
+		queue->pending_tail = &job->next;
+		queue->pending_count++;
+		pthread_cond_signal(&queue->work_cond);
+	}
+
+	pthread_mutex_unlock(&queue->mutex);
+
+	return 0;
+}
+
+int
+image_load_queue_dispatch(struct image_load_queue *queue)
+{
+	struct image_load_job *job, *next;
+	uint64_t count;
+	int n = 0;
+
+	if (read(queue->fd, &count, sizeof count) < 0 && errno != EAGAIN)
+		fprintf(stderr, "image load queue: %m\n");
+
+	pthread_mutex_lock(&queue->mutex);
+	job = queue->done;
+	queue->done = NULL;
+	queue->done_tail = &queue->done;
+	pthread_mutex_unlock(&queue->mutex);
+
+	for (; job; job = next) {
+		next = job->next;
+		job->func(job->image, job->filename, job->data);
+		job->image = NULL;
+		image_load_job_destroy(job);
+		n++;
+	}
+
+	return n;
+}
+
+void
+image_load_queue_wait(struct image_load_queue *queue)
+{
+	do {
+		pthread_mutex_lock(&queue->mutex);
+		while (queue->pending || queue->running > 0)
+			pthread_cond_wait(&queue->done_cond, &queue->mutex);
+		pthread_mutex_unlock(&queue->mutex);
+	} while (image_load_queue_dispatch(queue) > 0);
+}
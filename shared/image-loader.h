@@ -28,4 +28,33 @@
 pixman_image_t *
 load_image(const char *filename);
 
+/* Decodes images on worker threads.  The callback runs from
+ * image_load_queue_dispatch() and owns the image, which is NULL if
+ * loading failed. */
+struct image_load_queue;
+
+typedef void (*image_load_func_t)(pixman_image_t *image,
+				  const char *filename, void *data);
+
+struct image_load_queue *
+image_load_queue_create(int max_threads);
+
+void
+image_load_queue_destroy(struct image_load_queue *queue);
+
+/* Readable whenever loads have completed. */
+int
+image_load_queue_get_fd(struct image_load_queue *queue);
+
+int
+image_load_queue_add(struct image_load_queue *queue, const char *filename,
+		     image_load_func_t func, void *data);
+
+int
+image_load_queue_dispatch(struct image_load_queue *queue);
+
+/* Blocks until every added image is loaded and dispatched. */
+void
+image_load_queue_wait(struct image_load_queue *queue);
+
 #endif
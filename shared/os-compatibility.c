@@ -186,6 +186,33 @@ os_create_anonymous_file(off_t size)
 	return fd;
 }
 
+/*
+ * Write the whole buffer, retrying short writes and EINTR.
+ * Returns 0 on success, -1 on error with errno set.
+ */
+int
+os_write_all(int fd, const void *data, size_t size)
+{
+	const char *p = data;
+	ssize_t len;
+
+	while (size > 0) {
+		len = write(fd, p, size);
+		if (len < 0 && errno == EINTR)
+			continue;
+		if (len < 0)
+			return -1;
+		if (len == 0) {
+			errno = EIO;
+			return -1;
+		}
+		p += len;
+		size -= len;
+	}
+
+	return 0;
+}
+
 #ifndef HAVE_STRCHRNUL
 char *
 strchrnul(const char *s, int c)
@@ -25,6 +25,7 @@
 #include <stdlib.h>
 
 #include "compositor.h"
+#include "../shared/hash.h"
 
 struct weston_binding {
 	uint32_t key;
@@ -34,8 +35,103 @@ struct weston_binding {
 	void *handler;
 	void *data;
 	struct wl_list link;
+	struct wl_list index_link;
 };
 
+/* Key, button, axis and modifier bindings are also indexed by kind,
+ * code and modifiers, so that dispatching an event only looks at the
+ * bindings that can match it instead of walking every binding. */
+enum binding_kind {
+	BINDING_KEY,
+	BINDING_BUTTON,
+	BINDING_AXIS,
+	BINDING_MODIFIER
+};
+
+/* The bindings sharing an index key, in the order they were added.
+ * Chains stay in the index once created, so a handler can destroy
+ * bindings while its chain is being dispatched. */
+struct binding_chain {
+	struct wl_list bindings;
+};
+
+static uint32_t
+binding_index_key(enum binding_kind kind, uint32_t code, uint32_t modifier)
+{
+	/* Exact for codes below 2^24 and the four modifier bits; anything
+	 * else only shares a chain, as bindings are compared on dispatch. */
+	return (uint32_t) kind << 28 | (modifier & 0xf) << 24 |
+		(code & 0xffffff);
+}
+
+static struct binding_chain *
+binding_chain_lookup(struct weston_compositor *compositor,
+		     enum binding_kind kind, uint32_t code, uint32_t modifier)
+{
+	if (compositor->binding_index == NULL)
+		return NULL;
+
+	return hash_table_lookup(compositor->binding_index,
+				 binding_index_key(kind, code, modifier));
+}
+
+static int
+binding_index_add(struct weston_compositor *compositor,
+		  struct weston_binding *binding,
+		  enum binding_kind kind, uint32_t code)
+{
+	struct binding_chain *chain;
+	uint32_t key;
+
+	if (compositor->binding_index == NULL) {
+		compositor->binding_index = hash_table_create();
+		if (compositor->binding_index == NULL)
+			return -1;
+	}
+
+	key = binding_index_key(kind, code, binding->modifier);
+	chain = hash_table_lookup(compositor->binding_index, key);
+	if (chain == NULL) {
+		chain = malloc(sizeof *chain);
+		if (chain == NULL)
+			return -1;
+		wl_list_init(&chain->bindings);
+		if (hash_table_insert(compositor->binding_index,
+				      key, chain) < 0) {
+			free(chain);
+			return -1;
+		}
+	}
+
+	wl_list_insert(chain->bindings.prev, &binding->index_link);
+
+	return 0;
+}
+
+static void
+binding_chain_destroy(void *element, void *data)
+{
+	struct binding_chain *chain = element;
+	struct weston_binding *binding, *tmp;
+
+	/* Bindings outliving the index unlink cleanly. */
+	wl_list_for_each_safe(binding, tmp, &chain->bindings, index_link)
+		wl_list_init(&binding->index_link);
+	free(chain);
+}
+
+void
+weston_compositor_destroy_binding_index(struct weston_compositor *compositor)
+{
+	if (compositor->binding_index == NULL)
+		return;
+
+	hash_table_for_each(compositor->binding_index,
+			    binding_chain_destroy, NULL);
+	hash_table_destroy(compositor->binding_index);
+	compositor->binding_index = NULL;
+}
+
 static struct weston_binding *
 weston_compositor_add_binding(struct weston_compositor *compositor,
 			      uint32_t key, uint32_t button, uint32_t axis,
@@ -53,6 +149,7 @@ weston_compositor_add_binding(struct weston_compositor *compositor,
 	binding->modifier = modifier;
 	binding->handler = handler;
 	binding->data = data;
+	wl_list_init(&binding->index_link);
 
 	return binding;
 }
@@ -70,6 +167,11 @@ weston_compositor_add_key_binding(struct weston_compositor *compositor,
 	if (binding == NULL)
 		return NULL;
 
+	if (binding_index_add(compositor, binding, BINDING_KEY, key) < 0) {
+		free(binding);
+		return NULL;
+	}
+
 	wl_list_insert(compositor->key_binding_list.prev, &binding->link);
 
 	return binding;
@@ -88,6 +190,11 @@ weston_compositor_add_modifier_binding(struct weston_compositor *compositor,
 	if (binding == NULL)
 		return NULL;
 
+	if (binding_index_add(compositor, binding, BINDING_MODIFIER, 0) < 0) {
+		free(binding);
+		return NULL;
+	}
+
 	wl_list_insert(compositor->modifier_binding_list.prev, &binding->link);
 
 	return binding;
@@ -106,6 +213,11 @@ weston_compositor_add_button_binding(struct weston_compositor *compositor,
 	if (binding == NULL)
 		return NULL;
 
+	if (binding_index_add(compositor, binding, BINDING_BUTTON, button) < 0) {
+		free(binding);
+		return NULL;
+	}
+
 	wl_list_insert(compositor->button_binding_list.prev, &binding->link);
 
 	return binding;
@@ -142,6 +254,11 @@ weston_compositor_add_axis_binding(struct weston_compositor *compositor,
 	if (binding == NULL)
 		return NULL;
 
+	if (binding_index_add(compositor, binding, BINDING_AXIS, axis) < 0) {
+		free(binding);
+		return NULL;
+	}
+
 	wl_list_insert(compositor->axis_binding_list.prev, &binding->link);
 
 	return binding;
@@ -167,6 +284,7 @@ WL_EXPORT void
 weston_binding_destroy(struct weston_binding *binding)
 {
 	wl_list_remove(&binding->link);
+	wl_list_remove(&binding->index_link);
 	free(binding);
 }
 
@@ -281,6 +399,7 @@ weston_compositor_run_key_binding(struct weston_compositor *compositor,
 {
 	struct weston_binding *b, *tmp;
 	struct weston_surface *focus;
+	struct binding_chain *chain;
 
 	if (state == WL_KEYBOARD_KEY_STATE_RELEASED)
 		return;
@@ -289,7 +408,12 @@ weston_compositor_run_key_binding(struct weston_compositor *compositor,
 	wl_list_for_each(b, &compositor->modifier_binding_list, link)
 		b->key = key;
 
-	wl_list_for_each_safe(b, tmp, &compositor->key_binding_list, link) {
+	chain = binding_chain_lookup(compositor, BINDING_KEY,
+				     key, seat->modifier_state);
+	if (chain == NULL)
+		return;
+
+	wl_list_for_each_safe(b, tmp, &chain->bindings, index_link) {
 		if (b->key == key && b->modifier == seat->modifier_state) {
 			weston_key_binding_handler_t handler = b->handler;
 			focus = seat->keyboard->focus;
@@ -312,11 +436,16 @@ weston_compositor_run_modifier_binding(struct weston_compositor *compositor,
 				       enum wl_keyboard_key_state state)
 {
 	struct weston_binding *b, *tmp;
+	struct binding_chain *chain;
 
 	if (seat->keyboard->grab != &seat->keyboard->default_grab)
 		return;
 
-	wl_list_for_each_safe(b, tmp, &compositor->modifier_binding_list, link) {
+	chain = binding_chain_lookup(compositor, BINDING_MODIFIER, 0, modifier);
+	if (chain == NULL)
+		return;
+
+	wl_list_for_each_safe(b, tmp, &chain->bindings, index_link) {
 		weston_modifier_binding_handler_t handler = b->handler;
 
 		if (b->modifier != modifier)
@@ -343,6 +472,7 @@ weston_compositor_run_button_binding(struct weston_compositor *compositor,
 				     enum wl_pointer_button_state state)
 {
 	struct weston_binding *b, *tmp;
+	struct binding_chain *chain;
 
 	if (state == WL_POINTER_BUTTON_STATE_RELEASED)
 		return;
@@ -351,7 +481,12 @@ weston_compositor_run_button_binding(struct weston_compositor *compositor,
 	wl_list_for_each(b, &compositor->modifier_binding_list, link)
 		b->key = button;
 
-	wl_list_for_each_safe(b, tmp, &compositor->button_binding_list, link) {
+	chain = binding_chain_lookup(compositor, BINDING_BUTTON,
+				     button, seat->modifier_state);
+	if (chain == NULL)
+		return;
+
+	wl_list_for_each_safe(b, tmp, &chain->bindings, index_link) {
 		if (b->button == button && b->modifier == seat->modifier_state) {
 			weston_button_binding_handler_t handler = b->handler;
 			handler(seat, time, button, b->data);
@@ -384,12 +519,18 @@ weston_compositor_run_axis_binding(struct weston_compositor *compositor,
 				   wl_fixed_t value)
 {
 	struct weston_binding *b, *tmp;
+	struct binding_chain *chain;
 
 	/* Invalidate all active modifier bindings. */
 	wl_list_for_each(b, &compositor->modifier_binding_list, link)
 		b->key = axis;
 
-	wl_list_for_each_safe(b, tmp, &compositor->axis_binding_list, link) {
+	chain = binding_chain_lookup(compositor, BINDING_AXIS,
+				     axis, seat->modifier_state);
+	if (chain == NULL)
+		return 0;
+
+	wl_list_for_each_safe(b, tmp, &chain->bindings, index_link) {
 		if (b->axis == axis && b->modifier == seat->modifier_state) {
 			weston_axis_binding_handler_t handler = b->handler;
 			handler(seat, time, axis, value, b->data);
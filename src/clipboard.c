@@ -24,16 +24,27 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
 #include <linux/input.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <sys/uio.h>
+#include <sys/sendfile.h>
 
 #include "compositor.h"
+#include "../shared/os-compatibility.h"
+
+/* The clipboard contents are kept in an anonymous file rather than on
+ * the compositor heap, and are moved in and out of it with splice() and
+ * sendfile() so the data never has to be copied through user space.
+ * Each wakeup moves at most one chunk so that a large selection can't
+ * stall the compositor. */
+#define CLIPBOARD_CHUNK_SIZE (64 * 1024)
 
 struct clipboard_source {
 	struct weston_data_source base;
-	struct wl_array contents;
+	int contents_fd;
+	off_t size;
 	struct clipboard *clipboard;
 	struct wl_event_source *event_source;
 	uint32_t serial;
@@ -68,7 +79,7 @@ clipboard_source_unref(struct clipboard_source *source)
 	s = source->base.mime_types.data;
 	free(*s);
 	wl_array_release(&source->base.mime_types);
-	wl_array_release(&source->contents);
+	close(source->contents_fd);
 	free(source);
 }
 
@@ -77,17 +88,24 @@ clipboard_source_data(int fd, uint32_t mask, void *data)
 {
 	struct clipboard_source *source = data;
 	struct clipboard *clipboard = source->clipboard;
-	char *p;
-	int len, size;
-
-	if (source->contents.alloc - source->contents.size < 1024) {
-		wl_array_add(&source->contents, 1024);
-		source->contents.size -= 1024;
+	char buffer[4096];
+	loff_t offset = source->size;
+	ssize_t len;
+
+	len = splice(fd, NULL, source->contents_fd, &offset,
+		     CLIPBOARD_CHUNK_SIZE, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+	if (len == -1 && errno == EINVAL) {
+		/* The file system doesn't support splice, bounce the
+		 * data through a small buffer instead. */
+		len = read(fd, buffer, sizeof buffer);
+		if (len > 0 &&
+		    pwrite(source->contents_fd, buffer, len, source->size) != len)
+			len = -1;
 	}
 
-	p = source->contents.data + source->contents.size;
-	size = source->contents.alloc - source->contents.size;
-	len = read(fd, p, size);
+	if (len == -1 && errno == EAGAIN)
+		return 1;
+
 	if (len == 0) {
 		wl_event_source_remove(source->event_source);
 		close(fd);
@@ -96,7 +114,7 @@ clipboard_source_data(int fd, uint32_t mask, void *data)
 		clipboard_source_unref(source);
 		clipboard->source = NULL;
 	} else {
-		source->contents.size += len;
+		source->size += len;
 	}
 
 	return 1;
@@ -141,7 +159,13 @@ clipboard_source_create(struct clipboard *clipboard,
 	if (source == NULL)
 		return NULL;
 
-	wl_array_init(&source->contents);
+	/* posix_fallocate() rejects a zero size, so start out with room
+	 * for one chunk; the file grows as the data arrives. */
+	source->contents_fd = os_create_anonymous_file(CLIPBOARD_CHUNK_SIZE);
+	if (source->contents_fd < 0)
+		goto err_file;
+	source->size = 0;
+
 	wl_array_init(&source->base.mime_types);
 	source->base.resource = NULL;
 	source->base.accept = clipboard_source_accept;
@@ -172,6 +196,8 @@ clipboard_source_create(struct clipboard *clipboard,
  err_strdup:
 	wl_array_release(&source->base.mime_types);
  err_add:
+	close(source->contents_fd);
+ err_file:
 	free(source);
 
 	return NULL;
@@ -187,13 +213,29 @@ static int
 clipboard_client_data(int fd, uint32_t mask, void *data)
 {
 	struct clipboard_client *client = data;
-	char *p;
-	size_t size;
-	int len;
+	struct clipboard_source *source = client->source;
+	char buffer[4096];
+	off_t offset = client->offset;
+	size_t size, count;
+	ssize_t len;
+
+	size = source->size;
+	count = size - client->offset;
+	if (count > CLIPBOARD_CHUNK_SIZE)
+		count = CLIPBOARD_CHUNK_SIZE;
+
+	len = sendfile(fd, source->contents_fd, &offset, count);
+	if (len == -1 && (errno == EINVAL || errno == ENOSYS)) {
+		if (count > sizeof buffer)
+			count = sizeof buffer;
+		len = pread(source->contents_fd, buffer, count, client->offset);
+		if (len > 0)
+			len = write(fd, buffer, len);
+	}
+
+	if (len == -1 && errno == EAGAIN)
+		return 1;
 
-	size = client->source->contents.size;
-	p = client->source->contents.data;
-	len = write(fd, p + client->offset, size - client->offset);
 	if (len > 0)
 		client->offset += len;
 
@@ -219,6 +261,8 @@ clipboard_client_create(struct clipboard_source *source, int fd)
 	if (client == NULL)
 		return;
 
+	fcntl(fd, F_SETFL, O_WRONLY | O_NONBLOCK);
+
 	client->source = source;
 	source->refcount++;
 	client->event_source =
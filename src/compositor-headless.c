@@ -42,6 +42,7 @@ struct headless_output {
 	struct weston_output base;
 	struct weston_mode mode;
 	struct wl_event_source *finish_frame_timer;
+	struct timespec vblank;		/* latest simulated vblank */
 	uint32_t *image_buf;
 	pixman_image_t *image;
 };
@@ -53,27 +54,64 @@ struct headless_parameters {
 	uint32_t transform;
 };
 
+/*
+ * Frames are presented on a simulated vblank grid, one refresh period
+ * apart, which starts over whenever the repaint loop does.  That makes
+ * the finish_frame stamps as predictable as those of a real display.
+ */
 static void
-headless_output_start_repaint_loop(struct weston_output *output)
+headless_output_start_repaint_loop(struct weston_output *output_base)
 {
+	struct headless_output *output = (struct headless_output *) output_base;
 	struct timespec ts;
 
-	clock_gettime(output->compositor->presentation_clock, &ts);
-	weston_output_finish_frame(output, &ts, PRESENTATION_FEEDBACK_INVALID);
+	clock_gettime(output->base.compositor->presentation_clock, &ts);
+	output->vblank = ts;
+	weston_output_finish_frame(&output->base, &ts,
+				   PRESENTATION_FEEDBACK_INVALID);
 }
 
 static int
 finish_frame_handler(void *data)
 {
 	struct headless_output *output = data;
-	struct timespec ts;
+	struct timespec ts = output->vblank;
 
-	clock_gettime(output->base.compositor->presentation_clock, &ts);
-	weston_output_finish_frame(&output->base, &ts, 0);
+	weston_output_finish_frame(&output->base, &ts,
+				   PRESENTATION_FEEDBACK_KIND_VSYNC);
 
 	return 1;
 }
 
+/* Advance vblank to the first vblank of the grid that is still
+ * ahead, and arm the finish_frame timer for it. */
+static void
+headless_output_schedule_finish_frame(struct headless_output *output)
+{
+	int64_t refresh_nsec, nsec, frames;
+	struct timespec now;
+	int msec;
+
+	refresh_nsec = 1000000000000LL / output->mode.refresh;
+
+	clock_gettime(output->base.compositor->presentation_clock, &now);
+	nsec = (int64_t) (now.tv_sec - output->vblank.tv_sec) *
+		1000000000 + now.tv_nsec - output->vblank.tv_nsec;
+	frames = nsec < 0 ? 1 : nsec / refresh_nsec + 1;
+
+	nsec = output->vblank.tv_nsec + frames * refresh_nsec;
+	output->vblank.tv_sec += nsec / 1000000000;
+	output->vblank.tv_nsec = nsec % 1000000000;
+
+	nsec = (int64_t) (output->vblank.tv_sec - now.tv_sec) *
+		1000000000 + output->vblank.tv_nsec - now.tv_nsec;
+	msec = (nsec + 999999) / 1000000;
+	if (msec < 1)
+		msec = 1;
+
+	wl_event_source_timer_update(output->finish_frame_timer, msec);
+}
+
 static int
 headless_output_repaint(struct weston_output *output_base,
 		       pixman_region32_t *damage)
@@ -86,7 +124,7 @@ headless_output_repaint(struct weston_output *output_base,
 	pixman_region32_subtract(&ec->primary_plane.damage,
 				 &ec->primary_plane.damage, damage);
 
-	wl_event_source_timer_update(output->finish_frame_timer, 16);
+	headless_output_schedule_finish_frame(output);
 
 	return 0;
 }
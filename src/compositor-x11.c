@@ -160,7 +160,7 @@ x11_compositor_get_keymap(struct x11_compositor *c)
 	copy_prop_value(options);
 #undef copy_prop_value
 
-	ret = xkb_keymap_new_from_names(c->base.xkb_context, &names, 0);
+	ret = weston_compositor_compile_keymap(&c->base, &names);
 
 	free(reply);
 	return ret;
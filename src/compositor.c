@@ -551,9 +551,142 @@ surface_state_handle_buffer_destroy(struct wl_listener *listener, void *data)
 	state->buffer = NULL;
 }
 
+static uint64_t
+box_area(const pixman_box32_t *box)
+{
+	return (uint64_t) (box->x2 - box->x1) * (box->y2 - box->y1);
+}
+
+/* One box around each run of whole bands, at most max of them.  Bands
+ * do not share rows, so pixman keeps these boxes as they are. */
+static int
+damage_group_bands(const pixman_box32_t *boxes, int n, int max,
+		   pixman_box32_t *out)
+{
+	int i, bands, per, in_group, nout;
+
+	bands = 1;
+	for (i = 1; i < n; i++)
+		if (boxes[i].y1 != boxes[i - 1].y1)
+			bands++;
+	per = (bands + max - 1) / max;
+
+	nout = 0;
+	out[0] = boxes[0];
+	in_group = 1;
+	for (i = 1; i < n; i++) {
+		if (boxes[i].y1 != boxes[i - 1].y1) {
+			if (in_group == per) {
+				out[++nout] = boxes[i];
+				in_group = 1;
+				continue;
+			}
+			in_group++;
+		}
+		out[nout].x1 = MIN(out[nout].x1, boxes[i].x1);
+		out[nout].x2 = MAX(out[nout].x2, boxes[i].x2);
+		out[nout].y2 = MAX(out[nout].y2, boxes[i].y2);
+	}
+
+	return nout + 1;
+}
+
+/* Bound the number of rectangles in a damage region, by merging
+ * neighbouring ones as long as the merged box covers at most
+ * damage_overdraw percent more pixels than they do.  If that is not
+ * enough, whole bands are merged regardless of the overdraw.  The
+ * region only ever grows, so everything damaged is still repainted. */
+WL_EXPORT void
+weston_compositor_simplify_damage(struct weston_compositor *ec,
+				  pixman_region32_t *damage)
+{
+	pixman_box32_t *boxes, *out, extents, cur, merged;
+	pixman_region32_t simple;
+	uint64_t area, covered, limit;
+	int i, n, nout;
+
+	if (ec->damage_max_rects <= 0)
+		return;
+
+	boxes = pixman_region32_rectangles(damage, &n);
+	if (n <= ec->damage_max_rects)
+		return;
+
+	limit = 100 + ec->damage_overdraw;
+	extents = *pixman_region32_extents(damage);
+	area = 0;
+	for (i = 0; i < n; i++)
+		area += box_area(&boxes[i]);
+
+	ec->damage_rects_in += n;
+
+	if (box_area(&extents) * 100 <= area * limit) {
+		pixman_region32_fini(damage);
+		pixman_region32_init_with_extents(damage, &extents);
+		ec->damage_rects_out++;
+		return;
+	}
+
+	ec->damage_boxes.size = 0;
+	out = wl_array_add(&ec->damage_boxes, n * sizeof *out);
+	if (!out) {
+		pixman_region32_fini(damage);
+		pixman_region32_init_with_extents(damage, &extents);
+		ec->damage_rects_out++;
+		return;
+	}
+
+	/* The boxes come sorted in bands, so neighbours are next to
+	 * each other, mostly. */
+	nout = 0;
+	cur = boxes[0];
+	covered = box_area(&cur);
+	for (i = 1; i < n; i++) {
+		merged.x1 = MIN(cur.x1, boxes[i].x1);
+		merged.y1 = MIN(cur.y1, boxes[i].y1);
+		merged.x2 = MAX(cur.x2, boxes[i].x2);
+		merged.y2 = MAX(cur.y2, boxes[i].y2);
+		area = box_area(&boxes[i]);
+
+		if (box_area(&merged) * 100 <= (covered + area) * limit) {
+			cur = merged;
+			covered += area;
+		} else {
+			out[nout++] = cur;
+			cur = boxes[i];
+			covered = area;
+		}
+	}
+	out[nout++] = cur;
+
+	/* The merged boxes may overlap, and pixman splits them up again,
+	 * so the bound has to be checked on the result. */
+	if (nout < n && pixman_region32_init_rects(&simple, out, nout)) {
+		if (pixman_region32_n_rects(&simple) <=
+		    ec->damage_max_rects) {
+			pixman_region32_copy(damage, &simple);
+			pixman_region32_fini(&simple);
+			ec->damage_rects_out +=
+				pixman_region32_n_rects(damage);
+			return;
+		}
+		pixman_region32_fini(&simple);
+	}
+
+	nout = damage_group_bands(boxes, n, ec->damage_max_rects, out);
+	pixman_region32_fini(damage);
+	if (!pixman_region32_init_rects(damage, out, nout)) {
+		pixman_region32_fini(damage);
+		pixman_region32_init_with_extents(damage, &extents);
+	}
+
+	ec->damage_rects_out += pixman_region32_n_rects(damage);
+}
+
 static void
 weston_surface_state_init(struct weston_surface_state *state)
 {
+	state->changed = 0;
 	state->newly_attached = 0;
 	state->buffer = NULL;
 	state->buffer_destroy_listener.notify =
@@ -1797,12 +1930,17 @@ weston_output_damage(struct weston_output *output)
 	weston_output_schedule_repaint(output);
 }
 
-static void
+/* Returns 1 if shm buffer damage went to the renderer */
+static int
 surface_flush_damage(struct weston_surface *surface)
 {
+	int uploaded = 0;
+
 	if (surface->buffer_ref.buffer &&
-	    wl_shm_buffer_get(surface->buffer_ref.buffer->resource))
+	    wl_shm_buffer_get(surface->buffer_ref.buffer->resource)) {
+		uploaded = pixman_region32_not_empty(&surface->damage);
 		surface->compositor->renderer->flush_damage(surface);
+	}
 
 	if (weston_timeline_enabled_ &&
 	    pixman_region32_not_empty(&surface->damage))
@@ -1810,6 +1948,8 @@ surface_flush_damage(struct weston_surface *surface)
 			 TLP_OUTPUT(surface->output), TLP_END);
 
 	pixman_region32_clear(&surface->damage);
+
+	return uploaded;
 }
 
 static void
@@ -1845,12 +1985,14 @@ view_accumulate_damage(struct weston_view *view,
 	pixman_region32_union(opaque, opaque, &view->transform.masked_opaque);
 }
 
-static void
+/* Returns the number of shm buffers uploaded */
+static uint32_t
 compositor_accumulate_damage(struct weston_compositor *ec)
 {
 	struct weston_plane *plane;
 	struct weston_view *ev;
 	pixman_region32_t opaque, clip;
+	uint32_t uploads = 0;
 
 	pixman_region32_init(&clip);
 
@@ -1872,6 +2014,8 @@ compositor_accumulate_damage(struct weston_compositor *ec)
 
 	pixman_region32_fini(&clip);
 
+	weston_compositor_simplify_damage(ec, &ec->primary_plane.damage);
+
 	wl_list_for_each(ev, &ec->view_list, link)
 		ev->surface->touched = 0;
 
@@ -1880,7 +2024,7 @@ compositor_accumulate_damage(struct weston_compositor *ec)
 			continue;
 		ev->surface->touched = 1;
 
-		surface_flush_damage(ev->surface);
+		uploads += surface_flush_damage(ev->surface);
 
 		/* Both the renderer and the backend have seen the buffer
 		 * by now. If renderer needs the buffer, it has its own
@@ -1893,6 +2037,8 @@ compositor_accumulate_damage(struct weston_compositor *ec)
 		if (!ev->surface->keep_buffer)
 			weston_buffer_reference(&ev->surface->buffer_ref, NULL);
 	}
+
+	return uploads;
 }
 
 static void
@@ -2044,6 +2190,118 @@ weston_output_take_feedback_list(struct weston_output *output,
 	wl_list_init(&surface->feedback_list);
 }
 
+static void
+weston_output_update_repaint_time(struct weston_output *output,
+				  const struct timespec *start,
+				  const struct timespec *end)
+{
+	int64_t nsec;
+
+	nsec = (int64_t) (end->tv_sec - start->tv_sec) * 1000000000 +
+		end->tv_nsec - start->tv_nsec;
+	if (nsec < 0)
+		nsec = 0;
+	if (nsec > 1000000000)
+		nsec = 1000000000;
+
+	output->repaint_time_nsec =
+		((int64_t) output->repaint_time_nsec * 7 + nsec) / 8;
+}
+
+struct frame_arena_block {
+	struct wl_list link;
+	uint64_t data[];
+};
+
+static void
+weston_frame_arena_init(struct weston_frame_arena *arena)
+{
+	memset(arena, 0, sizeof *arena);
+	wl_list_init(&arena->overflow);
+}
+
+static void
+weston_frame_arena_release(struct weston_frame_arena *arena)
+{
+	struct frame_arena_block *block, *next;
+
+	wl_list_for_each_safe(block, next, &arena->overflow, link)
+		free(block);
+	wl_list_init(&arena->overflow);
+	arena->overflow_size = 0;
+	free(arena->data);
+	arena->data = NULL;
+	arena->size = 0;
+	arena->used = 0;
+}
+
+static void
+weston_frame_arena_reset(struct weston_frame_arena *arena)
+{
+	size_t size = arena->used + arena->overflow_size;
+
+	arena->grows = 0;
+	if (size <= arena->size) {
+		arena->used = 0;
+		return;
+	}
+
+	/* Make room for all of the last frame, so the next fits. */
+	weston_frame_arena_release(arena);
+	arena->data = malloc(size);
+	if (arena->data) {
+		arena->size = size;
+		arena->grows++;
+	}
+}
+
+/** Allocate scratch memory for the repaint of an output
+ *
+ * \param output The output being repainted
+ * \param size The number of bytes needed
+ * \return 8-byte aligned memory, or NULL when out of memory
+ *
+ * The memory stays valid until the next repaint of the output begins,
+ * and is never freed by the caller.
+ */
+WL_EXPORT void *
+weston_output_frame_alloc(struct weston_output *output, size_t size)
+{
+	struct weston_frame_arena *arena = &output->frame_arena;
+	struct frame_arena_block *block;
+	void *p;
+
+	size = (size + 7) & ~(size_t) 7;
+	if (arena->size - arena->used >= size) {
+		p = arena->data + arena->used;
+		arena->used += size;
+		return p;
+	}
+
+	block = malloc(sizeof *block + size);
+	if (!block)
+		return NULL;
+
+	wl_list_insert(&arena->overflow, &block->link);
+	arena->overflow_size += size;
+	arena->grows++;
+
+	return block->data;
+}
+
+static void
+frame_stats_phase(struct weston_frame_stats *frame,
+		  enum weston_frame_phase phase, struct timespec *mark)
+{
+	struct timespec now;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+	frame->phase_nsec[phase] =
+		(int64_t) (now.tv_sec - mark->tv_sec) * 1000000000 +
+		now.tv_nsec - mark->tv_nsec;
+	*mark = now;
+}
+
 static int
 weston_output_repaint(struct weston_output *output)
 {
@@ -2053,16 +2311,32 @@ weston_output_repaint(struct weston_output *output)
 	struct weston_frame_callback *cb, *cnext;
 	struct wl_list frame_callback_list;
 	pixman_region32_t output_damage;
-	int r;
+	struct timespec start, end, mark;
+	struct weston_frame_stats frame;
+	pixman_box32_t *boxes;
+	int stats, primary = 0, i, n, r;
 
 	if (output->destroying)
 		return 0;
 
 	TL_POINT("core_repaint_begin", TLP_OUTPUT(output), TLP_END);
+	clock_gettime(CLOCK_MONOTONIC, &start);
+
+	weston_frame_arena_reset(&output->frame_arena);
+
+	stats = !wl_list_empty(&output->frame_stats_list);
+	memset(&frame, 0, sizeof frame);
+	mark = start;
+
+	/* Deliver held back pointer motion, so the frame shows it. */
+	weston_compositor_flush_motion(ec);
 
 	/* Rebuild the surface list and update surface transforms up front. */
 	weston_compositor_build_view_list(ec);
 
+	if (stats)
+		frame_stats_phase(&frame, WESTON_FRAME_PHASE_VIEW_LIST, &mark);
+
 	if (output->assign_planes && !output->disable_planes) {
 		output->assign_planes(output);
 	} else {
@@ -2072,8 +2346,21 @@ weston_output_repaint(struct weston_output *output)
 		}
 	}
 
+	if (stats)
+		frame_stats_phase(&frame, WESTON_FRAME_PHASE_ASSIGN_PLANES,
+				  &mark);
+
 	wl_list_init(&frame_callback_list);
 	wl_list_for_each(ev, &ec->view_list, link) {
+		/* Each view off the primary plane has a plane of its own. */
+		if (stats && (ev->output_mask & (1u << output->id))) {
+			frame.views++;
+			if (ev->plane != &ec->primary_plane)
+				frame.planes++;
+			else
+				primary = 1;
+		}
+
 		/* Note: This operation is safe to do multiple times on the
 		 * same surface.
 		 */
@@ -2083,10 +2370,19 @@ weston_output_repaint(struct weston_output *output)
 			wl_list_init(&ev->surface->frame_callback_list);
 
 			weston_output_take_feedback_list(output, ev->surface);
+			weston_input_latency_take(output, ev->surface);
 		}
 	}
 
-	compositor_accumulate_damage(ec);
+	frame.planes += primary;
+	frame.uploads = compositor_accumulate_damage(ec);
+
+	/* Simplified since the last repaint of any output, commits
+	 * included. */
+	frame.damage_rects_in = ec->damage_rects_in;
+	frame.damage_rects_out = ec->damage_rects_out;
+	ec->damage_rects_in = 0;
+	ec->damage_rects_out = 0;
 
 	pixman_region32_init(&output_damage);
 	pixman_region32_intersect(&output_damage,
@@ -2097,8 +2393,24 @@ weston_output_repaint(struct weston_output *output)
 	if (output->dirty)
 		weston_output_update_matrix(output);
 
+	if (stats) {
+		boxes = pixman_region32_rectangles(&output_damage, &n);
+		for (i = 0; i < n; i++)
+			frame.damaged_pixels +=
+				(uint64_t) (boxes[i].x2 - boxes[i].x1) *
+				(boxes[i].y2 - boxes[i].y1);
+		frame_stats_phase(&frame, WESTON_FRAME_PHASE_ACCUMULATE_DAMAGE,
+				  &mark);
+	}
+
 	r = output->repaint(output, &output_damage);
 
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	weston_output_update_repaint_time(output, &start, &end);
+
+	if (stats)
+		frame_stats_phase(&frame, WESTON_FRAME_PHASE_REPAINT, &mark);
+
 	pixman_region32_fini(&output_damage);
 
 	output->repaint_needed = 0;
@@ -2116,6 +2428,13 @@ weston_output_repaint(struct weston_output *output)
 		animation->frame(animation, output, output->frame_time);
 	}
 
+	if (stats) {
+		frame_stats_phase(&frame, WESTON_FRAME_PHASE_POST_REPAINT,
+				  &mark);
+		frame.arena_grows = output->frame_arena.grows;
+		weston_frame_stats_frame(output, &frame);
+	}
+
 	TL_POINT("core_repaint_posted", TLP_OUTPUT(output), TLP_END);
 
 	return r;
@@ -2151,6 +2470,37 @@ weston_output_schedule_repaint_reset(struct weston_output *output)
 				     weston_compositor_read_input, compositor);
 }
 
+/* Returns how many ms to wait before repainting, so that the repaint
+ * starts the repaint window ahead of the vblank following the one at
+ * stamp.  Commits arriving in the meantime make it into that repaint. */
+static int32_t
+weston_output_repaint_delay(struct weston_output *output,
+			    const struct timespec *stamp,
+			    uint32_t refresh_nsec)
+{
+	struct timespec now;
+	int64_t nsec;
+	int32_t window;
+
+	if (output->repaint_window_msec <= 0)
+		return 0;
+
+	/* leave room for the repaint itself, with a ms to spare */
+	window = output->repaint_time_nsec / 1000000 + 1;
+	if (window < output->repaint_window_msec)
+		window = output->repaint_window_msec;
+
+	clock_gettime(output->compositor->presentation_clock, &now);
+	nsec = (int64_t) (stamp->tv_sec - now.tv_sec) * 1000000000 +
+		stamp->tv_nsec - now.tv_nsec + refresh_nsec;
+
+	/* a stamp from the future is not to be trusted */
+	if (nsec > refresh_nsec)
+		nsec = refresh_nsec;
+
+	return nsec / 1000000 - window;
+}
+
 WL_EXPORT void
 weston_output_finish_frame(struct weston_output *output,
 			   const struct timespec *stamp,
@@ -2158,6 +2508,7 @@ weston_output_finish_frame(struct weston_output *output,
 {
 	struct weston_compositor *compositor = output->compositor;
 	int r;
+	int32_t msec;
 	uint32_t refresh_nsec;
 
 	TL_POINT("core_repaint_finished", TLP_OUTPUT(output),
@@ -2168,12 +2519,27 @@ weston_output_finish_frame(struct weston_output *output,
 						  output, refresh_nsec, stamp,
 						  output->msc,
 						  presented_flags);
+	weston_input_latency_present(output, stamp);
+	weston_frame_stats_present(output, stamp, refresh_nsec);
 
 	output->frame_time = stamp->tv_sec * 1000 + stamp->tv_nsec / 1000000;
 
 	if (output->repaint_needed &&
 	    compositor->state != WESTON_COMPOSITOR_SLEEPING &&
 	    compositor->state != WESTON_COMPOSITOR_OFFSCREEN) {
+		/* Only a stamp that is a real vblank tells when the next
+		 * one comes, anything else is repainted right away. */
+		if (presented_flags & PRESENTATION_FEEDBACK_KIND_VSYNC)
+			msec = weston_output_repaint_delay(output, stamp,
+							   refresh_nsec);
+		else
+			msec = 0;
+		if (msec > 0) {
+			wl_event_source_timer_update(output->repaint_timer,
+						     msec);
+			return;
+		}
+
 		r = weston_output_repaint(output);
 		if (!r)
 			return;
@@ -2182,6 +2548,23 @@ weston_output_finish_frame(struct weston_output *output,
 	weston_output_schedule_repaint_reset(output);
 }
 
+static int
+output_repaint_timer_handler(void *data)
+{
+	struct weston_output *output = data;
+	struct weston_compositor *compositor = output->compositor;
+
+	if (output->repaint_needed &&
+	    compositor->state != WESTON_COMPOSITOR_SLEEPING &&
+	    compositor->state != WESTON_COMPOSITOR_OFFSCREEN &&
+	    weston_output_repaint(output) == 0)
+		return 0;
+
+	weston_output_schedule_repaint_reset(output);
+
+	return 0;
+}
+
 static void
 idle_repaint(void *data)
 {
@@ -2318,6 +2701,7 @@ surface_damage(struct wl_client *client,
 	pixman_region32_union_rect(&surface->pending.damage,
 				   &surface->pending.damage,
 				   x, y, width, height);
+	surface->pending.changed |= WESTON_SURFACE_STATE_DAMAGE;
 }
 
 static void
@@ -2356,14 +2740,51 @@ surface_frame(struct wl_client *client,
 	wl_list_insert(surface->pending.frame_callback_list.prev, &cb->link);
 }
 
+static void
+swap_region(pixman_region32_t *a, pixman_region32_t *b)
+{
+	pixman_region32_t tmp;
+
+	tmp = *a;
+	*a = *b;
+	*b = tmp;
+}
+
+/* A cached commit that did not set a region falls back to the pending
+ * one, which is what the client last set.  Before the client sets it
+ * anew, hand the old region over to the cache. */
+static void
+weston_surface_preserve_region(struct weston_surface *surface,
+			       uint32_t field, pixman_region32_t *pending,
+			       pixman_region32_t *cached)
+{
+	struct weston_subsurface *sub = weston_surface_to_subsurface(surface);
+
+	if (!sub || !sub->has_cached_data ||
+	    (surface->pending.changed & field) ||
+	    (sub->cached.changed & field))
+		return;
+
+	swap_region(pending, cached);
+	sub->cached.changed |= field;
+}
+
 static void
 surface_set_opaque_region(struct wl_client *client,
 			  struct wl_resource *resource,
 			  struct wl_resource *region_resource)
 {
 	struct weston_surface *surface = wl_resource_get_user_data(resource);
+	struct weston_subsurface *sub = weston_surface_to_subsurface(surface);
 	struct weston_region *region;
 
+	if (sub)
+		weston_surface_preserve_region(surface,
+					       WESTON_SURFACE_STATE_OPAQUE,
+					       &surface->pending.opaque,
+					       &sub->cached.opaque);
+	surface->pending.changed |= WESTON_SURFACE_STATE_OPAQUE;
+
 	if (region_resource) {
 		region = wl_resource_get_user_data(region_resource);
 		pixman_region32_copy(&surface->pending.opaque,
@@ -2379,8 +2800,16 @@ surface_set_input_region(struct wl_client *client,
 			 struct wl_resource *region_resource)
 {
 	struct weston_surface *surface = wl_resource_get_user_data(resource);
+	struct weston_subsurface *sub = weston_surface_to_subsurface(surface);
 	struct weston_region *region;
 
+	if (sub)
+		weston_surface_preserve_region(surface,
+					       WESTON_SURFACE_STATE_INPUT,
+					       &surface->pending.input,
+					       &sub->cached.input);
+	surface->pending.changed |= WESTON_SURFACE_STATE_INPUT;
+
 	if (region_resource) {
 		region = wl_resource_get_user_data(region_resource);
 		pixman_region32_copy(&surface->pending.input,
@@ -2409,6 +2838,8 @@ weston_surface_commit_state(struct weston_surface *surface,
 {
 	struct weston_view *view;
 	pixman_region32_t opaque;
+	int32_t width = surface->width, height = surface->height;
+	int resized;
 
 	/* wl_surface.set_buffer_transform */
 	/* wl_surface.set_buffer_scale */
@@ -2431,32 +2862,61 @@ weston_surface_commit_state(struct weston_surface *surface,
 	state->newly_attached = 0;
 	state->buffer_viewport.changed = 0;
 
+	resized = surface->width != width || surface->height != height;
+
+	/* Regions the commit did not set are the client's last ones, only
+	 * clipped again when the size changed.  A cached commit finds those
+	 * in the pending state, see weston_surface_preserve_region(). */
+
 	/* wl_surface.damage */
-	if (weston_timeline_enabled_ &&
-	    pixman_region32_not_empty(&state->damage))
-		TL_POINT("core_commit_damage", TLP_SURFACE(surface), TLP_END);
-	pixman_region32_union(&surface->damage, &surface->damage,
-			      &state->damage);
-	pixman_region32_intersect_rect(&surface->damage, &surface->damage,
-				       0, 0, surface->width, surface->height);
-	pixman_region32_clear(&state->damage);
+	if (state->changed & WESTON_SURFACE_STATE_DAMAGE) {
+		if (weston_timeline_enabled_ &&
+		    pixman_region32_not_empty(&state->damage))
+			TL_POINT("core_commit_damage", TLP_SURFACE(surface),
+				 TLP_END);
+		pixman_region32_union(&surface->damage, &surface->damage,
+				      &state->damage);
+		pixman_region32_clear(&state->damage);
+	}
+	if ((state->changed & WESTON_SURFACE_STATE_DAMAGE) || resized)
+		pixman_region32_intersect_rect(&surface->damage,
+					       &surface->damage, 0, 0,
+					       surface->width, surface->height);
+	if (state->changed & WESTON_SURFACE_STATE_DAMAGE)
+		weston_compositor_simplify_damage(surface->compositor,
+						  &surface->damage);
 
 	/* wl_surface.set_opaque_region */
-	pixman_region32_init(&opaque);
-	pixman_region32_intersect_rect(&opaque, &state->opaque,
-				       0, 0, surface->width, surface->height);
+	if ((state->changed & WESTON_SURFACE_STATE_OPAQUE) || resized) {
+		pixman_region32_init(&opaque);
+		pixman_region32_intersect_rect(&opaque,
+					       (state->changed &
+						WESTON_SURFACE_STATE_OPAQUE) ?
+					       &state->opaque :
+					       &surface->pending.opaque,
+					       0, 0,
+					       surface->width, surface->height);
+
+		if (!pixman_region32_equal(&opaque, &surface->opaque)) {
+			pixman_region32_copy(&surface->opaque, &opaque);
+			wl_list_for_each(view, &surface->views, surface_link)
+				weston_view_geometry_dirty(view);
+		}
 
-	if (!pixman_region32_equal(&opaque, &surface->opaque)) {
-		pixman_region32_copy(&surface->opaque, &opaque);
-		wl_list_for_each(view, &surface->views, surface_link)
-			weston_view_geometry_dirty(view);
+		pixman_region32_fini(&opaque);
 	}
 
-	pixman_region32_fini(&opaque);
-
 	/* wl_surface.set_input_region */
-	pixman_region32_intersect_rect(&surface->input, &state->input,
-				       0, 0, surface->width, surface->height);
+	if ((state->changed & WESTON_SURFACE_STATE_INPUT) || resized)
+		pixman_region32_intersect_rect(&surface->input,
+					       (state->changed &
+						WESTON_SURFACE_STATE_INPUT) ?
+					       &state->input :
+					       &surface->pending.input,
+					       0, 0,
+					       surface->width, surface->height);
+
+	state->changed = 0;
 
 	/* wl_surface.frame */
 	wl_list_insert_list(&surface->frame_callback_list,
@@ -2478,6 +2938,7 @@ static void
 weston_surface_commit(struct weston_surface *surface)
 {
 	weston_surface_commit_state(surface, &surface->pending);
+	weston_input_latency_note_commit(surface);
 
 	weston_surface_commit_subsurface_order(surface);
 
@@ -2686,12 +3147,22 @@ weston_subsurface_commit_to_cache(struct weston_subsurface *sub)
 	 * attach(dx, dy) parameters, the old damage region must be
 	 * translated to correspond to the new surface coordinate system
 	 * original_mode.
+	 *
+	 * Damage not yet cached is empty, and simply swapped in.
 	 */
-	pixman_region32_translate(&sub->cached.damage,
-				  -surface->pending.sx, -surface->pending.sy);
-	pixman_region32_union(&sub->cached.damage, &sub->cached.damage,
-			      &surface->pending.damage);
-	pixman_region32_clear(&surface->pending.damage);
+	if (sub->cached.changed & WESTON_SURFACE_STATE_DAMAGE) {
+		pixman_region32_translate(&sub->cached.damage,
+					  -surface->pending.sx,
+					  -surface->pending.sy);
+		if (surface->pending.changed & WESTON_SURFACE_STATE_DAMAGE) {
+			pixman_region32_union(&sub->cached.damage,
+					      &sub->cached.damage,
+					      &surface->pending.damage);
+			pixman_region32_clear(&surface->pending.damage);
+		}
+	} else if (surface->pending.changed & WESTON_SURFACE_STATE_DAMAGE) {
+		swap_region(&sub->cached.damage, &surface->pending.damage);
+	}
 
 	if (surface->pending.newly_attached) {
 		sub->cached.newly_attached = 1;
@@ -2714,9 +3185,18 @@ weston_subsurface_commit_to_cache(struct weston_subsurface *sub)
 
 	weston_surface_reset_pending_buffer(surface);
 
-	pixman_region32_copy(&sub->cached.opaque, &surface->pending.opaque);
+	/* The pending regions stay the client's current ones, so they are
+	 * copied, but only by the commits that set them. */
+	if (surface->pending.changed & WESTON_SURFACE_STATE_OPAQUE)
+		pixman_region32_copy(&sub->cached.opaque,
+				     &surface->pending.opaque);
 
-	pixman_region32_copy(&sub->cached.input, &surface->pending.input);
+	if (surface->pending.changed & WESTON_SURFACE_STATE_INPUT)
+		pixman_region32_copy(&sub->cached.input,
+				     &surface->pending.input);
+
+	sub->cached.changed |= surface->pending.changed;
+	surface->pending.changed = 0;
 
 	wl_list_insert_list(&sub->cached.frame_callback_list,
 			    &surface->pending.frame_callback_list);
@@ -3496,7 +3976,11 @@ weston_output_destroy(struct weston_output *output)
 
 	output->destroying = 1;
 
+	wl_event_source_remove(output->repaint_timer);
+
 	weston_presentation_feedback_discard_list(&output->feedback_list);
+	weston_frame_arena_release(&output->frame_arena);
+	wl_array_release(&output->input_latency_list);
 
 	weston_compositor_remove_output(output->compositor, output);
 	wl_list_remove(&output->link);
@@ -3688,6 +4172,9 @@ weston_output_init(struct weston_output *output, struct weston_compositor *c,
 		   int x, int y, int mm_width, int mm_height, uint32_t transform,
 		   int32_t scale)
 {
+	struct weston_config_section *section;
+	struct wl_event_loop *loop;
+
 	output->compositor = c;
 	output->x = x;
 	output->y = y;
@@ -3707,10 +4194,27 @@ weston_output_init(struct weston_output *output, struct weston_compositor *c,
 	wl_list_init(&output->animation_list);
 	wl_list_init(&output->resource_list);
 	wl_list_init(&output->feedback_list);
+	wl_array_init(&output->input_latency_list);
+	wl_list_init(&output->frame_stats_list);
+	weston_frame_arena_init(&output->frame_arena);
 
 	output->id = ffs(~output->compositor->output_id_pool) - 1;
 	output->compositor->output_id_pool |= 1 << output->id;
 
+	loop = wl_display_get_event_loop(c->wl_display);
+	output->repaint_timer =
+		wl_event_loop_add_timer(loop, output_repaint_timer_handler,
+					output);
+
+	output->repaint_window_msec = c->repaint_window_msec;
+	if (output->name) {
+		section = weston_config_get_section(c->config, "output",
+						    "name", output->name);
+		weston_config_section_get_int(section, "repaint-window",
+					      &output->repaint_window_msec,
+					      c->repaint_window_msec);
+	}
+
 	output->global =
 		wl_global_create(c->wl_display, &wl_output_interface, 2,
 				 output, bind_output);
@@ -4131,6 +4635,12 @@ weston_compositor_init(struct weston_compositor *ec,
 	struct wl_event_loop *loop;
 	struct xkb_rule_names xkb_names;
 	struct weston_config_section *s;
+	char *coalescing;
+
+	const struct weston_option options[] = {
+		{ WESTON_OPTION_INTEGER, "repaint-window", 0,
+		  &ec->repaint_window_msec },
+	};
 
 	ec->config = config;
 	ec->wl_display = display;
@@ -4184,6 +4694,28 @@ weston_compositor_init(struct weston_compositor *ec,
 	weston_plane_init(&ec->primary_plane, ec, 0, 0);
 	weston_compositor_stack_plane(ec, &ec->primary_plane, NULL);
 
+	s = weston_config_get_section(ec->config, "core", NULL, NULL);
+	weston_config_section_get_int(s, "repaint-window",
+				      &ec->repaint_window_msec, 0);
+	parse_options(options, ARRAY_LENGTH(options), argc, argv);
+	weston_config_section_get_string(s, "pointer-motion-coalescing",
+					 &coalescing, "none");
+	if (strcmp(coalescing, "latest") == 0)
+		ec->motion_coalescing = WESTON_MOTION_COALESCING_LATEST;
+	else if (strcmp(coalescing, "history") == 0)
+		ec->motion_coalescing = WESTON_MOTION_COALESCING_HISTORY;
+	else if (strcmp(coalescing, "none") != 0)
+		weston_log("invalid pointer-motion-coalescing: %s\n",
+			   coalescing);
+	free(coalescing);
+	weston_config_section_get_int(s, "damage-max-rects",
+				      &ec->damage_max_rects, 0);
+	weston_config_section_get_int(s, "damage-overdraw",
+				      &ec->damage_overdraw, 25);
+	if (ec->damage_overdraw < 0)
+		ec->damage_overdraw = 0;
+	wl_array_init(&ec->damage_boxes);
+
 	s = weston_config_get_section(ec->config, "keyboard", NULL, NULL);
 	weston_config_section_get_string(s, "keymap_rules",
 					 (char **) &xkb_names.rules, NULL);
@@ -4196,6 +4728,9 @@ weston_compositor_init(struct weston_compositor *ec,
 	weston_config_section_get_string(s, "keymap_options",
 					 (char **) &xkb_names.options, NULL);
 
+	weston_config_section_get_bool(s, "keymap_cache",
+				       &ec->cache_keymaps, 0);
+
 	if (weston_compositor_xkb_init(ec, &xkb_names) < 0)
 		return -1;
 
@@ -4206,6 +4741,9 @@ weston_compositor_init(struct weston_compositor *ec,
 
 	text_backend_init(ec);
 
+	weston_input_latency_init(ec);
+	weston_frame_stats_init(ec);
+
 	wl_data_device_manager_init(ec->wl_display);
 
 	wl_display_init_shm(display);
@@ -4248,6 +4786,9 @@ weston_compositor_shutdown(struct weston_compositor *ec)
 	weston_binding_list_destroy_all(&ec->touch_binding_list);
 	weston_binding_list_destroy_all(&ec->axis_binding_list);
 	weston_binding_list_destroy_all(&ec->debug_binding_list);
+	weston_compositor_destroy_binding_index(ec);
+	weston_input_latency_release(ec);
+	wl_array_release(&ec->damage_boxes);
 
 	weston_plane_release(&ec->primary_plane);
 
@@ -4629,6 +5170,7 @@ usage(int error_code)
 		"  --shell=MODULE\tShell module, defaults to desktop-shell.so\n"
 		"  -S, --socket=NAME\tName of socket to listen on\n"
 		"  -i, --idle-time=SECS\tIdle time in seconds\n"
+		"  --repaint-window=MSECS\tRepaint this long before vblank\n"
 		"  --modules\t\tLoad the comma-separated list of modules\n"
 		"  --log=FILE\t\tLog to the given file\n"
 		"  --no-config\t\tDo not read weston.ini\n"
@@ -4854,6 +5396,8 @@ int main(int argc, char *argv[])
 		{ WESTON_OPTION_BOOLEAN, "no-config", 0, &noconfig },
 	};
 
+	weston_timeline_startup_point("core_startup_begin");
+
 	parse_options(core_options, ARRAY_LENGTH(core_options), &argc, argv);
 
 	if (help)
@@ -4904,6 +5448,7 @@ int main(int argc, char *argv[])
 		weston_log("Starting with no config file.\n");
 	}
 	section = weston_config_get_section(config, "core", NULL, NULL);
+	weston_timeline_startup_point("core_startup_config");
 
 	if (!backend) {
 		weston_config_section_get_string(section, "backend", &backend,
@@ -4917,6 +5462,7 @@ int main(int argc, char *argv[])
 		ret = EXIT_FAILURE;
 		goto out_signals;
 	}
+	weston_timeline_startup_point("core_startup_backend_loaded");
 
 	ec = backend_init(display, &argc, argv, config);
 	if (ec == NULL) {
@@ -4924,6 +5470,7 @@ int main(int argc, char *argv[])
 		ret = EXIT_FAILURE;
 		goto out_signals;
 	}
+	weston_timeline_startup_point("core_startup_backend_init");
 
 	catch_signals();
 	segv_compositor = ec;
@@ -4975,8 +5522,11 @@ int main(int argc, char *argv[])
 		weston_config_section_get_string(section, "shell", &shell,
 						 "desktop-shell.so");
 
+	weston_timeline_startup_point("core_startup_socket");
+
 	if (load_modules(ec, shell, &argc, argv) < 0)
 		goto out;
+	weston_timeline_startup_point("core_startup_shell");
 
 	weston_config_section_get_string(section, "modules", &modules, "");
 	if (load_modules(ec, modules, &argc, argv) < 0)
@@ -4984,6 +5534,7 @@ int main(int argc, char *argv[])
 
 	if (load_modules(ec, option_modules, &argc, argv) < 0)
 		goto out;
+	weston_timeline_startup_point("core_startup_modules");
 
 	section = weston_config_get_section(config, "keyboard", NULL, NULL);
 	weston_config_section_get_bool(section, "numlock-on", &numlock_on, 0);
@@ -4998,6 +5549,9 @@ int main(int argc, char *argv[])
 
 	weston_compositor_wake(ec);
 
+	weston_timeline_startup_point("core_startup_end");
+	weston_timeline_log_startup();
+
 	wl_display_run(display);
 
 	/* Allow for setting return exit code after
@@ -46,6 +46,10 @@ extern "C" {
 #define MIN(x,y) (((x) < (y)) ? (x) : (y))
 #endif
 
+#ifndef MAX
+#define MAX(x,y) (((x) > (y)) ? (x) : (y))
+#endif
+
 #define ARRAY_LENGTH(a) (sizeof (a) / sizeof (a)[0])
 
 #define container_of(ptr, type, member) ({				\
@@ -64,6 +68,14 @@ struct weston_seat;
 struct weston_output;
 struct input_method;
 
+enum weston_motion_coalescing {
+	WESTON_MOTION_COALESCING_NONE = 0,
+	/* one motion event per repaint */
+	WESTON_MOTION_COALESCING_LATEST,
+	/* one pick per repaint, every sample sent to the focus */
+	WESTON_MOTION_COALESCING_HISTORY,
+};
+
 enum weston_keyboard_modifier {
 	MODIFIER_CTRL = (1 << 0),
 	MODIFIER_ALT = (1 << 1),
@@ -176,6 +188,19 @@ enum dpms_enum {
 	WESTON_DPMS_OFF
 };
 
+/* Scratch memory for one repaint of an output; everything allocated
+ * with weston_output_frame_alloc() is released at once when the next
+ * repaint begins.  The arena grows to what a frame needed, so a steady
+ * state repaint allocates nothing from the heap. */
+struct weston_frame_arena {
+	char *data;
+	size_t size;
+	size_t used;
+	struct wl_list overflow;	/* blocks that did not fit */
+	size_t overflow_size;
+	uint32_t grows;			/* arena heap allocations this frame */
+};
+
 struct weston_output {
 	uint32_t id;
 	char *name;
@@ -194,6 +219,12 @@ struct weston_output {
 	pixman_region32_t previous_damage;
 	int repaint_needed;
 	int repaint_scheduled;
+	/* Repaint this many ms before the next vblank, rather than right
+	 * after the last one; 0 disables it.  The window grows to cover
+	 * the measured repaint time. */
+	int32_t repaint_window_msec;
+	uint32_t repaint_time_nsec; /* moving average */
+	struct wl_event_source *repaint_timer;
 	struct weston_output_zoom zoom;
 	int dirty;
 	struct wl_signal frame_signal;
@@ -204,6 +235,11 @@ struct weston_output {
 	int disable_planes;
 	int destroying;
 	struct wl_list feedback_list;
+	/* inputs repainted, awaiting presentation; see input-latency.c */
+	struct wl_array input_latency_list;
+	/* subscribed weston_output_stats; see frame-stats.c */
+	struct wl_list frame_stats_list;
+	struct weston_frame_arena frame_arena;
 
 	char *make, *model, *serial_number;
 	uint32_t subpixel;
@@ -340,6 +376,20 @@ struct weston_pointer {
 	uint32_t button_count;
 
 	struct wl_listener output_destroy_listener;
+
+	/* relative motion held back until the next repaint */
+	struct {
+		int pending;
+		uint32_t time;
+		wl_fixed_t dx, dy;
+		struct wl_array history; /* struct weston_motion_sample */
+		uint64_t saved; /* motion events folded into a later one */
+	} coalesce;
+};
+
+struct weston_motion_sample {
+	uint32_t time;
+	wl_fixed_t dx, dy; /* since the last flush */
 };
 
 
@@ -384,6 +434,8 @@ void
 weston_pointer_move(struct weston_pointer *pointer,
 		    wl_fixed_t x, wl_fixed_t y);
 void
+weston_pointer_flush_motion(struct weston_pointer *pointer);
+void
 weston_pointer_set_default_grab(struct weston_pointer *pointer,
 		const struct weston_pointer_grab_interface *interface);
 
@@ -458,6 +510,10 @@ struct weston_xkb_info {
 	xkb_led_index_t num_led;
 	xkb_led_index_t caps_led;
 	xkb_led_index_t scroll_led;
+
+	/* the compositor's table of shared keymaps, if in there */
+	struct hash_table *cache;
+	uint32_t hash;
 };
 
 struct weston_keyboard {
@@ -632,11 +688,24 @@ struct weston_compositor {
 	struct wl_list touch_binding_list;
 	struct wl_list axis_binding_list;
 	struct wl_list debug_binding_list;
+	struct hash_table *binding_index;
 
 	uint32_t state;
 	struct wl_event_source *idle_source;
 	uint32_t idle_inhibit;
 	int idle_time;			/* timeout, s */
+	int32_t repaint_window_msec;	/* default for outputs, ms */
+	enum weston_motion_coalescing motion_coalescing;
+
+	/* Damage with more rectangles than this is simplified, merging
+	 * rectangles that cost at most damage_overdraw percent more
+	 * pixels; 0 disables it. */
+	int32_t damage_max_rects;
+	int32_t damage_overdraw;
+	struct wl_array damage_boxes;	/* scratch */
+	/* rectangles simplified, and what was left, since the last repaint */
+	uint32_t damage_rects_in;
+	uint32_t damage_rects_out;
 
 	const struct weston_pointer_grab_interface *default_pointer_grab;
 
@@ -659,6 +728,16 @@ struct weston_compositor {
 	struct xkb_rule_names xkb_names;
 	struct xkb_context *xkb_context;
 	struct weston_xkb_info *xkb_info;
+	/* global keymap being compiled in the background */
+	struct weston_keymap_job *keymap_job;
+	/* weston_xkb_info by keymap text */
+	struct hash_table *xkb_info_cache;
+	/* keep compiled keymaps on disk */
+	int cache_keymaps;
+
+	/* input to present latency, per client */
+	struct wl_list input_latency_client_list;
+	int input_latency_listeners;
 
 	/* Raw keyboard processing (no libxkbcommon initialization or handling) */
 	int use_xkbcommon;
@@ -821,7 +900,18 @@ struct weston_view {
 	uint32_t psf_flags;
 };
 
+/* What a commit sets, besides the attach and viewport state */
+enum weston_surface_state_field {
+	WESTON_SURFACE_STATE_DAMAGE = (1 << 0),
+	WESTON_SURFACE_STATE_OPAQUE = (1 << 1),
+	WESTON_SURFACE_STATE_INPUT = (1 << 2)
+};
+
 struct weston_surface_state {
+	/* WESTON_SURFACE_STATE_* set since the last commit; whoever
+	 * changes damage, opaque or input must set the bit */
+	uint32_t changed;
+
 	/* wl_surface.attach */
 	int newly_attached;
 	struct weston_buffer *buffer;
@@ -885,6 +975,10 @@ struct weston_surface {
 	struct wl_list frame_callback_list;
 	struct wl_list feedback_list;
 
+	/* arrival of the input answered by the last commit, zero if none
+	 * or already repainted */
+	struct timespec input_latency;
+
 	struct weston_buffer_reference buffer_ref;
 	struct weston_buffer_viewport buffer_viewport;
 	int32_t width_from_buffer; /* before applying viewport */
@@ -1084,10 +1178,62 @@ weston_output_damage(struct weston_output *output);
 void
 weston_compositor_schedule_repaint(struct weston_compositor *compositor);
 void
+weston_compositor_flush_motion(struct weston_compositor *compositor);
+
+enum weston_frame_phase {
+	WESTON_FRAME_PHASE_VIEW_LIST,
+	WESTON_FRAME_PHASE_ASSIGN_PLANES,
+	WESTON_FRAME_PHASE_ACCUMULATE_DAMAGE,
+	WESTON_FRAME_PHASE_REPAINT,
+	WESTON_FRAME_PHASE_POST_REPAINT,
+	WESTON_FRAME_PHASE_COUNT
+};
+
+/* What one weston_output_repaint() cost */
+struct weston_frame_stats {
+	uint64_t phase_nsec[WESTON_FRAME_PHASE_COUNT];
+	uint64_t damaged_pixels;
+	uint32_t views;
+	uint32_t planes;
+	uint32_t uploads;
+	uint32_t arena_grows;
+	uint32_t damage_rects_in;
+	uint32_t damage_rects_out;
+};
+
+void
+weston_frame_stats_init(struct weston_compositor *compositor);
+void
+weston_frame_stats_frame(struct weston_output *output,
+			 const struct weston_frame_stats *frame);
+void
+weston_frame_stats_present(struct weston_output *output,
+			   const struct timespec *stamp,
+			   uint32_t refresh_nsec);
+
+void
+weston_input_latency_init(struct weston_compositor *compositor);
+void
+weston_input_latency_release(struct weston_compositor *compositor);
+void
+weston_input_latency_note_input(struct weston_compositor *compositor,
+				struct weston_surface *focus);
+void
+weston_input_latency_note_commit(struct weston_surface *surface);
+void
+weston_input_latency_take(struct weston_output *output,
+			  struct weston_surface *surface);
+void
+weston_input_latency_present(struct weston_output *output,
+			     const struct timespec *stamp);
+void
 weston_compositor_fade(struct weston_compositor *compositor, float tint);
 void
 weston_compositor_damage_all(struct weston_compositor *compositor);
 void
+weston_compositor_simplify_damage(struct weston_compositor *ec,
+				  pixman_region32_t *damage);
+void
 weston_compositor_unlock(struct weston_compositor *compositor);
 void
 weston_compositor_wake(struct weston_compositor *compositor);
@@ -1160,6 +1306,9 @@ weston_binding_destroy(struct weston_binding *binding);
 void
 weston_binding_list_destroy_all(struct wl_list *list);
 
+void
+weston_compositor_destroy_binding_index(struct weston_compositor *compositor);
+
 void
 weston_compositor_run_key_binding(struct weston_compositor *compositor,
 				  struct weston_seat *seat, uint32_t time,
@@ -1301,6 +1450,8 @@ weston_output_init(struct weston_output *output, struct weston_compositor *c,
 		   int x, int y, int width, int height, uint32_t transform, int32_t scale);
 void
 weston_output_destroy(struct weston_output *output);
+void *
+weston_output_frame_alloc(struct weston_output *output, size_t size);
 void
 weston_output_transform_coordinate(struct weston_output *output,
 				   wl_fixed_t device_x, wl_fixed_t device_y,
@@ -1333,6 +1484,9 @@ weston_compositor_xkb_init(struct weston_compositor *ec,
 			   struct xkb_rule_names *names);
 void
 weston_compositor_xkb_destroy(struct weston_compositor *ec);
+struct xkb_keymap *
+weston_compositor_compile_keymap(struct weston_compositor *ec,
+				 const struct xkb_rule_names *names);
 
 /* String literal of spaces, the same width as the timestamp. */
 #define STAMP_SPACE "               "
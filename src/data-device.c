@@ -197,6 +197,7 @@ drag_surface_configure(struct weston_drag *drag,
 		weston_layer_entry_insert(list, &drag->icon->layer_link);
 		weston_view_update_transform(drag->icon);
 		pixman_region32_clear(&es->pending.input);
+		es->pending.changed |= WESTON_SURFACE_STATE_INPUT;
 	}
 
 	drag->dx += sx;
@@ -367,6 +368,8 @@ data_device_end_drag_grab(struct weston_drag *drag,
 		drag->icon->surface->configure = NULL;
 		weston_surface_set_label_func(drag->icon->surface, NULL);
 		pixman_region32_clear(&drag->icon->surface->pending.input);
+		drag->icon->surface->pending.changed |=
+			WESTON_SURFACE_STATE_INPUT;
 		wl_list_remove(&drag->icon_destroy_listener.link);
 		weston_view_destroy(drag->icon);
 	}
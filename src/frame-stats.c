@@ -0,0 +1,297 @@
+/*
+ * Copyright © 2015 The Weston contributors
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation, and that the name of the copyright holders not be used in
+ * advertising or publicity pertaining to distribution of the software
+ * without specific, written prior permission.  The copyright holders make
+ * no representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS
+ * SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS, IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER
+ * RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF
+ * CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+/*
+ * Per-output repaint statistics for monitoring clients.
+ *
+ * weston_output_repaint() fills in a struct weston_frame_stats for every
+ * frame while the output has subscribers, and each subscription sums
+ * the frames up until its window is full and sent.
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "compositor.h"
+#include "frame-stats-server-protocol.h"
+
+struct output_stats {
+	struct wl_resource *resource;
+	struct weston_output *output;	/* NULL once the output is gone */
+	struct wl_listener output_destroy_listener;
+	struct wl_list link;		/* weston_output::frame_stats_list */
+
+	uint32_t interval;
+
+	/* a frame was painted since the last finish_frame at stamp */
+	int painted;
+	struct timespec stamp;
+
+	uint32_t frames;
+	uint64_t phase_nsec[WESTON_FRAME_PHASE_COUNT];
+	uint64_t max_frame_nsec;
+	uint64_t damaged_pixels;
+	uint64_t views;
+	uint32_t planes;
+	uint32_t uploads;
+	uint32_t dropped;
+	uint32_t arena_grows;
+	uint32_t damage_rects_in;
+	uint32_t damage_rects_out;
+};
+
+static void
+output_stats_reset(struct output_stats *stats)
+{
+	stats->frames = 0;
+	memset(stats->phase_nsec, 0, sizeof stats->phase_nsec);
+	stats->max_frame_nsec = 0;
+	stats->damaged_pixels = 0;
+	stats->views = 0;
+	stats->planes = 0;
+	stats->uploads = 0;
+	stats->dropped = 0;
+	stats->arena_grows = 0;
+	stats->damage_rects_in = 0;
+	stats->damage_rects_out = 0;
+}
+
+static void
+output_stats_send(struct output_stats *stats)
+{
+	uint32_t usec[WESTON_FRAME_PHASE_COUNT];
+	int i;
+
+	for (i = 0; i < WESTON_FRAME_PHASE_COUNT; i++)
+		usec[i] = stats->phase_nsec[i] / stats->frames / 1000;
+
+	weston_output_stats_send_stats(stats->resource, stats->frames,
+				       usec[WESTON_FRAME_PHASE_VIEW_LIST],
+				       usec[WESTON_FRAME_PHASE_ASSIGN_PLANES],
+				       usec[WESTON_FRAME_PHASE_ACCUMULATE_DAMAGE],
+				       usec[WESTON_FRAME_PHASE_REPAINT],
+				       usec[WESTON_FRAME_PHASE_POST_REPAINT],
+				       stats->max_frame_nsec / 1000,
+				       stats->damaged_pixels / stats->frames,
+				       stats->views / stats->frames,
+				       stats->planes, stats->uploads,
+				       stats->dropped, stats->arena_grows,
+				       stats->damage_rects_in,
+				       stats->damage_rects_out);
+
+	output_stats_reset(stats);
+}
+
+/** Add a repainted frame to the output's subscriptions
+ *
+ * \param output The output repainted
+ * \param frame What the repaint cost
+ */
+void
+weston_frame_stats_frame(struct weston_output *output,
+			 const struct weston_frame_stats *frame)
+{
+	struct output_stats *stats;
+	uint64_t total;
+	int i;
+
+	wl_list_for_each(stats, &output->frame_stats_list, link) {
+		total = 0;
+		for (i = 0; i < WESTON_FRAME_PHASE_COUNT; i++) {
+			stats->phase_nsec[i] += frame->phase_nsec[i];
+			total += frame->phase_nsec[i];
+		}
+		if (total > stats->max_frame_nsec)
+			stats->max_frame_nsec = total;
+
+		stats->damaged_pixels += frame->damaged_pixels;
+		stats->views += frame->views;
+		if (frame->planes > stats->planes)
+			stats->planes = frame->planes;
+		stats->uploads += frame->uploads;
+		stats->arena_grows += frame->arena_grows;
+		stats->damage_rects_in += frame->damage_rects_in;
+		stats->damage_rects_out += frame->damage_rects_out;
+		stats->painted = 1;
+
+		if (++stats->frames >= stats->interval)
+			output_stats_send(stats);
+	}
+}
+
+/** Count the vblanks missed on the way to a presentation
+ *
+ * \param output The output that finished a frame
+ * \param stamp The presentation time
+ * \param refresh_nsec The refresh period of the output
+ *
+ * A frame painted after the previous finish_frame is due a refresh
+ * after it, so every further refresh before stamp is a dropped frame.
+ */
+void
+weston_frame_stats_present(struct weston_output *output,
+			   const struct timespec *stamp,
+			   uint32_t refresh_nsec)
+{
+	struct output_stats *stats;
+	int64_t nsec;
+
+	wl_list_for_each(stats, &output->frame_stats_list, link) {
+		if (stats->painted &&
+		    (stats->stamp.tv_sec || stats->stamp.tv_nsec) &&
+		    refresh_nsec > 0) {
+			nsec = (int64_t) (stamp->tv_sec - stats->stamp.tv_sec) *
+				1000000000 + stamp->tv_nsec -
+				stats->stamp.tv_nsec;
+			nsec = (nsec + refresh_nsec / 2) / refresh_nsec;
+			if (nsec > 1)
+				stats->dropped += nsec - 1;
+		}
+
+		stats->painted = 0;
+		stats->stamp = *stamp;
+	}
+}
+
+static void
+output_stats_output_destroyed(struct wl_listener *listener, void *data)
+{
+	struct output_stats *stats =
+		container_of(listener, struct output_stats,
+			     output_destroy_listener);
+
+	wl_list_remove(&stats->link);
+	wl_list_init(&stats->link);
+	wl_list_remove(&stats->output_destroy_listener.link);
+	wl_list_init(&stats->output_destroy_listener.link);
+	stats->output = NULL;
+}
+
+static void
+destroy_output_stats(struct wl_resource *resource)
+{
+	struct output_stats *stats = wl_resource_get_user_data(resource);
+
+	wl_list_remove(&stats->link);
+	wl_list_remove(&stats->output_destroy_listener.link);
+	free(stats);
+}
+
+static void
+output_stats_destroy(struct wl_client *client, struct wl_resource *resource)
+{
+	wl_resource_destroy(resource);
+}
+
+static const struct weston_output_stats_interface output_stats_implementation = {
+	output_stats_destroy
+};
+
+static void
+frame_stats_destroy(struct wl_client *client, struct wl_resource *resource)
+{
+	wl_resource_destroy(resource);
+}
+
+static void
+frame_stats_get_output_stats(struct wl_client *client,
+			     struct wl_resource *resource, uint32_t id,
+			     struct wl_resource *output_resource,
+			     uint32_t frames)
+{
+	struct weston_output *output =
+		wl_resource_get_user_data(output_resource);
+	struct output_stats *stats;
+
+	stats = zalloc(sizeof *stats);
+	if (stats == NULL)
+		goto err_calloc;
+
+	stats->resource = wl_resource_create(client,
+					     &weston_output_stats_interface,
+					     1, id);
+	if (stats->resource == NULL)
+		goto err_create;
+
+	wl_resource_set_implementation(stats->resource,
+				       &output_stats_implementation, stats,
+				       destroy_output_stats);
+
+	stats->output = output;
+	stats->interval = frames > 0 ? frames : 1;
+	wl_list_insert(&output->frame_stats_list, &stats->link);
+	stats->output_destroy_listener.notify = output_stats_output_destroyed;
+	wl_signal_add(&output->destroy_signal,
+		      &stats->output_destroy_listener);
+
+	return;
+
+err_create:
+	free(stats);
+
+err_calloc:
+	wl_client_post_no_memory(client);
+}
+
+static const struct weston_frame_stats_interface frame_stats_implementation = {
+	frame_stats_destroy,
+	frame_stats_get_output_stats
+};
+
+static void
+bind_frame_stats(struct wl_client *client,
+		 void *data, uint32_t version, uint32_t id)
+{
+	struct weston_compositor *compositor = data;
+	struct wl_resource *resource;
+
+	resource = wl_resource_create(client, &weston_frame_stats_interface,
+				      1, id);
+	if (resource == NULL) {
+		wl_client_post_no_memory(client);
+		return;
+	}
+
+	wl_resource_set_implementation(resource, &frame_stats_implementation,
+				       compositor, NULL);
+}
+
+void
+weston_frame_stats_init(struct weston_compositor *compositor)
+{
+	struct weston_config_section *s;
+	int enabled;
+
+	s = weston_config_get_section(compositor->config, "core", NULL, NULL);
+	weston_config_section_get_bool(s, "frame-stats", &enabled, 0);
+	if (!enabled)
+		return;
+
+	if (!wl_global_create(compositor->wl_display,
+			      &weston_frame_stats_interface, 1,
+			      compositor, bind_frame_stats))
+		weston_log("failed to create the frame stats global\n");
+}
@@ -311,8 +311,9 @@ merge_down(pixman_box32_t *a, pixman_box32_t *b, pixman_box32_t *merge)
 }
 
 static int
-compress_bands(pixman_box32_t *inrects, int nrects,
-		   pixman_box32_t **outrects)
+compress_bands(struct weston_output *output,
+	       pixman_box32_t *inrects, int nrects,
+	       pixman_box32_t **outrects)
 {
 	bool merged;
 	pixman_box32_t *out, merge_rect;
@@ -326,7 +327,13 @@ compress_bands(pixman_box32_t *inrects, int nrects,
 	/* nrects is an upper bound - we're not too worried about
 	 * allocating a little extra
 	 */
-	out = malloc(sizeof(pixman_box32_t) * nrects);
+	out = weston_output_frame_alloc(output,
+					sizeof(pixman_box32_t) * nrects);
+	if (!out) {
+		*outrects = inrects;
+		return nrects;
+	}
+
 	out[0] = inrects[0];
 	nout = 1;
 	for (i = 1; i < nrects; i++) {
@@ -347,8 +354,8 @@ compress_bands(pixman_box32_t *inrects, int nrects,
 }
 
 static int
-texture_region(struct weston_view *ev, pixman_region32_t *region,
-		pixman_region32_t *surf_region)
+texture_region(struct weston_view *ev, struct weston_output *output,
+	       pixman_region32_t *region, pixman_region32_t *surf_region)
 {
 	struct gl_surface_state *gs = get_surface_state(ev->surface);
 	struct weston_compositor *ec = ev->surface->compositor;
@@ -358,17 +365,14 @@ texture_region(struct weston_view *ev, pixman_region32_t *region,
 	pixman_box32_t *rects, *surf_rects;
 	pixman_box32_t *raw_rects;
 	int i, j, k, nrects, nsurf, raw_nrects;
-	bool used_band_compression;
 	raw_rects = pixman_region32_rectangles(region, &raw_nrects);
 	surf_rects = pixman_region32_rectangles(surf_region, &nsurf);
 
 	if (raw_nrects < 4) {
-		used_band_compression = false;
 		nrects = raw_nrects;
 		rects = raw_rects;
 	} else {
-		nrects = compress_bands(raw_rects, raw_nrects, &rects);
-		used_band_compression = true;
+		nrects = compress_bands(output, raw_rects, raw_nrects, &rects);
 	}
 	/* worst case we can have 8 vertices per rect (ie. clipped into
 	 * an octagon):
@@ -428,13 +432,12 @@ texture_region(struct weston_view *ev, pixman_region32_t *region,
 		}
 	}
 
-	if (used_band_compression)
-		free(rects);
 	return nvtx;
 }
 
 static void
-triangle_fan_debug(struct weston_view *view, int first, int count)
+triangle_fan_debug(struct weston_view *view, struct weston_output *output,
+		   int first, int count)
 {
 	struct weston_compositor *compositor = view->surface->compositor;
 	struct gl_renderer *gr = get_renderer(compositor);
@@ -452,7 +455,9 @@ triangle_fan_debug(struct weston_view *view, int first, int count)
 
 	nelems = (count - 1 + count - 2) * 2;
 
-	buffer = malloc(sizeof(GLushort) * nelems);
+	buffer = weston_output_frame_alloc(output, sizeof(GLushort) * nelems);
+	if (!buffer)
+		return;
 	index = buffer;
 
 	for (i = 1; i < count; i++) {
@@ -470,12 +475,11 @@ triangle_fan_debug(struct weston_view *view, int first, int count)
 			color[color_idx++ % ARRAY_LENGTH(color)]);
 	glDrawElements(GL_LINES, nelems, GL_UNSIGNED_SHORT, buffer);
 	glUseProgram(gr->current_shader->program);
-	free(buffer);
 }
 
 static void
-repaint_region(struct weston_view *ev, pixman_region32_t *region,
-		pixman_region32_t *surf_region)
+repaint_region(struct weston_view *ev, struct weston_output *output,
+	       pixman_region32_t *region, pixman_region32_t *surf_region)
 {
 	struct weston_compositor *ec = ev->surface->compositor;
 	struct gl_renderer *gr = get_renderer(ec);
@@ -491,7 +495,7 @@ repaint_region(struct weston_view *ev, pixman_region32_t *region,
 	 * polygon for each pair, and store it as a triangle fan if
 	 * it has a non-zero area (at least 3 vertices1, actually).
 	 */
-	nfans = texture_region(ev, region, surf_region);
+	nfans = texture_region(ev, output, region, surf_region);
 
 	v = gr->vertices.data;
 	vtxcnt = gr->vtxcnt.data;
@@ -507,7 +511,7 @@ repaint_region(struct weston_view *ev, pixman_region32_t *region,
 	for (i = 0, first = 0; i < nfans; i++) {
 		glDrawArrays(GL_TRIANGLE_FAN, first, vtxcnt[i]);
 		if (gr->fan_debug)
-			triangle_fan_debug(ev, first, vtxcnt[i]);
+			triangle_fan_debug(ev, output, first, vtxcnt[i]);
 		first += vtxcnt[i];
 	}
 
@@ -655,13 +659,13 @@ draw_view(struct weston_view *ev, struct weston_output *output,
 		else
 			glDisable(GL_BLEND);
 
-		repaint_region(ev, &repaint, &ev->surface->opaque);
+		repaint_region(ev, output, &repaint, &ev->surface->opaque);
 	}
 
 	if (pixman_region32_not_empty(&surface_blend)) {
 		use_shader(gr, gs->shader);
 		glEnable(GL_BLEND);
-		repaint_region(ev, &repaint, &surface_blend);
+		repaint_region(ev, output, &repaint, &surface_blend);
 	}
 
 	pixman_region32_fini(&surface_blend);
@@ -987,7 +991,11 @@ gl_renderer_repaint_output(struct weston_output *output,
 		}
 
 		rects = pixman_region32_rectangles(&buffer_damage, &nrects);
-		egl_damage = malloc(nrects * 4 * sizeof(EGLint));
+		egl_damage = weston_output_frame_alloc(output,
+						       nrects * 4 *
+						       sizeof(EGLint));
+		if (!egl_damage)
+			nrects = 0;
 
 		buffer_height = go->borders[GL_RENDERER_BORDER_TOP].height +
 				output->current_mode->height +
@@ -1003,7 +1011,6 @@ gl_renderer_repaint_output(struct weston_output *output,
 		ret = gr->swap_buffers_with_damage(gr->egl_display,
 						   go->egl_surface,
 						   egl_damage, nrects);
-		free(egl_damage);
 		pixman_region32_fini(&buffer_damage);
 	} else {
 		ret = eglSwapBuffers(gr->egl_display, go->egl_surface);
@@ -0,0 +1,323 @@
+/*
+ * Copyright © 2015 The Weston contributors
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation, and that the name of the copyright holders not be used in
+ * advertising or publicity pertaining to distribution of the software
+ * without specific, written prior permission.  The copyright holders make
+ * no representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS
+ * SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS, IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER
+ * RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF
+ * CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Input to presentation latency: the time from the compositor receiving
+ * an input event for a client's focused surface, to the presentation of
+ * the first commit the client makes after it.
+ *
+ * The arrival time of the oldest unanswered input is kept per client.
+ * The client's next commit moves it to the committed surface, the
+ * repaint that picks the surface up moves it to the output, and the
+ * output's next finish_frame turns it into a sample.
+ *
+ * Tracking is on while the timeline is open or a client has the
+ * weston_input_latency debug interface bound.
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "compositor.h"
+#include "timeline.h"
+#include "input-latency-server-protocol.h"
+
+/* one millisecond each, the last one open ended */
+#define LATENCY_BUCKETS 64
+
+struct input_latency_client {
+	struct weston_compositor *compositor;
+	struct wl_client *client;
+	struct wl_listener destroy_listener;
+	struct wl_list link;
+
+	/* oldest input not yet followed by a commit, or zero */
+	struct timespec pending;
+
+	uint32_t samples;
+	uint32_t histogram[LATENCY_BUCKETS];
+};
+
+struct input_latency_record {
+	/* NULL once the client is gone */
+	struct input_latency_client *client;
+	struct timespec input;
+};
+
+static int
+tracking(struct weston_compositor *compositor)
+{
+	return compositor->input_latency_listeners > 0 ||
+		weston_timeline_enabled_;
+}
+
+static void
+latency_client_destroy(struct wl_listener *listener, void *data)
+{
+	struct input_latency_client *lc =
+		container_of(listener, struct input_latency_client,
+			     destroy_listener);
+	struct input_latency_record *record;
+	struct weston_output *output;
+
+	wl_list_for_each(output, &lc->compositor->output_list, link) {
+		wl_array_for_each(record, &output->input_latency_list)
+			if (record->client == lc)
+				record->client = NULL;
+	}
+
+	wl_list_remove(&lc->link);
+	free(lc);
+}
+
+static struct input_latency_client *
+latency_client_get(struct weston_compositor *compositor,
+		   struct wl_client *client, int create)
+{
+	struct input_latency_client *lc;
+	struct wl_listener *listener;
+
+	listener = wl_client_get_destroy_listener(client,
+						  latency_client_destroy);
+	if (listener)
+		return container_of(listener, struct input_latency_client,
+				    destroy_listener);
+
+	if (!create)
+		return NULL;
+
+	lc = zalloc(sizeof *lc);
+	if (!lc)
+		return NULL;
+
+	lc->compositor = compositor;
+	lc->client = client;
+	lc->destroy_listener.notify = latency_client_destroy;
+	wl_client_add_destroy_listener(client, &lc->destroy_listener);
+	wl_list_insert(&compositor->input_latency_client_list, &lc->link);
+
+	return lc;
+}
+
+/** Note the arrival of an input event for a surface
+ *
+ * \param compositor The compositor
+ * \param focus The surface the event is delivered to, or NULL
+ */
+void
+weston_input_latency_note_input(struct weston_compositor *compositor,
+				struct weston_surface *focus)
+{
+	struct input_latency_client *lc;
+
+	if (!focus || !focus->resource || !tracking(compositor))
+		return;
+
+	lc = latency_client_get(compositor,
+				wl_resource_get_client(focus->resource), 1);
+	if (!lc || lc->pending.tv_sec || lc->pending.tv_nsec)
+		return;
+
+	clock_gettime(compositor->presentation_clock, &lc->pending);
+}
+
+/** Attribute pending input of the surface's client to this commit */
+void
+weston_input_latency_note_commit(struct weston_surface *surface)
+{
+	struct weston_compositor *compositor = surface->compositor;
+	struct input_latency_client *lc;
+
+	if (!surface->resource || !tracking(compositor))
+		return;
+
+	lc = latency_client_get(compositor,
+				wl_resource_get_client(surface->resource), 0);
+	if (!lc || (lc->pending.tv_sec == 0 && lc->pending.tv_nsec == 0))
+		return;
+
+	/* an older commit not yet repainted keeps the older input */
+	if (surface->input_latency.tv_sec == 0 &&
+	    surface->input_latency.tv_nsec == 0) {
+		surface->input_latency = lc->pending;
+		TL_POINT("core_input_commit", TLP_SURFACE(surface),
+			 TLP_INPUT(&lc->pending), TLP_END);
+	}
+
+	lc->pending.tv_sec = 0;
+	lc->pending.tv_nsec = 0;
+}
+
+/** Move the surface's committed input to the output being repainted */
+void
+weston_input_latency_take(struct weston_output *output,
+			  struct weston_surface *surface)
+{
+	struct input_latency_record *record;
+
+	if (surface->input_latency.tv_sec == 0 &&
+	    surface->input_latency.tv_nsec == 0)
+		return;
+
+	record = NULL;
+	if (surface->resource)
+		record = wl_array_add(&output->input_latency_list,
+				      sizeof *record);
+	if (record) {
+		record->client =
+			latency_client_get(surface->compositor,
+					   wl_resource_get_client(surface->resource),
+					   0);
+		record->input = surface->input_latency;
+	}
+
+	surface->input_latency.tv_sec = 0;
+	surface->input_latency.tv_nsec = 0;
+}
+
+/** Turn the inputs repainted on the output into samples */
+void
+weston_input_latency_present(struct weston_output *output,
+			     const struct timespec *stamp)
+{
+	struct input_latency_record *record;
+	int64_t msec;
+
+	wl_array_for_each(record, &output->input_latency_list) {
+		TL_POINT("core_input_presented", TLP_OUTPUT(output),
+			 TLP_INPUT(&record->input), TLP_VBLANK(stamp),
+			 TLP_END);
+
+		if (!record->client)
+			continue;
+
+		msec = (stamp->tv_sec - record->input.tv_sec) * 1000 +
+			(stamp->tv_nsec - record->input.tv_nsec) / 1000000;
+		if (msec < 0)
+			msec = 0;
+		if (msec >= LATENCY_BUCKETS)
+			msec = LATENCY_BUCKETS - 1;
+
+		record->client->histogram[msec]++;
+		record->client->samples++;
+	}
+
+	output->input_latency_list.size = 0;
+}
+
+static void
+latency_destroy(struct wl_client *client, struct wl_resource *resource)
+{
+	wl_resource_destroy(resource);
+}
+
+static void
+latency_report(struct wl_client *client, struct wl_resource *resource)
+{
+	struct weston_compositor *compositor =
+		wl_resource_get_user_data(resource);
+	struct input_latency_client *lc;
+	struct wl_array histogram;
+	pid_t pid;
+
+	wl_list_for_each(lc, &compositor->input_latency_client_list, link) {
+		if (lc->samples == 0)
+			continue;
+
+		wl_client_get_credentials(lc->client, &pid, NULL, NULL);
+		histogram.size = sizeof lc->histogram;
+		histogram.alloc = 0;
+		histogram.data = lc->histogram;
+		weston_input_latency_send_client(resource, pid, lc->samples,
+						 &histogram);
+	}
+
+	weston_input_latency_send_done(resource);
+}
+
+static const struct weston_input_latency_interface latency_implementation = {
+	latency_destroy,
+	latency_report
+};
+
+static void
+unbind_latency(struct wl_resource *resource)
+{
+	struct weston_compositor *compositor =
+		wl_resource_get_user_data(resource);
+
+	compositor->input_latency_listeners--;
+}
+
+static void
+bind_latency(struct wl_client *client,
+	     void *data, uint32_t version, uint32_t id)
+{
+	struct weston_compositor *compositor = data;
+	struct wl_resource *resource;
+
+	resource = wl_resource_create(client, &weston_input_latency_interface,
+				      1, id);
+	if (resource == NULL) {
+		wl_client_post_no_memory(client);
+		return;
+	}
+
+	wl_resource_set_implementation(resource, &latency_implementation,
+				       compositor, unbind_latency);
+	compositor->input_latency_listeners++;
+}
+
+void
+weston_input_latency_init(struct weston_compositor *compositor)
+{
+	struct weston_config_section *s;
+	int enabled;
+
+	wl_list_init(&compositor->input_latency_client_list);
+
+	s = weston_config_get_section(compositor->config, "core", NULL, NULL);
+	weston_config_section_get_bool(s, "input-latency", &enabled, 0);
+	if (!enabled)
+		return;
+
+	if (!wl_global_create(compositor->wl_display,
+			      &weston_input_latency_interface, 1,
+			      compositor, bind_latency))
+		weston_log("failed to create the input latency global\n");
+}
+
+void
+weston_input_latency_release(struct weston_compositor *compositor)
+{
+	struct input_latency_client *lc, *next;
+
+	wl_list_for_each_safe(lc, next,
+			      &compositor->input_latency_client_list, link) {
+		wl_list_remove(&lc->destroy_listener.link);
+		wl_list_remove(&lc->link);
+		free(lc);
+	}
+}
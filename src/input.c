@@ -24,14 +24,18 @@
 
 #include <stdlib.h>
 #include <stdint.h>
+#include <inttypes.h>
 #include <string.h>
 #include <sys/mman.h>
 #include <assert.h>
 #include <unistd.h>
 #include <fcntl.h>
 #include <limits.h>
+#include <pthread.h>
+#include <sys/stat.h>
 
 #include "../shared/os-compatibility.h"
+#include "../shared/hash.h"
 #include "compositor.h"
 
 static void
@@ -475,6 +479,7 @@ weston_pointer_create(struct weston_seat *seat)
 	wl_signal_init(&pointer->motion_signal);
 	wl_signal_init(&pointer->focus_signal);
 	wl_list_init(&pointer->focus_view_listener.link);
+	wl_array_init(&pointer->coalesce.history);
 
 	pointer->sprite_destroy_listener.notify = pointer_handle_sprite_destroy;
 
@@ -498,6 +503,11 @@ weston_pointer_destroy(struct weston_pointer *pointer)
 
 	/* XXX: What about pointer->resource_list? */
 
+	if (pointer->coalesce.saved)
+		weston_log("%" PRIu64 " pointer motion events coalesced\n",
+			   pointer->coalesce.saved);
+	wl_array_release(&pointer->coalesce.history);
+
 	wl_list_remove(&pointer->focus_resource_listener.link);
 	wl_list_remove(&pointer->focus_view_listener.link);
 	wl_list_remove(&pointer->output_destroy_listener.link);
@@ -937,6 +947,108 @@ weston_pointer_handle_output_destroy(struct wl_listener *listener, void *data)
 	weston_pointer_move(pointer, fx, fy);
 }
 
+/* Holds relative motion back until the next repaint, or until a
+ * button, axis, key or absolute event needs it delivered first. */
+static void
+weston_pointer_coalesce_motion(struct weston_pointer *pointer,
+			       uint32_t time, wl_fixed_t dx, wl_fixed_t dy)
+{
+	struct weston_compositor *ec = pointer->seat->compositor;
+	struct weston_motion_sample *sample;
+
+	if (pointer->coalesce.pending)
+		pointer->coalesce.saved++;
+	else
+		weston_compositor_schedule_repaint(ec);
+
+	pointer->coalesce.pending = 1;
+	pointer->coalesce.time = time;
+	pointer->coalesce.dx += dx;
+	pointer->coalesce.dy += dy;
+
+	if (ec->motion_coalescing != WESTON_MOTION_COALESCING_HISTORY)
+		return;
+
+	sample = wl_array_add(&pointer->coalesce.history, sizeof *sample);
+	if (sample) {
+		sample->time = time;
+		sample->dx = pointer->coalesce.dx;
+		sample->dy = pointer->coalesce.dy;
+	}
+}
+
+/* Sends all but the last held back sample to the focus, which only the
+ * default grab would have done anyway.  The samples are clamped like
+ * weston_pointer_move() does, and the history stops at the first one
+ * the focus would have been taken away at. */
+static void
+weston_pointer_send_motion_history(struct weston_pointer *pointer)
+{
+	struct weston_compositor *ec = pointer->seat->compositor;
+	struct wl_array *history = &pointer->coalesce.history;
+	struct weston_motion_sample *sample, *last;
+	struct wl_resource *resource;
+	wl_fixed_t x, y, sx, sy;
+
+	if (history->size < 2 * sizeof *sample || !pointer->focus ||
+	    pointer->grab != &pointer->default_grab ||
+	    pointer->grab->interface != &default_pointer_grab_interface)
+		return;
+
+	last = (struct weston_motion_sample *)
+		((char *) history->data + history->size) - 1;
+	for (sample = history->data; sample < last; sample++) {
+		x = pointer->x + sample->dx;
+		y = pointer->y + sample->dy;
+		weston_pointer_clamp(pointer, &x, &y);
+
+		if (weston_compositor_pick_view(ec, x, y, &sx, &sy) !=
+		    pointer->focus)
+			break;
+
+		wl_resource_for_each(resource, &pointer->focus_resource_list)
+			wl_pointer_send_motion(resource, sample->time, sx, sy);
+	}
+}
+
+WL_EXPORT void
+weston_pointer_flush_motion(struct weston_pointer *pointer)
+{
+	wl_fixed_t x, y;
+
+	if (!pointer || !pointer->coalesce.pending)
+		return;
+
+	weston_pointer_send_motion_history(pointer);
+
+	x = pointer->x + pointer->coalesce.dx;
+	y = pointer->y + pointer->coalesce.dy;
+	pointer->coalesce.pending = 0;
+	pointer->coalesce.dx = 0;
+	pointer->coalesce.dy = 0;
+	pointer->coalesce.history.size = 0;
+
+	pointer->grab->interface->motion(pointer->grab,
+					 pointer->coalesce.time, x, y);
+}
+
+WL_EXPORT void
+weston_compositor_flush_motion(struct weston_compositor *compositor)
+{
+	struct weston_seat *seat;
+
+	wl_list_for_each(seat, &compositor->seat_list, link)
+		weston_pointer_flush_motion(seat->pointer);
+}
+
+static void
+note_pointer_input(struct weston_pointer *pointer)
+{
+	weston_input_latency_note_input(pointer->seat->compositor,
+					pointer->focus ?
+					pointer->focus->surface : NULL);
+}
+
 WL_EXPORT void
 notify_motion(struct weston_seat *seat,
 	      uint32_t time, wl_fixed_t dx, wl_fixed_t dy)
@@ -945,6 +1057,13 @@ notify_motion(struct weston_seat *seat,
 	struct weston_pointer *pointer = seat->pointer;
 
 	weston_compositor_wake(ec);
+	note_pointer_input(pointer);
+
+	if (ec->motion_coalescing != WESTON_MOTION_COALESCING_NONE) {
+		weston_pointer_coalesce_motion(pointer, time, dx, dy);
+		return;
+	}
+
 	pointer->grab->interface->motion(pointer->grab, time, pointer->x + dx, pointer->y + dy);
 }
 
@@ -992,6 +1111,8 @@ notify_motion_absolute(struct weston_seat *seat,
 	struct weston_pointer *pointer = seat->pointer;
 
 	weston_compositor_wake(ec);
+	note_pointer_input(pointer);
+	weston_pointer_flush_motion(pointer);
 	pointer->grab->interface->motion(pointer->grab, time, x, y);
 }
 
@@ -1016,6 +1137,9 @@ notify_button(struct weston_seat *seat, uint32_t time, int32_t button,
 	struct weston_compositor *compositor = seat->compositor;
 	struct weston_pointer *pointer = seat->pointer;
 
+	note_pointer_input(pointer);
+	weston_pointer_flush_motion(pointer);
+
 	if (state == WL_POINTER_BUTTON_STATE_PRESSED) {
 		weston_compositor_idle_inhibit(compositor);
 		if (pointer->button_count == 0) {
@@ -1054,6 +1178,9 @@ notify_axis(struct weston_seat *seat, uint32_t time, uint32_t axis,
 	if (!value)
 		return;
 
+	note_pointer_input(pointer);
+	weston_pointer_flush_motion(pointer);
+
 	if (weston_compositor_run_axis_binding(compositor, seat,
 						   time, axis, value))
 		return;
@@ -1231,7 +1358,7 @@ send_modifiers(struct wl_resource *resource, uint32_t serial, struct weston_keyb
 }
 
 static struct weston_xkb_info *
-weston_xkb_info_create(struct xkb_keymap *keymap);
+weston_xkb_info_create(struct weston_compositor *ec, struct xkb_keymap *keymap);
 
 static void
 update_keymap(struct weston_seat *seat)
@@ -1243,7 +1370,8 @@ update_keymap(struct weston_seat *seat)
 	xkb_mod_mask_t latched_mods;
 	xkb_mod_mask_t locked_mods;
 
-	xkb_info = weston_xkb_info_create(keyboard->pending_keymap);
+	xkb_info = weston_xkb_info_create(seat->compositor,
+					  keyboard->pending_keymap);
 
 	xkb_keymap_unref(keyboard->pending_keymap);
 	keyboard->pending_keymap = NULL;
@@ -1319,6 +1447,11 @@ notify_key(struct weston_seat *seat, uint32_t time, uint32_t key,
 	struct weston_keyboard_grab *grab = keyboard->grab;
 	uint32_t *k, *end;
 
+	weston_input_latency_note_input(compositor, keyboard->focus);
+
+	/* bindings may act on the pointer position */
+	weston_pointer_flush_motion(seat->pointer);
+
 	if (state == WL_KEYBOARD_KEY_STATE_PRESSED) {
 		weston_compositor_idle_inhibit(compositor);
 	} else {
@@ -1372,6 +1505,8 @@ WL_EXPORT void
 notify_pointer_focus(struct weston_seat *seat, struct weston_output *output,
 		     wl_fixed_t x, wl_fixed_t y)
 {
+	weston_pointer_flush_motion(seat->pointer);
+
 	if (output) {
 		weston_pointer_move(seat->pointer, x, y);
 	} else {
@@ -1508,6 +1643,9 @@ notify_touch(struct weston_seat *seat, uint32_t time, int touch_id,
 	struct weston_view *ev;
 	wl_fixed_t sx, sy;
 
+	if (touch->focus)
+		weston_input_latency_note_input(ec, touch->focus->surface);
+
 	/* Update grab's global coordinates. */
 	if (touch_id == touch->grab_touch_id && touch_type != WL_TOUCH_UP) {
 		touch->grab_x = x;
@@ -1538,6 +1676,10 @@ notify_touch(struct weston_seat *seat, uint32_t time, int touch_id,
 			return;
 		}
 
+		/* the first finger down had no focus to note above */
+		if (ev)
+			weston_input_latency_note_input(ec, ev->surface);
+
 		weston_compositor_run_touch_binding(ec, seat,
 						    time, touch_type);
 
@@ -1616,6 +1758,7 @@ pointer_cursor_surface_configure(struct weston_surface *es,
 	weston_view_set_position(pointer->sprite, x, y);
 
 	empty_region(&es->pending.input);
+	es->pending.changed |= WESTON_SURFACE_STATE_INPUT;
 	empty_region(&es->input);
 
 	if (!weston_surface_is_mapped(es)) {
@@ -1902,6 +2045,277 @@ bind_seat(struct wl_client *client, void *data, uint32_t version, uint32_t id)
 }
 
 #ifdef ENABLE_XKBCOMMON
+static uint32_t
+keymap_hash(const char *str)
+{
+	uint32_t hash = 2166136261u;
+
+	for (; *str; str++)
+		hash = (hash ^ (unsigned char) *str) * 16777619u;
+
+	return hash;
+}
+
+/* Compiled keymaps can be kept on disk, one file per set of RMLVO names
+ * and the modification time of their rules file.  The file holds a
+ * header that repeats all of that, followed by the keymap as text,
+ * which compiles much faster than the names.  Files for stale rules
+ * are simply never looked up again. */
+static char *
+keymap_cache_header(struct xkb_context *context,
+		    const struct xkb_rule_names *names)
+{
+	struct stat st;
+	char path[PATH_MAX];
+	long long mtime = 0;
+	unsigned int i;
+	char *header;
+
+	for (i = 0; i < xkb_context_num_include_paths(context); i++) {
+		snprintf(path, sizeof path, "%s/rules/%s",
+			 xkb_context_include_path_get(context, i),
+			 names->rules);
+		if (stat(path, &st) == 0) {
+			mtime = st.st_mtime;
+			break;
+		}
+	}
+
+	if (asprintf(&header, "weston keymap 1\n"
+		     "rules=%s\nmodel=%s\nlayout=%s\nvariant=%s\n"
+		     "options=%s\nmtime=%lld\n\n",
+		     names->rules ? names->rules : "",
+		     names->model ? names->model : "",
+		     names->layout ? names->layout : "",
+		     names->variant ? names->variant : "",
+		     names->options ? names->options : "",
+		     mtime) < 0)
+		return NULL;
+
+	return header;
+}
+
+static int
+keymap_cache_path(char *path, size_t size, const char *header)
+{
+	const char *dir, *home;
+	int len;
+
+	dir = getenv("XDG_CACHE_HOME");
+	home = getenv("HOME");
+	if (dir && dir[0] == '/')
+		len = snprintf(path, size, "%s/weston/keymaps", dir);
+	else if (home)
+		len = snprintf(path, size, "%s/.cache/weston/keymaps", home);
+	else
+		return -1;
+
+	if (len < 0 || (size_t) len >= size - 16)
+		return -1;
+
+	if (header)
+		snprintf(path + len, size - len, "/%08x", keymap_hash(header));
+
+	return 0;
+}
+
+static struct xkb_keymap *
+keymap_cache_load(struct xkb_context *context,
+		  const struct xkb_rule_names *names)
+{
+	struct xkb_keymap *keymap = NULL;
+	char path[PATH_MAX];
+	char *header, *data;
+	size_t header_len;
+	struct stat st;
+	int fd;
+
+	header = keymap_cache_header(context, names);
+	if (header == NULL)
+		return NULL;
+
+	if (keymap_cache_path(path, sizeof path, header) < 0)
+		goto out_header;
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+	if (fd < 0)
+		goto out_header;
+
+	header_len = strlen(header);
+	if (fstat(fd, &st) < 0 || (size_t) st.st_size <= header_len)
+		goto out_fd;
+
+	data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (data == MAP_FAILED)
+		goto out_fd;
+
+	if (memcmp(data, header, header_len) == 0 &&
+	    data[st.st_size - 1] == '\0')
+		keymap = xkb_keymap_new_from_string(context, data + header_len,
+						    XKB_KEYMAP_FORMAT_TEXT_V1,
+						    0);
+
+	munmap(data, st.st_size);
+out_fd:
+	close(fd);
+out_header:
+	free(header);
+
+	return keymap;
+}
+
+static void
+keymap_cache_store(struct xkb_context *context,
+		   const struct xkb_rule_names *names,
+		   struct xkb_keymap *keymap)
+{
+	char path[PATH_MAX], tmp[PATH_MAX + 8];
+	char *header, *keymap_str, *p;
+	int fd, ret;
+
+	if (keymap_cache_path(path, sizeof path, NULL) < 0)
+		return;
+
+	/* create the directory and its parents, best effort */
+	for (p = strchr(path + 1, '/'); p; p = strchr(p + 1, '/')) {
+		*p = '\0';
+		mkdir(path, 0700);
+		*p = '/';
+	}
+	mkdir(path, 0700);
+
+	header = keymap_cache_header(context, names);
+	if (header == NULL)
+		return;
+
+	keymap_str = xkb_keymap_get_as_string(keymap,
+					      XKB_KEYMAP_FORMAT_TEXT_V1);
+	if (keymap_str == NULL)
+		goto out_header;
+
+	keymap_cache_path(path, sizeof path, header);
+	snprintf(tmp, sizeof tmp, "%s.XXXXXX", path);
+	fd = mkostemp(tmp, O_CLOEXEC);
+	if (fd < 0)
+		goto out_keymap_str;
+
+	ret = os_write_all(fd, header, strlen(header));
+	if (ret == 0)
+		ret = os_write_all(fd, keymap_str, strlen(keymap_str) + 1);
+	close(fd);
+
+	if (ret < 0 || rename(tmp, path) < 0)
+		unlink(tmp);
+
+out_keymap_str:
+	free(keymap_str);
+out_header:
+	free(header);
+}
+
+static struct xkb_keymap *
+compile_keymap(struct xkb_context *context,
+	       const struct xkb_rule_names *names, int use_cache)
+{
+	struct xkb_keymap *keymap;
+
+	if (use_cache) {
+		keymap = keymap_cache_load(context, names);
+		if (keymap)
+			return keymap;
+	}
+
+	keymap = xkb_keymap_new_from_names(context, names, 0);
+	if (keymap && use_cache)
+		keymap_cache_store(context, names, keymap);
+
+	return keymap;
+}
+
+/** Compile a keymap from RMLVO names
+ *
+ * \param ec The compositor
+ * \param names The rules, model, layout, variant and options
+ * \return A new keymap, or NULL if it failed to compile
+ *
+ * Goes through the on-disk keymap cache if [keyboard] keymap_cache is
+ * enabled.
+ */
+WL_EXPORT struct xkb_keymap *
+weston_compositor_compile_keymap(struct weston_compositor *ec,
+				 const struct xkb_rule_names *names)
+{
+	return compile_keymap(ec->xkb_context, names, ec->cache_keymaps);
+}
+
+/* The global keymap is compiled on a thread of its own, started from
+ * weston_compositor_xkb_init(), so that it overlaps with the backend
+ * bringing up its renderer and outputs.  The thread uses a private XKB
+ * context, as the compositor's context is not safe to share. */
+struct weston_keymap_job {
+	pthread_t thread;
+	struct xkb_rule_names names;
+	int use_cache;
+	struct xkb_keymap *keymap;
+};
+
+static void *
+keymap_job_run(void *data)
+{
+	struct weston_keymap_job *job = data;
+	struct xkb_context *context;
+
+	context = xkb_context_new(0);
+	if (context == NULL)
+		return NULL;
+
+	job->keymap = compile_keymap(context, &job->names, job->use_cache);
+	xkb_context_unref(context);
+
+	return NULL;
+}
+
+static void
+weston_compositor_start_keymap_job(struct weston_compositor *ec)
+{
+	struct weston_keymap_job *job;
+
+	if (ec->keymap_job || ec->xkb_info)
+		return;
+
+	job = zalloc(sizeof *job);
+	if (job == NULL)
+		return;
+
+	job->names = ec->xkb_names;
+	job->use_cache = ec->cache_keymaps;
+	if (pthread_create(&job->thread, NULL, keymap_job_run, job) != 0) {
+		free(job);
+		return;
+	}
+
+	ec->keymap_job = job;
+}
+
+/* Waits for the background keymap, returning NULL if there was none
+ * or it failed to compile. */
+static struct xkb_keymap *
+weston_compositor_finish_keymap_job(struct weston_compositor *ec)
+{
+	struct weston_keymap_job *job = ec->keymap_job;
+	struct xkb_keymap *keymap;
+
+	if (job == NULL)
+		return NULL;
+
+	pthread_join(job->thread, NULL);
+	keymap = job->keymap;
+	free(job);
+	ec->keymap_job = NULL;
+
+	return keymap;
+}
+
 int
 weston_compositor_xkb_init(struct weston_compositor *ec,
 			   struct xkb_rule_names *names)
@@ -1925,6 +2339,14 @@ weston_compositor_xkb_init(struct weston_compositor *ec,
 	if (!ec->xkb_names.layout)
 		ec->xkb_names.layout = strdup("us");
 
+	if (ec->xkb_info_cache == NULL) {
+		ec->xkb_info_cache = hash_table_create();
+		if (ec->xkb_info_cache == NULL)
+			return -1;
+	}
+
+	weston_compositor_start_keymap_job(ec);
+
 	return 0;
 }
 
@@ -1934,6 +2356,9 @@ weston_xkb_info_destroy(struct weston_xkb_info *xkb_info)
 	if (--xkb_info->ref_count > 0)
 		return;
 
+	if (xkb_info->cache)
+		hash_table_remove(xkb_info->cache, xkb_info->hash);
+
 	xkb_keymap_unref(xkb_info->keymap);
 
 	if (xkb_info->keymap_area)
@@ -1943,6 +2368,14 @@ weston_xkb_info_destroy(struct weston_xkb_info *xkb_info)
 	free(xkb_info);
 }
 
+static void
+xkb_info_forget_cache(void *element, void *data)
+{
+	struct weston_xkb_info *xkb_info = element;
+
+	xkb_info->cache = NULL;
+}
+
 void
 weston_compositor_xkb_destroy(struct weston_compositor *ec)
 {
@@ -1953,6 +2386,8 @@ weston_compositor_xkb_destroy(struct weston_compositor *ec)
 	if (!ec->use_xkbcommon)
 		return;
 
+	xkb_keymap_unref(weston_compositor_finish_keymap_job(ec));
+
 	free((char *) ec->xkb_names.rules);
 	free((char *) ec->xkb_names.model);
 	free((char *) ec->xkb_names.layout);
@@ -1962,20 +2397,80 @@ weston_compositor_xkb_destroy(struct weston_compositor *ec)
 	if (ec->xkb_info)
 		weston_xkb_info_destroy(ec->xkb_info);
 	xkb_context_unref(ec->xkb_context);
+
+	/* keyboards still holding keymaps go away after us */
+	if (ec->xkb_info_cache) {
+		hash_table_for_each(ec->xkb_info_cache,
+				    xkb_info_forget_cache, NULL);
+		hash_table_destroy(ec->xkb_info_cache);
+	}
+}
+
+/* Writes the keymap to a file of its own, which is sealed against
+ * changes where the kernel can, since every client shares it. */
+static int
+create_keymap_file(const char *keymap_str, size_t size)
+{
+	ssize_t len;
+	size_t done = 0;
+	int fd;
+
+#if defined(HAVE_MEMFD_CREATE) && defined(F_ADD_SEALS)
+	fd = memfd_create("weston-keymap", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+	if (fd < 0)
+#endif
+		fd = os_create_anonymous_file(size);
+	if (fd < 0)
+		return -1;
+
+	while (done < size) {
+		len = pwrite(fd, keymap_str + done, size - done, done);
+		if (len < 0) {
+			close(fd);
+			return -1;
+		}
+		done += len;
+	}
+
+#if defined(HAVE_MEMFD_CREATE) && defined(F_ADD_SEALS)
+	fcntl(fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW |
+	      F_SEAL_WRITE | F_SEAL_SEAL);
+#endif
+
+	return fd;
 }
 
+/* Keymaps are shared by their text, so seats and backends that end up
+ * with the same keymap also share one weston_xkb_info and one fd. */
 static struct weston_xkb_info *
-weston_xkb_info_create(struct xkb_keymap *keymap)
+weston_xkb_info_create(struct weston_compositor *ec, struct xkb_keymap *keymap)
 {
-	struct weston_xkb_info *xkb_info = zalloc(sizeof *xkb_info);
-	if (xkb_info == NULL)
+	struct weston_xkb_info *xkb_info;
+	char *keymap_str;
+	uint32_t hash;
+
+	keymap_str = xkb_keymap_get_as_string(keymap,
+					      XKB_KEYMAP_FORMAT_TEXT_V1);
+	if (keymap_str == NULL) {
+		weston_log("failed to get string version of keymap\n");
 		return NULL;
+	}
+
+	hash = keymap_hash(keymap_str);
+	xkb_info = hash_table_lookup(ec->xkb_info_cache, hash);
+	if (xkb_info && strcmp(xkb_info->keymap_area, keymap_str) == 0) {
+		free(keymap_str);
+		xkb_info->ref_count++;
+		return xkb_info;
+	}
+
+	xkb_info = zalloc(sizeof *xkb_info);
+	if (xkb_info == NULL)
+		goto err_keymap_str;
 
 	xkb_info->keymap = xkb_keymap_ref(keymap);
 	xkb_info->ref_count = 1;
 
-	char *keymap_str;
-
 	xkb_info->shift_mod = xkb_keymap_mod_get_index(xkb_info->keymap,
 						       XKB_MOD_NAME_SHIFT);
 	xkb_info->caps_mod = xkb_keymap_mod_get_index(xkb_info->keymap,
@@ -2000,41 +2495,42 @@ weston_xkb_info_create(struct xkb_keymap *keymap)
 	xkb_info->scroll_led = xkb_keymap_led_get_index(xkb_info->keymap,
 							XKB_LED_NAME_SCROLL);
 
-	keymap_str = xkb_keymap_get_as_string(xkb_info->keymap,
-					      XKB_KEYMAP_FORMAT_TEXT_V1);
-	if (keymap_str == NULL) {
-		weston_log("failed to get string version of keymap\n");
-		goto err_keymap;
-	}
 	xkb_info->keymap_size = strlen(keymap_str) + 1;
 
-	xkb_info->keymap_fd = os_create_anonymous_file(xkb_info->keymap_size);
+	xkb_info->keymap_fd = create_keymap_file(keymap_str,
+						 xkb_info->keymap_size);
 	if (xkb_info->keymap_fd < 0) {
 		weston_log("creating a keymap file for %lu bytes failed: %m\n",
 			(unsigned long) xkb_info->keymap_size);
-		goto err_keymap_str;
+		goto err_keymap;
 	}
 
 	xkb_info->keymap_area = mmap(NULL, xkb_info->keymap_size,
-				     PROT_READ | PROT_WRITE,
-				     MAP_SHARED, xkb_info->keymap_fd, 0);
+				     PROT_READ, MAP_SHARED,
+				     xkb_info->keymap_fd, 0);
 	if (xkb_info->keymap_area == MAP_FAILED) {
 		weston_log("failed to mmap() %lu bytes\n",
 			(unsigned long) xkb_info->keymap_size);
 		goto err_dev_zero;
 	}
-	strcpy(xkb_info->keymap_area, keymap_str);
 	free(keymap_str);
 
+	/* on a hash collision, the keymap already there stays shared */
+	if (hash_table_lookup(ec->xkb_info_cache, hash) == NULL &&
+	    hash_table_insert(ec->xkb_info_cache, hash, xkb_info) == 0) {
+		xkb_info->cache = ec->xkb_info_cache;
+		xkb_info->hash = hash;
+	}
+
 	return xkb_info;
 
 err_dev_zero:
 	close(xkb_info->keymap_fd);
-err_keymap_str:
-	free(keymap_str);
 err_keymap:
 	xkb_keymap_unref(xkb_info->keymap);
 	free(xkb_info);
+err_keymap_str:
+	free(keymap_str);
 	return NULL;
 }
 
@@ -2046,9 +2542,9 @@ weston_compositor_build_global_keymap(struct weston_compositor *ec)
 	if (ec->xkb_info != NULL)
 		return 0;
 
-	keymap = xkb_keymap_new_from_names(ec->xkb_context,
-					   &ec->xkb_names,
-					   0);
+	keymap = weston_compositor_finish_keymap_job(ec);
+	if (keymap == NULL)
+		keymap = weston_compositor_compile_keymap(ec, &ec->xkb_names);
 	if (keymap == NULL) {
 		weston_log("failed to compile global XKB keymap\n");
 		weston_log("  tried rules %s, model %s, layout %s, variant %s, "
@@ -2059,7 +2555,7 @@ weston_compositor_build_global_keymap(struct weston_compositor *ec)
 		return -1;
 	}
 
-	ec->xkb_info = weston_xkb_info_create(keymap);
+	ec->xkb_info = weston_xkb_info_create(ec, keymap);
 	xkb_keymap_unref(keymap);
 	if (ec->xkb_info == NULL)
 		return -1;
@@ -2119,7 +2615,9 @@ weston_seat_init_keyboard(struct weston_seat *seat, struct xkb_keymap *keymap)
 #ifdef ENABLE_XKBCOMMON
 	if (seat->compositor->use_xkbcommon) {
 		if (keymap != NULL) {
-			keyboard->xkb_info = weston_xkb_info_create(keymap);
+			keyboard->xkb_info =
+				weston_xkb_info_create(seat->compositor,
+						       keymap);
 			if (keyboard->xkb_info == NULL)
 				goto err;
 		} else {
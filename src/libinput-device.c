@@ -31,6 +31,7 @@
 #include <fcntl.h>
 #include <mtdev.h>
 #include <assert.h>
+#include <pthread.h>
 #include <libinput.h>
 
 #include "compositor.h"
@@ -50,15 +51,15 @@ evdev_led_update(struct evdev_device *device, enum weston_led weston_leds)
 	if (weston_leds & LED_SCROLL_LOCK)
 		leds |= LIBINPUT_LED_SCROLL_LOCK;
 
+	pthread_mutex_lock(device->lock);
 	libinput_device_led_update(device->device, leds);
+	pthread_mutex_unlock(device->lock);
 }
 
-static void
-handle_keyboard_key(struct libinput_device *libinput_device,
-		    struct libinput_event_keyboard *keyboard_event)
+static int
+decode_keyboard_key(struct libinput_event_keyboard *keyboard_event,
+		    struct evdev_event *out)
 {
-	struct evdev_device *device =
-		libinput_device_get_user_data(libinput_device);
 	int key_state =
 		libinput_event_keyboard_get_key_state(keyboard_event);
 	int seat_key_count =
@@ -69,67 +70,52 @@ handle_keyboard_key(struct libinput_device *libinput_device,
 	     seat_key_count != 1) ||
 	    (key_state == LIBINPUT_KEY_STATE_RELEASED &&
 	     seat_key_count != 0))
-		return;
+		return 0;
 
-	notify_key(device->seat,
-		   libinput_event_keyboard_get_time(keyboard_event),
-		   libinput_event_keyboard_get_key(keyboard_event),
-		   libinput_event_keyboard_get_key_state(keyboard_event),
-		   STATE_UPDATE_AUTOMATIC);
+	out->type = EVDEV_EVENT_KEY;
+	out->time = libinput_event_keyboard_get_time(keyboard_event);
+	out->u.key.key = libinput_event_keyboard_get_key(keyboard_event);
+	out->u.key.state = key_state;
+
+	return 1;
 }
 
-static void
-handle_pointer_motion(struct libinput_device *libinput_device,
-		      struct libinput_event_pointer *pointer_event)
+static int
+decode_pointer_motion(struct libinput_event_pointer *pointer_event,
+		      struct evdev_event *out)
 {
-	struct evdev_device *device =
-		libinput_device_get_user_data(libinput_device);
-	wl_fixed_t dx, dy;
-
-	dx = wl_fixed_from_double(libinput_event_pointer_get_dx(pointer_event));
-	dy = wl_fixed_from_double(libinput_event_pointer_get_dy(pointer_event));
-	notify_motion(device->seat,
-		      libinput_event_pointer_get_time(pointer_event),
-		      dx,
-		      dy);
+	out->type = EVDEV_EVENT_MOTION;
+	out->time = libinput_event_pointer_get_time(pointer_event);
+	out->u.motion.dx =
+		wl_fixed_from_double(libinput_event_pointer_get_dx(pointer_event));
+	out->u.motion.dy =
+		wl_fixed_from_double(libinput_event_pointer_get_dy(pointer_event));
+
+	return 1;
 }
 
-static void
-handle_pointer_motion_absolute(
-	struct libinput_device *libinput_device,
-	struct libinput_event_pointer *pointer_event)
+static int
+decode_pointer_motion_absolute(struct libinput_event_pointer *pointer_event,
+			       struct evdev_event *out)
 {
-	struct evdev_device *device =
-		libinput_device_get_user_data(libinput_device);
-	struct weston_output *output = device->output;
-	uint32_t time;
-	wl_fixed_t x, y;
-	uint32_t width, height;
-
-	if (!output)
-		return;
-
-	time = libinput_event_pointer_get_time(pointer_event);
-	width = device->output->current_mode->width;
-	height = device->output->current_mode->height;
-
-	x = wl_fixed_from_double(
-		libinput_event_pointer_get_absolute_x_transformed(pointer_event,
-								  width));
-	y = wl_fixed_from_double(
-		libinput_event_pointer_get_absolute_y_transformed(pointer_event,
-								  height));
-
-	weston_output_transform_coordinate(device->output, x, y, &x, &y);
-	notify_motion_absolute(device->seat, time, x, y);
+	out->type = EVDEV_EVENT_MOTION_ABSOLUTE;
+	out->time = libinput_event_pointer_get_time(pointer_event);
+	out->u.absolute.x =
+		libinput_event_pointer_get_absolute_x_transformed(
+			pointer_event, EVDEV_ABSOLUTE_SCALE) /
+		EVDEV_ABSOLUTE_SCALE;
+	out->u.absolute.y =
+		libinput_event_pointer_get_absolute_y_transformed(
+			pointer_event, EVDEV_ABSOLUTE_SCALE) /
+		EVDEV_ABSOLUTE_SCALE;
+
+	return 1;
 }
 
-static void
-handle_pointer_button(struct libinput_device *libinput_device,
-		      struct libinput_event_pointer *pointer_event)
+static int
+decode_pointer_button(struct libinput_event_pointer *pointer_event,
+		      struct evdev_event *out)
 {
-	struct evdev_device *device =
-		libinput_device_get_user_data(libinput_device);
 	int button_state =
 		libinput_event_pointer_get_button_state(pointer_event);
 	int seat_button_count =
@@ -140,12 +126,15 @@ handle_pointer_button(struct libinput_device *libinput_device,
 	     seat_button_count != 1) ||
 	    (button_state == LIBINPUT_BUTTON_STATE_RELEASED &&
 	     seat_button_count != 0))
-		return;
+		return 0;
+
+	out->type = EVDEV_EVENT_BUTTON;
+	out->time = libinput_event_pointer_get_time(pointer_event);
+	out->u.button.button =
+		libinput_event_pointer_get_button(pointer_event);
+	out->u.button.state = button_state;
 
-	notify_button(device->seat,
-		      libinput_event_pointer_get_time(pointer_event),
-		      libinput_event_pointer_get_button(pointer_event),
-		      libinput_event_pointer_get_button_state(pointer_event));
+	return 1;
 }
 
 static double
@@ -186,155 +175,218 @@ normalize_scroll(struct libinput_event_pointer *pointer_event,
 	return value;
 }
 
-static void
-handle_pointer_axis(struct libinput_device *libinput_device,
-		    struct libinput_event_pointer *pointer_event)
+static int
+decode_pointer_axis(struct libinput_event_pointer *pointer_event,
+		    struct evdev_event *out)
 {
-	struct evdev_device *device =
-		libinput_device_get_user_data(libinput_device);
-	double value;
 	enum libinput_pointer_axis axis;
+	int n = 0;
 
 	axis = LIBINPUT_POINTER_AXIS_SCROLL_VERTICAL;
 	if (libinput_event_pointer_has_axis(pointer_event, axis)) {
-		value = normalize_scroll(pointer_event, axis);
-		notify_axis(device->seat,
-			    libinput_event_pointer_get_time(pointer_event),
-			    WL_POINTER_AXIS_VERTICAL_SCROLL,
-			    wl_fixed_from_double(value));
+		out[n].type = EVDEV_EVENT_AXIS;
+		out[n].time = libinput_event_pointer_get_time(pointer_event);
+		out[n].u.axis.axis = WL_POINTER_AXIS_VERTICAL_SCROLL;
+		out[n].u.axis.value =
+			wl_fixed_from_double(normalize_scroll(pointer_event,
+							      axis));
+		n++;
 	}
 
 	axis = LIBINPUT_POINTER_AXIS_SCROLL_HORIZONTAL;
 	if (libinput_event_pointer_has_axis(pointer_event, axis)) {
-		value = normalize_scroll(pointer_event, axis);
-		notify_axis(device->seat,
-			    libinput_event_pointer_get_time(pointer_event),
-			    WL_POINTER_AXIS_HORIZONTAL_SCROLL,
-			    wl_fixed_from_double(value));
+		out[n].type = EVDEV_EVENT_AXIS;
+		out[n].time = libinput_event_pointer_get_time(pointer_event);
+		out[n].u.axis.axis = WL_POINTER_AXIS_HORIZONTAL_SCROLL;
+		out[n].u.axis.value =
+			wl_fixed_from_double(normalize_scroll(pointer_event,
+							      axis));
+		n++;
 	}
-}
-
-static void
-handle_touch_with_coords(struct libinput_device *libinput_device,
-			 struct libinput_event_touch *touch_event,
-			 int touch_type)
-{
-	struct evdev_device *device =
-		libinput_device_get_user_data(libinput_device);
-	wl_fixed_t x;
-	wl_fixed_t y;
-	uint32_t width, height;
-	uint32_t time;
-	int32_t slot;
-
-	if (!device->output)
-		return;
-
-	time = libinput_event_touch_get_time(touch_event);
-	slot = libinput_event_touch_get_seat_slot(touch_event);
-
-	width = device->output->current_mode->width;
-	height = device->output->current_mode->height;
-	x = wl_fixed_from_double(
-		libinput_event_touch_get_x_transformed(touch_event, width));
-	y = wl_fixed_from_double(
-		libinput_event_touch_get_y_transformed(touch_event, height));
 
-	weston_output_transform_coordinate(device->output,
-					   x, y, &x, &y);
-
-	notify_touch(device->seat, time, slot, x, y, touch_type);
-}
-
-static void
-handle_touch_down(struct libinput_device *device,
-		  struct libinput_event_touch *touch_event)
-{
-	handle_touch_with_coords(device, touch_event, WL_TOUCH_DOWN);
+	return n;
 }
 
-static void
-handle_touch_motion(struct libinput_device *device,
-		    struct libinput_event_touch *touch_event)
+static int
+decode_touch(struct libinput_event_touch *touch_event, int touch_type,
+	     struct evdev_event *out)
 {
-	handle_touch_with_coords(device, touch_event, WL_TOUCH_MOTION);
-}
-
-static void
-handle_touch_up(struct libinput_device *libinput_device,
-		struct libinput_event_touch *touch_event)
-{
-	struct evdev_device *device =
-		libinput_device_get_user_data(libinput_device);
-	uint32_t time = libinput_event_touch_get_time(touch_event);
-	int32_t slot = libinput_event_touch_get_seat_slot(touch_event);
-
-	notify_touch(device->seat, time, slot, 0, 0, WL_TOUCH_UP);
-}
+	out->type = EVDEV_EVENT_TOUCH;
+	out->time = libinput_event_touch_get_time(touch_event);
+	out->u.touch.type = touch_type;
+	out->u.touch.slot = libinput_event_touch_get_seat_slot(touch_event);
+
+	if (touch_type == WL_TOUCH_UP) {
+		out->u.touch.x = 0;
+		out->u.touch.y = 0;
+		return 1;
+	}
 
-static void
-handle_touch_frame(struct libinput_device *libinput_device,
-		   struct libinput_event_touch *touch_event)
-{
-	struct evdev_device *device =
-		libinput_device_get_user_data(libinput_device);
-	struct weston_seat *seat = device->seat;
+	out->u.touch.x =
+		libinput_event_touch_get_x_transformed(touch_event,
+						       EVDEV_ABSOLUTE_SCALE) /
+		EVDEV_ABSOLUTE_SCALE;
+	out->u.touch.y =
+		libinput_event_touch_get_y_transformed(touch_event,
+						       EVDEV_ABSOLUTE_SCALE) /
+		EVDEV_ABSOLUTE_SCALE;
 
-	notify_touch_frame(seat);
+	return 1;
 }
 
+/** Decode a libinput input event
+ *
+ * \param event The libinput event
+ * \param out Room for EVDEV_EVENT_MAX_DECODED decoded events
+ * \return The number of events decoded, or -1 for events that are not
+ * device input
+ *
+ * Decoding only looks at the libinput event, not at the evdev_device
+ * or its output, so it is safe to do on the input thread. Absolute
+ * coordinates are left normalized and are scaled to the output by
+ * evdev_event_deliver().
+ */
 int
-evdev_device_process_event(struct libinput_event *event)
+evdev_event_decode(struct libinput_event *event, struct evdev_event *out)
 {
 	struct libinput_device *libinput_device =
 		libinput_event_get_device(event);
-	int handled = 1;
+	int i, n;
 
 	switch (libinput_event_get_type(event)) {
 	case LIBINPUT_EVENT_KEYBOARD_KEY:
-		handle_keyboard_key(libinput_device,
-				    libinput_event_get_keyboard_event(event));
+		n = decode_keyboard_key(libinput_event_get_keyboard_event(event),
+					out);
 		break;
 	case LIBINPUT_EVENT_POINTER_MOTION:
-		handle_pointer_motion(libinput_device,
-				      libinput_event_get_pointer_event(event));
+		n = decode_pointer_motion(libinput_event_get_pointer_event(event),
+					  out);
 		break;
 	case LIBINPUT_EVENT_POINTER_MOTION_ABSOLUTE:
-		handle_pointer_motion_absolute(
-			libinput_device,
-			libinput_event_get_pointer_event(event));
+		n = decode_pointer_motion_absolute(
+			libinput_event_get_pointer_event(event), out);
 		break;
 	case LIBINPUT_EVENT_POINTER_BUTTON:
-		handle_pointer_button(libinput_device,
-				      libinput_event_get_pointer_event(event));
+		n = decode_pointer_button(libinput_event_get_pointer_event(event),
+					  out);
 		break;
 	case LIBINPUT_EVENT_POINTER_AXIS:
-		handle_pointer_axis(libinput_device,
-				    libinput_event_get_pointer_event(event));
+		n = decode_pointer_axis(libinput_event_get_pointer_event(event),
+					out);
 		break;
 	case LIBINPUT_EVENT_TOUCH_DOWN:
-		handle_touch_down(libinput_device,
-				  libinput_event_get_touch_event(event));
+		n = decode_touch(libinput_event_get_touch_event(event),
+				 WL_TOUCH_DOWN, out);
 		break;
 	case LIBINPUT_EVENT_TOUCH_MOTION:
-		handle_touch_motion(libinput_device,
-				    libinput_event_get_touch_event(event));
+		n = decode_touch(libinput_event_get_touch_event(event),
+				 WL_TOUCH_MOTION, out);
 		break;
 	case LIBINPUT_EVENT_TOUCH_UP:
-		handle_touch_up(libinput_device,
-				libinput_event_get_touch_event(event));
+		n = decode_touch(libinput_event_get_touch_event(event),
+				 WL_TOUCH_UP, out);
 		break;
 	case LIBINPUT_EVENT_TOUCH_FRAME:
-		handle_touch_frame(libinput_device,
-				   libinput_event_get_touch_event(event));
+		out->type = EVDEV_EVENT_TOUCH_FRAME;
+		out->time = 0;
+		n = 1;
 		break;
 	default:
-		handled = 0;
+		return -1;
+	}
+
+	for (i = 0; i < n; i++)
+		out[i].device = libinput_device;
+
+	return n;
+}
+
+/** Deliver a decoded event to the seat of its device
+ *
+ * Must be called on the main loop.
+ */
+void
+evdev_event_deliver(const struct evdev_event *event)
+{
+	struct evdev_device *device =
+		libinput_device_get_user_data(event->device);
+	struct weston_output *output;
+	wl_fixed_t x, y;
+
+	if (!device)
+		return;
+
+	output = device->output;
+
+	switch (event->type) {
+	case EVDEV_EVENT_KEY:
+		notify_key(device->seat, event->time,
+			   event->u.key.key, event->u.key.state,
+			   STATE_UPDATE_AUTOMATIC);
+		break;
+	case EVDEV_EVENT_MOTION:
+		notify_motion(device->seat, event->time,
+			      event->u.motion.dx, event->u.motion.dy);
+		break;
+	case EVDEV_EVENT_MOTION_ABSOLUTE:
+		if (!output)
+			break;
+
+		x = wl_fixed_from_double(event->u.absolute.x *
+					 output->current_mode->width);
+		y = wl_fixed_from_double(event->u.absolute.y *
+					 output->current_mode->height);
+		weston_output_transform_coordinate(output, x, y, &x, &y);
+		notify_motion_absolute(device->seat, event->time, x, y);
+		break;
+	case EVDEV_EVENT_BUTTON:
+		notify_button(device->seat, event->time,
+			      event->u.button.button, event->u.button.state);
+		break;
+	case EVDEV_EVENT_AXIS:
+		notify_axis(device->seat, event->time,
+			    event->u.axis.axis, event->u.axis.value);
+		break;
+	case EVDEV_EVENT_TOUCH:
+		if (event->u.touch.type == WL_TOUCH_UP) {
+			notify_touch(device->seat, event->time,
+				     event->u.touch.slot, 0, 0, WL_TOUCH_UP);
+			break;
+		}
+		if (!output)
+			break;
+
+		x = wl_fixed_from_double(event->u.touch.x *
+					 output->current_mode->width);
+		y = wl_fixed_from_double(event->u.touch.y *
+					 output->current_mode->height);
+		weston_output_transform_coordinate(output, x, y, &x, &y);
+		notify_touch(device->seat, event->time, event->u.touch.slot,
+			     x, y, event->u.touch.type);
+		break;
+	case EVDEV_EVENT_TOUCH_FRAME:
+		notify_touch_frame(device->seat);
+		break;
+	}
+}
+
+int
+evdev_device_process_event(struct libinput_event *event)
+{
+	struct evdev_event decoded[EVDEV_EVENT_MAX_DECODED];
+	int i, n;
+
+	n = evdev_event_decode(event, decoded);
+	if (n < 0) {
 		weston_log("unknown libinput event %d\n",
 			   libinput_event_get_type(event));
+		return 0;
 	}
 
-	return handled;
+	for (i = 0; i < n; i++)
+		evdev_event_deliver(&decoded[i]);
+
+	return 1;
 }
 
 static void
@@ -452,7 +504,10 @@ evdev_device_set_output(struct evdev_device *device,
 	device->output_destroy_listener.notify = notify_output_destroy;
 	wl_signal_add(&output->destroy_signal,
 		      &device->output_destroy_listener);
+
+	pthread_mutex_lock(device->lock);
 	evdev_device_set_calibration(device);
+	pthread_mutex_unlock(device->lock);
 }
 
 static void
@@ -482,7 +537,7 @@ configure_device(struct evdev_device *device)
 
 struct evdev_device *
 evdev_device_create(struct libinput_device *libinput_device,
-		    struct weston_seat *seat)
+		    struct weston_seat *seat, pthread_mutex_t *lock)
 {
 	struct evdev_device *device;
 
@@ -491,6 +546,7 @@ evdev_device_create(struct libinput_device *libinput_device,
 		return NULL;
 
 	device->seat = seat;
+	device->lock = lock;
 	wl_list_init(&device->link);
 	device->device = libinput_device;
 
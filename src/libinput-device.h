@@ -26,6 +26,7 @@
 #include "config.h"
 
 #include <linux/input.h>
+#include <pthread.h>
 #include <wayland-util.h>
 #include <libinput.h>
 
@@ -47,6 +48,60 @@ struct evdev_device {
 	char *devnode;
 	char *output_name;
 	int fd;
+
+	/* serializes calls into libinput with the input thread */
+	pthread_mutex_t *lock;
+};
+
+/* Absolute coordinates are decoded against this range, and scaled to
+ * the output size when delivered. */
+#define EVDEV_ABSOLUTE_SCALE 65536.0
+
+/* One libinput event decodes into at most this many evdev_events. */
+#define EVDEV_EVENT_MAX_DECODED 2
+
+enum evdev_event_type {
+	EVDEV_EVENT_KEY,
+	EVDEV_EVENT_MOTION,
+	EVDEV_EVENT_MOTION_ABSOLUTE,
+	EVDEV_EVENT_BUTTON,
+	EVDEV_EVENT_AXIS,
+	EVDEV_EVENT_TOUCH,
+	EVDEV_EVENT_TOUCH_FRAME
+};
+
+/* An input event decoded from libinput, no longer tied to the libinput
+ * event, so it can be handed from the input thread to the main loop. */
+struct evdev_event {
+	enum evdev_event_type type;
+	struct libinput_device *device;
+	uint32_t time;
+
+	union {
+		struct {
+			uint32_t key;
+			uint32_t state;
+		} key;
+		struct {
+			wl_fixed_t dx, dy;
+		} motion;
+		struct {
+			double x, y;
+		} absolute;
+		struct {
+			uint32_t button;
+			uint32_t state;
+		} button;
+		struct {
+			uint32_t axis;
+			wl_fixed_t value;
+		} axis;
+		struct {
+			int type;
+			int32_t slot;
+			double x, y;
+		} touch;
+	} u;
 };
 
 void
@@ -54,7 +109,13 @@ evdev_led_update(struct evdev_device *device, enum weston_led leds);
 
 struct evdev_device *
 evdev_device_create(struct libinput_device *libinput_device,
-		    struct weston_seat *seat);
+		    struct weston_seat *seat, pthread_mutex_t *lock);
+
+int
+evdev_event_decode(struct libinput_event *event, struct evdev_event *out);
+
+void
+evdev_event_deliver(const struct evdev_event *event);
 
 int
 evdev_device_process_event(struct libinput_event *event);
@@ -23,10 +23,15 @@
 
 #include "config.h"
 
+#include <errno.h>
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/eventfd.h>
 #include <libinput.h>
 #include <libudev.h>
 
@@ -44,6 +49,8 @@ static struct udev_seat *
 udev_seat_create(struct udev_input *input, const char *seat_name);
 static void
 udev_seat_destroy(struct udev_seat *seat);
+static void
+udev_input_remove_source(struct udev_input *input);
 
 static void
 device_added(struct udev_input *input, struct libinput_device *libinput_device)
@@ -66,7 +73,7 @@ device_added(struct udev_input *input, struct libinput_device *libinput_device)
 		return;
 
 	seat = &udev_seat->base;
-	device = evdev_device_create(libinput_device, seat);
+	device = evdev_device_create(libinput_device, seat, &input->lock);
 	if (device == NULL)
 		return;
 
@@ -110,6 +117,7 @@ udev_input_disable(struct udev_input *input)
 	if (input->suspended)
 		return;
 
+	udev_input_remove_source(input);
 	libinput_suspend(input->libinput);
 	process_events(input);
 	input->suspended = 1;
@@ -179,6 +187,405 @@ libinput_source_dispatch(int fd, uint32_t mask, void *data)
 	return udev_input_dispatch(input) != 0;
 }
 
+/* Capacity of the ring from the input thread to the main loop, a power
+ * of two. */
+#define INPUT_RING_SIZE 1024
+
+/* log2 buckets of the latency histograms */
+#define INPUT_LATENCY_BUCKETS 16
+
+struct input_ring_entry {
+	struct evdev_event event;
+
+	/* Device added and removed events are passed on undecoded, to
+	 * set up and tear down seats and devices on the main loop. */
+	struct libinput_event *raw;
+
+	/* when the input thread read the event, CLOCK_MONOTONIC */
+	struct timespec read_time;
+};
+
+struct input_thread {
+	struct udev_input *input;
+	pthread_t thread;
+	int wake_fd;
+	int quit_fd;
+	struct wl_event_source *wake_source;
+
+	/* Single producer, the input thread, and single consumer, the main
+	 * loop. head and tail run freely and are masked on access; they
+	 * sit on either side of the ring to keep them on separate cache
+	 * lines. */
+	uint32_t head;
+	struct input_ring_entry ring[INPUT_RING_SIZE];
+	uint32_t tail;
+
+	/* entries the thread could not queue before it was asked to quit */
+	struct input_ring_entry pending[EVDEV_EVENT_MAX_DECODED];
+	int pending_count;
+
+	/* times the thread found the ring full and waited */
+	uint32_t ring_full;
+
+	/* read by the thread to dispatch on the main loop, in
+	 * microseconds, and event timestamp to dispatch, in milliseconds */
+	uint32_t queue_latency[INPUT_LATENCY_BUCKETS];
+	uint32_t event_latency[INPUT_LATENCY_BUCKETS];
+};
+
+static int
+input_ring_push(struct input_thread *thread,
+		const struct input_ring_entry *entry)
+{
+	uint32_t head = thread->head;
+	uint32_t tail = __atomic_load_n(&thread->tail, __ATOMIC_ACQUIRE);
+
+	if (head - tail == INPUT_RING_SIZE)
+		return -1;
+
+	thread->ring[head & (INPUT_RING_SIZE - 1)] = *entry;
+	__atomic_store_n(&thread->head, head + 1, __ATOMIC_RELEASE);
+
+	return 0;
+}
+
+static int
+input_ring_pop(struct input_thread *thread, struct input_ring_entry *entry)
+{
+	uint32_t tail = thread->tail;
+	uint32_t head = __atomic_load_n(&thread->head, __ATOMIC_ACQUIRE);
+
+	if (head == tail)
+		return -1;
+
+	*entry = thread->ring[tail & (INPUT_RING_SIZE - 1)];
+	__atomic_store_n(&thread->tail, tail + 1, __ATOMIC_RELEASE);
+
+	return 0;
+}
+
+static void
+input_thread_wake(struct input_thread *thread)
+{
+	uint64_t one = 1;
+
+	if (write(thread->wake_fd, &one, sizeof one) < 0 && errno != EAGAIN)
+		weston_log("libinput: failed to wake the main loop: %m\n");
+}
+
+/* Queue entries, waiting for room while the main loop catches up. If
+ * the thread is asked to quit meanwhile, what is left is kept for the
+ * main loop to pick up after the thread is joined, and -1 returned. */
+static int
+input_thread_queue(struct input_thread *thread,
+		   struct input_ring_entry *entries, int count)
+{
+	struct pollfd pfd;
+	int i = 0;
+
+	while (i < count) {
+		if (input_ring_push(thread, &entries[i]) == 0) {
+			i++;
+			continue;
+		}
+
+		/* Don't hold the lock while waiting, the main loop may
+		 * need it to make progress. */
+		thread->ring_full++;
+		input_thread_wake(thread);
+		pthread_mutex_unlock(&thread->input->lock);
+
+		pfd.fd = thread->quit_fd;
+		pfd.events = POLLIN;
+		if (poll(&pfd, 1, 1) > 0) {
+			pthread_mutex_lock(&thread->input->lock);
+			memcpy(thread->pending, &entries[i],
+			       (count - i) * sizeof entries[0]);
+			thread->pending_count = count - i;
+			return -1;
+		}
+
+		pthread_mutex_lock(&thread->input->lock);
+	}
+
+	return 0;
+}
+
+static int
+input_thread_read_event(struct input_thread *thread,
+			struct libinput_event *event)
+{
+	struct input_ring_entry entries[EVDEV_EVENT_MAX_DECODED];
+	struct evdev_event decoded[EVDEV_EVENT_MAX_DECODED];
+	struct timespec now;
+	int i, n;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	switch (libinput_event_get_type(event)) {
+	case LIBINPUT_EVENT_DEVICE_ADDED:
+	case LIBINPUT_EVENT_DEVICE_REMOVED:
+		entries[0].raw = event;
+		entries[0].read_time = now;
+		return input_thread_queue(thread, entries, 1);
+	default:
+		break;
+	}
+
+	n = evdev_event_decode(event, decoded);
+	if (n < 0)
+		weston_log("unknown libinput event %d\n",
+			   libinput_event_get_type(event));
+	libinput_event_destroy(event);
+
+	for (i = 0; i < n; i++) {
+		entries[i].event = decoded[i];
+		entries[i].raw = NULL;
+		entries[i].read_time = now;
+	}
+
+	return input_thread_queue(thread, entries, n);
+}
+
+static void *
+input_thread_func(void *data)
+{
+	struct input_thread *thread = data;
+	struct udev_input *input = thread->input;
+	struct libinput_event *event;
+	struct pollfd fds[2];
+	uint32_t head;
+	int quit = 0;
+
+	fds[0].fd = libinput_get_fd(input->libinput);
+	fds[0].events = POLLIN;
+	fds[1].fd = thread->quit_fd;
+	fds[1].events = POLLIN;
+
+	while (!quit) {
+		if (poll(fds, 2, -1) < 0) {
+			if (errno == EINTR)
+				continue;
+			weston_log("libinput: input thread poll failed: %m\n");
+			break;
+		}
+
+		if (fds[1].revents)
+			break;
+
+		head = thread->head;
+
+		pthread_mutex_lock(&input->lock);
+		if (libinput_dispatch(input->libinput) != 0)
+			weston_log("libinput: Failed to dispatch libinput\n");
+		while (!quit && (event = libinput_get_event(input->libinput)))
+			quit = input_thread_read_event(thread, event) < 0;
+		pthread_mutex_unlock(&input->lock);
+
+		if (thread->head != head)
+			input_thread_wake(thread);
+	}
+
+	return NULL;
+}
+
+static int
+latency_bucket(uint32_t value)
+{
+	int bucket = 0;
+
+	while (value && bucket < INPUT_LATENCY_BUCKETS - 1) {
+		value >>= 1;
+		bucket++;
+	}
+
+	return bucket;
+}
+
+static void
+input_thread_record_latency(struct input_thread *thread,
+			    const struct input_ring_entry *entry)
+{
+	struct timespec now;
+	int64_t queued_usec;
+	uint32_t now_msec;
+
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	queued_usec = (now.tv_sec - entry->read_time.tv_sec) * 1000000LL +
+		(now.tv_nsec - entry->read_time.tv_nsec) / 1000;
+	thread->queue_latency[latency_bucket((uint32_t) queued_usec)]++;
+
+	/* libinput timestamps are CLOCK_MONOTONIC milliseconds */
+	if (entry->event.type == EVDEV_EVENT_TOUCH_FRAME)
+		return;
+	now_msec = now.tv_sec * 1000 + now.tv_nsec / 1000000;
+	thread->event_latency[latency_bucket(now_msec -
+					     entry->event.time)]++;
+}
+
+static void
+input_thread_deliver(struct input_thread *thread,
+		     struct input_ring_entry *entry)
+{
+	struct udev_input *input = thread->input;
+
+	if (entry->raw) {
+		pthread_mutex_lock(&input->lock);
+		udev_input_process_event(entry->raw);
+		libinput_event_destroy(entry->raw);
+		pthread_mutex_unlock(&input->lock);
+		return;
+	}
+
+	input_thread_record_latency(thread, entry);
+	evdev_event_deliver(&entry->event);
+}
+
+static int
+input_thread_dispatch(int fd, uint32_t mask, void *data)
+{
+	struct input_thread *thread = data;
+	struct input_ring_entry entry;
+	uint64_t count;
+
+	if (read(fd, &count, sizeof count) < 0 && errno != EAGAIN)
+		weston_log("libinput: failed to read input thread wakeup: "
+			   "%m\n");
+
+	while (input_ring_pop(thread, &entry) == 0)
+		input_thread_deliver(thread, &entry);
+
+	return 0;
+}
+
+static void
+log_latency(const char *what, const char *unit, const uint32_t *buckets)
+{
+	int i;
+
+	weston_log("libinput: %s latency (%s):", what, unit);
+	for (i = 0; i < INPUT_LATENCY_BUCKETS; i++)
+		if (buckets[i])
+			weston_log_continue(" <%u: %u", 1u << i, buckets[i]);
+	weston_log_continue("\n");
+}
+
+static int
+input_thread_start(struct udev_input *input)
+{
+	struct wl_event_loop *loop =
+		wl_display_get_event_loop(input->compositor->wl_display);
+	struct input_thread *thread;
+	sigset_t signals, saved;
+	int ret;
+
+	thread = zalloc(sizeof *thread);
+	if (!thread)
+		return -1;
+
+	thread->input = input;
+	thread->wake_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	thread->quit_fd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+	if (thread->wake_fd < 0 || thread->quit_fd < 0)
+		goto err;
+
+	thread->wake_source =
+		wl_event_loop_add_fd(loop, thread->wake_fd, WL_EVENT_READABLE,
+				     input_thread_dispatch, thread);
+	if (!thread->wake_source)
+		goto err;
+
+	/* Leave all signal handling to the main loop. */
+	sigfillset(&signals);
+	pthread_sigmask(SIG_BLOCK, &signals, &saved);
+	ret = pthread_create(&thread->thread, NULL, input_thread_func, thread);
+	pthread_sigmask(SIG_SETMASK, &saved, NULL);
+	if (ret != 0) {
+		weston_log("libinput: failed to start the input thread: %s\n",
+			   strerror(ret));
+		goto err;
+	}
+
+	input->thread = thread;
+
+	return 0;
+
+err:
+	if (thread->wake_source)
+		wl_event_source_remove(thread->wake_source);
+	if (thread->wake_fd >= 0)
+		close(thread->wake_fd);
+	if (thread->quit_fd >= 0)
+		close(thread->quit_fd);
+	free(thread);
+
+	return -1;
+}
+
+static void
+input_thread_stop(struct udev_input *input)
+{
+	struct input_thread *thread = input->thread;
+	struct input_ring_entry entry;
+	uint64_t one = 1;
+	int i;
+
+	if (write(thread->quit_fd, &one, sizeof one) < 0)
+		weston_log("libinput: failed to stop the input thread: %m\n");
+	pthread_join(thread->thread, NULL);
+
+	/* Deliver everything the thread read, in order. */
+	while (input_ring_pop(thread, &entry) == 0)
+		input_thread_deliver(thread, &entry);
+	for (i = 0; i < thread->pending_count; i++)
+		input_thread_deliver(thread, &thread->pending[i]);
+
+	log_latency("input thread queue", "usec", thread->queue_latency);
+	log_latency("input event", "msec", thread->event_latency);
+	if (thread->ring_full)
+		weston_log("libinput: input thread found the ring full "
+			   "%u times\n", thread->ring_full);
+
+	wl_event_source_remove(thread->wake_source);
+	close(thread->wake_fd);
+	close(thread->quit_fd);
+	free(thread);
+	input->thread = NULL;
+}
+
+static int
+udev_input_add_source(struct udev_input *input)
+{
+	struct wl_event_loop *loop;
+	int fd;
+
+	if (input->use_thread && input_thread_start(input) == 0)
+		return 0;
+
+	loop = wl_display_get_event_loop(input->compositor->wl_display);
+	fd = libinput_get_fd(input->libinput);
+	input->libinput_source =
+		wl_event_loop_add_fd(loop, fd, WL_EVENT_READABLE,
+				     libinput_source_dispatch, input);
+	if (!input->libinput_source)
+		return -1;
+
+	return 0;
+}
+
+static void
+udev_input_remove_source(struct udev_input *input)
+{
+	if (input->thread)
+		input_thread_stop(input);
+
+	if (input->libinput_source) {
+		wl_event_source_remove(input->libinput_source);
+		input->libinput_source = NULL;
+	}
+}
+
 static int
 open_restricted(const char *path, int flags, void *user_data)
 {
@@ -205,31 +612,21 @@ const struct libinput_interface libinput_interface = {
 int
 udev_input_enable(struct udev_input *input)
 {
-	struct wl_event_loop *loop;
-	struct weston_compositor *c = input->compositor;
-	int fd;
 	struct udev_seat *seat;
 	int devices_found = 0;
 
-	loop = wl_display_get_event_loop(c->wl_display);
-	fd = libinput_get_fd(input->libinput);
-	input->libinput_source =
-		wl_event_loop_add_fd(loop, fd, WL_EVENT_READABLE,
-				     libinput_source_dispatch, input);
-	if (!input->libinput_source) {
-		return -1;
-	}
-
 	if (input->suspended) {
-		if (libinput_resume(input->libinput) != 0) {
-			wl_event_source_remove(input->libinput_source);
-			input->libinput_source = NULL;
+		if (libinput_resume(input->libinput) != 0)
 			return -1;
-		}
 		input->suspended = 0;
 		process_events(input);
 	}
 
+	/* Only after the events above are processed, for the input
+	 * thread not to race the main loop for them. */
+	if (udev_input_add_source(input) < 0)
+		return -1;
+
 	wl_list_for_each(seat, &input->compositor->seat_list, base.link) {
 		evdev_notify_keyboard_focus(&seat->base, &seat->devices_list);
 
@@ -265,16 +662,30 @@ udev_input_init(struct udev_input *input, struct weston_compositor *c,
 {
 	enum libinput_log_priority priority = LIBINPUT_LOG_PRIORITY_INFO;
 	const char *log_priority = NULL;
+	struct weston_config_section *s;
+	pthread_mutexattr_t attr;
 
 	memset(input, 0, sizeof *input);
 
 	input->compositor = c;
 
+	s = weston_config_get_section(c->config, "libinput", NULL, NULL);
+	weston_config_section_get_bool(s, "input_thread",
+				       &input->use_thread, 0);
+
+	/* Recursive, the main loop takes it again in paths like device
+	 * setup that already hold it. */
+	pthread_mutexattr_init(&attr);
+	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+	pthread_mutex_init(&input->lock, &attr);
+	pthread_mutexattr_destroy(&attr);
+
 	log_priority = getenv("WESTON_LIBINPUT_LOG_PRIORITY");
 
 	input->libinput = libinput_udev_create_context(&libinput_interface,
 						       input, udev);
 	if (!input->libinput) {
+		pthread_mutex_destroy(&input->lock);
 		return -1;
 	}
 
@@ -294,6 +705,7 @@ udev_input_init(struct udev_input *input, struct weston_compositor *c,
 
 	if (libinput_udev_assign_seat(input->libinput, seat_id) != 0) {
 		libinput_unref(input->libinput);
+		pthread_mutex_destroy(&input->lock);
 		return -1;
 	}
 
@@ -307,10 +719,11 @@ udev_input_destroy(struct udev_input *input)
 {
 	struct udev_seat *seat, *next;
 
-	wl_event_source_remove(input->libinput_source);
+	udev_input_remove_source(input);
 	wl_list_for_each_safe(seat, next, &input->compositor->seat_list, base.link)
 		udev_seat_destroy(seat);
 	libinput_unref(input->libinput);
+	pthread_mutex_destroy(&input->lock);
 }
 
 static void
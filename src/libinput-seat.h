@@ -26,6 +26,7 @@
 
 #include "config.h"
 
+#include <pthread.h>
 #include <libudev.h>
 
 #include "compositor.h"
@@ -36,11 +37,21 @@ struct udev_seat {
 	struct wl_listener output_create_listener;
 };
 
+struct input_thread;
+
 struct udev_input {
 	struct libinput *libinput;
 	struct wl_event_source *libinput_source;
 	struct weston_compositor *compositor;
 	int suspended;
+
+	/* With [libinput] input_thread, libinput is read and its events
+	 * decoded on a thread of their own, and handed to the main loop
+	 * through a ring. The lock serializes every call into libinput
+	 * between the two. */
+	int use_thread;
+	struct input_thread *thread;
+	pthread_mutex_t lock;
 };
 
 int
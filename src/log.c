@@ -28,6 +28,7 @@
 #include <string.h>
 #include <sys/time.h>
 #include <time.h>
+#include <pthread.h>
 
 #include <wayland-util.h>
 
@@ -37,6 +38,9 @@ static FILE *weston_logfile = NULL;
 
 static int cached_tm_mday = -1;
 
+/* libinput may log from the input thread */
+static pthread_mutex_t log_mutex = PTHREAD_MUTEX_INITIALIZER;
+
 static int weston_log_timestamp(void)
 {
 	struct timeval tv;
@@ -64,9 +68,11 @@ static int weston_log_timestamp(void)
 static void
 custom_handler(const char *fmt, va_list arg)
 {
+	pthread_mutex_lock(&log_mutex);
 	weston_log_timestamp();
 	fprintf(weston_logfile, "libwayland: ");
 	vfprintf(weston_logfile, fmt, arg);
+	pthread_mutex_unlock(&log_mutex);
 }
 
 void
@@ -96,8 +102,10 @@ weston_vlog(const char *fmt, va_list ap)
 {
 	int l;
 
+	pthread_mutex_lock(&log_mutex);
 	l = weston_log_timestamp();
 	l += vfprintf(weston_logfile, fmt, ap);
+	pthread_mutex_unlock(&log_mutex);
 
 	return l;
 }
@@ -118,7 +126,13 @@ weston_log(const char *fmt, ...)
 WL_EXPORT int
 weston_vlog_continue(const char *fmt, va_list argp)
 {
-	return vfprintf(weston_logfile, fmt, argp);
+	int l;
+
+	pthread_mutex_lock(&log_mutex);
+	l = vfprintf(weston_logfile, fmt, argp);
+	pthread_mutex_unlock(&log_mutex);
+
+	return l;
 }
 
 WL_EXPORT int
@@ -42,6 +42,21 @@ struct timeline_log {
 WL_EXPORT int weston_timeline_enabled_;
 static struct timeline_log timeline_ = { CLOCK_MONOTONIC, NULL, 0 };
 
+/* Startup phases are recorded before any timeline can be open, and
+ * replayed into every timeline opened later. */
+#define STARTUP_POINTS_MAX 32
+
+struct startup_point {
+	const char *name;
+	struct timespec ts;
+};
+
+static struct startup_point startup_points[STARTUP_POINTS_MAX];
+static int startup_point_count;
+
+static void
+timeline_emit_startup(void);
+
 static int
 weston_timeline_do_open(void)
 {
@@ -101,6 +116,8 @@ weston_timeline_open(struct weston_compositor *compositor)
 		++timeline_.series;
 
 	weston_timeline_enabled_ = 1;
+
+	timeline_emit_startup();
 }
 
 void
@@ -234,26 +251,34 @@ emit_vblank_timestamp(struct timeline_emit_context *ctx, void *obj)
 	return 1;
 }
 
+static int
+emit_input_timestamp(struct timeline_emit_context *ctx, void *obj)
+{
+	struct timespec *ts = obj;
+
+	fprintf(ctx->cur, "\"input\":[%" PRId64 ", %ld]",
+		(int64_t)ts->tv_sec, ts->tv_nsec);
+
+	return 1;
+}
+
 typedef int (*type_func)(struct timeline_emit_context *ctx, void *obj);
 
 static const type_func type_dispatch[] = {
 	[TLT_OUTPUT] = emit_weston_output,
 	[TLT_SURFACE] = emit_weston_surface,
 	[TLT_VBLANK] = emit_vblank_timestamp,
+	[TLT_INPUT] = emit_input_timestamp,
 };
 
-WL_EXPORT void
-weston_timeline_point(const char *name, ...)
+static void
+timeline_point_at(const struct timespec *ts, const char *name, va_list argp)
 {
-	va_list argp;
-	struct timespec ts;
 	enum timeline_type otype;
 	void *obj;
 	char buf[512];
 	struct timeline_emit_context ctx;
 
-	clock_gettime(timeline_.clk_id, &ts);
-
 	ctx.out = timeline_.file;
 	ctx.cur = fmemopen(buf, sizeof(buf), "w");
 	ctx.series = timeline_.series;
@@ -265,9 +290,8 @@ weston_timeline_point(const char *name, ...)
 	}
 
 	fprintf(ctx.cur, "{ \"T\":[%" PRId64 ", %ld], \"N\":\"%s\"",
-		(int64_t)ts.tv_sec, ts.tv_nsec, name);
+		(int64_t)ts->tv_sec, ts->tv_nsec, name);
 
-	va_start(argp, name);
 	while (1) {
 		otype = va_arg(argp, enum timeline_type);
 		if (otype == TLT_END)
@@ -279,7 +303,6 @@ weston_timeline_point(const char *name, ...)
 			type_dispatch[otype](&ctx, obj);
 		}
 	}
-	va_end(argp);
 
 	fprintf(ctx.cur, " }\n");
 	fflush(ctx.cur);
@@ -292,3 +315,88 @@ weston_timeline_point(const char *name, ...)
 
 	fclose(ctx.cur);
 }
+
+WL_EXPORT void
+weston_timeline_point(const char *name, ...)
+{
+	va_list argp;
+	struct timespec ts;
+
+	clock_gettime(timeline_.clk_id, &ts);
+
+	va_start(argp, name);
+	timeline_point_at(&ts, name, argp);
+	va_end(argp);
+}
+
+static void
+timeline_startup_point_at(const struct timespec *ts, const char *name, ...)
+{
+	va_list argp;
+
+	va_start(argp, name);
+	timeline_point_at(ts, name, argp);
+	va_end(argp);
+}
+
+static void
+timeline_emit_startup(void)
+{
+	int i;
+
+	for (i = 0; i < startup_point_count && weston_timeline_enabled_; i++)
+		timeline_startup_point_at(&startup_points[i].ts,
+					  startup_points[i].name, TLP_END);
+}
+
+/** Record a startup phase
+ *
+ * \param name Name of the timeline point, must be a string literal.
+ *
+ * The point goes to the current timeline if one is open, and is kept
+ * for weston_timeline_log_startup() and for timelines opened later.
+ */
+WL_EXPORT void
+weston_timeline_startup_point(const char *name)
+{
+	struct startup_point *p;
+
+	if (startup_point_count == STARTUP_POINTS_MAX)
+		return;
+
+	p = &startup_points[startup_point_count++];
+	p->name = name;
+	clock_gettime(timeline_.clk_id, &p->ts);
+
+	if (weston_timeline_enabled_)
+		timeline_startup_point_at(&p->ts, name, TLP_END);
+}
+
+static uint32_t
+timespec_diff_ms(const struct timespec *a, const struct timespec *b)
+{
+	return (a->tv_sec - b->tv_sec) * 1000 +
+		(a->tv_nsec - b->tv_nsec) / 1000000;
+}
+
+/** Log how long each startup phase took */
+WL_EXPORT void
+weston_timeline_log_startup(void)
+{
+	struct startup_point *first = &startup_points[0];
+	int i;
+
+	if (startup_point_count < 2)
+		return;
+
+	weston_log("Startup took %u ms:\n",
+		   timespec_diff_ms(&startup_points[startup_point_count - 1].ts,
+				    &first->ts));
+	for (i = 1; i < startup_point_count; i++)
+		weston_log_continue(STAMP_SPACE "%-28s %5u ms (+%u ms)\n",
+				    startup_points[i].name,
+				    timespec_diff_ms(&startup_points[i].ts,
+						     &first->ts),
+				    timespec_diff_ms(&startup_points[i].ts,
+						     &startup_points[i - 1].ts));
+}
@@ -39,6 +39,7 @@ enum timeline_type {
 	TLT_OUTPUT,
 	TLT_SURFACE,
 	TLT_VBLANK,
+	TLT_INPUT,
 };
 
 #define TYPEVERIFY(type, arg) ({			\
@@ -50,6 +51,7 @@ enum timeline_type {
 #define TLP_OUTPUT(o) TLT_OUTPUT, TYPEVERIFY(struct weston_output *, (o))
 #define TLP_SURFACE(s) TLT_SURFACE, TYPEVERIFY(struct weston_surface *, (s))
 #define TLP_VBLANK(t) TLT_VBLANK, TYPEVERIFY(const struct timespec *, (t))
+#define TLP_INPUT(t) TLT_INPUT, TYPEVERIFY(const struct timespec *, (t))
 
 #define TL_POINT(...) do { \
 	if (weston_timeline_enabled_) \
@@ -59,4 +61,10 @@ enum timeline_type {
 void
 weston_timeline_point(const char *name, ...);
 
+void
+weston_timeline_startup_point(const char *name);
+
+void
+weston_timeline_log_startup(void);
+
 #endif /* WESTON_TIMELINE_H */
@@ -0,0 +1,221 @@
+/*
+ * Copyright © 2015 The Weston contributors
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation, and that the name of the copyright holders not be used in
+ * advertising or publicity pertaining to distribution of the software
+ * without specific, written prior permission.  The copyright holders make
+ * no representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS
+ * SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS, IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER
+ * RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF
+ * CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <assert.h>
+#include <time.h>
+#include <linux/input.h>
+
+#include "../src/compositor.h"
+
+#define BINDING_KEYS 250
+#define DISPATCH_COUNT 1000000
+
+static int order[8];
+static int calls;
+
+static void
+count_key(struct weston_seat *seat, uint32_t time, uint32_t key, void *data)
+{
+	order[calls++ % 8] = (intptr_t) data;
+}
+
+static void
+count_button(struct weston_seat *seat, uint32_t time, uint32_t button,
+	     void *data)
+{
+	calls++;
+}
+
+static void
+count_axis(struct weston_seat *seat, uint32_t time, uint32_t axis,
+	   wl_fixed_t value, void *data)
+{
+	calls++;
+}
+
+static void
+destroy_other(struct weston_seat *seat, uint32_t time, uint32_t key,
+	      void *data)
+{
+	weston_binding_destroy(data);
+	calls++;
+}
+
+static void
+release_key(struct weston_seat *seat, uint32_t key)
+{
+	struct weston_keyboard_grab *grab = seat->keyboard->grab;
+
+	/* ends the grab that swallows a bound key press */
+	grab->interface->key(grab, 0, key, WL_KEYBOARD_KEY_STATE_RELEASED);
+	assert(seat->keyboard->grab == &seat->keyboard->default_grab);
+}
+
+static double
+elapsed_ns(const struct timespec *begin)
+{
+	struct timespec end;
+
+	clock_gettime(CLOCK_MONOTONIC, &end);
+
+	return (end.tv_sec - begin->tv_sec) * 1e9 +
+		(end.tv_nsec - begin->tv_nsec);
+}
+
+static void
+test_dispatch(struct weston_compositor *compositor, struct weston_seat *seat)
+{
+	struct weston_binding *victim;
+	int i;
+
+	/* every binding on a key and modifiers runs, in the order added */
+	calls = 0;
+	weston_compositor_add_key_binding(compositor, KEY_F13, MODIFIER_CTRL,
+					  count_key, (void *) 1);
+	weston_compositor_add_key_binding(compositor, KEY_F13, 0,
+					  count_key, (void *) 3);
+	weston_compositor_add_key_binding(compositor, KEY_F13, MODIFIER_CTRL,
+					  count_key, (void *) 2);
+
+	seat->modifier_state = MODIFIER_CTRL;
+	weston_compositor_run_key_binding(compositor, seat, 0, KEY_F13,
+					  WL_KEYBOARD_KEY_STATE_PRESSED);
+	release_key(seat, KEY_F13);
+	assert(calls == 2 && order[0] == 1 && order[1] == 2);
+
+	seat->modifier_state = 0;
+	weston_compositor_run_key_binding(compositor, seat, 0, KEY_F13,
+					  WL_KEYBOARD_KEY_STATE_PRESSED);
+	release_key(seat, KEY_F13);
+	assert(calls == 3 && order[2] == 3);
+
+	/* a handler may destroy a binding on the same key */
+	calls = 0;
+	victim = weston_compositor_add_key_binding(compositor, KEY_F14, 0,
+						   count_key, (void *) 1);
+	weston_compositor_add_key_binding(compositor, KEY_F14, 0,
+					  destroy_other, victim);
+	weston_compositor_run_key_binding(compositor, seat, 0, KEY_F14,
+					  WL_KEYBOARD_KEY_STATE_PRESSED);
+	release_key(seat, KEY_F14);
+	assert(calls == 2);
+	weston_compositor_run_key_binding(compositor, seat, 0, KEY_F14,
+					  WL_KEYBOARD_KEY_STATE_PRESSED);
+	release_key(seat, KEY_F14);
+	assert(calls == 3);
+
+	/* only the first matching axis binding runs */
+	calls = 0;
+	for (i = 0; i < 2; i++)
+		weston_compositor_add_axis_binding(compositor,
+						   WL_POINTER_AXIS_VERTICAL_SCROLL,
+						   MODIFIER_SUPER,
+						   count_axis, NULL);
+	seat->modifier_state = MODIFIER_SUPER;
+	assert(weston_compositor_run_axis_binding(compositor, seat, 0,
+						  WL_POINTER_AXIS_VERTICAL_SCROLL,
+						  0) == 1);
+	assert(calls == 1);
+	seat->modifier_state = 0;
+	assert(weston_compositor_run_axis_binding(compositor, seat, 0,
+						  WL_POINTER_AXIS_VERTICAL_SCROLL,
+						  0) == 0);
+}
+
+static void
+benchmark(struct weston_compositor *compositor, struct weston_seat *seat)
+{
+	struct timespec begin;
+	uint32_t modifier;
+	int i;
+
+	/* thousands of bindings, on every key with every modifier but
+	 * shift alone, and on the mouse buttons */
+	for (modifier = 0; modifier < 16; modifier++) {
+		if (modifier == MODIFIER_SHIFT)
+			continue;
+		for (i = 1; i <= BINDING_KEYS; i++)
+			weston_compositor_add_key_binding(compositor, i,
+							  modifier,
+							  count_key, NULL);
+		for (i = BTN_LEFT; i <= BTN_TASK; i++)
+			weston_compositor_add_button_binding(compositor, i,
+							     modifier,
+							     count_button,
+							     NULL);
+	}
+
+	/* Typing: key presses matching no binding, the common case. */
+	seat->modifier_state = MODIFIER_SHIFT;
+	clock_gettime(CLOCK_MONOTONIC, &begin);
+	for (i = 0; i < DISPATCH_COUNT; i++)
+		weston_compositor_run_key_binding(compositor, seat, 0,
+						  1 + i % BINDING_KEYS,
+						  WL_KEYBOARD_KEY_STATE_PRESSED);
+	fprintf(stderr, "%d key bindings, unbound key dispatch: %.1f ns\n",
+		15 * BINDING_KEYS, elapsed_ns(&begin) / DISPATCH_COUNT);
+
+	calls = 0;
+	seat->modifier_state = MODIFIER_CTRL | MODIFIER_ALT | MODIFIER_SHIFT;
+	clock_gettime(CLOCK_MONOTONIC, &begin);
+	for (i = 0; i < DISPATCH_COUNT; i++)
+		weston_compositor_run_button_binding(compositor, seat, 0,
+						     BTN_LEFT + i % 8,
+						     WL_POINTER_BUTTON_STATE_PRESSED);
+	fprintf(stderr, "bound button dispatch: %.1f ns\n",
+		elapsed_ns(&begin) / DISPATCH_COUNT);
+	assert(calls == DISPATCH_COUNT);
+
+	seat->modifier_state = 0;
+}
+
+static void
+bindings_test(void *data)
+{
+	struct weston_compositor *compositor = data;
+	struct weston_seat *seat;
+
+	assert(!wl_list_empty(&compositor->seat_list));
+	seat = container_of(compositor->seat_list.next,
+			    struct weston_seat, link);
+	assert(seat->keyboard);
+
+	test_dispatch(compositor, seat);
+	benchmark(compositor, seat);
+
+	wl_display_terminate(compositor->wl_display);
+}
+
+WL_EXPORT int
+module_init(struct weston_compositor *compositor, int *argc, char *argv[])
+{
+	struct wl_event_loop *loop;
+
+	loop = wl_display_get_event_loop(compositor->wl_display);
+
+	wl_event_loop_add_idle(loop, bindings_test, compositor);
+
+	return 0;
+}
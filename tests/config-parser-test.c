@@ -25,6 +25,7 @@
 #include <stdlib.h>
 #include <stdint.h>
 #include <string.h>
+#include <stdio.h>
 #include <assert.h>
 #include <errno.h>
 #include <unistd.h>
@@ -49,6 +50,49 @@ run_test(const char *text)
 	return config;
 }
 
+static void
+rewrite_file(const char *file, const char *text)
+{
+	FILE *fp;
+
+	fp = fopen(file, "w");
+	assert(fp);
+	assert(fputs(text, fp) >= 0);
+	fclose(fp);
+}
+
+struct diff_record {
+	char changes[16][128];
+	int count;
+};
+
+static void
+record_diff(struct weston_config_section *old_section,
+	    struct weston_config_section *new_section,
+	    const char *section, const char *key,
+	    const char *old_value, const char *new_value,
+	    void *data)
+{
+	struct diff_record *record = data;
+
+	assert(record->count < 16);
+	snprintf(record->changes[record->count++], 128, "%s %s %s %s",
+		 section, key ? key : "-",
+		 old_value ? old_value : "-", new_value ? new_value : "-");
+}
+
+static int
+has_change(struct diff_record *record, const char *change)
+{
+	int i;
+
+	for (i = 0; i < record->count; i++)
+		if (strcmp(record->changes[i], change) == 0)
+			return 1;
+
+	return 0;
+}
+
 static const char t0[] =
 	"# nothing in this file...\n";
 
@@ -96,6 +140,171 @@ static const char t4[] =
 	"[bambam]\n"
 	"=not valid at all\n";
 
+static const char t5[] =
+	"[output]\n"
+	"name=LVDS1\n"
+	"mode=preferred\n"
+	"\n"
+	"[output]\n"
+	"name=VGA1\n"
+	"mode=off\n"
+	"\n"
+	"[output]\n"
+	"name=HDMI1\n"
+	"mode=off\n"
+	"mode=preferred\n"
+	"\n"
+	"[shell]\n"
+	"locking=true\n";
+
+static const char t6[] =
+	"[output]\n"
+	"name=LVDS1\n"
+	"mode=1024x768\n"
+	"\n"
+	"[output]\n"
+	"name=VGA1\n"
+	"mode=off\n"
+	"\n"
+	"[keyboard]\n"
+	"keymap_layout=de\n";
+
+static void
+test_multi_match(void)
+{
+	struct weston_config *config;
+	struct weston_config_section *section;
+	char *s;
+	int i;
+
+	config = run_test(t5);
+	assert(config);
+
+	/* every [output] with mode=off, in file order; the HDMI1
+	 * duplicate is shadowed by its first mode entry */
+	section = NULL;
+	i = 0;
+	while ((section = weston_config_next_section_match(config, section,
+							     "output", "mode",
+							     "off"))) {
+		weston_config_section_get_string(section, "name", &s, NULL);
+		assert(strcmp(s, i == 0 ? "VGA1" : "HDMI1") == 0);
+		free(s);
+		i++;
+	}
+	assert(i == 2);
+
+	section = weston_config_get_section(config, "output", "mode",
+					    "preferred");
+	weston_config_section_get_string(section, "name", &s, NULL);
+	assert(strcmp(s, "LVDS1") == 0);
+	free(s);
+	assert(weston_config_next_section_match(config, section, "output",
+						"mode", "preferred") == NULL);
+
+	section = NULL;
+	i = 0;
+	while ((section = weston_config_next_section_match(config, section,
+							     "output",
+							     NULL, NULL)))
+		i++;
+	assert(i == 3);
+
+	weston_config_destroy(config);
+}
+
+static void
+test_many_sections(void)
+{
+	struct weston_config *config;
+	struct weston_config_section *section;
+	char file[] = "/tmp/weston-config-parser-test-XXXXXX";
+	char name[32];
+	FILE *fp;
+	int32_t n;
+	int fd, i;
+
+	fd = mkstemp(file);
+	fp = fdopen(fd, "w");
+	assert(fp);
+	for (i = 0; i < 5000; i++)
+		fprintf(fp, "[launcher]\npath=/bin/app%d\nindex=%d\n\n",
+			i, i);
+	fclose(fp);
+
+	config = weston_config_parse(file);
+	unlink(file);
+	assert(config);
+
+	for (i = 0; i < 5000; i++) {
+		snprintf(name, sizeof name, "/bin/app%d", i);
+		section = weston_config_get_section(config, "launcher",
+						    "path", name);
+		assert(section);
+		assert(weston_config_section_get_int(section, "index",
+						     &n, -1) == 0);
+		assert(n == i);
+	}
+
+	assert(!weston_config_get_section(config, "launcher", "path",
+					  "/bin/app5000"));
+
+	weston_config_destroy(config);
+}
+
+static void
+test_reload(void)
+{
+	struct weston_config *config, *reloaded;
+	struct weston_config_section *section;
+	struct diff_record record = { .count = 0 };
+	char file[] = "/tmp/weston-config-parser-test-XXXXXX";
+	char *s;
+	int fd;
+
+	fd = mkstemp(file);
+	close(fd);
+	rewrite_file(file, t5);
+
+	config = weston_config_parse(file);
+	assert(config);
+
+	rewrite_file(file, t6);
+	reloaded = weston_config_reload(config);
+	assert(reloaded);
+	assert(strcmp(weston_config_get_full_path(reloaded),
+		      weston_config_get_full_path(config)) == 0);
+
+	section = weston_config_get_section(reloaded, "output", "name",
+					    "LVDS1");
+	weston_config_section_get_string(section, "mode", &s, NULL);
+	assert(strcmp(s, "1024x768") == 0);
+	free(s);
+
+	assert(weston_config_diff(config, reloaded,
+				  record_diff, &record) == 8);
+	assert(record.count == 8);
+	assert(has_change(&record, "output mode preferred 1024x768"));
+	assert(has_change(&record, "output - - -"));
+	assert(has_change(&record, "output name HDMI1 -"));
+	assert(has_change(&record, "output mode off -"));
+	assert(has_change(&record, "shell - - -"));
+	assert(has_change(&record, "shell locking true -"));
+	assert(has_change(&record, "keyboard - - -"));
+	assert(has_change(&record, "keyboard keymap_layout - de"));
+
+	/* no changes, nothing reported */
+	record.count = 0;
+	assert(weston_config_diff(reloaded, reloaded,
+				  record_diff, &record) == 0);
+
+	weston_config_destroy(config);
+	weston_config_destroy(reloaded);
+
+	unlink(file);
+	assert(weston_config_reload(NULL) == NULL);
+}
+
 int main(int argc, char *argv[])
 {
 	struct weston_config *config;
@@ -201,5 +410,9 @@ int main(int argc, char *argv[])
 	section = weston_config_get_section(NULL, "bucket", NULL, NULL);
 	assert(section == NULL);
 
+	test_multi_match();
+	test_many_sections();
+	test_reload();
+
 	return 0;
 }
@@ -0,0 +1,109 @@
+/*
+ * Copyright © 2015 The Weston contributors
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation, and that the name of the copyright holders not be used in
+ * advertising or publicity pertaining to distribution of the software
+ * without specific, written prior permission.  The copyright holders make
+ * no representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS
+ * SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS, IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER
+ * RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF
+ * CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <assert.h>
+
+#include "../src/compositor.h"
+
+#define MAX_RECTS 16
+
+static void
+check_simplified(struct weston_compositor *compositor,
+		 pixman_box32_t *boxes, int n)
+{
+	pixman_region32_t damage;
+	int i;
+
+	pixman_region32_init_rects(&damage, boxes, n);
+	fprintf(stderr, "%d boxes, %d rectangles", n,
+		pixman_region32_n_rects(&damage));
+	assert(pixman_region32_n_rects(&damage) > MAX_RECTS);
+
+	weston_compositor_simplify_damage(compositor, &damage);
+	fprintf(stderr, ", simplified to %d\n",
+		pixman_region32_n_rects(&damage));
+
+	assert(pixman_region32_n_rects(&damage) <= MAX_RECTS);
+	for (i = 0; i < n; i++)
+		assert(pixman_region32_contains_rectangle(&damage, &boxes[i]) ==
+		       PIXMAN_REGION_IN);
+
+	pixman_region32_fini(&damage);
+}
+
+static void
+damage_test(void *data)
+{
+	struct weston_compositor *compositor = data;
+	pixman_box32_t boxes[400];
+	int32_t max_rects = compositor->damage_max_rects;
+	int32_t overdraw = compositor->damage_overdraw;
+	int i;
+
+	compositor->damage_max_rects = MAX_RECTS;
+	compositor->damage_overdraw = 25;
+
+	/* A sparse grid of pixels, too far apart to merge within the
+	 * allowed overdraw. */
+	for (i = 0; i < 400; i++) {
+		boxes[i].x1 = (i % 20) * 50;
+		boxes[i].y1 = (i / 20) * 50;
+		boxes[i].x2 = boxes[i].x1 + 1;
+		boxes[i].y2 = boxes[i].y1 + 1;
+	}
+	check_simplified(compositor, boxes, 400);
+
+	/* Two diagonals of small squares, whose merged boxes overlap and
+	 * get split up again. */
+	for (i = 0; i < 200; i++) {
+		boxes[i].x1 = i * 3;
+		boxes[i].y1 = i * 2;
+		boxes[i].x2 = boxes[i].x1 + 4;
+		boxes[i].y2 = boxes[i].y1 + 4;
+
+		boxes[200 + i].x1 = 1000 - i * 3;
+		boxes[200 + i].y1 = i * 2;
+		boxes[200 + i].x2 = boxes[200 + i].x1 + 4;
+		boxes[200 + i].y2 = boxes[200 + i].y1 + 4;
+	}
+	check_simplified(compositor, boxes, 400);
+
+	compositor->damage_max_rects = max_rects;
+	compositor->damage_overdraw = overdraw;
+
+	wl_display_terminate(compositor->wl_display);
+}
+
+WL_EXPORT int
+module_init(struct weston_compositor *compositor, int *argc, char *argv[])
+{
+	struct wl_event_loop *loop;
+
+	loop = wl_display_get_event_loop(compositor->wl_display);
+
+	wl_event_loop_add_idle(loop, damage_test, compositor);
+
+	return 0;
+}
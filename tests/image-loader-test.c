@@ -0,0 +1,319 @@
+/*
+ * Copyright © 2015 The Weston contributors
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and its
+ * documentation for any purpose is hereby granted without fee, provided that
+ * the above copyright notice appear in all copies and that both that copyright
+ * notice and this permission notice appear in supporting documentation, and
+ * that the name of the copyright holders not be used in advertising or
+ * publicity pertaining to distribution of the software without specific,
+ * written prior permission.  The copyright holders make no representations
+ * about the suitability of this software for any purpose.  It is provided "as
+ * is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS SOFTWARE,
+ * INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS, IN NO
+ * EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY SPECIAL, INDIRECT OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS OF USE,
+ * DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT, NEGLIGENCE OR OTHER
+ * TORTIOUS ACTION, ARISING OUT OF OR IN CONNECTION WITH THE USE OR PERFORMANCE
+ * OF THIS SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <stdio.h>
+#include <assert.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <png.h>
+
+#include "image-loader.h"
+
+#define SIZE 256
+#define CACHE_MAX_ENTRIES 64	/* IMAGE_CACHE_MAX_ENTRIES */
+
+static char dir[] = "/tmp/weston-image-loader-test-XXXXXX";
+static char png_file[64];
+static char cache_dir[64];
+
+/* every alpha against every red level, straight alpha */
+static void
+pattern(int x, int y, uint8_t *p)
+{
+	p[0] = x;
+	p[1] = x ^ 0x5a;
+	p[2] = 255 - x;
+	p[3] = y;
+}
+
+static uint32_t
+premultiplied(int x, int y)
+{
+	uint8_t p[4];
+	uint32_t w;
+	int i, t;
+
+	pattern(x, y, p);
+	w = (uint32_t) p[3] << 24;
+	for (i = 0; i < 3; i++) {
+		t = p[3] * p[i] + 0x80;
+		w |= ((t + (t >> 8)) >> 8) << (16 - i * 8);
+	}
+
+	return w;
+}
+
+static void
+write_png(const char *filename)
+{
+	png_structp png;
+	png_infop info;
+	uint8_t row[SIZE * 4];
+	FILE *fp;
+	int x, y;
+
+	fp = fopen(filename, "wb");
+	assert(fp);
+	png = png_create_write_struct(PNG_LIBPNG_VER_STRING,
+				      NULL, NULL, NULL);
+	assert(png);
+	info = png_create_info_struct(png);
+	assert(info);
+
+	png_init_io(png, fp);
+	png_set_IHDR(png, info, SIZE, SIZE, 8, PNG_COLOR_TYPE_RGB_ALPHA,
+		     PNG_INTERLACE_NONE, PNG_COMPRESSION_TYPE_DEFAULT,
+		     PNG_FILTER_TYPE_DEFAULT);
+	png_write_info(png, info);
+	for (y = 0; y < SIZE; y++) {
+		for (x = 0; x < SIZE; x++)
+			pattern(x, y, &row[x * 4]);
+		png_write_row(png, row);
+	}
+	png_write_end(png, info);
+	png_destroy_write_struct(&png, &info);
+	fclose(fp);
+}
+
+static void
+check_pattern(pixman_image_t *image)
+{
+	uint32_t *data;
+	int x, y, stride;
+
+	assert(image);
+	assert(pixman_image_get_width(image) == SIZE);
+	assert(pixman_image_get_height(image) == SIZE);
+
+	data = pixman_image_get_data(image);
+	stride = pixman_image_get_stride(image) / 4;
+	for (y = 0; y < SIZE; y++)
+		for (x = 0; x < SIZE; x++)
+			assert(data[y * stride + x] == premultiplied(x, y));
+}
+
+static int
+cache_file(char *path, size_t size)
+{
+	struct dirent *de;
+	DIR *d;
+	int count = 0;
+
+	d = opendir(cache_dir);
+	if (!d)
+		return 0;
+
+	while ((de = readdir(d))) {
+		if (de->d_name[0] == '.')
+			continue;
+		snprintf(path, size, "%s/%s", cache_dir, de->d_name);
+		count++;
+	}
+	closedir(d);
+
+	return count;
+}
+
+static void
+test_decode_and_cache(void)
+{
+	pixman_image_t *image;
+	struct timeval times[2];
+	char path[512];
+	uint32_t *data;
+	off_t offset;
+	FILE *fp;
+
+	image = load_image(png_file);
+	check_pattern(image);
+	pixman_image_unref(image);
+
+	/* the decoded image went into the cache */
+	assert(cache_file(path, sizeof path) == 1);
+
+	/* blank the cached pixels, and the next load returns them */
+	fp = fopen(path, "r+b");
+	assert(fp);
+	assert(fseek(fp, 0, SEEK_END) == 0);
+	offset = ftell(fp) - SIZE * SIZE * 4;
+	assert(fseek(fp, offset, SEEK_SET) == 0);
+	data = calloc(SIZE * SIZE, 4);
+	assert(fwrite(data, 4, SIZE * SIZE, fp) == SIZE * SIZE);
+	free(data);
+	fclose(fp);
+
+	image = load_image(png_file);
+	assert(image);
+	data = pixman_image_get_data(image);
+	assert(data[SIZE * SIZE - 1] == 0);
+	pixman_image_unref(image);
+
+	/* a new mtime makes the source win again */
+	times[0].tv_sec = times[1].tv_sec = 1000000000;
+	times[0].tv_usec = times[1].tv_usec = 0;
+	assert(utimes(png_file, times) == 0);
+
+	image = load_image(png_file);
+	check_pattern(image);
+	pixman_image_unref(image);
+
+	assert(cache_file(path, sizeof path) == 1);
+	image = load_image(png_file);
+	check_pattern(image);
+	pixman_image_unref(image);
+}
+
+static void
+set_mtime(const char *path, time_t sec)
+{
+	struct timeval times[2];
+
+	times[0].tv_sec = times[1].tv_sec = sec;
+	times[0].tv_usec = times[1].tv_usec = 0;
+	assert(utimes(path, times) == 0);
+}
+
+static void
+test_eviction(void)
+{
+	pixman_image_t *image;
+	char path[512], entry[512];
+	struct stat st;
+	FILE *fp;
+	int i, n = CACHE_MAX_ENTRIES + 8;
+
+	assert(cache_file(entry, sizeof entry) == 1);
+
+	/* a hit marks the entry recently used */
+	set_mtime(entry, 1000000000);
+	image = load_image(png_file);
+	check_pattern(image);
+	pixman_image_unref(image);
+	assert(stat(entry, &st) == 0);
+	assert(st.st_mtime > 1000000000);
+
+	/* fill the cache with older entries */
+	for (i = 0; i < n; i++) {
+		snprintf(path, sizeof path, "%s/%016x", cache_dir, i);
+		fp = fopen(path, "wb");
+		assert(fp);
+		fclose(fp);
+		set_mtime(path, 1000000000 + i);
+	}
+
+	/* storing a fresh decode evicts the least recently used */
+	set_mtime(png_file, 1100000000);
+	image = load_image(png_file);
+	check_pattern(image);
+	pixman_image_unref(image);
+
+	assert(cache_file(path, sizeof path) == CACHE_MAX_ENTRIES);
+	assert(stat(entry, &st) == 0);
+	for (i = 0; i < n; i++) {
+		snprintf(path, sizeof path, "%s/%016x", cache_dir, i);
+		assert((stat(path, &st) == 0) == (i > n - CACHE_MAX_ENTRIES));
+	}
+}
+
+struct load_result {
+	int loaded;
+	int failed;
+};
+
+static void
+loaded(pixman_image_t *image, const char *filename, void *data)
+{
+	struct load_result *result = data;
+
+	if (image) {
+		check_pattern(image);
+		pixman_image_unref(image);
+		result->loaded++;
+	} else {
+		result->failed++;
+	}
+}
+
+static void
+test_queue(void)
+{
+	struct image_load_queue *queue;
+	struct load_result result = { 0, 0 };
+	char missing[128];
+	int i;
+
+	snprintf(missing, sizeof missing, "%s/missing.png", dir);
+
+	queue = image_load_queue_create(4);
+	assert(queue);
+	assert(image_load_queue_get_fd(queue) >= 0);
+
+	for (i = 0; i < 16; i++)
+		assert(image_load_queue_add(queue, png_file,
+					    loaded, &result) == 0);
+	assert(image_load_queue_add(queue, missing, loaded, &result) == 0);
+
+	image_load_queue_wait(queue);
+	assert(result.loaded == 16);
+	assert(result.failed == 1);
+	assert(image_load_queue_dispatch(queue) == 0);
+
+	/* queued loads are dropped without their callbacks */
+	for (i = 0; i < 16; i++)
+		assert(image_load_queue_add(queue, png_file,
+					    loaded, &result) == 0);
+	image_load_queue_destroy(queue);
+	assert(result.loaded == 16);
+}
+
+int main(int argc, char *argv[])
+{
+	char path[512];
+
+	assert(mkdtemp(dir));
+	snprintf(png_file, sizeof png_file, "%s/test.png", dir);
+	snprintf(cache_dir, sizeof cache_dir, "%s/weston/images", dir);
+	setenv("XDG_CACHE_HOME", dir, 1);
+
+	write_png(png_file);
+
+	test_decode_and_cache();
+	test_eviction();
+	test_queue();
+
+	while (cache_file(path, sizeof path) > 0)
+		unlink(path);
+	rmdir(cache_dir);
+	snprintf(path, sizeof path, "%s/weston", dir);
+	rmdir(path);
+	unlink(png_file);
+	rmdir(dir);
+
+	return 0;
+}
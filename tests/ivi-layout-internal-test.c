@@ -0,0 +1,384 @@
+/*
+ * Copyright © 2015 The Weston contributors
+ *
+ * Permission to use, copy, modify, distribute, and sell this software and
+ * its documentation for any purpose is hereby granted without fee, provided
+ * that the above copyright notice appear in all copies and that both that
+ * copyright notice and this permission notice appear in supporting
+ * documentation, and that the name of the copyright holders not be used in
+ * advertising or publicity pertaining to distribution of the software
+ * without specific, written prior permission.  The copyright holders make
+ * no representations about the suitability of this software for any
+ * purpose.  It is provided "as is" without express or implied warranty.
+ *
+ * THE COPYRIGHT HOLDERS DISCLAIM ALL WARRANTIES WITH REGARD TO THIS
+ * SOFTWARE, INCLUDING ALL IMPLIED WARRANTIES OF MERCHANTABILITY AND
+ * FITNESS, IN NO EVENT SHALL THE COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * SPECIAL, INDIRECT OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER
+ * RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF
+ * CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "config.h"
+
+#include <stdio.h>
+#include <assert.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+
+/* The layout internals are static, so build them into the test. */
+#include "../ivi-shell/ivi-layout.c"
+#include "../ivi-shell/ivi-layout-transition.c"
+
+#define LAYER_COUNT 2
+#define SURFACE_COUNT 8
+
+#define STRESS_LAYER_COUNT 256
+#define STRESS_SURFACE_COUNT 4096
+
+struct test_layout {
+	struct wl_client *client;
+	int fds[2];
+
+	struct weston_surface *surfaces[SURFACE_COUNT];
+	struct ivi_layout_surface *ivisurfs[SURFACE_COUNT];
+	struct ivi_layout_layer *layers[LAYER_COUNT];
+
+	int surface_notified[SURFACE_COUNT];
+	int layer_notified[LAYER_COUNT];
+	int32_t update_count[SURFACE_COUNT];
+};
+
+static void
+surface_notification(struct ivi_layout_surface *ivisurf,
+		     const struct ivi_layout_surface_properties *prop,
+		     enum ivi_layout_notification_mask mask,
+		     void *userdata)
+{
+	int *count = userdata;
+
+	assert(mask != 0);
+	(*count)++;
+}
+
+static void
+layer_notification(struct ivi_layout_layer *ivilayer,
+		   const struct ivi_layout_layer_properties *prop,
+		   enum ivi_layout_notification_mask mask,
+		   void *userdata)
+{
+	int *count = userdata;
+
+	assert(mask != 0);
+	(*count)++;
+}
+
+static void
+reset_counters(struct test_layout *t)
+{
+	int i;
+
+	for (i = 0; i < SURFACE_COUNT; i++) {
+		t->surface_notified[i] = 0;
+		t->update_count[i] = t->ivisurfs[i]->update_count;
+	}
+
+	for (i = 0; i < LAYER_COUNT; i++)
+		t->layer_notified[i] = 0;
+}
+
+/* Surface i sits on layer i % LAYER_COUNT. */
+static void
+setup(struct test_layout *t, struct weston_compositor *compositor)
+{
+	const struct ivi_controller_interface *ctl = &ivi_controller_interface;
+	struct ivi_layout_screen *iviscrn;
+	int i;
+
+	iviscrn = ctl->get_screen_from_id(0);
+	assert(iviscrn);
+
+	assert(socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, t->fds) == 0);
+	t->client = wl_client_create(compositor->wl_display, t->fds[0]);
+	assert(t->client);
+
+	for (i = 0; i < LAYER_COUNT; i++) {
+		t->layers[i] = ctl->layer_create_with_dimension(100 + i,
+								1000, 1000);
+		assert(t->layers[i]);
+		ctl->layer_set_visibility(t->layers[i], true);
+		ctl->layer_add_notification(t->layers[i], layer_notification,
+					    &t->layer_notified[i]);
+		ctl->screen_add_layer(iviscrn, t->layers[i]);
+	}
+
+	for (i = 0; i < SURFACE_COUNT; i++) {
+		t->surfaces[i] = weston_surface_create(compositor);
+		assert(t->surfaces[i]);
+		t->surfaces[i]->resource =
+			wl_resource_create(t->client, &wl_surface_interface,
+					   1, 0);
+		assert(t->surfaces[i]->resource);
+
+		t->ivisurfs[i] = ivi_layout_surface_create(t->surfaces[i],
+							   1000 + i);
+		assert(t->ivisurfs[i]);
+		ivi_layout_surface_configure(t->ivisurfs[i], 100, 100);
+		ctl->surface_set_destination_rectangle(t->ivisurfs[i],
+						       i * 100, 0, 100, 100);
+		ctl->surface_set_visibility(t->ivisurfs[i], true);
+		ctl->surface_add_notification(t->ivisurfs[i],
+					      surface_notification,
+					      &t->surface_notified[i]);
+		ctl->layer_add_surface(t->layers[i % LAYER_COUNT],
+				       t->ivisurfs[i]);
+	}
+
+	ctl->commit_changes();
+}
+
+static void
+teardown(struct test_layout *t)
+{
+	int i;
+
+	/* destroying the client runs the ivi surface destroy listeners */
+	wl_client_destroy(t->client);
+	close(t->fds[1]);
+
+	for (i = 0; i < SURFACE_COUNT; i++)
+		weston_surface_destroy(t->surfaces[i]);
+
+	for (i = 0; i < LAYER_COUNT; i++)
+		ivi_controller_interface.layer_remove(t->layers[i]);
+}
+
+static void
+test_incremental_commit(struct weston_compositor *compositor)
+{
+	const struct ivi_controller_interface *ctl = &ivi_controller_interface;
+	struct test_layout t = { 0 };
+	int i;
+
+	setup(&t, compositor);
+
+	for (i = 0; i < SURFACE_COUNT; i++)
+		assert(t.ivisurfs[i]->update_count > 0);
+
+	/* an empty commit touches nothing */
+	reset_counters(&t);
+	ctl->commit_changes();
+	for (i = 0; i < SURFACE_COUNT; i++) {
+		assert(t.surface_notified[i] == 0);
+		assert(t.ivisurfs[i]->update_count == t.update_count[i]);
+	}
+	for (i = 0; i < LAYER_COUNT; i++)
+		assert(t.layer_notified[i] == 0);
+
+	/* a single surface property updates only that surface */
+	reset_counters(&t);
+	ctl->surface_set_opacity(t.ivisurfs[3], wl_fixed_from_double(0.5));
+	ctl->commit_changes();
+	for (i = 0; i < SURFACE_COUNT; i++) {
+		assert(t.surface_notified[i] == (i == 3));
+		assert(t.ivisurfs[i]->update_count ==
+		       t.update_count[i] + (i == 3));
+	}
+	for (i = 0; i < LAYER_COUNT; i++)
+		assert(t.layer_notified[i] == 0);
+
+	/* a layer property updates the surfaces on that layer only */
+	reset_counters(&t);
+	ctl->layer_set_opacity(t.layers[1], wl_fixed_from_double(0.5));
+	ctl->commit_changes();
+	for (i = 0; i < SURFACE_COUNT; i++) {
+		assert(t.surface_notified[i] == 0);
+		assert(t.ivisurfs[i]->update_count ==
+		       t.update_count[i] + (i % LAYER_COUNT == 1));
+	}
+	assert(t.layer_notified[0] == 0);
+	assert(t.layer_notified[1] == 1);
+
+	/* several changes to one object are folded into one update */
+	reset_counters(&t);
+	ctl->surface_set_opacity(t.ivisurfs[0], wl_fixed_from_double(0.25));
+	ctl->surface_set_destination_rectangle(t.ivisurfs[0],
+					       10, 10, 100, 100);
+	ctl->surface_set_opacity(t.ivisurfs[0], wl_fixed_from_double(0.75));
+	ctl->commit_changes();
+	assert(t.surface_notified[0] == 1);
+	assert(t.ivisurfs[0]->update_count == t.update_count[0] + 1);
+	for (i = 1; i < SURFACE_COUNT; i++) {
+		assert(t.surface_notified[i] == 0);
+		assert(t.ivisurfs[i]->update_count == t.update_count[i]);
+	}
+
+	teardown(&t);
+}
+
+/* Spread the ids so they do not come in creation order. */
+static uint32_t
+stress_id(int i)
+{
+	return 0x10000 + (uint32_t) i * 7919;
+}
+
+static double
+elapsed_ns(const struct timespec *start, const struct timespec *end)
+{
+	return (end->tv_sec - start->tv_sec) * 1e9 +
+		(end->tv_nsec - start->tv_nsec);
+}
+
+static void
+test_id_lookup_stress(struct weston_compositor *compositor)
+{
+	const struct ivi_controller_interface *ctl = &ivi_controller_interface;
+	static struct weston_surface *surfaces[STRESS_SURFACE_COUNT];
+	static struct ivi_layout_surface *ivisurfs[STRESS_SURFACE_COUNT];
+	static struct ivi_layout_layer *layers[STRESS_LAYER_COUNT];
+	struct ivi_layout *layout = get_instance();
+	struct ivi_layout_transition *transition;
+	struct wl_client *client;
+	struct timespec start, end;
+	int fds[2];
+	int i;
+
+	assert(socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) == 0);
+	client = wl_client_create(compositor->wl_display, fds[0]);
+	assert(client);
+
+	for (i = 0; i < STRESS_LAYER_COUNT; i++) {
+		layers[i] = ctl->layer_create_with_dimension(stress_id(i),
+							     100, 100);
+		assert(layers[i]);
+	}
+
+	for (i = 0; i < STRESS_SURFACE_COUNT; i++) {
+		surfaces[i] = weston_surface_create(compositor);
+		assert(surfaces[i]);
+		surfaces[i]->resource =
+			wl_resource_create(client, &wl_surface_interface, 1, 0);
+		assert(surfaces[i]->resource);
+
+		ivisurfs[i] = ivi_layout_surface_create(surfaces[i],
+							stress_id(i));
+		assert(ivisurfs[i]);
+		ctl->layer_add_surface(layers[i % STRESS_LAYER_COUNT],
+				       ivisurfs[i]);
+	}
+
+	/* ids are unique */
+	assert(ivi_layout_surface_create(surfaces[0], stress_id(0)) == NULL);
+	assert(ctl->layer_create_with_dimension(stress_id(0), 100, 100) ==
+	       layers[0]);
+
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	for (i = 0; i < STRESS_SURFACE_COUNT; i++)
+		assert(ctl->get_surface_from_id(stress_id(i)) == ivisurfs[i]);
+	clock_gettime(CLOCK_MONOTONIC, &end);
+	fprintf(stderr, "%d surface lookups: %.0f ns each\n",
+		STRESS_SURFACE_COUNT,
+		elapsed_ns(&start, &end) / STRESS_SURFACE_COUNT);
+
+	for (i = 0; i < STRESS_LAYER_COUNT; i++)
+		assert(ctl->get_layer_from_id(stress_id(i)) == layers[i]);
+
+	assert(ctl->get_surface_from_id(1) == NULL);
+	assert(ctl->get_layer_from_id(1) == NULL);
+
+	/* one move transition per layer, however often it is started */
+	for (i = 0; i < STRESS_LAYER_COUNT; i++) {
+		ivi_layout_transition_move_layer(layers[i], 10, 10, 100);
+		ivi_layout_transition_move_layer(layers[i], 20, 20, 100);
+	}
+	assert(transition_count(layout->transitions) == STRESS_LAYER_COUNT);
+	assert(layout->transitions->pending_count == STRESS_LAYER_COUNT);
+
+	for (i = 0; i < STRESS_LAYER_COUNT; i++) {
+		transition = get_transition_from_type_and_id(
+					IVI_LAYOUT_TRANSITION_LAYER_MOVE,
+					stress_id(i), layers[i]);
+		assert(transition);
+		assert(!get_transition_from_type_and_id(
+					IVI_LAYOUT_TRANSITION_LAYER_FADE,
+					stress_id(i), layers[i]));
+
+		ivi_layout_transition_move_layer_cancel(layers[i]);
+		assert(!get_transition_from_type_and_id(
+					IVI_LAYOUT_TRANSITION_LAYER_MOVE,
+					stress_id(i), layers[i]));
+	}
+	assert(transition_count(layout->transitions) == 0);
+	assert(layout->transitions->pending_count == 0);
+
+	/* destroying every other surface drops it from the index */
+	for (i = 0; i < STRESS_SURFACE_COUNT; i += 2) {
+		wl_resource_destroy(surfaces[i]->resource);
+		weston_surface_destroy(surfaces[i]);
+	}
+
+	for (i = 0; i < STRESS_SURFACE_COUNT; i++) {
+		if (i % 2 == 0)
+			assert(ctl->get_surface_from_id(stress_id(i)) == NULL);
+		else
+			assert(ctl->get_surface_from_id(stress_id(i)) ==
+			       ivisurfs[i]);
+	}
+
+	/* and the ids can be used again */
+	for (i = 0; i < STRESS_SURFACE_COUNT; i += 2) {
+		surfaces[i] = weston_surface_create(compositor);
+		assert(surfaces[i]);
+		surfaces[i]->resource =
+			wl_resource_create(client, &wl_surface_interface, 1, 0);
+		assert(surfaces[i]->resource);
+
+		ivisurfs[i] = ivi_layout_surface_create(surfaces[i],
+							stress_id(i));
+		assert(ivisurfs[i]);
+	}
+
+	for (i = 0; i < STRESS_SURFACE_COUNT; i++)
+		assert(ctl->get_surface_from_id(stress_id(i)) == ivisurfs[i]);
+
+	wl_client_destroy(client);
+	close(fds[1]);
+
+	for (i = 0; i < STRESS_SURFACE_COUNT; i++) {
+		assert(ctl->get_surface_from_id(stress_id(i)) == NULL);
+		weston_surface_destroy(surfaces[i]);
+	}
+
+	for (i = 0; i < STRESS_LAYER_COUNT; i++) {
+		ctl->layer_remove(layers[i]);
+		assert(ctl->get_layer_from_id(stress_id(i)) == NULL);
+	}
+}
+
+static void
+run_tests(void *data)
+{
+	struct weston_compositor *compositor = data;
+
+	ivi_layout_init_with_compositor(compositor);
+
+	test_incremental_commit(compositor);
+	test_id_lookup_stress(compositor);
+
+	wl_display_terminate(compositor->wl_display);
+}
+
+WL_EXPORT int
+module_init(struct weston_compositor *compositor, int *argc, char *argv[])
+{
+	struct wl_event_loop *loop;
+
+	loop = wl_display_get_event_loop(compositor->wl_display);
+
+	wl_event_loop_add_idle(loop, run_tests, compositor);
+
+	return 0;
+}
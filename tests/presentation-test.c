@@ -31,6 +31,24 @@
 #include "weston-test-client-helper.h"
 #include "presentation_timing-client-protocol.h"
 
+#define REPAINT_WINDOW_MSEC 8
+
+/* the headless output repaints this long before its vblanks */
+char *server_parameters = "--repaint-window=8";
+
+static clockid_t clk_id = CLOCK_MONOTONIC;
+
+static void
+presentation_clock_id(void *data, struct presentation *presentation,
+		      uint32_t clock_id)
+{
+	clk_id = clock_id;
+}
+
+static const struct presentation_listener presentation_listener = {
+	presentation_clock_id
+};
+
 static struct presentation *
 get_presentation(struct client *client)
 {
@@ -58,6 +76,7 @@ get_presentation(struct client *client)
 	pres = wl_registry_bind(client->wl_registry, global_pres->name,
 				&presentation_interface, 1);
 	assert(pres);
+	presentation_add_listener(pres, &presentation_listener, NULL);
 
 	return pres;
 }
@@ -236,3 +255,79 @@ TEST(test_presentation_feedback_simple)
 
 	feedback_destroy(fb);
 }
+
+static int64_t
+timespec_sub_to_nsec(const struct timespec *a, const struct timespec *b)
+{
+	return (int64_t) (a->tv_sec - b->tv_sec) * 1000000000 +
+		a->tv_nsec - b->tv_nsec;
+}
+
+#define N_FRAMES 16
+
+TEST(test_presentation_repaint_window)
+{
+	struct client *client;
+	struct surface *surface;
+	struct feedback *fb[N_FRAMES];
+	struct timespec commit[N_FRAMES];
+	int64_t latency, min_latency = INT64_MAX, interval;
+	int i, done;
+
+	client = client_create(100, 50, 123, 77);
+	assert(client);
+	surface = client->surface;
+
+	/* for the clock_id event */
+	get_presentation(client);
+	client_roundtrip(client);
+
+	/* Each frame is committed as soon as the previous one has been
+	 * repainted, which keeps the output in its repaint loop. */
+	for (i = 0; i < N_FRAMES; i++) {
+		wl_surface_attach(surface->wl_surface,
+				  surface->wl_buffer, 0, 0);
+		wl_surface_damage(surface->wl_surface, 0, 0,
+				  surface->width, surface->height);
+		fb[i] = feedback_create(client, surface->wl_surface);
+		frame_callback_set(surface->wl_surface, &done);
+		clock_gettime(clk_id, &commit[i]);
+		wl_surface_commit(surface->wl_surface);
+		frame_callback_wait(client, &done);
+	}
+
+	for (i = 0; i < N_FRAMES; i++) {
+		feedback_wait(fb[i]);
+		assert(fb[i]->result == FB_PRESENTED);
+		assert(fb[i]->refresh_nsec > 0);
+
+		latency = timespec_sub_to_nsec(&fb[i]->time, &commit[i]);
+		assert(latency > 0);
+
+		/* past the first frame, presentation follows the
+		 * output's vblank grid */
+		if (i == 0)
+			continue;
+
+		assert(fb[i]->flags & PRESENTATION_FEEDBACK_KIND_VSYNC);
+		interval = timespec_sub_to_nsec(&fb[i]->time,
+						&fb[i - 1]->time);
+		assert(interval > 0);
+		assert(interval % fb[i]->refresh_nsec == 0);
+
+		if (latency < min_latency)
+			min_latency = latency;
+	}
+
+	printf("%s: min latency %" PRId64 " us, refresh %u us\n", __func__,
+	       min_latency / 1000, fb[1]->refresh_nsec / 1000);
+
+	/* A commit right after a repaint makes the next one, which
+	 * happens the repaint window ahead of the vblank after next;
+	 * without the window it would take two full refresh periods. */
+	assert(min_latency < 2 * (int64_t) fb[1]->refresh_nsec -
+	       REPAINT_WINDOW_MSEC * 1000000 / 2);
+
+	for (i = 0; i < N_FRAMES; i++)
+		feedback_destroy(fb[i]);
+}
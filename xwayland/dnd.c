@@ -146,17 +146,23 @@ data_source_cancel(struct weston_data_source *source)
 	weston_log("got cancel\n");
 }
 
+static int
+is_text_type(const char *name)
+{
+	return strcmp(name, "UTF8_STRING") == 0 ||
+		strcmp(name, "text/plain;charset=utf-8") == 0 ||
+		strcmp(name, "text/plain") == 0;
+}
+
 static void
-handle_enter(struct weston_wm *wm, xcb_client_message_event_t *client_message)
+handle_enter_type_names(struct weston_wm *wm, void *data,
+			void **replies, int count)
 {
 	struct dnd_data_source *source;
 	struct weston_seat *seat = weston_wm_pick_seat(wm);
-	char **p;
-	const char *name;
-	uint32_t *types;
-	int i, length, has_text;
-	xcb_get_property_cookie_t cookie;
-	xcb_get_property_reply_t *reply;
+	xcb_get_atom_name_reply_t *reply;
+	char **p, *name;
+	int i, has_text;
 
 	source = malloc(sizeof *source);
 	if (source == NULL)
@@ -167,52 +173,103 @@ handle_enter(struct weston_wm *wm, xcb_client_message_event_t *client_message)
 	source->base.send = data_source_send;
 	source->base.cancel = data_source_cancel;
 	source->wm = wm;
-	source->window = client_message->data.data32[0];
-	source->version = client_message->data.data32[1] >> 24;
-
-	if (client_message->data.data32[1] & 1) {
-		cookie = xcb_get_property(wm->conn,
-					  0, /* delete */
-					  source->window,
-					  wm->atom.xdnd_type_list,
-					  XCB_ATOM_ANY, 0, 2048);
-		reply = xcb_get_property_reply(wm->conn, cookie, NULL);
-		types = xcb_get_property_value(reply);
-		length = reply->value_len;
-	} else {
-		reply = NULL;
-		types = &client_message->data.data32[2];
-		length = 3;
-	}
+	source->window = wm->dnd_enter_window;
+	source->version = wm->dnd_enter_version;
 
 	wl_array_init(&source->base.mime_types);
 	has_text = 0;
-	for (i = 0; i < length; i++) {
-		if (types[i] == XCB_ATOM_NONE)
+	for (i = 0; i < count; i++) {
+		reply = replies[i];
+		if (reply == NULL)
 			continue;
 
-		name = get_atom_name(wm->conn, types[i]);
-		if (types[i] == wm->atom.utf8_string ||
-		    types[i] == wm->atom.text_plain_utf8 ||
-		    types[i] == wm->atom.text_plain) {
-			if (has_text)
-				continue;
+		name = strndup(xcb_get_atom_name_name(reply),
+			       xcb_get_atom_name_name_length(reply));
+		if (name == NULL)
+			continue;
 
-			has_text = 1;
-			p = wl_array_add(&source->base.mime_types, sizeof *p);
-			if (p)
-				*p = strdup("text/plain;charset=utf-8");
+		if (is_text_type(name)) {
+			if (!has_text) {
+				has_text = 1;
+				p = wl_array_add(&source->base.mime_types,
+						 sizeof *p);
+				if (p)
+					*p = strdup("text/plain;charset=utf-8");
+			}
 		} else if (strchr(name, '/')) {
 			p = wl_array_add(&source->base.mime_types, sizeof *p);
-			if (p)
-				*p = strdup(name);
+			if (p) {
+				*p = name;
+				continue;
+			}
 		}
+
+		free(name);
 	}
 
-	free(reply);
 	weston_pointer_start_drag(seat->pointer, &source->base, NULL, NULL);
 }
 
+/* All the type names are asked for at once, and the drag starts when
+ * they are in, instead of taking a round trip per type. */
+static void
+handle_enter_types(struct weston_wm *wm, const uint32_t *types, int length)
+{
+	xcb_get_atom_name_cookie_t cookie;
+	unsigned int *sequence;
+	int i, count = 0;
+
+	sequence = malloc((length + 1) * sizeof *sequence);
+	if (sequence == NULL)
+		return;
+
+	for (i = 0; i < length; i++) {
+		if (types[i] == XCB_ATOM_NONE)
+			continue;
+
+		cookie = xcb_get_atom_name(wm->conn, types[i]);
+		sequence[count++] = cookie.sequence;
+	}
+
+	weston_wm_queue_request(wm, wm, sequence, count,
+				handle_enter_type_names);
+	free(sequence);
+}
+
+static void
+handle_enter_type_list(struct weston_wm *wm, void *data,
+		       void **replies, int count)
+{
+	xcb_get_property_reply_t *reply = replies[0];
+
+	if (reply == NULL)
+		handle_enter_types(wm, NULL, 0);
+	else
+		handle_enter_types(wm, xcb_get_property_value(reply),
+				   reply->value_len);
+}
+
+static void
+handle_enter(struct weston_wm *wm, xcb_client_message_event_t *client_message)
+{
+	xcb_get_property_cookie_t cookie;
+
+	wm->dnd_enter_window = client_message->data.data32[0];
+	wm->dnd_enter_version = client_message->data.data32[1] >> 24;
+
+	if (client_message->data.data32[1] & 1) {
+		cookie = xcb_get_property(wm->conn,
+					  0, /* delete */
+					  wm->dnd_enter_window,
+					  wm->atom.xdnd_type_list,
+					  XCB_ATOM_ANY, 0, 2048);
+		weston_wm_queue_request(wm, wm, &cookie.sequence, 1,
+					handle_enter_type_list);
+	} else {
+		handle_enter_types(wm, &client_message->data.data32[2], 3);
+	}
+}
+
 int
 weston_wm_handle_dnd_event(struct weston_wm *wm,
 			   xcb_generic_event_t *event)
@@ -26,53 +26,134 @@
 #include <string.h>
 #include <unistd.h>
 #include <fcntl.h>
+#include <errno.h>
 
 #include "xwayland.h"
 
+/* Selection data is moved between the X property and the wayland fd
+ * in pieces of this size, in both directions.  The compositor never
+ * holds more than about one piece of a transfer. */
+static const size_t incr_chunk_size = 64 * 1024;
+
+/* Asks for the next piece of the selection property.  The reply is
+ * not waited for, func gets it from the event loop. */
+static void
+weston_wm_get_selection_chunk(struct weston_wm *wm,
+			      weston_wm_reply_func_t func)
+{
+	xcb_get_property_cookie_t cookie;
+
+	/* Offset and length are in 32 bit units. */
+	cookie = xcb_get_property(wm->conn,
+				  0, /* delete */
+				  wm->selection_window,
+				  wm->atom.wl_selection,
+				  XCB_GET_PROPERTY_TYPE_ANY,
+				  wm->property_offset,
+				  incr_chunk_size / 4);
+
+	weston_wm_queue_request(wm, wm, &cookie.sequence, 1, func);
+}
+
+/* Keeps the reply past the handler and moves the offset beyond it. */
+static xcb_get_property_reply_t *
+weston_wm_take_selection_chunk(struct weston_wm *wm, void **replies)
+{
+	xcb_get_property_reply_t *reply = replies[0];
+
+	replies[0] = NULL;
+	if (reply)
+		wm->property_offset +=
+			xcb_get_property_value_length(reply) / 4;
+
+	return reply;
+}
+
+static void
+weston_wm_selection_write_done(struct weston_wm *wm)
+{
+	if (wm->property_source)
+		wl_event_source_remove(wm->property_source);
+	wm->property_source = NULL;
+}
+
 static int
-writable_callback(int fd, uint32_t mask, void *data)
+writable_callback(int fd, uint32_t mask, void *data);
+
+static void
+weston_wm_selection_chunk_received(struct weston_wm *wm, void *data,
+				   void **replies, int count);
+
+/* Writes out as much of the current piece as the reader takes.  Once
+ * it is all out, the next piece is asked for, or the owner is told to
+ * send it in incremental mode. */
+static void
+weston_wm_write_selection_chunk(struct weston_wm *wm)
 {
-	struct weston_wm *wm = data;
+	int fd = wm->data_source_fd;
 	unsigned char *property;
 	int len, remainder;
+	uint32_t bytes_after;
 
 	property = xcb_get_property_value(wm->property_reply);
 	remainder = xcb_get_property_value_length(wm->property_reply) -
 		wm->property_start;
 
 	len = write(fd, property + wm->property_start, remainder);
+	if (len == -1 && errno == EAGAIN)
+		len = 0;
 	if (len == -1) {
 		free(wm->property_reply);
 		wm->property_reply = NULL;
-		if (wm->property_source)
-			wl_event_source_remove(wm->property_source);
-		wm->property_source = NULL;
+		weston_wm_selection_write_done(wm);
 		close(fd);
 		weston_log("write error to target fd: %m\n");
-		return 1;
+		return;
 	}
 
-	weston_log("wrote %d (chunk size %d) of %d bytes\n",
-		wm->property_start + len,
-		len, xcb_get_property_value_length(wm->property_reply));
-
 	wm->property_start += len;
-	if (len == remainder) {
-		free(wm->property_reply);
-		wm->property_reply = NULL;
-		if (wm->property_source)
-			wl_event_source_remove(wm->property_source);
-		wm->property_source = NULL;
+	if (len < remainder) {
+		/* Wait for the reader to catch up. */
+		if (!wm->property_source)
+			wm->property_source =
+				wl_event_loop_add_fd(wm->server->loop,
+						     fd,
+						     WL_EVENT_WRITABLE,
+						     writable_callback,
+						     wm);
+		return;
+	}
 
-		if (wm->incr) {
-			xcb_delete_property(wm->conn,
-					    wm->selection_window,
-					    wm->atom.wl_selection);
-		} else {
-			weston_log("transfer complete\n");
-			close(fd);
-		}
+	bytes_after = wm->property_reply->bytes_after;
+	free(wm->property_reply);
+	wm->property_reply = NULL;
+	weston_wm_selection_write_done(wm);
+
+	if (bytes_after > 0) {
+		weston_wm_get_selection_chunk(wm,
+			weston_wm_selection_chunk_received);
+		return;
+	}
+
+	/* In incremental mode, deleting the property asks the owner for
+	 * the next chunk. */
+	xcb_delete_property(wm->conn,
+			    wm->selection_window,
+			    wm->atom.wl_selection);
+
+	if (!wm->incr) {
+		weston_log("transfer complete\n");
+		close(fd);
 	}
+}
+
+static int
+writable_callback(int fd, uint32_t mask, void *data)
+{
+	struct weston_wm *wm = data;
+
+	weston_wm_write_selection_chunk(wm);
+	weston_wm_flush(wm);
 
 	return 1;
 }
@@ -82,35 +163,36 @@ weston_wm_write_property(struct weston_wm *wm, xcb_get_property_reply_t *reply)
 {
 	wm->property_start = 0;
 	wm->property_reply = reply;
-	writable_callback(wm->data_source_fd, WL_EVENT_WRITABLE, wm);
-
-	if (wm->property_reply)
-		wm->property_source =
-			wl_event_loop_add_fd(wm->server->loop,
-					     wm->data_source_fd,
-					     WL_EVENT_WRITABLE,
-					     writable_callback, wm);
+	weston_wm_write_selection_chunk(wm);
 }
 
 static void
-weston_wm_get_incr_chunk(struct weston_wm *wm)
+weston_wm_selection_chunk_received(struct weston_wm *wm, void *data,
+				   void **replies, int count)
 {
-	xcb_get_property_cookie_t cookie;
 	xcb_get_property_reply_t *reply;
 
-	cookie = xcb_get_property(wm->conn,
-				  0, /* delete */
-				  wm->selection_window,
-				  wm->atom.wl_selection,
-				  XCB_GET_PROPERTY_TYPE_ANY,
-				  0, /* offset */
-				  0x1fffffff /* length */);
+	reply = weston_wm_take_selection_chunk(wm, replies);
+	if (reply == NULL) {
+		weston_log("selection property went away\n");
+		close(wm->data_source_fd);
+		return;
+	}
+
+	weston_wm_write_property(wm, reply);
+}
+
+static void
+weston_wm_incr_chunk_received(struct weston_wm *wm, void *data,
+			      void **replies, int count)
+{
+	xcb_get_property_reply_t *reply;
 
-	reply = xcb_get_property_reply(wm->conn, cookie, NULL);
+	reply = weston_wm_take_selection_chunk(wm, replies);
 
 	dump_property(wm, wm->atom.wl_selection, reply);
 
-	if (xcb_get_property_value_length(reply) > 0) {
+	if (reply && xcb_get_property_value_length(reply) > 0) {
 		weston_wm_write_property(wm, reply);
 	} else {
 		weston_log("transfer complete\n");
@@ -119,6 +201,13 @@ weston_wm_get_incr_chunk(struct weston_wm *wm)
 	}
 }
 
+static void
+weston_wm_get_incr_chunk(struct weston_wm *wm)
+{
+	wm->property_offset = 0;
+	weston_wm_get_selection_chunk(wm, weston_wm_incr_chunk_received);
+}
+
 struct x11_data_source {
 	struct weston_data_source base;
 	struct weston_wm *wm;
@@ -146,10 +235,12 @@ data_source_send(struct weston_data_source *base,
 				      wm->atom.wl_selection,
 				      XCB_TIME_CURRENT_TIME);
 
-		xcb_flush(wm->conn);
+		weston_wm_flush(wm);
 
 		fcntl(fd, F_SETFL, O_WRONLY | O_NONBLOCK);
 		wm->data_source_fd = fd;
+	} else {
+		close(fd);
 	}
 }
 
@@ -159,33 +250,21 @@ data_source_cancel(struct weston_data_source *source)
 }
 
 static void
-weston_wm_get_selection_targets(struct weston_wm *wm)
+weston_wm_selection_targets_received(struct weston_wm *wm, void *data,
+				     void **replies, int count)
 {
 	struct x11_data_source *source;
 	struct weston_compositor *compositor;
 	struct weston_seat *seat = weston_wm_pick_seat(wm);
-	xcb_get_property_cookie_t cookie;
-	xcb_get_property_reply_t *reply;
+	xcb_get_property_reply_t *reply = replies[0];
 	xcb_atom_t *value;
 	char **p;
 	uint32_t i;
 
-	cookie = xcb_get_property(wm->conn,
-				  1, /* delete */
-				  wm->selection_window,
-				  wm->atom.wl_selection,
-				  XCB_GET_PROPERTY_TYPE_ANY,
-				  0, /* offset */
-				  4096 /* length */);
-
-	reply = xcb_get_property_reply(wm->conn, cookie, NULL);
-
 	dump_property(wm, wm->atom.wl_selection, reply);
 
-	if (reply->type != XCB_ATOM_ATOM) {
-		free(reply);
+	if (reply == NULL || reply->type != XCB_ATOM_ATOM)
 		return;
-	}
 
 	source = malloc(sizeof *source);
 	if (source == NULL)
@@ -210,15 +289,12 @@ weston_wm_get_selection_targets(struct weston_wm *wm)
 	compositor = wm->server->compositor;
 	weston_seat_set_selection(seat, &source->base,
 				  wl_display_next_serial(compositor->wl_display));
-
-	free(reply);
 }
 
 static void
-weston_wm_get_selection_data(struct weston_wm *wm)
+weston_wm_get_selection_targets(struct weston_wm *wm)
 {
 	xcb_get_property_cookie_t cookie;
-	xcb_get_property_reply_t *reply;
 
 	cookie = xcb_get_property(wm->conn,
 				  1, /* delete */
@@ -226,14 +302,33 @@ weston_wm_get_selection_data(struct weston_wm *wm)
 				  wm->atom.wl_selection,
 				  XCB_GET_PROPERTY_TYPE_ANY,
 				  0, /* offset */
-				  0x1fffffff /* length */);
+				  4096 /* length */);
+
+	weston_wm_queue_request(wm, wm, &cookie.sequence, 1,
+				weston_wm_selection_targets_received);
+}
+
+static void
+weston_wm_selection_data_received(struct weston_wm *wm, void *data,
+				  void **replies, int count)
+{
+	xcb_get_property_reply_t *reply;
 
-	reply = xcb_get_property_reply(wm->conn, cookie, NULL);
+	reply = weston_wm_take_selection_chunk(wm, replies);
+	if (reply == NULL) {
+		close(wm->data_source_fd);
+		return;
+	}
 
 	if (reply->type == wm->atom.incr) {
 		dump_property(wm, wm->atom.wl_selection, reply);
 		wm->incr = 1;
 		free(reply);
+
+		/* Deleting the INCR property starts the transfer. */
+		xcb_delete_property(wm->conn,
+				    wm->selection_window,
+				    wm->atom.wl_selection);
 	} else {
 		dump_property(wm, wm->atom.wl_selection, reply);
 		wm->incr = 0;
@@ -241,6 +336,13 @@ weston_wm_get_selection_data(struct weston_wm *wm)
 	}
 }
 
+static void
+weston_wm_get_selection_data(struct weston_wm *wm)
+{
+	wm->property_offset = 0;
+	weston_wm_get_selection_chunk(wm, weston_wm_selection_data_received);
+}
+
 static void
 weston_wm_handle_selection_notify(struct weston_wm *wm,
 				xcb_generic_event_t *event)
@@ -257,8 +359,6 @@ weston_wm_handle_selection_notify(struct weston_wm *wm,
 	}
 }
 
-static const size_t incr_chunk_size = 64 * 1024;
-
 static void
 weston_wm_send_selection_notify(struct weston_wm *wm, xcb_atom_t property)
 {
@@ -350,6 +450,8 @@ weston_wm_read_data_source(int fd, uint32_t mask, void *data)
 	available = wm->source_data.alloc - current;
 
 	len = read(fd, p, available);
+	if (len == -1 && errno == EAGAIN)
+		return 1;
 	if (len == -1) {
 		weston_log("read error from data source: %m\n");
 		weston_wm_send_selection_notify(wm, XCB_ATOM_NONE);
@@ -357,6 +459,7 @@ weston_wm_read_data_source(int fd, uint32_t mask, void *data)
 		wm->property_source = NULL;
 		close(fd);
 		wl_array_release(&wm->source_data);
+		return 1;
 	}
 
 	weston_log("read %d (available %d, mask 0x%x) bytes: \"%.*s\"\n",
@@ -398,7 +501,7 @@ weston_wm_read_data_source(int fd, uint32_t mask, void *data)
 		/* Non-incr transfer all done. */
 		weston_wm_flush_source_data(wm);
 		weston_wm_send_selection_notify(wm, wm->selection_request.property);
-		xcb_flush(wm->conn);
+		weston_wm_flush(wm);
 		wl_event_source_remove(wm->property_source);
 		wm->property_source = NULL;
 		close(fd);
@@ -417,7 +520,7 @@ weston_wm_read_data_source(int fd, uint32_t mask, void *data)
 				wm->source_data.size);
 			weston_wm_flush_source_data(wm);
 		}
-		xcb_flush(wm->conn);
+		weston_wm_flush(wm);
 		wl_event_source_remove(wm->property_source);
 		wm->property_source = NULL;
 		close(wm->data_source_fd);
@@ -522,12 +625,15 @@ weston_wm_handle_selection_request(struct weston_wm *wm,
 	xcb_selection_request_event_t *selection_request =
 		(xcb_selection_request_event_t *) event;
 
+#ifdef WM_DEBUG
+	/* Naming the atoms takes round trips to the X server. */
 	weston_log("selection request, %s, ",
 		get_atom_name(wm->conn, selection_request->selection));
 	weston_log_continue("target %s, ",
 		get_atom_name(wm->conn, selection_request->target));
 	weston_log_continue("property %s\n",
 		get_atom_name(wm->conn, selection_request->property));
+#endif
 
 	wm->selection_request = *selection_request;
 	wm->incr = 0;
@@ -22,6 +22,7 @@
 
 #include "config.h"
 
+#include <assert.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -32,6 +33,7 @@
 #include <unistd.h>
 #include <signal.h>
 #include <X11/Xcursor/Xcursor.h>
+#include <xcb/xcbext.h>
 #include <linux/input.h>
 
 #include "xwayland.h"
@@ -129,6 +131,9 @@ struct weston_wm_window {
 	struct wl_event_source *repaint_source;
 	struct wl_event_source *configure_source;
 	int properties_dirty;
+	int properties_pending;
+	int map_pending;
+	int shell_state_pending;
 	int pid;
 	char *machine;
 	char *class;
@@ -195,6 +200,112 @@ wm_log_continue(const char *fmt, ...)
 #endif
 }
 
+/* Replies to requests the window manager needs are not waited for.
+ * The sequence numbers are queued instead, and the replies are picked
+ * up from the event loop.  X answers requests in order, so only the
+ * head of the queue has to be polled. */
+
+struct weston_wm_request {
+	struct wl_list link;
+	void *data;
+	weston_wm_reply_func_t func;
+	int count;
+	int received;
+	unsigned int *sequence;
+	void **replies;
+};
+
+void
+weston_wm_queue_request(struct weston_wm *wm, void *data,
+			const unsigned int *sequence, int count,
+			weston_wm_reply_func_t func)
+{
+	struct weston_wm_request *request;
+
+	request = zalloc(sizeof *request +
+			 count * (sizeof *request->sequence +
+				  sizeof *request->replies));
+	if (request == NULL) {
+		weston_log("failed to allocate xwm request\n");
+		for (; count > 0; count--, sequence++)
+			xcb_discard_reply(wm->conn, *sequence);
+		return;
+	}
+
+	request->data = data;
+	request->func = func;
+	request->count = count;
+	request->replies = (void **) (request + 1);
+	request->sequence = (unsigned int *) (request->replies + count);
+	memcpy(request->sequence, sequence, count * sizeof *sequence);
+	wl_list_insert(wm->request_list.prev, &request->link);
+}
+
+static void
+weston_wm_request_destroy(struct weston_wm *wm,
+			  struct weston_wm_request *request)
+{
+	int i;
+
+	for (i = 0; i < request->received; i++)
+		free(request->replies[i]);
+	for (; i < request->count; i++)
+		xcb_discard_reply(wm->conn, request->sequence[i]);
+
+	wl_list_remove(&request->link);
+	free(request);
+}
+
+/* Runs the handlers of the requests whose replies are all in, and
+ * returns how many ran. */
+static int
+weston_wm_process_replies(struct weston_wm *wm)
+{
+	struct weston_wm_request *request;
+	xcb_generic_error_t *error;
+	void *reply;
+	int i, handled = 0;
+
+	while (!wl_list_empty(&wm->request_list)) {
+		request = container_of(wm->request_list.next,
+				       struct weston_wm_request, link);
+
+		while (request->received < request->count) {
+			i = request->received;
+			if (!xcb_poll_for_reply(wm->conn, request->sequence[i],
+						&reply, &error))
+				return handled;
+
+			/* A failed request gives a NULL reply, which
+			 * the handlers treat as a missing property. */
+			free(error);
+			request->replies[i] = reply;
+			request->received++;
+		}
+
+		/* Unlink first, the handler may queue new requests.
+		 * It may also keep a reply by clearing its slot. */
+		wl_list_remove(&request->link);
+		wl_list_init(&request->link);
+		request->func(wm, request->data,
+			      request->replies, request->count);
+		weston_wm_request_destroy(wm, request);
+		handled++;
+	}
+
+	return handled;
+}
+
+void
+weston_wm_cancel_requests(struct weston_wm *wm, void *data)
+{
+	struct weston_wm_request *request, *next;
+
+	wl_list_for_each_safe(request, next, &wm->request_list, link)
+		if (request->data == data)
+			weston_wm_request_destroy(wm, request);
+}
+
 
 const char *
 get_atom_name(xcb_connection_t *c, xcb_atom_t atom)
@@ -300,6 +411,9 @@ void
 dump_property(struct weston_wm *wm,
 	      xcb_atom_t property, xcb_get_property_reply_t *reply)
 {
+#ifdef WM_DEBUG
+	/* Resolving the atom names takes round trips to the X server,
+	 * which only debug builds can afford. */
 	int32_t *incr_value;
 	const char *text_value, *name;
 	xcb_atom_t *atom_value;
@@ -346,23 +460,30 @@ dump_property(struct weston_wm *wm,
 	} else {
 		wm_log_continue("huh?\n");
 	}
+#endif
+}
+
+#ifdef WM_DEBUG
+static void
+dump_property_reply(struct weston_wm *wm, void *data,
+		    void **replies, int count)
+{
+	wm_log("  ");
+	dump_property(wm, (xcb_atom_t) (uintptr_t) data, replies[0]);
 }
 
 static void
 read_and_dump_property(struct weston_wm *wm,
 		       xcb_window_t window, xcb_atom_t property)
 {
-	xcb_get_property_reply_t *reply;
 	xcb_get_property_cookie_t cookie;
 
 	cookie = xcb_get_property(wm->conn, 0, window,
 				  property, XCB_ATOM_ANY, 0, 2048);
-	reply = xcb_get_property_reply(wm->conn, cookie, NULL);
-
-	dump_property(wm, property, reply);
-
-	free(reply);
+	weston_wm_queue_request(wm, (void *) (uintptr_t) property,
+				&cookie.sequence, 1, dump_property_reply);
 }
+#endif
 
 /* We reuse some predefined, but otherwise useles atoms */
 #define TYPE_WM_PROTOCOLS	XCB_ATOM_CUT_BUFFER0
@@ -370,19 +491,20 @@ read_and_dump_property(struct weston_wm *wm,
 #define TYPE_NET_WM_STATE	XCB_ATOM_CUT_BUFFER2
 #define TYPE_WM_NORMAL_HINTS	XCB_ATOM_CUT_BUFFER3
 
+struct wm_property {
+	xcb_atom_t atom;
+	xcb_atom_t type;
+	int offset;
+};
+
+#define WM_PROPERTY_COUNT 11
+
 static void
-weston_wm_window_read_properties(struct weston_wm_window *window)
+weston_wm_get_window_properties(struct weston_wm *wm,
+				struct wm_property props[WM_PROPERTY_COUNT])
 {
-	struct weston_wm *wm = window->wm;
-	struct weston_shell_interface *shell_interface =
-		&wm->server->compositor->shell_interface;
-
 #define F(field) offsetof(struct weston_wm_window, field)
-	const struct {
-		xcb_atom_t atom;
-		xcb_atom_t type;
-		int offset;
-	} props[] = {
+	const struct wm_property table[WM_PROPERTY_COUNT] = {
 		{ XCB_ATOM_WM_CLASS, XCB_ATOM_STRING, F(class) },
 		{ XCB_ATOM_WM_NAME, XCB_ATOM_STRING, F(name) },
 		{ XCB_ATOM_WM_TRANSIENT_FOR, XCB_ATOM_WINDOW, F(transient_for) },
@@ -397,43 +519,54 @@ weston_wm_window_read_properties(struct weston_wm_window *window)
 	};
 #undef F
 
-	xcb_get_property_cookie_t cookie[ARRAY_LENGTH(props)];
+	memcpy(props, table, sizeof table);
+}
+
+static void
+weston_wm_window_map(struct weston_wm_window *window);
+
+static void
+weston_wm_window_read_properties(struct weston_wm_window *window);
+
+static void
+weston_wm_window_set_shell_state(struct weston_wm_window *window);
+
+static void
+weston_wm_window_handle_properties(struct weston_wm *wm, void *data,
+				   void **replies, int count)
+{
+	struct weston_wm_window *window = data;
+	struct weston_shell_interface *shell_interface =
+		&wm->server->compositor->shell_interface;
+	struct wm_property props[WM_PROPERTY_COUNT];
 	xcb_get_property_reply_t *reply;
 	void *p;
 	uint32_t *xid;
 	xcb_atom_t *atom;
 	uint32_t i;
+	int j;
 
-	if (!window->properties_dirty)
-		return;
-	window->properties_dirty = 0;
+	window->properties_pending = 0;
 
-	for (i = 0; i < ARRAY_LENGTH(props); i++)
-		cookie[i] = xcb_get_property(wm->conn,
-					     0, /* delete */
-					     window->id,
-					     props[i].atom,
-					     XCB_ATOM_ANY, 0, 2048);
+	weston_wm_get_window_properties(wm, props);
 
 	window->decorate = !window->override_redirect;
 	window->size_hints.flags = 0;
 	window->motif_hints.flags = 0;
 	window->delete_window = 0;
 
-	for (i = 0; i < ARRAY_LENGTH(props); i++)  {
-		reply = xcb_get_property_reply(wm->conn, cookie[i], NULL);
+	for (j = 0; j < count; j++)  {
+		reply = replies[j];
 		if (!reply)
 			/* Bad window, typically */
 			continue;
-		if (reply->type == XCB_ATOM_NONE) {
+		if (reply->type == XCB_ATOM_NONE)
 			/* No such property */
-			free(reply);
 			continue;
-		}
 
-		p = ((char *) window + props[i].offset);
+		p = ((char *) window + props[j].offset);
 
-		switch (props[i].type) {
+		switch (props[j].type) {
 		case XCB_ATOM_WM_CLIENT_MACHINE:
 		case XCB_ATOM_STRING:
 			/* FIXME: We're using this for both string and
@@ -461,8 +594,6 @@ weston_wm_window_read_properties(struct weston_wm_window *window)
 				if (atom[i] == wm->atom.wm_delete_window)
 					window->delete_window = 1;
 			break;
-
-			break;
 		case TYPE_WM_NORMAL_HINTS:
 			memcpy(&window->size_hints,
 			       xcb_get_property_value(reply),
@@ -490,13 +621,66 @@ weston_wm_window_read_properties(struct weston_wm_window *window)
 		default:
 			break;
 		}
-		free(reply);
 	}
 
 	if (window->shsurf && window->name)
 		shell_interface->set_title(window->shsurf, window->name);
 	if (window->frame && window->name)
 		frame_set_title(window->frame, window->name);
+
+	/* Properties that changed while these were in flight are
+	 * fetched again, and whatever waits for the properties waits
+	 * for that fetch too. */
+	weston_wm_window_read_properties(window);
+
+	/* A map request or a shell surface that arrived while the
+	 * properties were in flight was deferred until now, since the
+	 * frame and the shell state depend on them. */
+	if (window->map_pending && !window->properties_pending) {
+		window->map_pending = 0;
+		weston_wm_window_map(window);
+	}
+
+	if (window->shell_state_pending && !window->properties_pending) {
+		window->shell_state_pending = 0;
+		if (window->shsurf)
+			weston_wm_window_set_shell_state(window);
+	}
+
+	weston_wm_window_schedule_repaint(window);
+}
+
+/* Requests the tracked properties of the window without waiting for
+ * the replies.  They are applied from the event loop once they all
+ * arrived, and property notifications received in the meantime only
+ * trigger one more fetch after that. */
+static void
+weston_wm_window_read_properties(struct weston_wm_window *window)
+{
+	struct weston_wm *wm = window->wm;
+	struct wm_property props[WM_PROPERTY_COUNT];
+	unsigned int sequence[WM_PROPERTY_COUNT];
+	xcb_get_property_cookie_t cookie;
+	int i;
+
+	if (!window->properties_dirty || window->properties_pending)
+		return;
+	window->properties_dirty = 0;
+	window->properties_pending = 1;
+
+	weston_wm_get_window_properties(wm, props);
+
+	for (i = 0; i < WM_PROPERTY_COUNT; i++) {
+		cookie = xcb_get_property(wm->conn,
+					  0, /* delete */
+					  window->id,
+					  props[i].atom,
+					  XCB_ATOM_ANY, 0, 2048);
+		sequence[i] = cookie.sequence;
+	}
+
+	weston_wm_queue_request(wm, window, sequence, WM_PROPERTY_COUNT,
+				weston_wm_window_handle_properties);
 }
 
 static void
@@ -765,7 +949,7 @@ weston_wm_window_transform(struct wl_listener *listener, void *data)
 		mask = XCB_CONFIG_WINDOW_X | XCB_CONFIG_WINDOW_Y;
 
 		xcb_configure_window(wm->conn, window->frame_id, mask, values);
-		xcb_flush(wm->conn);
+		weston_wm_flush(wm);
 	}
 }
 
@@ -843,6 +1027,7 @@ weston_wm_window_create_frame(struct weston_wm_window *window)
 		XCB_EVENT_MASK_POINTER_MOTION |
 		XCB_EVENT_MASK_ENTER_WINDOW |
 		XCB_EVENT_MASK_LEAVE_WINDOW |
+		XCB_EVENT_MASK_EXPOSURE |
 		XCB_EVENT_MASK_SUBSTRUCTURE_NOTIFY |
 		XCB_EVENT_MASK_SUBSTRUCTURE_REDIRECT;
 	values[2] = wm->colormap;
@@ -917,8 +1102,26 @@ weston_wm_handle_map_request(struct weston_wm *wm, xcb_generic_event_t *event)
 
 	weston_wm_window_read_properties(window);
 
+	if (window->properties_pending) {
+		wm_log("XCB_MAP_REQUEST (window %d, deferred)\n", window->id);
+		window->map_pending = 1;
+		return;
+	}
+
+	weston_wm_window_map(window);
+}
+
+static void
+weston_wm_window_map(struct weston_wm_window *window)
+{
+	struct weston_wm *wm = window->wm;
+
+	/* A frame window mapped again comes back cleared, so all of
+	 * the decoration needs drawing. */
 	if (window->frame_id == XCB_WINDOW_NONE)
 		weston_wm_window_create_frame(window);
+	else
+		frame_damage_all(window->frame);
 
 	wm_log("XCB_MAP_REQUEST (window %d, %p, frame %d)\n",
 	       window->id, window, window->frame_id);
@@ -927,10 +1130,27 @@ weston_wm_handle_map_request(struct weston_wm *wm, xcb_generic_event_t *event)
 	weston_wm_window_set_net_wm_state(window);
 	weston_wm_window_set_virtual_desktop(window, 0);
 
-	xcb_map_window(wm->conn, map_request->window);
+	xcb_map_window(wm->conn, window->id);
 	xcb_map_window(wm->conn, window->frame_id);
 }
 
+static void
+weston_wm_handle_expose(struct weston_wm *wm, xcb_generic_event_t *event)
+{
+	xcb_expose_event_t *expose = (xcb_expose_event_t *) event;
+	struct weston_wm_window *window;
+
+	wm_log("XCB_EXPOSE (window %d, count %d)\n",
+	       expose->window, expose->count);
+
+	window = hash_table_lookup(wm->window_hash, expose->window);
+	if (!window || window->frame_id != expose->window || !window->frame)
+		return;
+
+	frame_damage_all(window->frame);
+	weston_wm_window_schedule_repaint(window);
+}
+
 static void
 weston_wm_handle_map_notify(struct weston_wm *wm, xcb_generic_event_t *event)
 {
@@ -973,6 +1193,7 @@ weston_wm_handle_unmap_notify(struct weston_wm *wm, xcb_generic_event_t *event)
 	window->surface = NULL;
 	window->shsurf = NULL;
 	window->view = NULL;
+	window->shell_state_pending = 0;
 
 	weston_wm_window_set_wm_state(window, ICCCM_WITHDRAWN_STATE);
 	weston_wm_window_set_virtual_desktop(window, -1);
@@ -991,9 +1212,6 @@ weston_wm_window_draw_decoration(void *data)
 	int32_t input_x, input_y, input_w, input_h;
 	struct weston_shell_interface *shell_interface =
 		&wm->server->compositor->shell_interface;
-	uint32_t flags = 0;
-
-	weston_wm_window_read_properties(window);
 
 	window->repaint_source = NULL;
 
@@ -1004,18 +1222,18 @@ weston_wm_window_draw_decoration(void *data)
 	cr = cairo_create(window->cairo_surface);
 
 	if (window->fullscreen) {
-		/* nothing */
+		frame_damage_all(window->frame);
 	} else if (window->decorate) {
-		if (wm->focus_window == window)
-			flags |= THEME_FRAME_ACTIVE;
-
-		frame_repaint(window->frame, cr);
+		/* The frame window keeps its contents, so only the
+		 * parts of the decoration that changed are redrawn. */
+		frame_repaint_damage(window->frame, cr);
 	} else {
 		cairo_set_operator(cr, CAIRO_OPERATOR_SOURCE);
 		cairo_set_source_rgba(cr, 0, 0, 0, 0);
 		cairo_paint(cr);
 
 		render_shadow(cr, t->shadow, 2, 2, width + 8, height + 8, 64, 64);
+		frame_damage_all(window->frame);
 	}
 
 	cairo_destroy(cr);
@@ -1033,6 +1251,9 @@ weston_wm_window_draw_decoration(void *data)
 						  window->width + 2,
 						  window->height + 2);
 		}
+		window->surface->pending.changed |=
+			WESTON_SURFACE_STATE_OPAQUE |
+			WESTON_SURFACE_STATE_INPUT;
 		if (window->view)
 			weston_view_geometry_dirty(window->view);
 
@@ -1072,6 +1293,8 @@ weston_wm_window_schedule_repaint(struct weston_wm_window *window)
 				pixman_region32_init_rect(&window->surface->pending.opaque, 0, 0,
 							  width, height);
 			}
+			window->surface->pending.changed |=
+				WESTON_SURFACE_STATE_OPAQUE;
 			if (window->view)
 				weston_view_geometry_dirty(window->view);
 		}
@@ -1093,23 +1316,50 @@ weston_wm_handle_property_notify(struct weston_wm *wm, xcb_generic_event_t *even
 	xcb_property_notify_event_t *property_notify =
 		(xcb_property_notify_event_t *) event;
 	struct weston_wm_window *window;
+	struct wm_property props[WM_PROPERTY_COUNT];
+	int i;
 
 	window = hash_table_lookup(wm->window_hash, property_notify->window);
 	if (!window)
 		return;
 
-	window->properties_dirty = 1;
-
-	wm_log("XCB_PROPERTY_NOTIFY: window %d, ", property_notify->window);
-	if (property_notify->state == XCB_PROPERTY_DELETE)
-		wm_log("deleted\n");
-	else
+#ifdef WM_DEBUG
+	if (property_notify->state == XCB_PROPERTY_DELETE) {
+		wm_log("XCB_PROPERTY_NOTIFY: window %d, deleted\n",
+		       property_notify->window);
+	} else {
+		wm_log("XCB_PROPERTY_NOTIFY: window %d, new value\n",
+		       property_notify->window);
 		read_and_dump_property(wm, property_notify->window,
 				       property_notify->atom);
+	}
+#endif
 
-	if (property_notify->atom == wm->atom.net_wm_name ||
-	    property_notify->atom == XCB_ATOM_WM_NAME)
-		weston_wm_window_schedule_repaint(window);
+	weston_wm_get_window_properties(wm, props);
+	for (i = 0; i < WM_PROPERTY_COUNT; i++)
+		if (props[i].atom == property_notify->atom)
+			break;
+	if (i == WM_PROPERTY_COUNT)
+		return;
+
+	/* The repaint is scheduled once the new values arrived. */
+	window->properties_dirty = 1;
+	weston_wm_window_read_properties(window);
+}
+
+static void
+weston_wm_window_handle_geometry(struct weston_wm *wm, void *data,
+				 void **replies, int count)
+{
+	struct weston_wm_window *window = data;
+	xcb_get_geometry_reply_t *geometry_reply = replies[0];
+
+	/* technically we should use XRender and check the visual format's
+	alpha_mask, but checking depth is simpler and works in all known cases */
+	if (geometry_reply != NULL)
+		window->has_alpha = geometry_reply->depth == 32;
+
+	weston_wm_window_schedule_repaint(window);
 }
 
 static void
@@ -1119,7 +1369,6 @@ weston_wm_window_create(struct weston_wm *wm,
 	struct weston_wm_window *window;
 	uint32_t values[1];
 	xcb_get_geometry_cookie_t geometry_cookie;
-	xcb_get_geometry_reply_t *geometry_reply;
 
 	window = zalloc(sizeof *window);
 	if (window == NULL) {
@@ -1141,14 +1390,14 @@ weston_wm_window_create(struct weston_wm *wm,
 	window->x = x;
 	window->y = y;
 
-	geometry_reply = xcb_get_geometry_reply(wm->conn, geometry_cookie, NULL);
-	/* technically we should use XRender and check the visual format's
-	alpha_mask, but checking depth is simpler and works in all known cases */
-	if(geometry_reply != NULL)
-		window->has_alpha = geometry_reply->depth == 32;
-	free(geometry_reply);
-
 	hash_table_insert(wm->window_hash, id, window);
+
+	weston_wm_queue_request(wm, window, &geometry_cookie.sequence, 1,
+				weston_wm_window_handle_geometry);
+
+	/* Start fetching the properties right away, so they are usually
+	 * in by the time the window gets mapped. */
+	weston_wm_window_read_properties(window);
 }
 
 static void
@@ -1156,6 +1405,8 @@ weston_wm_window_destroy(struct weston_wm_window *window)
 {
 	struct weston_wm *wm = window->wm;
 
+	weston_wm_cancel_requests(wm, window);
+
 	if (window->repaint_source)
 		wl_event_source_remove(window->repaint_source);
 	if (window->cairo_surface)
@@ -1475,6 +1726,7 @@ weston_wm_handle_client_message(struct weston_wm *wm,
 
 	window = hash_table_lookup(wm->window_hash, client_message->window);
 
+#ifdef WM_DEBUG
 	wm_log("XCB_CLIENT_MESSAGE (%s %d %d %d %d %d win %d)\n",
 	       get_atom_name(wm->conn, client_message->type),
 	       client_message->data.data32[0],
@@ -1483,6 +1735,7 @@ weston_wm_handle_client_message(struct weston_wm *wm,
 	       client_message->data.data32[3],
 	       client_message->data.data32[4],
 	       client_message->window);
+#endif
 
 	/* The window may get created and destroyed before we actually
 	 * handle the message.  If it doesn't exist, bail.
@@ -1818,6 +2071,68 @@ weston_wm_handle_leave(struct weston_wm *wm, xcb_generic_event_t *event)
 	weston_wm_window_set_cursor(wm, window->frame_id, XWM_CURSOR_LEFT_PTR);
 }
 
+static void
+weston_wm_dispatch_event(struct weston_wm *wm, xcb_generic_event_t *event)
+{
+	if (weston_wm_handle_selection_event(wm, event))
+		return;
+
+	if (weston_wm_handle_dnd_event(wm, event))
+		return;
+
+	switch (EVENT_TYPE(event)) {
+	case XCB_BUTTON_PRESS:
+	case XCB_BUTTON_RELEASE:
+		weston_wm_handle_button(wm, event);
+		break;
+	case XCB_ENTER_NOTIFY:
+		weston_wm_handle_enter(wm, event);
+		break;
+	case XCB_LEAVE_NOTIFY:
+		weston_wm_handle_leave(wm, event);
+		break;
+	case XCB_MOTION_NOTIFY:
+		weston_wm_handle_motion(wm, event);
+		break;
+	case XCB_CREATE_NOTIFY:
+		weston_wm_handle_create_notify(wm, event);
+		break;
+	case XCB_MAP_REQUEST:
+		weston_wm_handle_map_request(wm, event);
+		break;
+	case XCB_MAP_NOTIFY:
+		weston_wm_handle_map_notify(wm, event);
+		break;
+	case XCB_EXPOSE:
+		weston_wm_handle_expose(wm, event);
+		break;
+	case XCB_UNMAP_NOTIFY:
+		weston_wm_handle_unmap_notify(wm, event);
+		break;
+	case XCB_REPARENT_NOTIFY:
+		weston_wm_handle_reparent_notify(wm, event);
+		break;
+	case XCB_CONFIGURE_REQUEST:
+		weston_wm_handle_configure_request(wm, event);
+		break;
+	case XCB_CONFIGURE_NOTIFY:
+		weston_wm_handle_configure_notify(wm, event);
+		break;
+	case XCB_DESTROY_NOTIFY:
+		weston_wm_handle_destroy_notify(wm, event);
+		break;
+	case XCB_MAPPING_NOTIFY:
+		wm_log("XCB_MAPPING_NOTIFY\n");
+		break;
+	case XCB_PROPERTY_NOTIFY:
+		weston_wm_handle_property_notify(wm, event);
+		break;
+	case XCB_CLIENT_MESSAGE:
+		weston_wm_handle_client_message(wm, event);
+		break;
+	}
+}
+
 static int
 weston_wm_handle_event(int fd, uint32_t mask, void *data)
 {
@@ -1825,75 +2140,50 @@ weston_wm_handle_event(int fd, uint32_t mask, void *data)
 	xcb_generic_event_t *event;
 	int count = 0;
 
-	while (event = xcb_poll_for_event(wm->conn), event != NULL) {
-		if (weston_wm_handle_selection_event(wm, event)) {
-			free(event);
-			count++;
-			continue;
-		}
-
-		if (weston_wm_handle_dnd_event(wm, event)) {
-			free(event);
-			count++;
-			continue;
-		}
-
-		switch (EVENT_TYPE(event)) {
-		case XCB_BUTTON_PRESS:
-		case XCB_BUTTON_RELEASE:
-			weston_wm_handle_button(wm, event);
-			break;
-		case XCB_ENTER_NOTIFY:
-			weston_wm_handle_enter(wm, event);
-			break;
-		case XCB_LEAVE_NOTIFY:
-			weston_wm_handle_leave(wm, event);
-			break;
-		case XCB_MOTION_NOTIFY:
-			weston_wm_handle_motion(wm, event);
-			break;
-		case XCB_CREATE_NOTIFY:
-			weston_wm_handle_create_notify(wm, event);
-			break;
-		case XCB_MAP_REQUEST:
-			weston_wm_handle_map_request(wm, event);
-			break;
-		case XCB_MAP_NOTIFY:
-			weston_wm_handle_map_notify(wm, event);
-			break;
-		case XCB_UNMAP_NOTIFY:
-			weston_wm_handle_unmap_notify(wm, event);
-			break;
-		case XCB_REPARENT_NOTIFY:
-			weston_wm_handle_reparent_notify(wm, event);
-			break;
-		case XCB_CONFIGURE_REQUEST:
-			weston_wm_handle_configure_request(wm, event);
-			break;
-		case XCB_CONFIGURE_NOTIFY:
-			weston_wm_handle_configure_notify(wm, event);
-			break;
-		case XCB_DESTROY_NOTIFY:
-			weston_wm_handle_destroy_notify(wm, event);
-			break;
-		case XCB_MAPPING_NOTIFY:
-			wm_log("XCB_MAPPING_NOTIFY\n");
-			break;
-		case XCB_PROPERTY_NOTIFY:
-			weston_wm_handle_property_notify(wm, event);
-			break;
-		case XCB_CLIENT_MESSAGE:
-			weston_wm_handle_client_message(wm, event);
-			break;
+	for (;;) {
+		event = xcb_poll_for_event(wm->conn);
+		if (event == NULL) {
+			/* Flushing and polling for replies read from the
+			 * connection too, and what they read in is not
+			 * signalled on the X fd again. */
+			xcb_flush(wm->conn);
+			if (weston_wm_process_replies(wm) > 0)
+				continue;
+			event = xcb_poll_for_queued_event(wm->conn);
+			if (event == NULL)
+				break;
 		}
 
+		weston_wm_dispatch_event(wm, event);
 		free(event);
 		count++;
 	}
 
+	return count;
+}
+
+static void
+weston_wm_flush_idle(void *data)
+{
+	struct weston_wm *wm = data;
+
+	wm->flush_source = NULL;
+	weston_wm_handle_event(wm->server->wm_fd, WL_EVENT_READABLE, wm);
+}
+
+/* For requests made outside of the X event handler.  Flushing may read
+ * replies and events off the connection, which the X fd does not
+ * signal again, so those are handled from an idle callback, out of the
+ * way of the caller. */
+void
+weston_wm_flush(struct weston_wm *wm)
+{
 	xcb_flush(wm->conn);
 
-	return count;
+	if (wm->flush_source == NULL)
+		wm->flush_source =
+			wl_event_loop_add_idle(wm->server->loop,
+					       weston_wm_flush_idle, wm);
 }
 
 static void
@@ -2131,6 +2421,7 @@ weston_wm_create(struct weston_xserver *wxs, int fd)
 		return NULL;
 
 	wm->server = wxs;
+	wl_list_init(&wm->request_list);
 	wm->window_hash = hash_table_create();
 	if (wm->window_hash == NULL) {
 		free(wm);
@@ -2220,6 +2511,14 @@ weston_wm_create(struct weston_xserver *wxs, int fd)
 void
 weston_wm_destroy(struct weston_wm *wm)
 {
+	struct weston_wm_request *request, *next;
+
+	wl_list_for_each_safe(request, next, &wm->request_list, link)
+		weston_wm_request_destroy(wm, request);
+
+	if (wm->flush_source)
+		wl_event_source_remove(wm->flush_source);
+
 	/* FIXME: Free windows in hash. */
 	hash_table_destroy(wm->window_hash);
 	weston_wm_destroy_cursors(wm);
@@ -2388,11 +2687,11 @@ xserver_map_shell_surface(struct weston_wm_window *window,
 	struct weston_wm *wm = window->wm;
 	struct weston_shell_interface *shell_interface =
 		&wm->server->compositor->shell_interface;
-	struct weston_output *output;
-	struct weston_wm_window *parent;
-	int flags = 0;
 
+	/* This is usually reached from the wayland side, where nothing
+	 * else sends the requests out. */
 	weston_wm_window_read_properties(window);
+	weston_wm_flush(wm);
 
 	/* A weston_wm_window may have many different surfaces assigned
 	 * throughout its life, so we must make sure to remove the listener
@@ -2427,6 +2726,26 @@ xserver_map_shell_surface(struct weston_wm_window *window,
 	window->view = shell_interface->get_primary_view(shell_interface->shell,
 							 window->shsurf);
 
+	/* The shell state depends on the properties, so it waits for
+	 * them if they are in flight. */
+	if (window->properties_pending) {
+		window->shell_state_pending = 1;
+		return;
+	}
+
+	weston_wm_window_set_shell_state(window);
+}
+
+static void
+weston_wm_window_set_shell_state(struct weston_wm_window *window)
+{
+	struct weston_wm *wm = window->wm;
+	struct weston_shell_interface *shell_interface =
+		&wm->server->compositor->shell_interface;
+	struct weston_output *output;
+	struct weston_wm_window *parent;
+	int flags = 0;
+
 	if (window->name)
 		shell_interface->set_title(window->shsurf, window->name);
 
@@ -54,6 +54,7 @@ struct weston_wm {
 	xcb_connection_t *conn;
 	const xcb_query_extension_reply_t *xfixes;
 	struct wl_event_source *source;
+	struct wl_event_source *flush_source;
 	xcb_screen_t *screen;
 	struct hash_table *window_hash;
 	struct weston_xserver *server;
@@ -70,6 +71,7 @@ struct weston_wm {
 	struct wl_listener transform_listener;
 	struct wl_listener kill_listener;
 	struct wl_list unpaired_window_list;
+	struct wl_list request_list;
 
 	xcb_window_t selection_window;
 	xcb_window_t selection_owner;
@@ -78,6 +80,7 @@ struct weston_wm {
 	struct wl_event_source *property_source;
 	xcb_get_property_reply_t *property_reply;
 	int property_start;
+	uint32_t property_offset;
 	struct wl_array source_data;
 	xcb_selection_request_event_t selection_request;
 	xcb_atom_t selection_target;
@@ -88,6 +91,8 @@ struct weston_wm {
 
 	xcb_window_t dnd_window;
 	xcb_window_t dnd_owner;
+	xcb_window_t dnd_enter_window;
+	int dnd_enter_version;
 
 	struct {
 		xcb_atom_t		 wm_protocols;
@@ -153,6 +158,18 @@ struct weston_wm {
 	} atom;
 };
 
+typedef void (*weston_wm_reply_func_t)(struct weston_wm *wm, void *data,
+				       void **replies, int count);
+
+void
+weston_wm_queue_request(struct weston_wm *wm, void *data,
+			const unsigned int *sequence, int count,
+			weston_wm_reply_func_t func);
+void
+weston_wm_cancel_requests(struct weston_wm *wm, void *data);
+void
+weston_wm_flush(struct weston_wm *wm);
+
 void
 dump_property(struct weston_wm *wm, xcb_atom_t property,
 	      xcb_get_property_reply_t *reply);